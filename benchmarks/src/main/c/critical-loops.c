@@ -0,0 +1,78 @@
+#include <jni.h>
+
+#include "com_github_marschall_jnicriticalreporter_benchmarks_CriticalLoops.h"
+
+// maximum nesting depth of criticals
+#define MAX_DEPTH 16
+
+
+JNIEXPORT jlong JNICALL Java_com_github_marschall_jnicriticalreporter_benchmarks_CriticalLoops_arrayCriticals
+  (JNIEnv *env, jclass clazz, jobjectArray arrays, jint depth, jint iterations) {
+  jarray pinned[MAX_DEPTH];
+  jbyte *elements[MAX_DEPTH];
+
+  jsize length = (*env)->GetArrayLength(env, arrays);
+  if (depth > MAX_DEPTH) {
+    depth = MAX_DEPTH;
+  }
+  if (depth > length) {
+    depth = length;
+  }
+  // no other JNI calls are allowed while a critical is held, look up the arrays first
+  for (jint i = 0; i < depth; i++) {
+    pinned[i] = (*env)->GetObjectArrayElement(env, arrays, i);
+  }
+
+  jlong sum = 0L;
+  for (jint iteration = 0; iteration < iterations; iteration++) {
+    for (jint i = 0; i < depth; i++) {
+      elements[i] = (*env)->GetPrimitiveArrayCritical(env, pinned[i], NULL);
+      if (elements[i] == NULL) {
+        // OutOfMemoryError is pending
+        for (jint j = i - 1; j >= 0; j--) {
+          (*env)->ReleasePrimitiveArrayCritical(env, pinned[j], elements[j], JNI_ABORT);
+        }
+        return -1L;
+      }
+    }
+    for (jint i = 0; i < depth; i++) {
+      sum += elements[i][0];
+    }
+    for (jint i = depth - 1; i >= 0; i--) {
+      (*env)->ReleasePrimitiveArrayCritical(env, pinned[i], elements[i], JNI_ABORT);
+    }
+  }
+
+  for (jint i = 0; i < depth; i++) {
+    (*env)->DeleteLocalRef(env, pinned[i]);
+  }
+  return sum;
+}
+
+JNIEXPORT jlong JNICALL Java_com_github_marschall_jnicriticalreporter_benchmarks_CriticalLoops_stringCriticals
+  (JNIEnv *env, jclass clazz, jstring string, jint iterations) {
+  jlong sum = 0L;
+  for (jint iteration = 0; iteration < iterations; iteration++) {
+    const jchar *chars = (*env)->GetStringCritical(env, string, NULL);
+    if (chars == NULL) {
+      // OutOfMemoryError is pending
+      return -1L;
+    }
+    sum += chars[0];
+    (*env)->ReleaseStringCritical(env, string, chars);
+  }
+  return sum;
+}
+
+JNIEXPORT jlong JNICALL Java_com_github_marschall_jnicriticalreporter_benchmarks_CriticalLoops_arrayRegions
+  (JNIEnv *env, jclass clazz, jbyteArray array, jint iterations) {
+  jbyte buffer[64];
+  jsize length = (*env)->GetArrayLength(env, array);
+  jsize regionLength = length < (jsize) sizeof(buffer) ? length : (jsize) sizeof(buffer);
+  jlong sum = 0L;
+  for (jint iteration = 0; iteration < iterations; iteration++) {
+    (*env)->GetByteArrayRegion(env, array, 0, regionLength, buffer);
+    sum += buffer[0];
+  }
+  return sum;
+}
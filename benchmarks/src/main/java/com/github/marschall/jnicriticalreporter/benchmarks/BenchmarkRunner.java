@@ -0,0 +1,108 @@
+package com.github.marschall.jnicriticalreporter.benchmarks;
+
+import java.util.ArrayList;
+import java.util.List;
+
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.results.format.ResultFormatType;
+import org.openjdk.jmh.runner.Runner;
+import org.openjdk.jmh.runner.RunnerException;
+import org.openjdk.jmh.runner.options.ChainedOptionsBuilder;
+import org.openjdk.jmh.runner.options.OptionsBuilder;
+
+/**
+ * Runs {@link CriticalBenchmarks} without the agent, with an idle agent and with a recording agent.
+ * <p>
+ * System properties:
+ * <dl>
+ *  <dt>{@code agentPath}</dt>
+ *  <dd>path to the agent library, required</dd>
+ *  <dt>{@code agentOptions}</dt>
+ *  <dd>options passed to the agent, optional</dd>
+ *  <dt>{@code java.library.path}</dt>
+ *  <dd>has to contain the benchmark library, passed on to the forked JVMs</dd>
+ *  <dt>{@code threads}</dt>
+ *  <dd>comma separated thread counts for the throughput scaling runs, defaults to 1 up to the number of cores</dd>
+ * </dl>
+ * Results are written to {@code jmh-<configuration>-<mode>.json}.
+ */
+public final class BenchmarkRunner {
+
+  private BenchmarkRunner() {
+    throw new AssertionError("not instantiable");
+  }
+
+  public static void main(String[] args) throws RunnerException {
+    String agentPath = System.getProperty("agentPath");
+    if (agentPath == null) {
+      System.err.println("usage: java -DagentPath=/path/to/libjni-critical-reporter.so -Djava.library.path=/path/to/benchmark/lib -jar benchmarks.jar");
+      System.exit(1);
+    }
+    String agentOptions = System.getProperty("agentOptions", "");
+    String agent = "-agentpath:" + agentPath + (agentOptions.isEmpty() ? "" : "=" + agentOptions);
+    String onDemandAgent = "-agentpath:" + agentPath + "=" + (agentOptions.isEmpty() ? "" : agentOptions + ",") + "onDemand=true";
+    String recording = "-XX:StartFlightRecording:filename=benchmark.jfr,maxsize=100m";
+
+    List<Configuration> configurations = List.of(
+        new Configuration("noAgent"),
+        // the redirection is installed but no recording has the event enabled
+        new Configuration("idle", agent),
+        // the redirection is not installed until a recording has the event enabled
+        new Configuration("idleOnDemand", onDemandAgent),
+        new Configuration("recording", agent, recording, "-Xlog:jfr+startup=error"));
+
+    for (Configuration configuration : configurations) {
+      // per-call overhead with a single thread
+      run(configuration, Mode.AverageTime, 1);
+      // throughput scaling across cores
+      for (int threads : threadCounts()) {
+        run(configuration, Mode.Throughput, threads);
+      }
+    }
+  }
+
+  private static void run(Configuration configuration, Mode mode, int threads) throws RunnerException {
+    List<String> jvmArgs = new ArrayList<>(configuration.jvmArgs());
+    jvmArgs.add("-Djava.library.path=" + System.getProperty("java.library.path"));
+    String resultName = "jmh-" + configuration.name() + "-" + mode.shortLabel() + (mode == Mode.Throughput ? "-" + threads : "") + ".json";
+    ChainedOptionsBuilder options = new OptionsBuilder()
+        .include(CriticalBenchmarks.class.getName())
+        .mode(mode)
+        .threads(threads)
+        .forks(1)
+        .jvmArgsAppend(jvmArgs.toArray(new String[0]))
+        .resultFormat(ResultFormatType.JSON)
+        .result(resultName);
+    if (mode == Mode.Throughput) {
+      // scaling is measured for the smallest arrays where the agent overhead dominates
+      options.param("arraySize", "16");
+    }
+    new Runner(options.build()).run();
+  }
+
+  private static List<Integer> threadCounts() {
+    String threads = System.getProperty("threads");
+    List<Integer> counts = new ArrayList<>();
+    if (threads != null) {
+      for (String count : threads.split(",")) {
+        counts.add(Integer.valueOf(count.trim()));
+      }
+      return counts;
+    }
+    int cores = Runtime.getRuntime().availableProcessors();
+    for (int count = 1; count < cores; count *= 2) {
+      counts.add(count);
+    }
+    counts.add(cores);
+    return counts;
+  }
+
+  record Configuration(String name, List<String> jvmArgs) {
+
+    Configuration(String name, String... jvmArgs) {
+      this(name, List.of(jvmArgs));
+    }
+
+  }
+
+}
@@ -0,0 +1,66 @@
+package com.github.marschall.jnicriticalreporter.benchmarks;
+
+import static java.util.concurrent.TimeUnit.NANOSECONDS;
+
+import org.openjdk.jmh.annotations.Benchmark;
+import org.openjdk.jmh.annotations.BenchmarkMode;
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.annotations.OperationsPerInvocation;
+import org.openjdk.jmh.annotations.OutputTimeUnit;
+import org.openjdk.jmh.annotations.Param;
+import org.openjdk.jmh.annotations.Scope;
+import org.openjdk.jmh.annotations.Setup;
+import org.openjdk.jmh.annotations.State;
+
+/**
+ * Measures the cost of a single JNI critical, the JNI transition is amortized over {@value #ITERATIONS} criticals.
+ * <p>
+ * Run through {@link BenchmarkRunner} to compare no agent, an idle agent and a recording agent.
+ */
+@State(Scope.Thread)
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(NANOSECONDS)
+public class CriticalBenchmarks {
+
+  static final int ITERATIONS = 100;
+
+  @Param({"16", "4096", "1048576"})
+  public int arraySize;
+
+  @Param({"1", "4"})
+  public int depth;
+
+  private byte[][] arrays;
+
+  private String string;
+
+  @Setup
+  public void setup() {
+    this.arrays = new byte[this.depth][];
+    for (int i = 0; i < this.depth; i++) {
+      this.arrays[i] = new byte[this.arraySize];
+      this.arrays[i][0] = (byte) i;
+    }
+    // UTF-16 so that GetStringCritical does not need to inflate a Latin-1 string
+    this.string = "€".repeat(this.arraySize);
+  }
+
+  @Benchmark
+  @OperationsPerInvocation(ITERATIONS)
+  public long arrayCritical() {
+    return CriticalLoops.arrayCriticals(this.arrays, this.depth, ITERATIONS);
+  }
+
+  @Benchmark
+  @OperationsPerInvocation(ITERATIONS)
+  public long stringCritical() {
+    return CriticalLoops.stringCriticals(this.string, ITERATIONS);
+  }
+
+  @Benchmark
+  @OperationsPerInvocation(ITERATIONS)
+  public long arrayRegion() {
+    return CriticalLoops.arrayRegions(this.arrays[0], ITERATIONS);
+  }
+
+}
@@ -0,0 +1,44 @@
+package com.github.marschall.jnicriticalreporter.benchmarks;
+
+/**
+ * Calls JNI criticals in tight native loops so that the JNI transition is amortized.
+ */
+final class CriticalLoops {
+
+  static {
+    NarSystem.loadLibrary();
+  }
+
+  private CriticalLoops() {
+    throw new AssertionError("not instantiable");
+  }
+
+  /**
+   * Pins the first {@code depth} arrays with nested {@code GetPrimitiveArrayCritical} calls.
+   *
+   * @param arrays the arrays to pin, must not be empty
+   * @param depth the nesting depth, at most 16
+   * @param iterations how often the arrays are pinned
+   * @return the sum of the first elements to prevent dead code elimination
+   */
+  static native long arrayCriticals(byte[][] arrays, int depth, int iterations);
+
+  /**
+   * Calls {@code GetStringCritical} and {@code ReleaseStringCritical} in a loop.
+   *
+   * @param string the string to pin, must not be empty
+   * @param iterations how often the string is pinned
+   * @return the sum of the first characters to prevent dead code elimination
+   */
+  static native long stringCriticals(String string, int iterations);
+
+  /**
+   * Calls {@code GetByteArrayRegion} for up to 64 bytes in a loop.
+   *
+   * @param array the array to copy from, must not be empty
+   * @param iterations how often the region is copied
+   * @return the sum of the first elements to prevent dead code elimination
+   */
+  static native long arrayRegions(byte[] array, int iterations);
+
+}
@@ -0,0 +1,97 @@
+package com.github.marschall.jnicriticalreporter.benchmarks;
+
+import static java.nio.charset.StandardCharsets.UTF_8;
+
+import java.io.ByteArrayOutputStream;
+import java.io.IOException;
+import java.nio.file.Path;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+import java.util.zip.DeflaterOutputStream;
+
+/**
+ * Measures the wall clock time of a JVM that deflates a few bytes and exits without the agent, with the agent and
+ * with {@code lazy=true}.
+ * <p>
+ * System properties:
+ * <dl>
+ *  <dt>{@code agentPath}</dt>
+ *  <dd>path to the agent library, required</dd>
+ *  <dt>{@code agentOptions}</dt>
+ *  <dd>options passed to the agent, optional</dd>
+ *  <dt>{@code runs}</dt>
+ *  <dd>number of measured JVMs per configuration, defaults to 20</dd>
+ * </dl>
+ * The median and minimum are printed in milliseconds.
+ */
+public final class StartupRunner {
+
+  private static final String CHILD = "child";
+  private static final int WARMUP_RUNS = 3;
+
+  private StartupRunner() {
+    throw new AssertionError("not instantiable");
+  }
+
+  public static void main(String[] args) throws IOException, InterruptedException {
+    if (args.length == 1 && args[0].equals(CHILD)) {
+      deflate();
+      return;
+    }
+    String agentPath = System.getProperty("agentPath");
+    if (agentPath == null) {
+      System.err.println("usage: java -DagentPath=/path/to/libjni-critical-reporter.so -cp benchmarks.jar " + StartupRunner.class.getName());
+      System.exit(1);
+    }
+    String agentOptions = System.getProperty("agentOptions", "");
+    String agent = "-agentpath:" + agentPath + (agentOptions.isEmpty() ? "" : "=" + agentOptions);
+    String lazyAgent = "-agentpath:" + agentPath + "=" + (agentOptions.isEmpty() ? "" : agentOptions + ",") + "lazy=true";
+    int runs = Integer.getInteger("runs", 20);
+
+    List<BenchmarkRunner.Configuration> configurations = List.of(
+        new BenchmarkRunner.Configuration("noAgent"),
+        new BenchmarkRunner.Configuration("agent", agent),
+        // only the idle table is installed until the first critical
+        new BenchmarkRunner.Configuration("lazyAgent", lazyAgent));
+
+    for (BenchmarkRunner.Configuration configuration : configurations) {
+      for (int i = 0; i < WARMUP_RUNS; i++) {
+        run(configuration);
+      }
+      long[] nanos = new long[runs];
+      for (int i = 0; i < runs; i++) {
+        nanos[i] = run(configuration);
+      }
+      Arrays.sort(nanos);
+      System.out.printf("%-10s median %7.1f ms  min %7.1f ms%n", configuration.name(), nanos[runs / 2] / 1_000_000.0d, nanos[0] / 1_000_000.0d);
+    }
+  }
+
+  private static long run(BenchmarkRunner.Configuration configuration) throws IOException, InterruptedException {
+    List<String> command = new ArrayList<>();
+    command.add(Path.of(System.getProperty("java.home"), "bin", "java").toString());
+    command.addAll(configuration.jvmArgs());
+    command.add("-cp");
+    command.add(System.getProperty("java.class.path"));
+    command.add(StartupRunner.class.getName());
+    command.add(CHILD);
+    long start = System.nanoTime();
+    Process process = new ProcessBuilder(command).inheritIO().start();
+    int exitValue = process.waitFor();
+    long elapsed = System.nanoTime() - start;
+    if (exitValue != 0) {
+      throw new IllegalStateException(configuration.name() + " exited with " + exitValue);
+    }
+    return elapsed;
+  }
+
+  // Deflater#deflate uses GetPrimitiveArrayCritical
+  private static void deflate() throws IOException {
+    ByteArrayOutputStream bos = new ByteArrayOutputStream();
+    try (DeflaterOutputStream deflater = new DeflaterOutputStream(bos)) {
+      deflater.write(StartupRunner.class.getName().getBytes(UTF_8));
+    }
+  }
+
+}
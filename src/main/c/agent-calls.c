@@ -0,0 +1,108 @@
+#include <jni.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "agent-calls.h"
+
+// published depth of a single thread, reused by a new thread once the owning thread ended
+struct AgentCallSlot {
+  // registry of all slots, immutable once published
+  struct AgentCallSlot *next;
+  // copy of agentCallDepth of the owning thread, read by agentCallsClose
+  _Atomic jint depth;
+  // whether a live thread owns the slot
+  _Atomic jboolean owned;
+};
+
+__thread jint agentCallDepth = 0;
+
+static __thread struct AgentCallSlot *currentSlot = NULL;
+
+static _Atomic(struct AgentCallSlot *) slots = NULL;
+
+static _Atomic jboolean closed = JNI_FALSE;
+
+// the destructor releases the slot of an ending thread, independent of JVMTI events that are disabled while detached
+static pthread_key_t slotKey;
+static pthread_once_t slotKeyOnce = PTHREAD_ONCE_INIT;
+
+static void releaseSlot(void *value) {
+  struct AgentCallSlot *slot = value;
+  atomic_store_explicit(&slot->depth, 0, memory_order_relaxed);
+  atomic_store_explicit(&slot->owned, JNI_FALSE, memory_order_release);
+}
+
+static void createSlotKey(void) {
+  if (pthread_key_create(&slotKey, &releaseSlot) != 0) {
+    fprintf(stderr, "pthread_key_create() failed\n");
+  }
+}
+
+static struct AgentCallSlot *claimSlot(void) {
+  struct AgentCallSlot *slot;
+  for (slot = atomic_load_explicit(&slots, memory_order_acquire); slot != NULL; slot = slot->next) {
+    jboolean expected = JNI_FALSE;
+    if (!atomic_load_explicit(&slot->owned, memory_order_relaxed)
+        && atomic_compare_exchange_strong(&slot->owned, &expected, JNI_TRUE)) {
+      break;
+    }
+  }
+  if (slot == NULL) {
+    slot = calloc(1, sizeof(struct AgentCallSlot));
+    if (slot == NULL) {
+      fprintf(stderr, "calloc(AgentCallSlot) failed\n");
+      return NULL;
+    }
+    atomic_init(&slot->depth, 0);
+    atomic_init(&slot->owned, JNI_TRUE);
+    // publish
+    struct AgentCallSlot *head = atomic_load(&slots);
+    do {
+      slot->next = head;
+    } while (!atomic_compare_exchange_weak(&slots, &head, slot));
+  }
+  pthread_once(&slotKeyOnce, &createSlotKey);
+  pthread_setspecific(slotKey, slot);
+  return slot;
+}
+
+jboolean agentCallEnter(void) {
+  struct AgentCallSlot *slot = currentSlot;
+  if (slot == NULL) {
+    slot = claimSlot();
+    if (slot == NULL) {
+      return JNI_FALSE;
+    }
+    currentSlot = slot;
+  }
+  agentCallDepth += 1;
+  // pairs with agentCallsClose, a store followed by a load of a different variable needs sequential consistency
+  atomic_store(&slot->depth, agentCallDepth);
+  if (atomic_load(&closed)) {
+    agentCallExit();
+    return JNI_FALSE;
+  }
+  return JNI_TRUE;
+}
+
+void agentCallExit(void) {
+  agentCallDepth -= 1;
+  atomic_store_explicit(&currentSlot->depth, agentCallDepth, memory_order_release);
+}
+
+void agentCallsClose(void) {
+  atomic_store(&closed, JNI_TRUE);
+  for (struct AgentCallSlot *slot = atomic_load(&slots); slot != NULL; slot = slot->next) {
+    // calls are short, they never span a critical region
+    while (atomic_load(&slot->depth) > 0) {
+      sched_yield();
+    }
+  }
+}
+
+void agentCallsOpen(void) {
+  atomic_store(&closed, JNI_FALSE);
+}
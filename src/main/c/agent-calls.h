@@ -0,0 +1,28 @@
+#ifndef AGENT_CALLS_H
+#define AGENT_CALLS_H
+
+#include <jni.h>
+
+// number of agent calls the current thread is inside, nested calls count separately
+extern __thread jint agentCallDepth;
+
+// entered by application threads before agent code in a redirected JNI function uses JNI global references
+// returns JNI_FALSE while the agent is detaching, the caller then only forwards to the original function
+// registers the thread on its first call, makes no JNI calls
+jboolean agentCallEnter(void);
+
+// leaves the call entered by a successful agentCallEnter
+void agentCallExit(void);
+
+// whether the current thread runs agent code, the JNI calls made by the agent are not application calls
+static inline jboolean isInAgentCall(void) {
+  return agentCallDepth > 0;
+}
+
+// rejects new calls and waits until no thread is inside one, called by detachAgent
+void agentCallsClose(void);
+
+// accepts calls again, called when attaching again
+void agentCallsOpen(void);
+
+#endif
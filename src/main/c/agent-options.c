@@ -0,0 +1,470 @@
+#include <jni.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "agent-options.h"
+#include "hot-arrays.h"
+#include "probes.h"
+#include "stack-traces.h"
+
+
+#define DEFAULT_BUFFER_SIZE 1024
+#define MAX_BUFFER_SIZE (1 << 24)
+#define DEFAULT_FLUSH_INTERVAL_MILLIS 100L
+#define DEFAULT_CALL_SITES 1024
+#define MAX_CALL_SITES (1 << 20)
+#define DEFAULT_PERIOD_MILLIS 10000L
+#define DEFAULT_WATCHDOG_INTERVAL_MILLIS 100L
+#define DEFAULT_TRACE_SIZE (64L * 1024L * 1024L)
+#define DEFAULT_BUDGET_INTERVAL_MILLIS 1000L
+#define DEFAULT_TRANSITION_SAMPLE 64
+
+static const struct AgentOptions defaultAgentOptions = {
+  .mode = MODE_SYNC,
+  .bufferSize = DEFAULT_BUFFER_SIZE,
+  .flushIntervalMillis = DEFAULT_FLUSH_INTERVAL_MILLIS,
+  .sampleInterval = 1,
+  .thresholdNanos = 0L,
+  .methods = METHODS_ALL,
+  .callSites = DEFAULT_CALL_SITES,
+  .periodMillis = DEFAULT_PERIOD_MILLIS,
+  .histogram = JNI_FALSE,
+  .gcStalls = JNI_FALSE,
+  .nested = JNI_FALSE,
+  .copies = JNI_FALSE,
+  .onDemand = JNI_FALSE,
+  .stackDepth = 0,
+  .clockSource = CLOCK_SOURCE_MONOTONIC,
+  .overhead = JNI_FALSE,
+  .watchdogNanos = 0L,
+  .watchdogIntervalMillis = DEFAULT_WATCHDOG_INTERVAL_MILLIS,
+  .traceFile = "",
+  .traceSize = DEFAULT_TRACE_SIZE,
+  .budget = 0.0,
+  .budgetIntervalMillis = DEFAULT_BUDGET_INTERVAL_MILLIS,
+  .hotArrays = 0,
+  .transitions = JNI_FALSE,
+  .transitionSample = DEFAULT_TRANSITION_SAMPLE,
+  .jmx = JNI_FALSE,
+  .lazy = JNI_FALSE
+};
+
+struct AgentOptions agentOptions;
+
+// parses a duration like "100ms", "50us", "2s" or "500ns" into nanoseconds
+// durations that do not fit into a jlong are rejected
+jint parseDurationNanos(const char *value, jlong *result) {
+  char *unit;
+  errno = 0;
+  long long amount = strtoll(value, &unit, 10);
+  if (unit == value || amount < 0 || errno == ERANGE) {
+    return JNI_ERR;
+  }
+  jlong multiplier;
+  if (strcmp(unit, "ns") == 0) {
+    multiplier = 1L;
+  } else if (strcmp(unit, "us") == 0) {
+    multiplier = 1000L;
+  } else if (strcmp(unit, "ms") == 0 || strcmp(unit, "") == 0) {
+    multiplier = 1000000L;
+  } else if (strcmp(unit, "s") == 0) {
+    multiplier = 1000000000L;
+  } else {
+    return JNI_ERR;
+  }
+  if (amount > INT64_MAX / multiplier) {
+    return JNI_ERR;
+  }
+  *result = (jlong) amount * multiplier;
+  return JNI_OK;
+}
+
+jint parseBoolean(const char *value, jboolean *result) {
+  if (strcmp(value, "true") == 0) {
+    *result = JNI_TRUE;
+  } else if (strcmp(value, "false") == 0) {
+    *result = JNI_FALSE;
+  } else {
+    return JNI_ERR;
+  }
+  return JNI_OK;
+}
+
+jint parseMode(const char *value, struct AgentOptions *result) {
+  if (strcmp(value, "sync") == 0) {
+    result->mode = MODE_SYNC;
+  } else if (strcmp(value, "async") == 0) {
+    result->mode = MODE_ASYNC;
+  } else if (strcmp(value, "aggregate") == 0) {
+    result->mode = MODE_AGGREGATE;
+  } else if (strcmp(value, "probes") == 0) {
+    result->mode = MODE_PROBES;
+  } else if (strcmp(value, "trace") == 0) {
+    result->mode = MODE_TRACE;
+  } else {
+    return JNI_ERR;
+  }
+  return JNI_OK;
+}
+
+// parses a positive number and rounds it up to the next power of two so that it can be used as a mask
+jint parsePowerOfTwo(const char *value, jint max, jint *result) {
+  char *end;
+  long size = strtol(value, &end, 10);
+  if (end == value || *end != '\0' || size <= 0 || size > max) {
+    return JNI_ERR;
+  }
+  jint powerOfTwo = 1;
+  while (powerOfTwo < size) {
+    powerOfTwo <<= 1;
+  }
+  *result = powerOfTwo;
+  return JNI_OK;
+}
+
+jint parseBufferSize(const char *value, struct AgentOptions *result) {
+  return parsePowerOfTwo(value, MAX_BUFFER_SIZE, &result->bufferSize);
+}
+
+jint parseCallSites(const char *value, struct AgentOptions *result) {
+  return parsePowerOfTwo(value, MAX_CALL_SITES, &result->callSites);
+}
+
+jint parsePeriod(const char *value, struct AgentOptions *result) {
+  jlong nanos;
+  if (parseDurationNanos(value, &nanos) != JNI_OK || nanos < 1000000L) {
+    return JNI_ERR;
+  }
+  result->periodMillis = nanos / 1000000L;
+  return JNI_OK;
+}
+
+jint parseFlushInterval(const char *value, struct AgentOptions *result) {
+  jlong nanos;
+  if (parseDurationNanos(value, &nanos) != JNI_OK || nanos < 1000000L) {
+    return JNI_ERR;
+  }
+  result->flushIntervalMillis = nanos / 1000000L;
+  return JNI_OK;
+}
+
+jint parseWatchdog(const char *value, struct AgentOptions *result) {
+  return parseDurationNanos(value, &result->watchdogNanos);
+}
+
+jint parseWatchdogInterval(const char *value, struct AgentOptions *result) {
+  jlong nanos;
+  if (parseDurationNanos(value, &nanos) != JNI_OK || nanos < 1000000L) {
+    return JNI_ERR;
+  }
+  result->watchdogIntervalMillis = nanos / 1000000L;
+  return JNI_OK;
+}
+
+// parses a fraction like "0.5%" or "0.005", 0 disables the governor
+jint parseBudget(const char *value, struct AgentOptions *result) {
+  char *end;
+  double budget = strtod(value, &end);
+  if (end == value || budget < 0.0) {
+    return JNI_ERR;
+  }
+  if (*end == '%') {
+    budget /= 100.0;
+    end += 1;
+  }
+  if (*end != '\0' || budget > 1.0) {
+    return JNI_ERR;
+  }
+  result->budget = budget;
+  return JNI_OK;
+}
+
+jint parseBudgetInterval(const char *value, struct AgentOptions *result) {
+  jlong nanos;
+  if (parseDurationNanos(value, &nanos) != JNI_OK || nanos < 1000000L) {
+    return JNI_ERR;
+  }
+  result->budgetIntervalMillis = nanos / 1000000L;
+  return JNI_OK;
+}
+
+jint parseHotArrays(const char *value, struct AgentOptions *result) {
+  char *end;
+  long count = strtol(value, &end, 10);
+  if (end == value || *end != '\0' || count < 0 || count > MAX_HOT_ARRAYS) {
+    return JNI_ERR;
+  }
+  result->hotArrays = (jint) count;
+  return JNI_OK;
+}
+
+jint parseTraceFile(const char *value, struct AgentOptions *result) {
+  size_t length = strlen(value);
+  if (length == 0 || length >= sizeof(result->traceFile)) {
+    return JNI_ERR;
+  }
+  memcpy(result->traceFile, value, length + 1);
+  return JNI_OK;
+}
+
+// parses a size like "64m", "512k", "1g" or "4096" into bytes
+jint parseTraceSize(const char *value, struct AgentOptions *result) {
+  char *end;
+  errno = 0;
+  long long size = strtoll(value, &end, 10);
+  if (end == value || size <= 0 || errno == ERANGE) {
+    return JNI_ERR;
+  }
+  long long factor;
+  if (*end == '\0') {
+    factor = 1LL;
+  } else if (strcmp(end, "k") == 0) {
+    factor = 1024LL;
+  } else if (strcmp(end, "m") == 0) {
+    factor = 1024LL * 1024LL;
+  } else if (strcmp(end, "g") == 0) {
+    factor = 1024LL * 1024LL * 1024LL;
+  } else {
+    return JNI_ERR;
+  }
+  if (size > INT64_MAX / factor) {
+    return JNI_ERR;
+  }
+  result->traceSize = (jlong) (size * factor);
+  return JNI_OK;
+}
+
+// parses "1/N" or "N"
+jint parseSample(const char *value, struct AgentOptions *result) {
+  const char *interval = value;
+  if (strncmp(value, "1/", 2) == 0) {
+    interval = value + 2;
+  }
+  char *end;
+  long sampleInterval = strtol(interval, &end, 10);
+  if (end == interval || *end != '\0' || sampleInterval <= 0 || sampleInterval > INT32_MAX) {
+    return JNI_ERR;
+  }
+  result->sampleInterval = (jint) sampleInterval;
+  return JNI_OK;
+}
+
+// parses "1/N", "N" or "0"
+jint parseTransitionSample(const char *value, struct AgentOptions *result) {
+  if (strcmp(value, "0") == 0) {
+    result->transitionSample = 0;
+    return JNI_OK;
+  }
+  // reuses the parsing of sample without changing it
+  struct AgentOptions parsed = *result;
+  if (parseSample(value, &parsed) != JNI_OK) {
+    return JNI_ERR;
+  }
+  result->transitionSample = parsed.sampleInterval;
+  return JNI_OK;
+}
+
+jint parseThreshold(const char *value, struct AgentOptions *result) {
+  return parseDurationNanos(value, &result->thresholdNanos);
+}
+
+jint parseClock(const char *value, struct AgentOptions *result) {
+  if (strcmp(value, "monotonic") == 0) {
+    result->clockSource = CLOCK_SOURCE_MONOTONIC;
+  } else if (strcmp(value, "tsc") == 0) {
+    result->clockSource = CLOCK_SOURCE_TSC;
+  } else {
+    return JNI_ERR;
+  }
+  return JNI_OK;
+}
+
+// parses "jfr", "caller" or the number of frames
+jint parseStacks(const char *value, struct AgentOptions *result) {
+  if (strcmp(value, "jfr") == 0) {
+    result->stackDepth = 0;
+    return JNI_OK;
+  } else if (strcmp(value, "caller") == 0) {
+    result->stackDepth = 1;
+    return JNI_OK;
+  }
+  char *end;
+  long depth = strtol(value, &end, 10);
+  if (end == value || *end != '\0' || depth <= 0 || depth > MAX_STACK_DEPTH) {
+    return JNI_ERR;
+  }
+  result->stackDepth = (jint) depth;
+  return JNI_OK;
+}
+
+// adds a single method, the list is reset in resetListOption
+jint parseMethod(const char *value, struct AgentOptions *result) {
+  if (strcmp(value, "string") == 0) {
+    result->methods |= METHODS_STRING;
+  } else if (strcmp(value, "array") == 0) {
+    result->methods |= METHODS_ARRAY;
+  } else {
+    return JNI_ERR;
+  }
+  return JNI_OK;
+}
+
+// adds a single library name to a filter, the list is reset in resetListOption
+jint parseLibrary(const char *value, char names[][LIBRARY_FILTER_LENGTH], jint *count) {
+  size_t length = strlen(value);
+  if (length == 0 || length >= LIBRARY_FILTER_LENGTH || *count == MAX_LIBRARY_FILTERS) {
+    return JNI_ERR;
+  }
+  memcpy(names[*count], value, length + 1);
+  *count += 1;
+  return JNI_OK;
+}
+
+// list valued options take the following values without a key, eg. methods=string,array
+jboolean isListOption(const char *key) {
+  return strcmp(key, "methods") == 0 || strcmp(key, "libraries") == 0 || strcmp(key, "excludeLibraries") == 0;
+}
+
+void resetListOption(const char *key, struct AgentOptions *result) {
+  if (strcmp(key, "methods") == 0) {
+    result->methods = 0;
+  } else if (strcmp(key, "libraries") == 0) {
+    result->libraryCount = 0;
+  } else if (strcmp(key, "excludeLibraries") == 0) {
+    result->excludedLibraryCount = 0;
+  }
+}
+
+jint parseAgentOption(const char *key, const char *value, struct AgentOptions *result) {
+  if (strcmp(key, "mode") == 0) {
+    return parseMode(value, result);
+  } else if (strcmp(key, "bufferSize") == 0) {
+    return parseBufferSize(value, result);
+  } else if (strcmp(key, "flushInterval") == 0) {
+    return parseFlushInterval(value, result);
+  } else if (strcmp(key, "sample") == 0) {
+    return parseSample(value, result);
+  } else if (strcmp(key, "threshold") == 0) {
+    return parseThreshold(value, result);
+  } else if (strcmp(key, "methods") == 0) {
+    return parseMethod(value, result);
+  } else if (strcmp(key, "callSites") == 0) {
+    return parseCallSites(value, result);
+  } else if (strcmp(key, "period") == 0) {
+    return parsePeriod(value, result);
+  } else if (strcmp(key, "histogram") == 0) {
+    return parseBoolean(value, &result->histogram);
+  } else if (strcmp(key, "gcStalls") == 0) {
+    return parseBoolean(value, &result->gcStalls);
+  } else if (strcmp(key, "nested") == 0) {
+    return parseBoolean(value, &result->nested);
+  } else if (strcmp(key, "copies") == 0) {
+    return parseBoolean(value, &result->copies);
+  } else if (strcmp(key, "onDemand") == 0) {
+    return parseBoolean(value, &result->onDemand);
+  } else if (strcmp(key, "stacks") == 0) {
+    return parseStacks(value, result);
+  } else if (strcmp(key, "clock") == 0) {
+    return parseClock(value, result);
+  } else if (strcmp(key, "overhead") == 0) {
+    return parseBoolean(value, &result->overhead);
+  } else if (strcmp(key, "watchdog") == 0) {
+    return parseWatchdog(value, result);
+  } else if (strcmp(key, "watchdogInterval") == 0) {
+    return parseWatchdogInterval(value, result);
+  } else if (strcmp(key, "traceFile") == 0) {
+    return parseTraceFile(value, result);
+  } else if (strcmp(key, "traceSize") == 0) {
+    return parseTraceSize(value, result);
+  } else if (strcmp(key, "budget") == 0) {
+    return parseBudget(value, result);
+  } else if (strcmp(key, "budgetInterval") == 0) {
+    return parseBudgetInterval(value, result);
+  } else if (strcmp(key, "hotArrays") == 0) {
+    return parseHotArrays(value, result);
+  } else if (strcmp(key, "transitions") == 0) {
+    return parseBoolean(value, &result->transitions);
+  } else if (strcmp(key, "transitionSample") == 0) {
+    return parseTransitionSample(value, result);
+  } else if (strcmp(key, "jmx") == 0) {
+    return parseBoolean(value, &result->jmx);
+  } else if (strcmp(key, "lazy") == 0) {
+    return parseBoolean(value, &result->lazy);
+  } else if (strcmp(key, "libraries") == 0) {
+    return parseLibrary(value, result->libraries, &result->libraryCount);
+  } else if (strcmp(key, "excludeLibraries") == 0) {
+    return parseLibrary(value, result->excludedLibraries, &result->excludedLibraryCount);
+  }
+  return JNI_ERR;
+}
+
+// checks combinations of options that can't be validated individually
+jint validateAgentOptions(const struct AgentOptions *options) {
+#ifndef HAVE_SDT_PROBES
+  if (options->mode == MODE_PROBES) {
+    fprintf(stderr, "mode=probes is not supported, the agent was built without sys/sdt.h\n");
+    return JNI_ERR;
+  }
+#endif
+  // probes and trace mode must work without JFR
+  if ((options->mode == MODE_PROBES || options->mode == MODE_TRACE)
+      && (options->histogram || options->gcStalls || options->copies || options->onDemand || options->stackDepth > 0
+          || options->overhead || options->watchdogNanos > 0 || options->budget > 0.0 || options->hotArrays > 0
+          || options->transitions || options->jmx || options->lazy)) {
+    fprintf(stderr, "mode=probes and mode=trace can not be combined with options that report JFR events\n");
+    return JNI_ERR;
+  }
+  return JNI_OK;
+}
+
+jint parseAgentOptions(const char *options, struct AgentOptions *result) {
+  *result = defaultAgentOptions;
+  if (options == NULL || *options == '\0') {
+    return JNI_OK;
+  }
+  char *copy = strdup(options);
+  if (copy == NULL) {
+    fprintf(stderr, "strdup() failed\n");
+    return JNI_ERR;
+  }
+  jint return_value = JNI_OK;
+  char *saveptr;
+  const char *listKey = NULL;
+  for (char *option = strtok_r(copy, ",", &saveptr); option != NULL; option = strtok_r(NULL, ",", &saveptr)) {
+    const char *key;
+    const char *value;
+    char *separator = strchr(option, '=');
+    if (separator != NULL) {
+      *separator = '\0';
+      key = option;
+      value = separator + 1;
+      if (isListOption(key)) {
+        resetListOption(key, result);
+        listKey = key;
+      } else {
+        listKey = NULL;
+      }
+    } else if (listKey != NULL) {
+      // additional value of a list option
+      key = listKey;
+      value = option;
+    } else {
+      fprintf(stderr, "agent option without value: %s\n", option);
+      return_value = JNI_ERR;
+      break;
+    }
+    if (parseAgentOption(key, value, result) != JNI_OK) {
+      fprintf(stderr, "invalid agent option: %s=%s\n", key, value);
+      return_value = JNI_ERR;
+      break;
+    }
+  }
+  free(copy);
+  if (return_value == JNI_OK) {
+    return_value = validateAgentOptions(result);
+  }
+  return return_value;
+}
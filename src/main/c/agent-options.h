@@ -0,0 +1,103 @@
+#ifndef AGENT_OPTIONS_H
+#define AGENT_OPTIONS_H
+
+#include <jni.h>
+
+#include "clock.h"
+
+enum ReportingMode {
+  // JFR events are committed on the thread that released the critical
+  MODE_SYNC,
+  // records are written to a per-thread ring buffer and committed by an agent thread
+  MODE_ASYNC,
+  // criticals are aggregated per call site and reported periodically
+  MODE_AGGREGATE,
+  // no JFR events, criticals are only visible through the USDT probes
+  MODE_PROBES,
+  // no JFR events, records are appended to a memory-mapped trace file
+  MODE_TRACE
+};
+
+// bit masks for AgentOptions.methods, bit n corresponds to enum CriticalMethod n
+#define METHODS_STRING 0x1
+#define METHODS_ARRAY 0x2
+#define METHODS_ALL (METHODS_STRING | METHODS_ARRAY)
+
+// maximum length of AgentOptions.traceFile including the terminating NUL
+#define TRACE_FILE_LENGTH 1024
+// maximum number of names in AgentOptions.libraries and AgentOptions.excludedLibraries
+#define MAX_LIBRARY_FILTERS 16
+// maximum length of a library name in a filter including the terminating NUL
+#define LIBRARY_FILTER_LENGTH 64
+
+// options passed to the agent, eg. -agentpath:libjni-critical-reporter.so=mode=async,bufferSize=4096
+struct AgentOptions {
+  enum ReportingMode mode;
+  // number of records per thread in async mode, a power of two
+  jint bufferSize;
+  // how often the ring buffers are drained in async mode
+  jlong flushIntervalMillis;
+  // every sampleInterval-th critical of a thread is recorded
+  jint sampleInterval;
+  // criticals held for a shorter time are not reported
+  jlong thresholdNanos;
+  // which JNI critical methods are reported, combination of METHODS_*
+  jint methods;
+  // number of call sites in aggregate mode, a power of two
+  jint callSites;
+  // how often periodic events are committed
+  jlong periodMillis;
+  // whether hold time histograms are reported
+  jboolean histogram;
+  // whether criticals delaying garbage collections are reported
+  jboolean gcStalls;
+  // whether nested criticals are reported in addition to the outermost one
+  jboolean nested;
+  // whether the copying JNI array and string functions are intercepted
+  jboolean copies;
+  // whether the JNI functions are only redirected while a recording has one of our events enabled
+  jboolean onDemand;
+  // number of Java frames captured and interned by the agent, 0 if JFR records the stack trace
+  jint stackDepth;
+  // clock used for all native timestamps
+  enum ClockSource clockSource;
+  // whether the time spent in the agent is reported per thread
+  jboolean overhead;
+  // criticals held longer are reported by the watchdog while they are still held, 0 if disabled
+  jlong watchdogNanos;
+  // how often the watchdog checks the criticals currently held
+  jlong watchdogIntervalMillis;
+  // path of the trace file in trace mode, empty for the default name
+  char traceFile[TRACE_FILE_LENGTH];
+  // maximum size of the trace file in bytes
+  jlong traceSize;
+  // only criticals entered from these native libraries are reported, all if libraryCount is 0
+  // a name matches the file name of a library or its prefix up to a dot, eg. libz matches libz.so.1
+  char libraries[MAX_LIBRARY_FILTERS][LIBRARY_FILTER_LENGTH];
+  jint libraryCount;
+  // criticals entered from these native libraries are not reported
+  char excludedLibraries[MAX_LIBRARY_FILTERS][LIBRARY_FILTER_LENGTH];
+  jint excludedLibraryCount;
+  // maximum fraction of the CPU time of the process spent in the agent, the sampling interval is adjusted to stay below it
+  // 0 if the sampling interval is fixed
+  jdouble budget;
+  // how often the governor adjusts the sampling interval
+  jlong budgetIntervalMillis;
+  // number of arrays with the longest cumulative hold time reported every period, 0 if arrays are not tagged
+  jint hotArrays;
+  // whether every JNI function is wrapped to count its calls
+  jboolean transitions;
+  // the time of every transitionSample-th JNI call of a thread is measured, 0 only counts calls
+  jint transitionSample;
+  // whether CriticalMonitor is started to publish the events as an MXBean
+  jboolean jmx;
+  // whether the event types are only defined once a critical was seen or JFR was initialized
+  jboolean lazy;
+};
+
+extern struct AgentOptions agentOptions;
+
+// parses the agent options string, options may be NULL, options not present get their default value
+jint parseAgentOptions(const char *options, struct AgentOptions *result);
+
+#endif
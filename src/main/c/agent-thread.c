@@ -0,0 +1,99 @@
+#include <jni.h>
+#include <jvmti.h>
+#include <stdio.h>
+
+#include "agent-thread.h"
+#include "jni-transitions.h"
+
+
+void JNICALL runAgentThread(jvmtiEnv *jvmti, JNIEnv *env, void *arg) {
+  struct AgentThread *agentThread = arg;
+  // the JNI calls made to report don't belong to the application
+  transitionsExcludeCurrentThread();
+
+  (*jvmti)->RawMonitorEnter(jvmti, agentThread->monitor);
+  while (agentThread->running) {
+    (*jvmti)->RawMonitorWait(jvmti, agentThread->monitor, agentThread->intervalMillis);
+    if (!agentThread->running) {
+      break;
+    }
+    // don't hold the monitor while calling into Java
+    (*jvmti)->RawMonitorExit(jvmti, agentThread->monitor);
+    agentThread->tick(jvmti, env);
+    (*jvmti)->RawMonitorEnter(jvmti, agentThread->monitor);
+  }
+  agentThread->stopped = JNI_TRUE;
+  (*jvmti)->RawMonitorNotifyAll(jvmti, agentThread->monitor);
+  (*jvmti)->RawMonitorExit(jvmti, agentThread->monitor);
+}
+
+jint newThread(JNIEnv *env, const char *name, jthread *result) {
+  // new Thread(name)
+  jclass threadClass = (*env)->FindClass(env, "java/lang/Thread");
+  if (threadClass == NULL) {
+    fprintf(stderr, "FindClass(java/lang/Thread) failed\n");
+    return JNI_ERR;
+  }
+  jmethodID threadConstructor = (*env)->GetMethodID(env, threadClass, "<init>", "(Ljava/lang/String;)V");
+  if (threadConstructor == NULL) {
+    fprintf(stderr, "GetMethodID(java/lang/Thread#<init>) failed\n");
+    return JNI_ERR;
+  }
+  jstring nameString = (*env)->NewStringUTF(env, name);
+  if (nameString == NULL) {
+    fprintf(stderr, "NewStringUTF(%s) failed\n", name);
+    return JNI_ERR;
+  }
+  jthread thread = (*env)->NewObject(env, threadClass, threadConstructor, nameString);
+  if (thread == NULL) {
+    fprintf(stderr, "new Thread(%s) failed\n", name);
+    return JNI_ERR;
+  }
+  *result = thread;
+  // threadConstructor jmethodID does not need to be freed
+  (*env)->DeleteLocalRef(env, threadClass);
+  (*env)->DeleteLocalRef(env, nameString);
+  return JNI_OK;
+}
+
+jint startAgentThread(jvmtiEnv *jvmti, JNIEnv *env, struct AgentThread *agentThread) {
+  jvmtiError tiErr = (*jvmti)->CreateRawMonitor(jvmti, agentThread->name, &agentThread->monitor);
+  if (tiErr != JVMTI_ERROR_NONE) {
+    fprintf(stderr, "CreateRawMonitor (JVMTI) failed with error(%d)\n", tiErr);
+    return JNI_ERR;
+  }
+
+  jthread thread;
+  if (newThread(env, agentThread->name, &thread) != JNI_OK) {
+    return JNI_ERR;
+  }
+
+  agentThread->running = JNI_TRUE;
+  agentThread->stopped = JNI_FALSE;
+  tiErr = (*jvmti)->RunAgentThread(jvmti, thread, &runAgentThread, agentThread, JVMTI_THREAD_NORM_PRIORITY);
+  (*env)->DeleteLocalRef(env, thread);
+  if (tiErr != JVMTI_ERROR_NONE) {
+    fprintf(stderr, "RunAgentThread (JVMTI) failed with error(%d)\n", tiErr);
+    agentThread->running = JNI_FALSE;
+    agentThread->stopped = JNI_TRUE;
+    return JNI_ERR;
+  }
+  return JNI_OK;
+}
+
+void stopAgentThread(jvmtiEnv *jvmti, struct AgentThread *agentThread) {
+  if (agentThread->monitor == NULL) {
+    // never started
+    return;
+  }
+  (*jvmti)->RawMonitorEnter(jvmti, agentThread->monitor);
+  agentThread->running = JNI_FALSE;
+  (*jvmti)->RawMonitorNotifyAll(jvmti, agentThread->monitor);
+  while (!agentThread->stopped) {
+    (*jvmti)->RawMonitorWait(jvmti, agentThread->monitor, 0L);
+  }
+  (*jvmti)->RawMonitorExit(jvmti, agentThread->monitor);
+  // allows the thread to be started again
+  (*jvmti)->DestroyRawMonitor(jvmti, agentThread->monitor);
+  agentThread->monitor = NULL;
+}
@@ -0,0 +1,26 @@
+#ifndef AGENT_THREAD_H
+#define AGENT_THREAD_H
+
+#include <jni.h>
+#include <jvmti.h>
+
+// a JVMTI agent thread that periodically calls tick
+struct AgentThread {
+  // name of the java.lang.Thread
+  const char *name;
+  jlong intervalMillis;
+  void (*tick)(jvmtiEnv *jvmti, JNIEnv *env);
+
+  // guards running and stopped
+  jrawMonitorID monitor;
+  jboolean running;
+  jboolean stopped;
+};
+
+// has to be called in the live phase
+jint startAgentThread(jvmtiEnv *jvmti, JNIEnv *env, struct AgentThread *agentThread);
+
+// signals the agent thread to stop and waits until the current tick is done, does nothing if not running
+void stopAgentThread(jvmtiEnv *jvmti, struct AgentThread *agentThread);
+
+#endif
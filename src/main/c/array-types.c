@@ -0,0 +1,149 @@
+#include <jni.h>
+#include <stdio.h>
+
+#include "array-types.h"
+
+
+struct ArrayTypeInfo {
+  // JNI class name of the array class
+  const char *className;
+  // Java name of the element type
+  const char *elementName;
+  jint elementSize;
+  // JNI global reference
+  jclass arrayClass;
+  // JNI global reference
+  jstring elementNameString;
+};
+
+// indexed by enum ArrayType
+static struct ArrayTypeInfo arrayTypes[ARRAY_TYPE_COUNT] = {
+  { "[Z", "boolean", sizeof(jboolean), NULL, NULL },
+  { "[B", "byte", sizeof(jbyte), NULL, NULL },
+  { "[C", "char", sizeof(jchar), NULL, NULL },
+  { "[S", "short", sizeof(jshort), NULL, NULL },
+  { "[I", "int", sizeof(jint), NULL, NULL },
+  { "[J", "long", sizeof(jlong), NULL, NULL },
+  { "[F", "float", sizeof(jfloat), NULL, NULL },
+  { "[D", "double", sizeof(jdouble), NULL, NULL }
+};
+
+// type of the last array seen by the current thread, most threads only use one type
+static __thread jint lastArrayType = ARRAY_TYPE_BYTE;
+
+// private final byte coder of java.lang.String, NULL before JDK 9
+static jfieldID coderField = NULL;
+// names indexed by enum StringCoder - 1, JNI global references
+static jstring coderNames[2] = { NULL, NULL };
+
+static jint stringCodersInit(JNIEnv *env) {
+  jclass stringClass = (*env)->FindClass(env, "java/lang/String");
+  if (stringClass == NULL) {
+    fprintf(stderr, "FindClass(java/lang/String) failed\n");
+    return JNI_ERR;
+  }
+  // JNI does not check access, the field is not there before compact strings
+  coderField = (*env)->GetFieldID(env, stringClass, "coder", "B");
+  if (coderField == NULL) {
+    (*env)->ExceptionClear(env);
+  }
+  (*env)->DeleteLocalRef(env, stringClass);
+
+  const char *names[2] = { "LATIN1", "UTF16" };
+  for (jint i = 0; i < 2; i++) {
+    jstring name = (*env)->NewStringUTF(env, names[i]);
+    if (name == NULL) {
+      fprintf(stderr, "NewStringUTF(%s) failed\n", names[i]);
+      return JNI_ERR;
+    }
+    coderNames[i] = (*env)->NewGlobalRef(env, name);
+    (*env)->DeleteLocalRef(env, name);
+  }
+  return JNI_OK;
+}
+
+jint arrayTypesInit(JNIEnv *env) {
+  for (jint i = 0; i < ARRAY_TYPE_COUNT; i++) {
+    struct ArrayTypeInfo *info = &arrayTypes[i];
+    jclass arrayClass = (*env)->FindClass(env, info->className);
+    if (arrayClass == NULL) {
+      fprintf(stderr, "FindClass(%s) failed\n", info->className);
+      return JNI_ERR;
+    }
+    jstring elementNameString = (*env)->NewStringUTF(env, info->elementName);
+    if (elementNameString == NULL) {
+      fprintf(stderr, "NewStringUTF(%s) failed\n", info->elementName);
+      return JNI_ERR;
+    }
+    info->arrayClass = (*env)->NewGlobalRef(env, arrayClass);
+    info->elementNameString = (*env)->NewGlobalRef(env, elementNameString);
+    (*env)->DeleteLocalRef(env, arrayClass);
+    (*env)->DeleteLocalRef(env, elementNameString);
+  }
+  return stringCodersInit(env);
+}
+
+void arrayTypesDestroy(JNIEnv *env) {
+  for (jint i = 0; i < ARRAY_TYPE_COUNT; i++) {
+    struct ArrayTypeInfo *info = &arrayTypes[i];
+    if (info->arrayClass != NULL) {
+      (*env)->DeleteGlobalRef(env, info->arrayClass);
+      info->arrayClass = NULL;
+    }
+    if (info->elementNameString != NULL) {
+      (*env)->DeleteGlobalRef(env, info->elementNameString);
+      info->elementNameString = NULL;
+    }
+  }
+  for (jint i = 0; i < 2; i++) {
+    if (coderNames[i] != NULL) {
+      (*env)->DeleteGlobalRef(env, coderNames[i]);
+      coderNames[i] = NULL;
+    }
+  }
+}
+
+jint arrayType(JNIEnv *env, jarray array) {
+  jint last = lastArrayType;
+  // IsInstanceOf does not create a local reference unlike GetObjectClass
+  if ((*env)->IsInstanceOf(env, array, arrayTypes[last].arrayClass)) {
+    return last;
+  }
+  for (jint i = 0; i < ARRAY_TYPE_COUNT; i++) {
+    if (i != last && (*env)->IsInstanceOf(env, array, arrayTypes[i].arrayClass)) {
+      lastArrayType = i;
+      return i;
+    }
+  }
+  return ARRAY_TYPE_UNKNOWN;
+}
+
+jint arrayTypeElementSize(jint type) {
+  if (type < 0 || type >= ARRAY_TYPE_COUNT) {
+    return 0;
+  }
+  return arrayTypes[type].elementSize;
+}
+
+jstring arrayTypeName(jint type) {
+  if (type < 0 || type >= ARRAY_TYPE_COUNT) {
+    return NULL;
+  }
+  return arrayTypes[type].elementNameString;
+}
+
+jint stringCoder(JNIEnv *env, jstring string) {
+  if (coderField == NULL) {
+    return STRING_CODER_UNKNOWN;
+  }
+  // String.LATIN1 is 0, String.UTF16 is 1
+  jbyte coder = (*env)->GetByteField(env, string, coderField);
+  return coder == 0 ? STRING_CODER_LATIN1 : STRING_CODER_UTF16;
+}
+
+jstring stringCoderName(jint coder) {
+  if (coder != STRING_CODER_LATIN1 && coder != STRING_CODER_UTF16) {
+    return NULL;
+  }
+  return coderNames[coder - 1];
+}
@@ -0,0 +1,55 @@
+#ifndef ARRAY_TYPES_H
+#define ARRAY_TYPES_H
+
+#include <jni.h>
+
+// element types of primitive arrays, strings are reported as ARRAY_TYPE_CHAR
+enum ArrayType {
+  ARRAY_TYPE_BOOLEAN = 0,
+  ARRAY_TYPE_BYTE = 1,
+  ARRAY_TYPE_CHAR = 2,
+  ARRAY_TYPE_SHORT = 3,
+  ARRAY_TYPE_INT = 4,
+  ARRAY_TYPE_LONG = 5,
+  ARRAY_TYPE_FLOAT = 6,
+  ARRAY_TYPE_DOUBLE = 7,
+  ARRAY_TYPE_UNKNOWN = 8
+};
+
+#define ARRAY_TYPE_COUNT 8
+
+// coder of a java.lang.String, with compact strings a LATIN1 string is always copied by GetStringCritical
+// 0 is unknown so that zeroed records need no initialization
+enum StringCoder {
+  STRING_CODER_UNKNOWN = 0,
+  STRING_CODER_LATIN1 = 1,
+  STRING_CODER_UTF16 = 2
+};
+
+// looks up the primitive array classes and the String coder field and creates the element type and coder names
+jint arrayTypesInit(JNIEnv *env);
+
+// deletes the global references created by arrayTypesInit
+void arrayTypesDestroy(JNIEnv *env);
+
+// element type of a primitive array without looking up its class
+// must not be called while a critical is held
+jint arrayType(JNIEnv *env, jarray array);
+
+// size of a single element in bytes, 0 for ARRAY_TYPE_UNKNOWN
+jint arrayTypeElementSize(jint type);
+
+// Java name of the element type like "int"
+// JNI global reference, NULL for ARRAY_TYPE_UNKNOWN
+jstring arrayTypeName(jint type);
+
+// coder of the string read from the private String.coder field
+// STRING_CODER_UNKNOWN if the JDK has no such field (JDK 8)
+// must not be called while a critical is held
+jint stringCoder(JNIEnv *env, jstring string);
+
+// "LATIN1" or "UTF16"
+// JNI global reference, NULL for STRING_CODER_UNKNOWN
+jstring stringCoderName(jint coder);
+
+#endif
@@ -0,0 +1,191 @@
+// for dladdr
+#define _GNU_SOURCE
+#include <jni.h>
+#include <dlfcn.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "call-sites.h"
+
+// linear probing gives up after this many slots and uses the overflow call site
+#define MAX_PROBES 32
+// number of formatted call sites cached by callSiteString, a power of two
+#define CALL_SITE_STRINGS 4096
+
+// a formatted call site, name is published before address
+struct CallSiteString {
+  _Atomic uintptr_t address;
+  _Atomic(jstring) name;
+};
+
+
+// capacity slots followed by the overflow call site
+static struct CallSite *callSites = NULL;
+static uintptr_t callSitesMask = 0;
+
+static struct CallSiteString callSiteStrings[CALL_SITE_STRINGS];
+// serializes the insertion of formatted call sites, lookups are lock free
+static atomic_flag callSiteStringsLock = ATOMIC_FLAG_INIT;
+
+jint callSitesInit(jint capacity) {
+  if (callSites != NULL) {
+    // attached again, the table is kept
+    return JNI_OK;
+  }
+  callSites = calloc((size_t) capacity + 1, sizeof(struct CallSite));
+  if (callSites == NULL) {
+    fprintf(stderr, "calloc(%d) failed\n", capacity + 1);
+    return JNI_ERR;
+  }
+  callSitesMask = (uintptr_t) capacity - 1;
+  return JNI_OK;
+}
+
+static inline uintptr_t hashKey(uintptr_t key) {
+  // Fibonacci hashing, the low bits of return addresses are not well distributed
+  uint64_t hash = (uint64_t) key * UINT64_C(0x9E3779B97F4A7C15);
+  return (uintptr_t) (hash >> 32);
+}
+
+struct CallSite *findCallSite(void *address, jint method) {
+  uintptr_t key = ((uintptr_t) address << 1) | (uintptr_t) method;
+  uintptr_t hash = hashKey(key);
+  for (uintptr_t probe = 0; probe < MAX_PROBES; probe++) {
+    struct CallSite *site = &callSites[(hash + probe) & callSitesMask];
+    uintptr_t current = atomic_load_explicit(&site->key, memory_order_acquire);
+    if (current == key) {
+      return site;
+    }
+    if (current == 0) {
+      if (atomic_compare_exchange_strong(&site->key, &current, key) || current == key) {
+        return site;
+      }
+    }
+  }
+  return &callSites[callSitesMask + 1];
+}
+
+jint callSitesCapacity(void) {
+  return callSites == NULL ? 0 : (jint) (callSitesMask + 2);
+}
+
+jboolean callSiteSnapshot(jint index, struct CallSiteSnapshot *snapshot) {
+  struct CallSite *site = &callSites[index];
+  uintptr_t key = atomic_load_explicit(&site->key, memory_order_acquire);
+  jboolean overflow = (uintptr_t) index == callSitesMask + 1;
+  if (key == 0 && !overflow) {
+    return JNI_FALSE;
+  }
+  uint64_t count = atomic_exchange_explicit(&site->count, 0, memory_order_relaxed);
+  if (count == 0) {
+    return JNI_FALSE;
+  }
+  snapshot->address = overflow ? NULL : (void *) (key >> 1);
+  snapshot->method = overflow ? -1 : (jint) (key & 1);
+  snapshot->count = count;
+  snapshot->totalNanos = atomic_exchange_explicit(&site->totalNanos, 0, memory_order_relaxed);
+  snapshot->maxNanos = atomic_exchange_explicit(&site->maxNanos, 0, memory_order_relaxed);
+  snapshot->copies = atomic_exchange_explicit(&site->copies, 0, memory_order_relaxed);
+  snapshot->latin1Strings = atomic_exchange_explicit(&site->latin1Strings, 0, memory_order_relaxed);
+
+  // concurrent updates may end up in the next interval, use the histogram total for the percentile
+  uint64_t counts[HISTOGRAM_BUCKETS];
+  uint64_t total = 0;
+  for (jint bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+    counts[bucket] = atomic_exchange_explicit(&site->histogram[bucket], 0, memory_order_relaxed);
+    total += counts[bucket];
+  }
+  snapshot->p99Nanos = histogramPercentile(counts, total, 0.99);
+  return JNI_TRUE;
+}
+
+void callSiteName(void *address, char *buffer, size_t size) {
+  if (address == NULL) {
+    snprintf(buffer, size, "other");
+    return;
+  }
+  Dl_info info;
+  if (dladdr(address, &info) == 0 || info.dli_fname == NULL) {
+    snprintf(buffer, size, "%p", address);
+    return;
+  }
+  const char *library = strrchr(info.dli_fname, '/');
+  library = library == NULL ? info.dli_fname : library + 1;
+  if (info.dli_sname != NULL) {
+    snprintf(buffer, size, "%s+0x%lx (%s)", info.dli_sname,
+             (unsigned long) ((uintptr_t) address - (uintptr_t) info.dli_saddr), library);
+  } else {
+    snprintf(buffer, size, "0x%lx (%s)",
+             (unsigned long) ((uintptr_t) address - (uintptr_t) info.dli_fbase), library);
+  }
+}
+
+// has to be called with callSiteStringsLock held
+static jstring insertCallSiteString(JNIEnv *env, uintptr_t key) {
+  uintptr_t index = hashKey(key);
+  for (jint probe = 0; probe < MAX_PROBES; probe++) {
+    struct CallSiteString *slot = &callSiteStrings[(index + (uintptr_t) probe) & (CALL_SITE_STRINGS - 1)];
+    uintptr_t current = atomic_load_explicit(&slot->address, memory_order_relaxed);
+    if (current == key) {
+      // inserted by an other thread
+      return atomic_load_explicit(&slot->name, memory_order_relaxed);
+    }
+    if (current == 0) {
+      char name[CALL_SITE_NAME_LENGTH];
+      callSiteName((void *) key, name, sizeof(name));
+      jstring nameString = (*env)->NewStringUTF(env, name);
+      if (nameString == NULL) {
+        fprintf(stderr, "NewStringUTF(%s) failed\n", name);
+        (*env)->ExceptionClear(env);
+        return NULL;
+      }
+      jstring global = (*env)->NewGlobalRef(env, nameString);
+      (*env)->DeleteLocalRef(env, nameString);
+      atomic_store_explicit(&slot->name, global, memory_order_relaxed);
+      atomic_store_explicit(&slot->address, key, memory_order_release);
+      return global;
+    }
+  }
+  return NULL;
+}
+
+jstring callSiteString(JNIEnv *env, void *address) {
+  uintptr_t key = (uintptr_t) address;
+  if (key == 0) {
+    return NULL;
+  }
+  uintptr_t index = hashKey(key);
+  for (jint probe = 0; probe < MAX_PROBES; probe++) {
+    struct CallSiteString *slot = &callSiteStrings[(index + (uintptr_t) probe) & (CALL_SITE_STRINGS - 1)];
+    uintptr_t current = atomic_load_explicit(&slot->address, memory_order_acquire);
+    if (current == key) {
+      return atomic_load_explicit(&slot->name, memory_order_relaxed);
+    }
+    if (current == 0) {
+      break;
+    }
+  }
+  // formatting is slow and happens once per call site, a spin lock is good enough
+  while (atomic_flag_test_and_set_explicit(&callSiteStringsLock, memory_order_acquire)) {
+    sched_yield();
+  }
+  jstring name = insertCallSiteString(env, key);
+  atomic_flag_clear_explicit(&callSiteStringsLock, memory_order_release);
+  return name;
+}
+
+void callSiteStringsDestroy(JNIEnv *env) {
+  for (jint i = 0; i < CALL_SITE_STRINGS; i++) {
+    struct CallSiteString *slot = &callSiteStrings[i];
+    jstring name = atomic_load_explicit(&slot->name, memory_order_relaxed);
+    if (name != NULL) {
+      (*env)->DeleteGlobalRef(env, name);
+    }
+    atomic_store_explicit(&slot->name, NULL, memory_order_relaxed);
+    atomic_store_explicit(&slot->address, 0, memory_order_relaxed);
+  }
+}
@@ -0,0 +1,84 @@
+#ifndef CALL_SITES_H
+#define CALL_SITES_H
+
+#include <jni.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "array-types.h"
+#include "histogram.h"
+
+// maximum length of a formatted call site
+#define CALL_SITE_NAME_LENGTH 512
+
+// aggregated statistics of all criticals entered from the same native return address
+// all counters are reset when they are reported
+struct CallSite {
+  // (return address << 1) | method, 0 if the slot is empty
+  _Atomic uintptr_t key;
+  _Atomic uint64_t count;
+  _Atomic uint64_t totalNanos;
+  _Atomic uint64_t maxNanos;
+  _Atomic uint64_t copies;
+  // number of GetStringCritical calls on LATIN1 strings, these are always copied
+  _Atomic uint64_t latin1Strings;
+  _Atomic uint32_t histogram[HISTOGRAM_BUCKETS];
+};
+
+// statistics of a call site since the last report, read by the agent thread
+struct CallSiteSnapshot {
+  void *address;
+  jint method;
+  uint64_t count;
+  uint64_t totalNanos;
+  uint64_t maxNanos;
+  uint64_t copies;
+  uint64_t latin1Strings;
+  jlong p99Nanos;
+};
+
+// capacity has to be a power of two
+jint callSitesInit(jint capacity);
+
+// finds or inserts the call site
+// if the table is full an overflow call site with a NULL address is returned
+struct CallSite *findCallSite(void *address, jint method);
+
+// coder is an enum StringCoder
+static inline void callSiteRecord(struct CallSite *site, jlong nanos, jboolean isCopy, jint coder) {
+  uint64_t duration = nanos < 0 ? 0 : (uint64_t) nanos;
+  atomic_fetch_add_explicit(&site->count, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&site->totalNanos, duration, memory_order_relaxed);
+  uint64_t max = atomic_load_explicit(&site->maxNanos, memory_order_relaxed);
+  while (duration > max
+         && !atomic_compare_exchange_weak_explicit(&site->maxNanos, &max, duration, memory_order_relaxed, memory_order_relaxed)) {
+    // max was reloaded
+  }
+  if (isCopy == JNI_TRUE) {
+    atomic_fetch_add_explicit(&site->copies, 1, memory_order_relaxed);
+  }
+  if (coder == STRING_CODER_LATIN1) {
+    atomic_fetch_add_explicit(&site->latin1Strings, 1, memory_order_relaxed);
+  }
+  atomic_fetch_add_explicit(&site->histogram[histogramBucket(nanos)], 1, memory_order_relaxed);
+}
+
+// number of slots in the table including the overflow call site, valid indices for callSiteSnapshot
+jint callSitesCapacity(void);
+
+// reads and resets the statistics of a slot, returns JNI_FALSE if no critical was recorded since the last call
+jboolean callSiteSnapshot(jint index, struct CallSiteSnapshot *snapshot);
+
+// formats the call site as symbol+offset (library), called by the agent thread
+void callSiteName(void *address, char *buffer, size_t size);
+
+// the call site formatted by callSiteName, NULL if the address is NULL or the cache is full
+// cached independently of the call site table, available in every mode
+// JNI global reference, must not be called while a critical is held
+jstring callSiteString(JNIEnv *env, void *address);
+
+// deletes the global references created by callSiteString
+void callSiteStringsDestroy(JNIEnv *env);
+
+#endif
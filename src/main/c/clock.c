@@ -0,0 +1,91 @@
+#include <jni.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#include "clock.h"
+
+// how long the time stamp counter is calibrated
+#define TSC_CALIBRATION_NANOS 10000000L
+
+uint64_t tscNanosPerTick = 0;
+uint64_t tscBase = 0;
+jlong tscBaseNanos = 0L;
+
+// difference between CLOCK_REALTIME and nanoTime() in nanoseconds
+static jlong epochOffsetNanos = 0L;
+static jboolean clockInitialized = JNI_FALSE;
+static enum ClockSource clockSource = CLOCK_SOURCE_MONOTONIC;
+
+static jlong monotonicNanos(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (jlong) now.tv_sec * 1000000000L + (jlong) now.tv_nsec;
+}
+
+#if defined(__x86_64__)
+// the counter has to tick at a constant rate independent of frequency scaling and sleep states
+static jboolean isTscInvariant(void) {
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0) {
+    return JNI_FALSE;
+  }
+  return (edx & (1U << 8)) != 0;
+}
+
+static void calibrateTsc(void) {
+  jlong startNanos = monotonicNanos();
+  uint64_t startTicks = __rdtsc();
+  struct timespec duration = { 0, TSC_CALIBRATION_NANOS };
+  nanosleep(&duration, NULL);
+  jlong endNanos = monotonicNanos();
+  uint64_t endTicks = __rdtsc();
+  if (endTicks <= startTicks || endNanos <= startNanos) {
+    return;
+  }
+  tscBase = startTicks;
+  tscBaseNanos = startNanos;
+  tscNanosPerTick = ((uint64_t) (endNanos - startNanos) << 32) / (endTicks - startTicks);
+}
+#endif
+
+jint clockInit(enum ClockSource source) {
+  if (!clockInitialized) {
+#if defined(__x86_64__)
+    if (source == CLOCK_SOURCE_TSC) {
+      if (isTscInvariant()) {
+        calibrateTsc();
+      } else {
+        fprintf(stderr, "no invariant TSC, using CLOCK_MONOTONIC\n");
+      }
+    }
+#else
+    if (source == CLOCK_SOURCE_TSC) {
+      fprintf(stderr, "TSC not supported, using CLOCK_MONOTONIC\n");
+    }
+#endif
+    clockSource = source;
+    clockInitialized = JNI_TRUE;
+  } else if (source != clockSource) {
+    // timestamps taken before would no longer be comparable
+    fprintf(stderr, "clock can not be changed once initialized\n");
+    return JNI_ERR;
+  }
+
+  struct timespec wallClock;
+  clock_gettime(CLOCK_REALTIME, &wallClock);
+  jlong wallClockNanos = (jlong) wallClock.tv_sec * 1000000000L + (jlong) wallClock.tv_nsec;
+  epochOffsetNanos = wallClockNanos - nanoTime();
+  return JNI_OK;
+}
+
+jlong nanoTimeToEpochMillis(jlong nanos) {
+  return nanoTimeToEpochNanos(nanos) / 1000000L;
+}
+
+jlong nanoTimeToEpochNanos(jlong nanos) {
+  return nanos + epochOffsetNanos;
+}
@@ -0,0 +1,48 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <jni.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+enum ClockSource {
+  // clock_gettime(CLOCK_MONOTONIC), the same clock as JFR ticks on Linux
+  CLOCK_SOURCE_MONOTONIC,
+  // invariant time stamp counter calibrated against CLOCK_MONOTONIC, falls back to CLOCK_MONOTONIC if not available
+  CLOCK_SOURCE_TSC
+};
+
+// nanoseconds per time stamp counter tick as 32.32 fixed point, 0 if CLOCK_MONOTONIC is used
+extern uint64_t tscNanosPerTick;
+// time stamp counter value at calibration
+extern uint64_t tscBase;
+// CLOCK_MONOTONIC at tscBase in nanoseconds
+extern jlong tscBaseNanos;
+
+// native monotonic time in nanoseconds, cheap enough to be called for every critical
+static inline jlong nanoTime(void) {
+#if defined(__x86_64__)
+  if (tscNanosPerTick != 0) {
+    uint64_t ticks = __rdtsc() - tscBase;
+    return tscBaseNanos + (jlong) (((unsigned __int128) ticks * tscNanosPerTick) >> 32);
+  }
+#endif
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (jlong) now.tv_sec * 1000000000L + (jlong) now.tv_nsec;
+}
+
+// selects and calibrates the clock and records the offset between the monotonic and the wall clock
+// the source can not be changed once initialized, called again the offset is only updated
+jint clockInit(enum ClockSource source);
+
+// converts a value returned by nanoTime() to milliseconds since the epoch
+jlong nanoTimeToEpochMillis(jlong nanos);
+
+// converts a value returned by nanoTime() to nanoseconds since the epoch
+jlong nanoTimeToEpochNanos(jlong nanos);
+
+#endif
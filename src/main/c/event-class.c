@@ -0,0 +1,436 @@
+#include <jni.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "event-class.h"
+
+// Java 17
+#define CLASS_FILE_MAJOR_VERSION 61
+#define ACC_PUBLIC 0x0001
+#define ACC_PRIVATE 0x0002
+#define ACC_STATIC 0x0008
+#define ACC_FINAL 0x0010
+#define ACC_SUPER 0x0020
+
+#define CONSTANT_UTF8 1
+#define CONSTANT_INTEGER 3
+#define CONSTANT_CLASS 7
+#define CONSTANT_FIELDREF 9
+#define CONSTANT_METHODREF 10
+#define CONSTANT_NAME_AND_TYPE 12
+
+#define OPCODE_ILOAD 0x15
+#define OPCODE_LLOAD 0x16
+#define OPCODE_FLOAD 0x17
+#define OPCODE_DLOAD 0x18
+#define OPCODE_ALOAD 0x19
+#define OPCODE_ASTORE 0x3A
+#define OPCODE_ALOAD_0 0x2A
+#define OPCODE_DUP 0x59
+#define OPCODE_RETURN 0xB1
+#define OPCODE_PUTFIELD 0xB5
+#define OPCODE_INVOKEVIRTUAL 0xB6
+#define OPCODE_INVOKESPECIAL 0xB7
+#define OPCODE_NEW 0xBB
+
+// maximum length of a field or method descriptor
+#define DESCRIPTOR_LENGTH 1024
+
+// growable byte array, failed is set once an allocation failed
+struct ByteBuffer {
+  unsigned char *data;
+  size_t length;
+  size_t capacity;
+  jboolean failed;
+};
+
+// a class file is assembled from the constant pool and everything after it
+struct ClassWriter {
+  struct ByteBuffer pool;
+  // number of constant pool entries + 1
+  uint16_t poolCount;
+  struct ByteBuffer body;
+};
+
+static void putBytes(struct ByteBuffer *buffer, const void *bytes, size_t count) {
+  if (buffer->failed) {
+    return;
+  }
+  if (buffer->length + count > buffer->capacity) {
+    size_t capacity = buffer->capacity == 0 ? 1024 : buffer->capacity;
+    while (buffer->length + count > capacity) {
+      capacity *= 2;
+    }
+    unsigned char *data = realloc(buffer->data, capacity);
+    if (data == NULL) {
+      fprintf(stderr, "realloc(%zu) failed\n", capacity);
+      buffer->failed = JNI_TRUE;
+      return;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+  }
+  memcpy(buffer->data + buffer->length, bytes, count);
+  buffer->length += count;
+}
+
+static void putU1(struct ByteBuffer *buffer, uint8_t value) {
+  putBytes(buffer, &value, 1);
+}
+
+// class files are big endian
+static void putU2(struct ByteBuffer *buffer, uint16_t value) {
+  unsigned char bytes[] = { (unsigned char) (value >> 8), (unsigned char) value };
+  putBytes(buffer, bytes, sizeof(bytes));
+}
+
+static void putU4(struct ByteBuffer *buffer, uint32_t value) {
+  unsigned char bytes[] = { (unsigned char) (value >> 24), (unsigned char) (value >> 16),
+                            (unsigned char) (value >> 8), (unsigned char) value };
+  putBytes(buffer, bytes, sizeof(bytes));
+}
+
+// reserves a u4 length, returns the offset to pass to endLength
+static size_t beginLength(struct ByteBuffer *buffer) {
+  putU4(buffer, 0);
+  return buffer->length;
+}
+
+// writes the number of bytes since beginLength
+static void endLength(struct ByteBuffer *buffer, size_t start) {
+  if (buffer->failed) {
+    return;
+  }
+  uint32_t length = (uint32_t) (buffer->length - start);
+  unsigned char *bytes = buffer->data + start - 4;
+  bytes[0] = (unsigned char) (length >> 24);
+  bytes[1] = (unsigned char) (length >> 16);
+  bytes[2] = (unsigned char) (length >> 8);
+  bytes[3] = (unsigned char) length;
+}
+
+// entries are not deduplicated, the pool of a single event class is small
+static uint16_t poolUtf8(struct ClassWriter *writer, const char *value) {
+  // the values are plain ASCII, identical in modified UTF-8
+  size_t length = strlen(value);
+  putU1(&writer->pool, CONSTANT_UTF8);
+  putU2(&writer->pool, (uint16_t) length);
+  putBytes(&writer->pool, value, length);
+  return writer->poolCount++;
+}
+
+static uint16_t poolInteger(struct ClassWriter *writer, int32_t value) {
+  putU1(&writer->pool, CONSTANT_INTEGER);
+  putU4(&writer->pool, (uint32_t) value);
+  return writer->poolCount++;
+}
+
+static uint16_t poolClass(struct ClassWriter *writer, const char *className) {
+  uint16_t name = poolUtf8(writer, className);
+  putU1(&writer->pool, CONSTANT_CLASS);
+  putU2(&writer->pool, name);
+  return writer->poolCount++;
+}
+
+static uint16_t poolMemberRef(struct ClassWriter *writer, uint8_t tag, uint16_t owner, const char *name, const char *descriptor) {
+  uint16_t nameIndex = poolUtf8(writer, name);
+  uint16_t descriptorIndex = poolUtf8(writer, descriptor);
+  putU1(&writer->pool, CONSTANT_NAME_AND_TYPE);
+  putU2(&writer->pool, nameIndex);
+  putU2(&writer->pool, descriptorIndex);
+  uint16_t nameAndType = writer->poolCount++;
+  putU1(&writer->pool, tag);
+  putU2(&writer->pool, owner);
+  putU2(&writer->pool, nameAndType);
+  return writer->poolCount++;
+}
+
+// "J" stays "J", "java/lang/String" becomes "Ljava/lang/String;"
+static void typeDescriptor(const char *type, char *buffer, size_t size) {
+  if (strlen(type) == 1) {
+    snprintf(buffer, size, "%s", type);
+  } else {
+    snprintf(buffer, size, "L%s;", type);
+  }
+}
+
+// number of local variable slots of a parameter of the type
+static uint16_t slotSize(const char *type) {
+  return strcmp(type, "J") == 0 || strcmp(type, "D") == 0 ? 2 : 1;
+}
+
+static uint8_t loadOpcode(const char *type) {
+  if (strlen(type) > 1) {
+    return OPCODE_ALOAD;
+  }
+  switch (type[0]) {
+    case 'J':
+      return OPCODE_LLOAD;
+    case 'F':
+      return OPCODE_FLOAD;
+    case 'D':
+      return OPCODE_DLOAD;
+    default:
+      // boolean, byte, char, short and int are all ints on the operand stack
+      return OPCODE_ILOAD;
+  }
+}
+
+// annotation with a single String value, without any element value pair if value is NULL
+static void putStringAnnotation(struct ClassWriter *writer, const char *annotationType, const char *value) {
+  char descriptor[DESCRIPTOR_LENGTH];
+  typeDescriptor(annotationType, descriptor, sizeof(descriptor));
+  putU2(&writer->body, poolUtf8(writer, descriptor));
+  if (value == NULL) {
+    putU2(&writer->body, 0);
+    return;
+  }
+  // one element value pair
+  putU2(&writer->body, 1);
+  putU2(&writer->body, poolUtf8(writer, "value"));
+  putU1(&writer->body, 's');
+  putU2(&writer->body, poolUtf8(writer, value));
+}
+
+// @Name, @Label, @Description, @Category({"JNI"}) and optionally @StackTrace(false)
+static void putClassAnnotations(struct ClassWriter *writer, const struct EventTypeSpec *spec) {
+  putU2(&writer->body, poolUtf8(writer, "RuntimeVisibleAnnotations"));
+  size_t start = beginLength(&writer->body);
+  putU2(&writer->body, spec->disableStackTrace ? 5 : 4);
+  putStringAnnotation(writer, "jdk/jfr/Name", spec->name);
+  putStringAnnotation(writer, "jdk/jfr/Label", spec->label);
+  putStringAnnotation(writer, "jdk/jfr/Description", spec->description);
+
+  putU2(&writer->body, poolUtf8(writer, "Ljdk/jfr/Category;"));
+  putU2(&writer->body, 1);
+  putU2(&writer->body, poolUtf8(writer, "value"));
+  putU1(&writer->body, '[');
+  putU2(&writer->body, 1);
+  putU1(&writer->body, 's');
+  putU2(&writer->body, poolUtf8(writer, "JNI"));
+
+  if (spec->disableStackTrace) {
+    putU2(&writer->body, poolUtf8(writer, "Ljdk/jfr/StackTrace;"));
+    putU2(&writer->body, 1);
+    putU2(&writer->body, poolUtf8(writer, "value"));
+    putU1(&writer->body, 'Z');
+    putU2(&writer->body, poolInteger(writer, 0));
+  }
+  endLength(&writer->body, start);
+}
+
+// @Label, @Description and the optional additional annotation
+static void putField(struct ClassWriter *writer, const struct EventFieldSpec *field) {
+  char descriptor[DESCRIPTOR_LENGTH];
+  typeDescriptor(field->type, descriptor, sizeof(descriptor));
+  putU2(&writer->body, ACC_PRIVATE);
+  putU2(&writer->body, poolUtf8(writer, field->name));
+  putU2(&writer->body, poolUtf8(writer, descriptor));
+  // attributes_count
+  putU2(&writer->body, 1);
+  putU2(&writer->body, poolUtf8(writer, "RuntimeVisibleAnnotations"));
+  size_t start = beginLength(&writer->body);
+  putU2(&writer->body, field->annotationType != NULL ? 3 : 2);
+  putStringAnnotation(writer, "jdk/jfr/Label", field->label);
+  putStringAnnotation(writer, "jdk/jfr/Description", field->description);
+  if (field->annotationType != NULL) {
+    putStringAnnotation(writer, field->annotationType, field->annotationValue);
+  }
+  endLength(&writer->body, start);
+}
+
+static void putMethod(struct ClassWriter *writer, uint16_t access, const char *name, const char *descriptor,
+                      uint16_t maxStack, uint16_t maxLocals, const struct ByteBuffer *code) {
+  putU2(&writer->body, access);
+  putU2(&writer->body, poolUtf8(writer, name));
+  putU2(&writer->body, poolUtf8(writer, descriptor));
+  // attributes_count
+  putU2(&writer->body, 1);
+  putU2(&writer->body, poolUtf8(writer, "Code"));
+  size_t start = beginLength(&writer->body);
+  putU2(&writer->body, maxStack);
+  putU2(&writer->body, maxLocals);
+  putU4(&writer->body, (uint32_t) code->length);
+  putBytes(&writer->body, code->data, code->length);
+  // exception_table_length and attributes_count
+  putU2(&writer->body, 0);
+  putU2(&writer->body, 0);
+  endLength(&writer->body, start);
+}
+
+// (<field types>)V
+static void emitDescriptor(const struct EventTypeSpec *spec, char *buffer, size_t size) {
+  size_t position = (size_t) snprintf(buffer, size, "(");
+  for (jsize i = 0; i < spec->fieldCount && position < size; i++) {
+    typeDescriptor(spec->fields[i].type, buffer + position, size - position);
+    position += strlen(buffer + position);
+  }
+  if (position < size) {
+    snprintf(buffer + position, size - position, ")V");
+  }
+}
+
+// public CriticalEvent() { super(); }
+static void putConstructor(struct ClassWriter *writer) {
+  uint16_t eventClass = poolClass(writer, "jdk/jfr/Event");
+  uint16_t superConstructor = poolMemberRef(writer, CONSTANT_METHODREF, eventClass, "<init>", "()V");
+  struct ByteBuffer code = { NULL, 0, 0, JNI_FALSE };
+  putU1(&code, OPCODE_ALOAD_0);
+  putU1(&code, OPCODE_INVOKESPECIAL);
+  putU2(&code, superConstructor);
+  putU1(&code, OPCODE_RETURN);
+  writer->body.failed |= code.failed;
+  putMethod(writer, ACC_PUBLIC, "<init>", "()V", 1, 1, &code);
+  free(code.data);
+}
+
+// public static void emit(...) {
+//   CriticalEvent event = new CriticalEvent();
+//   event.field0 = arg0;
+//   ...
+//   event.commit();
+// }
+static void putEmitMethod(struct ClassWriter *writer, const struct EventTypeSpec *spec, uint16_t thisClass, const char *descriptor) {
+  uint16_t constructor = poolMemberRef(writer, CONSTANT_METHODREF, thisClass, "<init>", "()V");
+  // resolves to the commit method added by the JFR instrumentation, jdk.jfr.Event#commit() otherwise
+  uint16_t commit = poolMemberRef(writer, CONSTANT_METHODREF, thisClass, "commit", "()V");
+
+  uint16_t eventLocal = 0;
+  for (jsize i = 0; i < spec->fieldCount; i++) {
+    eventLocal += slotSize(spec->fields[i].type);
+  }
+
+  struct ByteBuffer code = { NULL, 0, 0, JNI_FALSE };
+  putU1(&code, OPCODE_NEW);
+  putU2(&code, thisClass);
+  putU1(&code, OPCODE_DUP);
+  putU1(&code, OPCODE_INVOKESPECIAL);
+  putU2(&code, constructor);
+  putU1(&code, OPCODE_ASTORE);
+  putU1(&code, (uint8_t) eventLocal);
+
+  uint16_t slot = 0;
+  for (jsize i = 0; i < spec->fieldCount; i++) {
+    const struct EventFieldSpec *field = &spec->fields[i];
+    char fieldDescriptor[DESCRIPTOR_LENGTH];
+    typeDescriptor(field->type, fieldDescriptor, sizeof(fieldDescriptor));
+    uint16_t fieldRef = poolMemberRef(writer, CONSTANT_FIELDREF, thisClass, field->name, fieldDescriptor);
+    putU1(&code, OPCODE_ALOAD);
+    putU1(&code, (uint8_t) eventLocal);
+    putU1(&code, loadOpcode(field->type));
+    putU1(&code, (uint8_t) slot);
+    putU1(&code, OPCODE_PUTFIELD);
+    putU2(&code, fieldRef);
+    slot += slotSize(field->type);
+  }
+
+  putU1(&code, OPCODE_ALOAD);
+  putU1(&code, (uint8_t) eventLocal);
+  putU1(&code, OPCODE_INVOKEVIRTUAL);
+  putU2(&code, commit);
+  putU1(&code, OPCODE_RETURN);
+  writer->body.failed |= code.failed;
+  // the event and a long value
+  putMethod(writer, ACC_PUBLIC | ACC_STATIC, "emit", descriptor, 3, (uint16_t) (eventLocal + 1), &code);
+  free(code.data);
+}
+
+// assembles the class file, the result has to be freed
+static jint writeEventClass(const struct EventTypeSpec *spec, const char *className, const char *emit,
+                            struct ByteBuffer *result) {
+  struct ClassWriter writer = { { NULL, 0, 0, JNI_FALSE }, 1, { NULL, 0, 0, JNI_FALSE } };
+
+  uint16_t thisClass = poolClass(&writer, className);
+  uint16_t superClass = poolClass(&writer, "jdk/jfr/Event");
+  putU2(&writer.body, ACC_PUBLIC | ACC_FINAL | ACC_SUPER);
+  putU2(&writer.body, thisClass);
+  putU2(&writer.body, superClass);
+  // interfaces_count
+  putU2(&writer.body, 0);
+
+  putU2(&writer.body, (uint16_t) spec->fieldCount);
+  for (jsize i = 0; i < spec->fieldCount; i++) {
+    putField(&writer, &spec->fields[i]);
+  }
+
+  putU2(&writer.body, 2);
+  putConstructor(&writer);
+  putEmitMethod(&writer, spec, thisClass, emit);
+
+  // attributes_count
+  putU2(&writer.body, 1);
+  putClassAnnotations(&writer, spec);
+
+  putU4(result, 0xCAFEBABE);
+  putU2(result, 0);
+  putU2(result, CLASS_FILE_MAJOR_VERSION);
+  putU2(result, writer.poolCount);
+  putBytes(result, writer.pool.data, writer.pool.length);
+  putBytes(result, writer.body.data, writer.body.length);
+  jboolean failed = writer.pool.failed || writer.body.failed || result->failed;
+  free(writer.pool.data);
+  free(writer.body.data);
+  return failed ? JNI_ERR : JNI_OK;
+}
+
+jint registerEventClass(JNIEnv *env, jclass eventClass) {
+  // FlightRecorder.register(eventClass)
+  jclass flightRecorderClass = (*env)->FindClass(env, "jdk/jfr/FlightRecorder");
+  if (flightRecorderClass == NULL) {
+    fprintf(stderr, "FindClass(jdk/jfr/FlightRecorder) failed\n");
+    return JNI_ERR;
+  }
+  jmethodID registerMethod = (*env)->GetStaticMethodID(env, flightRecorderClass, "register", "(Ljava/lang/Class;)V");
+  if (registerMethod == NULL) {
+    fprintf(stderr, "GetStaticMethodID(FlightRecorder#register) failed\n");
+    return JNI_ERR;
+  }
+  (*env)->CallStaticVoidMethod(env, flightRecorderClass, registerMethod, eventClass);
+  (*env)->DeleteLocalRef(env, flightRecorderClass);
+  if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
+    fprintf(stderr, "FlightRecorder.register() threw\n");
+    return JNI_ERR;
+  }
+  return JNI_OK;
+}
+
+jint defineEventClass(JNIEnv *env, const struct EventTypeSpec *spec, const char *className,
+                      jclass *eventClass, jmethodID *emitMethod) {
+  // local variable indices are written as a single byte
+  if (spec->fieldCount > 100) {
+    fprintf(stderr, "too many fields in %s\n", spec->name);
+    return JNI_ERR;
+  }
+  char emit[DESCRIPTOR_LENGTH];
+  emitDescriptor(spec, emit, sizeof(emit));
+
+  struct ByteBuffer classFile = { NULL, 0, 0, JNI_FALSE };
+  if (writeEventClass(spec, className, emit, &classFile) != JNI_OK) {
+    fprintf(stderr, "writeEventClass(%s) failed\n", className);
+    free(classFile.data);
+    return JNI_ERR;
+  }
+  // the bootstrap class loader is the only one available in the start phase and it can see jdk.jfr
+  jclass localClass = (*env)->DefineClass(env, className, NULL, (const jbyte *) classFile.data, (jsize) classFile.length);
+  free(classFile.data);
+  if (localClass == NULL) {
+    fprintf(stderr, "DefineClass(%s) failed\n", className);
+    return JNI_ERR;
+  }
+  jmethodID method = (*env)->GetStaticMethodID(env, localClass, "emit", emit);
+  if (method == NULL) {
+    fprintf(stderr, "GetStaticMethodID(emit) failed\n");
+    (*env)->DeleteLocalRef(env, localClass);
+    return JNI_ERR;
+  }
+  if (registerEventClass(env, localClass) != JNI_OK) {
+    (*env)->DeleteLocalRef(env, localClass);
+    return JNI_ERR;
+  }
+  *eventClass = (*env)->NewGlobalRef(env, localClass);
+  *emitMethod = method;
+  (*env)->DeleteLocalRef(env, localClass);
+  return JNI_OK;
+}
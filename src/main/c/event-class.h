@@ -0,0 +1,17 @@
+#ifndef EVENT_CLASS_H
+#define EVENT_CLASS_H
+
+#include <jni.h>
+
+#include "jfr-event-factory.h"
+
+// defines a final subclass of jdk.jfr.Event with one field per field of spec and registers it
+// the class has a method
+//   public static void emit(<field types in spec order>)
+// that creates, populates and commits an event with a single upcall
+// className is a binary name like com/github/marschall/Example, the class is defined to the bootstrap class loader
+// eventClass is a JNI global reference
+jint defineEventClass(JNIEnv *env, const struct EventTypeSpec *spec, const char *className,
+                      jclass *eventClass, jmethodID *emitMethod);
+
+#endif
@@ -0,0 +1,103 @@
+#include <jni.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "clock.h"
+#include "gc-stalls.h"
+
+
+_Atomic jint inFlightCriticals = 0;
+
+// the last release, written by several threads without synchronization
+// the fields may be slightly inconsistent if two threads release at the same time, this only affects attribution
+static _Atomic(struct ThreadState *) lastReleaseState = NULL;
+static _Atomic uint32_t lastReleaseGeneration = 0;
+static _Atomic jint lastReleaseMethod = 0;
+static _Atomic jlong lastReleaseStartNanos = 0L;
+static _Atomic jlong lastReleaseEndNanos = 0L;
+
+// single producer, single consumer queue of garbage collections
+// the producer is the VM thread running the garbage collection, the consumer is the reporter thread
+static struct GcStallSnapshot snapshots[GC_STALL_SNAPSHOTS];
+// next snapshot to publish, only written by the producer
+static _Atomic uint64_t snapshotHead = 0;
+// next snapshot to read, only written by the consumer
+static _Atomic uint64_t snapshotTail = 0;
+// whether the garbage collection in progress is recorded, only accessed by the producer
+static jboolean recording = JNI_FALSE;
+
+void gcStallsLastRelease(struct ThreadState *state, jint method, jlong startNanos, jlong endNanos) {
+  atomic_store_explicit(&lastReleaseState, state, memory_order_relaxed);
+  if (state != NULL) {
+    atomic_store_explicit(&lastReleaseGeneration, atomic_load_explicit(&state->generation, memory_order_relaxed), memory_order_relaxed);
+  }
+  atomic_store_explicit(&lastReleaseMethod, method, memory_order_relaxed);
+  atomic_store_explicit(&lastReleaseStartNanos, startNanos, memory_order_relaxed);
+  atomic_store_explicit(&lastReleaseEndNanos, endNanos, memory_order_release);
+}
+
+void gcStallsGcStart(void) {
+  jlong gcStartNanos = nanoTime();
+  jint inFlight = atomic_load_explicit(&inFlightCriticals, memory_order_acquire);
+  jlong lastReleaseNanos = atomic_load_explicit(&lastReleaseEndNanos, memory_order_acquire);
+  jboolean afterRelease = lastReleaseNanos != 0L && gcStartNanos - lastReleaseNanos < GC_LOCKER_WINDOW_NANOS;
+  recording = JNI_FALSE;
+  if (inFlight == 0 && !afterRelease) {
+    // not related to criticals
+    return;
+  }
+  uint64_t head = atomic_load_explicit(&snapshotHead, memory_order_relaxed);
+  if (head - atomic_load_explicit(&snapshotTail, memory_order_acquire) == GC_STALL_SNAPSHOTS) {
+    // the reporter thread fell behind, don't block the garbage collection
+    return;
+  }
+  recording = JNI_TRUE;
+
+  struct GcStallSnapshot *snapshot = &snapshots[head & (GC_STALL_SNAPSHOTS - 1)];
+  memset(snapshot, 0, sizeof(struct GcStallSnapshot));
+  snapshot->gcStartNanos = gcStartNanos;
+  snapshot->inFlightCriticals = inFlight;
+  if (afterRelease) {
+    snapshot->lastRelease.state = atomic_load_explicit(&lastReleaseState, memory_order_relaxed);
+    snapshot->lastRelease.generation = atomic_load_explicit(&lastReleaseGeneration, memory_order_relaxed);
+    snapshot->lastRelease.method = atomic_load_explicit(&lastReleaseMethod, memory_order_relaxed);
+    snapshot->lastRelease.startNanos = atomic_load_explicit(&lastReleaseStartNanos, memory_order_relaxed);
+    snapshot->lastRelease.endNanos = lastReleaseNanos;
+  }
+  if (inFlight > 0) {
+    jint holderCount = 0;
+    for (struct ThreadState *state = firstThreadState(); state != NULL && holderCount < GC_STALL_HOLDERS; state = state->next) {
+      jlong startNanos = atomic_load_explicit(&state->inFlight.startNanos, memory_order_acquire);
+      if (startNanos == 0L || atomic_load_explicit(&state->status, memory_order_relaxed) == THREAD_STATE_FREE) {
+        continue;
+      }
+      struct CriticalHolder *holder = &snapshot->holders[holderCount++];
+      holder->state = state;
+      holder->generation = atomic_load_explicit(&state->generation, memory_order_relaxed);
+      holder->method = atomic_load_explicit(&state->inFlight.method, memory_order_relaxed);
+      holder->startNanos = startNanos;
+    }
+    snapshot->holderCount = holderCount;
+  }
+}
+
+void gcStallsGcFinish(void) {
+  if (!recording) {
+    return;
+  }
+  recording = JNI_FALSE;
+  uint64_t head = atomic_load_explicit(&snapshotHead, memory_order_relaxed);
+  snapshots[head & (GC_STALL_SNAPSHOTS - 1)].gcEndNanos = nanoTime();
+  atomic_store_explicit(&snapshotHead, head + 1, memory_order_release);
+}
+
+jboolean gcStallsPoll(struct GcStallSnapshot *result) {
+  uint64_t tail = atomic_load_explicit(&snapshotTail, memory_order_relaxed);
+  if (tail == atomic_load_explicit(&snapshotHead, memory_order_acquire)) {
+    return JNI_FALSE;
+  }
+  memcpy(result, &snapshots[tail & (GC_STALL_SNAPSHOTS - 1)], sizeof(struct GcStallSnapshot));
+  atomic_store_explicit(&snapshotTail, tail + 1, memory_order_release);
+  return JNI_TRUE;
+}
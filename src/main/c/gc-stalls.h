@@ -0,0 +1,90 @@
+#ifndef GC_STALLS_H
+#define GC_STALLS_H
+
+#include <jni.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "thread-state.h"
+
+// maximum number of in-flight criticals recorded per garbage collection
+#define GC_STALL_HOLDERS 32
+// number of garbage collections that can be recorded before the reporter thread catches up, a power of two
+#define GC_STALL_SNAPSHOTS 16
+// a garbage collection starting this soon after the last critical was released is assumed to have waited for it
+// the GCLocker starts the delayed collection as soon as the last critical is released
+#define GC_LOCKER_WINDOW_NANOS 1000000L
+
+// a critical held by a thread
+struct CriticalHolder {
+  // NULL if unknown
+  struct ThreadState *state;
+  // value of ThreadState.generation when the holder was recorded
+  uint32_t generation;
+  // enum CriticalMethod
+  jint method;
+  // nanoTime() before Get*Critical
+  jlong startNanos;
+  // nanoTime() after Release*Critical, 0 if still held
+  jlong endNanos;
+};
+
+// criticals related to a single garbage collection
+struct GcStallSnapshot {
+  jlong gcStartNanos;
+  jlong gcEndNanos;
+  // number of criticals held when the garbage collection started
+  jint inFlightCriticals;
+  // criticals held when the garbage collection started, at most GC_STALL_HOLDERS
+  jint holderCount;
+  struct CriticalHolder holders[GC_STALL_HOLDERS];
+  // critical released last before the garbage collection started, state is NULL if none
+  struct CriticalHolder lastRelease;
+};
+
+// number of criticals currently held by all threads
+extern _Atomic jint inFlightCriticals;
+
+// called by the thread entering the outermost critical
+static inline void gcStallsEnter(struct ThreadState *state, jint method, jlong startNanos) {
+  atomic_fetch_add_explicit(&inFlightCriticals, 1, memory_order_relaxed);
+  if (state != NULL) {
+    inFlightEnter(&state->inFlight, method, startNanos);
+  }
+}
+
+// records the last release, only called when no critical is held any more
+void gcStallsLastRelease(struct ThreadState *state, jint method, jlong startNanos, jlong endNanos);
+
+// called by the thread leaving the outermost critical
+static inline void gcStallsExit(struct ThreadState *state, jlong endNanos) {
+  jint method = 0;
+  jlong startNanos = 0L;
+  if (state != NULL) {
+    method = atomic_load_explicit(&state->inFlight.method, memory_order_relaxed);
+    startNanos = atomic_load_explicit(&state->inFlight.startNanos, memory_order_relaxed);
+    inFlightExit(&state->inFlight);
+  }
+  if (atomic_fetch_sub_explicit(&inFlightCriticals, 1, memory_order_release) == 1) {
+    gcStallsLastRelease(state, method, startNanos, endNanos);
+  }
+}
+
+// called by a thread that held a critical while the redirection was removed, the release was not seen
+static inline void gcStallsAbandon(struct ThreadState *state) {
+  if (state != NULL) {
+    inFlightExit(&state->inFlight);
+  }
+  atomic_fetch_sub_explicit(&inFlightCriticals, 1, memory_order_release);
+}
+
+// called from the JVMTI GarbageCollectionStart event, must not call JNI
+void gcStallsGcStart(void);
+
+// called from the JVMTI GarbageCollectionFinish event, must not call JNI
+void gcStallsGcFinish(void);
+
+// copies the oldest finished garbage collection to result, returns JNI_FALSE if there is none
+jboolean gcStallsPoll(struct GcStallSnapshot *result);
+
+#endif
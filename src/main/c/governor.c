@@ -0,0 +1,64 @@
+#include <jni.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "governor.h"
+
+// the interval is only lowered once the overhead dropped below this fraction of the budget
+#define LOWER_THRESHOLD 0.5
+
+_Atomic jint governedSampleInterval = 1;
+
+// the governor never samples more often than configured
+static jint minimumSampleInterval = 1;
+// CPU time of the process at the last adjustment
+static jlong lastCpuNanos = 0L;
+
+// CPU time of all threads of the process including the JVM and the agent
+static jlong processCpuNanos(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+  return (jlong) now.tv_sec * 1000000000L + (jlong) now.tv_nsec;
+}
+
+void governorInit(jint minimumInterval) {
+  minimumSampleInterval = minimumInterval;
+  atomic_store_explicit(&governedSampleInterval, minimumInterval, memory_order_relaxed);
+  lastCpuNanos = processCpuNanos();
+}
+
+jboolean governorAdjust(uint64_t agentNanos, jdouble budget, struct GovernorDecision *decision) {
+  jlong cpuNanos = processCpuNanos();
+  jlong elapsedCpuNanos = cpuNanos - lastCpuNanos;
+  lastCpuNanos = cpuNanos;
+  jint interval = atomic_load_explicit(&governedSampleInterval, memory_order_relaxed);
+  decision->previousInterval = interval;
+  decision->interval = interval;
+  decision->overhead = elapsedCpuNanos > 0 ? (jdouble) agentNanos / (jdouble) elapsedCpuNanos : 0.0;
+  if (elapsedCpuNanos <= 0) {
+    // nothing to measure against
+    return JNI_FALSE;
+  }
+
+  jlong next = interval;
+  if (decision->overhead > budget) {
+    // most of the cost is in sampled criticals, scale the interval by the excess
+    next = (jlong) ((jdouble) interval * (decision->overhead / budget)) + 1;
+    if (next > MAX_GOVERNED_SAMPLE_INTERVAL) {
+      next = MAX_GOVERNED_SAMPLE_INTERVAL;
+    }
+  } else if (decision->overhead < budget * LOWER_THRESHOLD && interval > minimumSampleInterval) {
+    // approach the configured rate slowly to avoid oscillating
+    next = interval / 2;
+    if (next < minimumSampleInterval) {
+      next = minimumSampleInterval;
+    }
+  }
+  if (next == interval) {
+    return JNI_FALSE;
+  }
+  decision->interval = (jint) next;
+  atomic_store_explicit(&governedSampleInterval, (jint) next, memory_order_relaxed);
+  return JNI_TRUE;
+}
@@ -0,0 +1,32 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <jni.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// upper bound of the sampling interval chosen by the governor
+#define MAX_GOVERNED_SAMPLE_INTERVAL (1 << 20)
+
+// every governedSampleInterval-th critical and copy of a thread is recorded
+// agentOptions.sampleInterval unless the governor raised it, read by every critical and copy
+extern _Atomic jint governedSampleInterval;
+
+// result of a single adjustment
+struct GovernorDecision {
+  jint previousInterval;
+  jint interval;
+  // time spent in the agent divided by the CPU time of the process since the last adjustment
+  jdouble overhead;
+};
+
+// resets the sampling interval and the window, the governor never samples more than minimumInterval
+void governorInit(jint minimumInterval);
+
+// raises the sampling interval if the agent used more than budget of the CPU time since the last call
+// and lowers it again if it used less than half of it
+// agentNanos is the total time spent in the agent by all threads since the previous call
+// returns JNI_TRUE if the interval changed
+jboolean governorAdjust(uint64_t agentNanos, jdouble budget, struct GovernorDecision *decision);
+
+#endif
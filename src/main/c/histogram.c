@@ -0,0 +1,36 @@
+#include <jni.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "histogram.h"
+
+
+jlong histogramPercentile(const uint64_t *counts, uint64_t total, double percentile) {
+  if (total == 0) {
+    return 0L;
+  }
+  // rank of the value, at least 1
+  uint64_t rank = (uint64_t) (percentile * (double) total);
+  if ((double) rank < percentile * (double) total || rank == 0) {
+    rank += 1;
+  }
+  uint64_t seen = 0;
+  for (jint bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+    seen += counts[bucket];
+    if (seen >= rank) {
+      return histogramBucketUpperBound(bucket);
+    }
+  }
+  return histogramBucketUpperBound(HISTOGRAM_BUCKETS - 1);
+}
+
+void histogramShardMerge(struct HistogramShard *shard, uint64_t *counts, uint64_t *totalNanos) {
+  for (jint bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+    uint64_t count = atomic_load_explicit(&shard->counts[bucket], memory_order_relaxed);
+    counts[bucket] += count - shard->mergedCounts[bucket];
+    shard->mergedCounts[bucket] = count;
+  }
+  uint64_t total = atomic_load_explicit(&shard->totalNanos, memory_order_relaxed);
+  *totalNanos += total - shard->mergedTotalNanos;
+  shard->mergedTotalNanos = total;
+}
@@ -0,0 +1,70 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <jni.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// log-linear buckets, every power of two is split into HISTOGRAM_SUB_BUCKETS linear buckets
+// this gives a relative error of at most 1 / HISTOGRAM_SUB_BUCKETS
+#define HISTOGRAM_SUB_BUCKET_BITS 3
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+// values of 2^(HISTOGRAM_MAX_BIT + 1) nanoseconds (about 36 minutes) and more end up in the last bucket
+#define HISTOGRAM_MAX_BIT 40
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BIT - HISTOGRAM_SUB_BUCKET_BITS + 2) * HISTOGRAM_SUB_BUCKETS)
+
+static inline jint histogramBucket(jlong value) {
+  if (value < HISTOGRAM_SUB_BUCKETS) {
+    return value < 0 ? 0 : (jint) value;
+  }
+  jint msb = 63 - __builtin_clzll((unsigned long long) value);
+  if (msb > HISTOGRAM_MAX_BIT) {
+    return HISTOGRAM_BUCKETS - 1;
+  }
+  jint shift = msb - HISTOGRAM_SUB_BUCKET_BITS;
+  jint subBucket = (jint) ((uint64_t) value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1);
+  return (shift + 1) * HISTOGRAM_SUB_BUCKETS + subBucket;
+}
+
+// smallest value that ends up in the bucket
+static inline jlong histogramBucketLowerBound(jint bucket) {
+  if (bucket < HISTOGRAM_SUB_BUCKETS) {
+    return bucket;
+  }
+  jint shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+  jint subBucket = bucket % HISTOGRAM_SUB_BUCKETS;
+  return (jlong) (HISTOGRAM_SUB_BUCKETS + subBucket) << shift;
+}
+
+// largest value that ends up in the bucket
+static inline jlong histogramBucketUpperBound(jint bucket) {
+  if (bucket == HISTOGRAM_BUCKETS - 1) {
+    return INT64_MAX;
+  }
+  return histogramBucketLowerBound(bucket + 1) - 1;
+}
+
+// histogram with a single writer, written by the owning thread and merged by the reporter thread
+struct HistogramShard {
+  _Atomic uint64_t counts[HISTOGRAM_BUCKETS];
+  _Atomic uint64_t totalNanos;
+  // values at the last merge, only accessed by the reporter thread
+  uint64_t mergedCounts[HISTOGRAM_BUCKETS];
+  uint64_t mergedTotalNanos;
+};
+
+static inline void histogramShardRecord(struct HistogramShard *shard, jlong nanos) {
+  // single writer, no need for an atomic read-modify-write
+  _Atomic uint64_t *count = &shard->counts[histogramBucket(nanos)];
+  atomic_store_explicit(count, atomic_load_explicit(count, memory_order_relaxed) + 1, memory_order_relaxed);
+  uint64_t total = atomic_load_explicit(&shard->totalNanos, memory_order_relaxed);
+  atomic_store_explicit(&shard->totalNanos, total + (uint64_t) (nanos < 0 ? 0 : nanos), memory_order_relaxed);
+}
+
+// adds the values recorded since the last merge to counts and totalNanos
+void histogramShardMerge(struct HistogramShard *shard, uint64_t *counts, uint64_t *totalNanos);
+
+// returns the upper bound of the bucket containing the given percentile, percentile is between 0.0 and 1.0
+jlong histogramPercentile(const uint64_t *counts, uint64_t total, double percentile);
+
+#endif
@@ -0,0 +1,237 @@
+#include <jni.h>
+#include <jvmti.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "array-types.h"
+#include "clock.h"
+#include "hot-arrays.h"
+#include "stack-traces.h"
+
+static struct HotArray hotArrays[HOT_ARRAY_CAPACITY];
+// indices of free entries, guarded by hotArraysLock
+static jint freeEntries[HOT_ARRAY_CAPACITY];
+// only written while holding hotArraysLock, read without it to skip full tables
+static _Atomic jint freeCount = 0;
+static jboolean freeEntriesInitialized = JNI_FALSE;
+// serializes tagging and the free list, never taken by the ObjectFree callback
+static atomic_flag hotArraysLock = ATOMIC_FLAG_INIT;
+
+// last array pinned by the current thread and its entry, a weak global reference
+static __thread jweak lastPinnedArray = NULL;
+static __thread jint lastPinnedEntry = HOT_ARRAY_NONE;
+// incremented by hotArraysReset, the cached entry of a thread is only valid in the generation it was cached in
+static _Atomic uint32_t tableGeneration = 0;
+static __thread uint32_t lastPinnedGeneration = 0;
+
+static void lockHotArrays(void) {
+  while (atomic_flag_test_and_set_explicit(&hotArraysLock, memory_order_acquire)) {
+    sched_yield();
+  }
+}
+
+static void unlockHotArrays(void) {
+  atomic_flag_clear_explicit(&hotArraysLock, memory_order_release);
+}
+
+void hotArraysInit(void) {
+  lockHotArrays();
+  if (!freeEntriesInitialized) {
+    // lowest index on top
+    for (jint i = 0; i < HOT_ARRAY_CAPACITY; i++) {
+      freeEntries[i] = HOT_ARRAY_CAPACITY - 1 - i;
+    }
+    atomic_store_explicit(&freeCount, HOT_ARRAY_CAPACITY, memory_order_relaxed);
+    freeEntriesInitialized = JNI_TRUE;
+  }
+  unlockHotArrays();
+}
+
+void hotArraysReset(jvmtiEnv *jvmti, JNIEnv *env) {
+  lockHotArrays();
+  jint tagCount = 0;
+  jlong *tags = malloc(sizeof(jlong) * HOT_ARRAY_CAPACITY);
+  if (tags == NULL) {
+    fprintf(stderr, "malloc(tags) failed\n");
+  } else {
+    for (jint i = 0; i < HOT_ARRAY_CAPACITY; i++) {
+      if (atomic_load_explicit(&hotArrays[i].state, memory_order_acquire) == HOT_ARRAY_LIVE) {
+        tags[tagCount] = (jlong) i + 1;
+        tagCount += 1;
+      }
+    }
+  }
+  if (tagCount > 0) {
+    jint objectCount = 0;
+    jobject *objects = NULL;
+    jvmtiError error = (*jvmti)->GetObjectsWithTags(jvmti, tagCount, tags, &objectCount, &objects, NULL);
+    if (error == JVMTI_ERROR_NONE) {
+      for (jint i = 0; i < objectCount; i++) {
+        (*jvmti)->SetTag(jvmti, objects[i], 0L);
+        (*env)->DeleteLocalRef(env, objects[i]);
+      }
+      (*jvmti)->Deallocate(jvmti, (unsigned char *) objects);
+    } else {
+      fprintf(stderr, "GetObjectsWithTags (JVMTI) failed with error(%d)\n", error);
+    }
+  }
+  free(tags);
+  for (jint i = 0; i < HOT_ARRAY_CAPACITY; i++) {
+    atomic_store_explicit(&hotArrays[i].state, HOT_ARRAY_FREE, memory_order_relaxed);
+  }
+  // refilled by hotArraysInit when attaching again
+  atomic_store_explicit(&freeCount, 0, memory_order_relaxed);
+  freeEntriesInitialized = JNI_FALSE;
+  atomic_fetch_add_explicit(&tableGeneration, 1, memory_order_relaxed);
+  unlockHotArrays();
+}
+
+// has to be called with hotArraysLock held
+static jint popFreeEntry(void) {
+  jint count = atomic_load_explicit(&freeCount, memory_order_relaxed);
+  if (count == 0) {
+    return HOT_ARRAY_NONE;
+  }
+  atomic_store_explicit(&freeCount, count - 1, memory_order_relaxed);
+  return freeEntries[count - 1];
+}
+
+// has to be called with hotArraysLock held
+static void pushFreeEntry(jint entry) {
+  jint count = atomic_load_explicit(&freeCount, memory_order_relaxed);
+  freeEntries[count] = entry;
+  atomic_store_explicit(&freeCount, count + 1, memory_order_relaxed);
+}
+
+// tags the array with a new entry unless an other thread was faster, returns the entry
+static jint tagArray(jvmtiEnv *jvmti, JNIEnv *env, jarray array) {
+  // outside of the lock, may be thrown away if an other thread tags the array first
+  jint stackId = captureStack(jvmti, HOT_ARRAY_STACK_DEPTH);
+  jint length = (*env)->GetArrayLength(env, array);
+  jint elementType = arrayType(env, array);
+
+  jint entry = HOT_ARRAY_NONE;
+  lockHotArrays();
+  jlong tag = 0L;
+  jvmtiError error = (*jvmti)->GetTag(jvmti, array, &tag);
+  if (error == JVMTI_ERROR_NONE && tag != 0L) {
+    entry = (jint) (tag - 1);
+  } else if (error == JVMTI_ERROR_NONE && (entry = popFreeEntry()) != HOT_ARRAY_NONE) {
+    struct HotArray *hot = &hotArrays[entry];
+    hot->length = length;
+    hot->elementType = elementType;
+    hot->stackId = stackId;
+    hot->firstPinNanos = nanoTime();
+    atomic_store_explicit(&hot->pins, 0, memory_order_relaxed);
+    atomic_store_explicit(&hot->holdNanos, 0, memory_order_relaxed);
+    atomic_store_explicit(&hot->state, HOT_ARRAY_LIVE, memory_order_release);
+    error = (*jvmti)->SetTag(jvmti, array, (jlong) entry + 1);
+    if (error != JVMTI_ERROR_NONE) {
+      fprintf(stderr, "SetTag (JVMTI) failed with error(%d)\n", error);
+      atomic_store_explicit(&hot->state, HOT_ARRAY_FREE, memory_order_relaxed);
+      pushFreeEntry(entry);
+      entry = HOT_ARRAY_NONE;
+    }
+  }
+  unlockHotArrays();
+  return entry;
+}
+
+jint hotArraysPin(jvmtiEnv *jvmti, JNIEnv *env, jarray array) {
+  uint32_t generation = atomic_load_explicit(&tableGeneration, memory_order_relaxed);
+  // IsSameObject does not need to resolve a handle into the tag map
+  if (lastPinnedArray != NULL && lastPinnedGeneration == generation && (*env)->IsSameObject(env, array, lastPinnedArray)) {
+    return lastPinnedEntry;
+  }
+  jlong tag = 0L;
+  jvmtiError error = (*jvmti)->GetTag(jvmti, array, &tag);
+  if (error != JVMTI_ERROR_NONE) {
+    return HOT_ARRAY_NONE;
+  }
+  jint entry;
+  if (tag != 0L) {
+    entry = (jint) (tag - 1);
+  } else if (atomic_load_explicit(&freeCount, memory_order_relaxed) == 0) {
+    // full, don't capture a stack for nothing
+    return HOT_ARRAY_NONE;
+  } else {
+    entry = tagArray(jvmti, env, array);
+    if (entry == HOT_ARRAY_NONE) {
+      return HOT_ARRAY_NONE;
+    }
+  }
+  if (lastPinnedArray != NULL) {
+    (*env)->DeleteWeakGlobalRef(env, lastPinnedArray);
+  }
+  lastPinnedArray = (*env)->NewWeakGlobalRef(env, array);
+  lastPinnedEntry = entry;
+  lastPinnedGeneration = generation;
+  return entry;
+}
+
+void hotArraysRecord(jint entry, jlong holdNanos) {
+  struct HotArray *hot = &hotArrays[entry];
+  atomic_fetch_add_explicit(&hot->pins, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&hot->holdNanos, (uint64_t) (holdNanos < 0 ? 0 : holdNanos), memory_order_relaxed);
+}
+
+void hotArraysFree(jlong tag) {
+  if (tag <= 0 || tag > HOT_ARRAY_CAPACITY) {
+    return;
+  }
+  atomic_store_explicit(&hotArrays[tag - 1].state, HOT_ARRAY_DEAD, memory_order_release);
+}
+
+void hotArraysReclaim(void) {
+  lockHotArrays();
+  for (jint i = 0; i < HOT_ARRAY_CAPACITY; i++) {
+    if (atomic_load_explicit(&hotArrays[i].state, memory_order_acquire) == HOT_ARRAY_DEAD) {
+      atomic_store_explicit(&hotArrays[i].state, HOT_ARRAY_FREE, memory_order_relaxed);
+      pushFreeEntry(i);
+    }
+  }
+  unlockHotArrays();
+}
+
+jint hotArraysTop(struct HotArraySnapshot *top, jint count) {
+  jint selected = 0;
+  for (jint i = 0; i < HOT_ARRAY_CAPACITY; i++) {
+    struct HotArray *hot = &hotArrays[i];
+    if (atomic_load_explicit(&hot->state, memory_order_acquire) != HOT_ARRAY_LIVE) {
+      continue;
+    }
+    uint64_t holdNanos = atomic_load_explicit(&hot->holdNanos, memory_order_relaxed);
+    uint64_t pins = atomic_load_explicit(&hot->pins, memory_order_relaxed);
+    if (pins == 0 || (selected == count && holdNanos <= top[count - 1].holdNanos)) {
+      continue;
+    }
+    // insertion into the sorted selection, count is small
+    jint position = selected < count ? selected : count - 1;
+    while (position > 0 && top[position - 1].holdNanos < holdNanos) {
+      top[position] = top[position - 1];
+      position -= 1;
+    }
+    top[position].entry = i;
+    top[position].pins = pins;
+    top[position].holdNanos = holdNanos;
+    if (selected < count) {
+      selected += 1;
+    }
+  }
+  return selected;
+}
+
+const struct HotArray *hotArray(jint entry) {
+  return &hotArrays[entry];
+}
+
+void hotArraysThreadEnd(JNIEnv *env) {
+  if (lastPinnedArray != NULL) {
+    (*env)->DeleteWeakGlobalRef(env, lastPinnedArray);
+    lastPinnedArray = NULL;
+    lastPinnedEntry = HOT_ARRAY_NONE;
+  }
+}
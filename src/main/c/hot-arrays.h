@@ -0,0 +1,81 @@
+#ifndef HOT_ARRAYS_H
+#define HOT_ARRAYS_H
+
+#include <jni.h>
+#include <jvmti.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// maximum number of arrays tracked at the same time, further arrays are not tracked
+#define HOT_ARRAY_CAPACITY 16384
+// number of Java frames captured when an array is pinned the first time
+#define HOT_ARRAY_STACK_DEPTH 16
+// maximum number of arrays reported per period
+#define MAX_HOT_ARRAYS 64
+// entry of arrays that are not tracked
+#define HOT_ARRAY_NONE (-1)
+
+enum HotArrayState {
+  // not used, on the free list
+  HOT_ARRAY_FREE = 0,
+  // the array is alive and tagged with the entry index + 1
+  HOT_ARRAY_LIVE = 1,
+  // the array was freed by the garbage collector, waits to be reclaimed by the agent thread
+  HOT_ARRAY_DEAD = 2
+};
+
+// statistics of a single array, identified by its JVMTI tag
+struct HotArray {
+  _Atomic int state;
+  // number of outermost criticals that pinned the array
+  _Atomic uint64_t pins;
+  // sum of the hold times of these criticals
+  _Atomic uint64_t holdNanos;
+  // written before the array is tagged, immutable while the entry is live
+  jint length;
+  // enum ArrayType
+  jint elementType;
+  // Java frames of the first pin, STACK_ID_UNKNOWN if they could not be interned
+  jint stackId;
+  // nanoTime() of the first pin
+  jlong firstPinNanos;
+};
+
+// a live entry selected by hotArraysTop, counters read at selection time
+struct HotArraySnapshot {
+  jint entry;
+  uint64_t pins;
+  uint64_t holdNanos;
+};
+
+// fills the free list unless it is already filled
+void hotArraysInit(void);
+
+// removes the tags of all tracked arrays and empties the table, called when detaching
+// no thread may pin an array concurrently
+void hotArraysReset(jvmtiEnv *jvmti, JNIEnv *env);
+
+// looks up the entry of the array by its JVMTI tag, tags the array if it is pinned the first time
+// the last array pinned by the thread is cached in a weak global reference to skip the tag lookup
+// must not be called while a critical is held
+jint hotArraysPin(jvmtiEnv *jvmti, JNIEnv *env, jarray array);
+
+// records a released pin of the array, does not call JNI
+void hotArraysRecord(jint entry, jlong holdNanos);
+
+// ObjectFree callback, must neither block nor call JNI
+void hotArraysFree(jlong tag);
+
+// puts the entries of freed arrays back on the free list, called by the agent thread
+void hotArraysReclaim(void);
+
+// selects at most count live entries with the longest cumulative hold time, longest first, returns the number selected
+jint hotArraysTop(struct HotArraySnapshot *top, jint count);
+
+// entry of a snapshot, valid until the next hotArraysReclaim
+const struct HotArray *hotArray(jint entry);
+
+// deletes the weak reference cached by the current thread, called when the thread ends
+void hotArraysThreadEnd(JNIEnv *env);
+
+#endif
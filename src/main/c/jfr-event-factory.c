@@ -0,0 +1,439 @@
+#include <jni.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "jfr-event-factory.h"
+
+
+// at most label, description and one additional annotation
+#define MAX_FIELD_ANNOTATIONS 3
+
+jint newAnnotationElement(JNIEnv *env, const char *annotationTypeClassName, const char *value, jobject *result) {
+  // new AnnotationElement(annotationTypeClassName.class, value) or new AnnotationElement(annotationTypeClassName.class)
+  jclass annotationTypeClass = (*env)->FindClass(env, annotationTypeClassName);
+  if (annotationTypeClass == NULL) {
+    fprintf(stderr, "FindClass(%s) failed\n", annotationTypeClassName);
+    return JNI_ERR;
+  }
+
+  jstring valueString = NULL;
+  if (value != NULL) {
+    valueString = (*env)->NewStringUTF(env, value);
+    if (valueString == NULL) {
+      fprintf(stderr, "NewStringUTF(%s) failed\n", value);
+      return JNI_ERR;
+    }
+  }
+
+  jclass annotationElementClass = (*env)->FindClass(env, "jdk/jfr/AnnotationElement");
+  if (annotationElementClass == NULL) {
+    fprintf(stderr, "FindClass(jdk/jfr/AnnotationElement) failed\n");
+    return JNI_ERR;
+  }
+  const char *constructorSignature = value != NULL ? "(Ljava/lang/Class;Ljava/lang/Object;)V" : "(Ljava/lang/Class;)V";
+  jmethodID annotationElementConstructor = (*env)->GetMethodID(env, annotationElementClass,
+                                                                    "<init>", constructorSignature);
+  if (annotationElementConstructor == NULL) {
+    fprintf(stderr, "GetMethodID(jdk/jfr/AnnotationElement#<init>) failed\n");
+    return JNI_ERR;
+  }
+
+  jobject annotationElement;
+  if (valueString != NULL) {
+    annotationElement = (*env)->NewObject(env, annotationElementClass, annotationElementConstructor,
+                                          annotationTypeClass, valueString);
+  } else {
+    annotationElement = (*env)->NewObject(env, annotationElementClass, annotationElementConstructor, annotationTypeClass);
+  }
+  if (annotationElement == NULL) {
+    fprintf(stderr, "new %s() failed\n", annotationTypeClassName);
+    return JNI_ERR;
+  }
+  *result = annotationElement;
+  // annotationElementConstructor jmethodID does not need to be freed
+  (*env)->DeleteLocalRef(env, annotationElementClass);
+  (*env)->DeleteLocalRef(env, annotationTypeClass);
+  if (valueString != NULL) {
+    (*env)->DeleteLocalRef(env, valueString);
+  }
+  return JNI_OK;
+}
+
+jint newList(JNIEnv *env, jobject *elements, jsize count, jobject *result) {
+  // return List.of(elements)
+
+  jclass objectClass = (*env)->FindClass(env, "java/lang/Object");
+  if (objectClass == NULL) {
+    fprintf(stderr, "FindClass(java/lang/Object) failed\n");
+    return JNI_ERR;
+  }
+  jobjectArray array = (*env)->NewObjectArray(env, count, objectClass, NULL);
+  if (array == NULL) {
+    fprintf(stderr, "NewObjectArray(%d, java/lang/Object) failed\n", count);
+    return JNI_ERR;
+  }
+  for (jsize i = 0; i < count; i++) {
+    (*env)->SetObjectArrayElement(env, array, i, elements[i]);
+  }
+
+  jclass listClass = (*env)->FindClass(env, "java/util/List");
+  if (listClass == NULL) {
+    fprintf(stderr, "FindClass(java/util/List) failed\n");
+    return JNI_ERR;
+  }
+  jmethodID listOfMethod = (*env)->GetStaticMethodID(env, listClass,
+                                                     "of", "([Ljava/lang/Object;)Ljava/util/List;");
+  if (listOfMethod == NULL) {
+    fprintf(stderr, "GetMethodID(List#of(Object...)) failed\n");
+    return JNI_ERR;
+  }
+  jobject list = (*env)->CallStaticObjectMethod(env, listClass, listOfMethod, array);
+  if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
+    fprintf(stderr, "List.of() threw\n");
+    return JNI_ERR;
+  }
+  // listOfMethod jmethodID does not need to be freed
+  (*env)->DeleteLocalRef(env, listClass);
+  (*env)->DeleteLocalRef(env, array);
+  (*env)->DeleteLocalRef(env, objectClass);
+
+  *result = list;
+  return JNI_OK;
+}
+
+jint getEventAnnotations(JNIEnv *env, const struct EventTypeSpec *spec, jobject *result) {
+
+  // String[] category = { "JNI" };
+  jstring categoryString = (*env)->NewStringUTF(env, "JNI");
+  if (categoryString == NULL) {
+    fprintf(stderr, "NewStringUTF(JNI) failed\n");
+    return JNI_ERR;
+  }
+  jclass stringClass = (*env)->FindClass(env, "java/lang/String");
+  if (stringClass == NULL) {
+    fprintf(stderr, "FindClass(java/lang/String) failed\n");
+    return JNI_ERR;
+  }
+  jobjectArray categoryArray = (*env)->NewObjectArray(env, 1, stringClass, categoryString);
+  if (categoryArray == NULL) {
+    fprintf(stderr, "NewObjectArray(1, java/lang/String) failed\n");
+    return JNI_ERR;
+  }
+  (*env)->DeleteLocalRef(env, categoryString);
+  (*env)->DeleteLocalRef(env, stringClass);
+
+  jobject nameElement;
+  jint name_result = newAnnotationElement(env, "jdk/jfr/Name", spec->name, &nameElement);
+  if (name_result != JNI_OK) {
+    fprintf(stderr, "new AnnotationElement(Name.class failed\n");
+    return JNI_ERR;
+  }
+
+  jobject labelElement;
+  jint label_result = newAnnotationElement(env, "jdk/jfr/Label", spec->label, &labelElement);
+  if (label_result != JNI_OK) {
+    fprintf(stderr, "new AnnotationElement(Label.class failed\n");
+    return JNI_ERR;
+  }
+
+  jobject descriptionElement;
+  jint description_result = newAnnotationElement(env, "jdk/jfr/Description", spec->description, &descriptionElement);
+  if (description_result != JNI_OK) {
+    fprintf(stderr, "new AnnotationElement(Description.class failed\n");
+    return JNI_ERR;
+  }
+
+  // new AnnotationElement
+  jclass categoryClass = (*env)->FindClass(env, "jdk/jfr/Category");
+  if (categoryClass == NULL) {
+    fprintf(stderr, "FindClass(jdk/jfr/Category) failed\n");
+    return JNI_ERR;
+  }
+  jclass annotationElementClass = (*env)->FindClass(env, "jdk/jfr/AnnotationElement");
+  if (annotationElementClass == NULL) {
+    fprintf(stderr, "FindClass(jdk/jfr/AnnotationElement) failed\n");
+    return JNI_ERR;
+  }
+  jmethodID annotationElementConstructor = (*env)->GetMethodID(env, annotationElementClass,
+                                                               "<init>", "(Ljava/lang/Class;Ljava/lang/Object;)V");
+  if (annotationElementConstructor == NULL) {
+    fprintf(stderr, "GetMethodID(jdk/jfr/AnnotationElement#<init>) failed\n");
+    return JNI_ERR;
+  }
+  jobject categoryElement = (*env)->NewObject(env, annotationElementClass, annotationElementConstructor,
+                                                   categoryClass, categoryArray);
+  if (categoryElement == NULL) {
+    fprintf(stderr, "NewObject failed\n");
+    return JNI_ERR;
+  }
+
+  (*env)->DeleteLocalRef(env, categoryClass);
+  (*env)->DeleteLocalRef(env, categoryArray);
+
+  jobject stackTraceElement = NULL;
+  if (spec->disableStackTrace) {
+    // new AnnotationElement(StackTrace.class, Boolean.FALSE)
+    jclass stackTraceClass = (*env)->FindClass(env, "jdk/jfr/StackTrace");
+    if (stackTraceClass == NULL) {
+      fprintf(stderr, "FindClass(jdk/jfr/StackTrace) failed\n");
+      return JNI_ERR;
+    }
+    jobject falseObject;
+    if (getBooleanField(env, "FALSE", &falseObject) != JNI_OK) {
+      fprintf(stderr, "getBooleanField(FALSE) failed\n");
+      return JNI_ERR;
+    }
+    stackTraceElement = (*env)->NewObject(env, annotationElementClass, annotationElementConstructor,
+                                          stackTraceClass, falseObject);
+    if (stackTraceElement == NULL) {
+      fprintf(stderr, "NewObject failed\n");
+      return JNI_ERR;
+    }
+    (*env)->DeleteLocalRef(env, stackTraceClass);
+    (*env)->DeleteLocalRef(env, falseObject);
+  }
+  (*env)->DeleteLocalRef(env, annotationElementClass);
+
+  // List.of(nameElement, labelElement, descriptionElement, categoryElement[, stackTraceElement])
+
+  jobject elements[] = { nameElement, labelElement, descriptionElement, categoryElement, stackTraceElement };
+  jint return_value = newList(env, elements, stackTraceElement == NULL ? 4 : 5, result);
+  (*env)->DeleteLocalRef(env, nameElement);
+  (*env)->DeleteLocalRef(env, labelElement);
+  (*env)->DeleteLocalRef(env, descriptionElement);
+  (*env)->DeleteLocalRef(env, categoryElement);
+  if (stackTraceElement != NULL) {
+    (*env)->DeleteLocalRef(env, stackTraceElement);
+  }
+  return return_value;
+}
+
+jint newAnnotationElements(JNIEnv *env, const struct EventFieldSpec *field, jobject *result) {
+  // return List.of(
+  // new AnnotationElement(Label.class, label)
+  // new AnnotationElement(Description.class, description)
+  // [new AnnotationElement(annotationType.class, annotationValue)]
+
+  jobject elements[MAX_FIELD_ANNOTATIONS];
+  jsize elementCount = 0;
+
+  jint label_result = newAnnotationElement(env, "jdk/jfr/Label", field->label, &elements[elementCount]);
+  if (label_result != JNI_OK) {
+    fprintf(stderr, "new AnnotationElement(Label.class failed\n");
+    return JNI_ERR;
+  }
+  elementCount += 1;
+
+  jint description_result = newAnnotationElement(env, "jdk/jfr/Description", field->description, &elements[elementCount]);
+  if (description_result != JNI_OK) {
+    fprintf(stderr, "new AnnotationElement(Description.class failed\n");
+    return JNI_ERR;
+  }
+  elementCount += 1;
+
+  if (field->annotationType != NULL) {
+    jint annotation_result = newAnnotationElement(env, field->annotationType, field->annotationValue, &elements[elementCount]);
+    if (annotation_result != JNI_OK) {
+      fprintf(stderr, "new AnnotationElement(%s.class failed\n", field->annotationType);
+      return JNI_ERR;
+    }
+    elementCount += 1;
+  }
+
+  jint return_value = newList(env, elements, elementCount, result);
+  for (jsize i = 0; i < elementCount; i++) {
+    (*env)->DeleteLocalRef(env, elements[i]);
+  }
+  return return_value;
+}
+
+jint getBooleanField(JNIEnv *env, const char *fieldName, jobject *result) {
+
+  jclass clazz = (*env)->FindClass(env, "java/lang/Boolean");
+  if (clazz == NULL) {
+    fprintf(stderr, "FindClass(java/lang/Boolean) failed\n");
+    return JNI_ERR;
+  }
+  jfieldID typeField = (*env)->GetStaticFieldID(env, clazz, fieldName, "Ljava/lang/Boolean;");
+  if (typeField == NULL) {
+    fprintf(stderr, "GetStaticFieldID(%s#TYPE) failed\n", fieldName);
+    return JNI_ERR;
+  }
+  jobject fieldValue = (*env)->GetStaticObjectField(env, clazz, typeField);
+  (*env)->DeleteLocalRef(env, clazz);
+  *result = fieldValue;
+  return JNI_OK;
+}
+
+jint getTypeField(JNIEnv *env, const char *className, jclass *result) {
+
+  jclass clazz = (*env)->FindClass(env, className);
+  if (clazz == NULL) {
+    fprintf(stderr, "FindClass(%s) failed\n", className);
+    return JNI_ERR;
+  }
+  jfieldID typeField = (*env)->GetStaticFieldID(env, clazz, "TYPE", "Ljava/lang/Class;");
+  if (typeField == NULL) {
+    fprintf(stderr, "GetStaticFieldID(%s#TYPE) failed\n", className);
+    return JNI_ERR;
+  }
+  jobject fieldValue = (*env)->GetStaticObjectField(env, clazz, typeField);
+  (*env)->DeleteLocalRef(env, clazz);
+  *result = fieldValue;
+  return JNI_OK;
+}
+
+jint resolveType(JNIEnv *env, const char *className, jclass *result) {
+  if (strcmp(className, "Z") == 0) {
+    return getTypeField(env, "java/lang/Boolean", result);
+  } else if (strcmp(className, "B") == 0) {
+    return getTypeField(env, "java/lang/Byte", result);
+  } else if (strcmp(className, "C") == 0) {
+    return getTypeField(env, "java/lang/Character", result);
+  } else if (strcmp(className, "S") == 0) {
+    return getTypeField(env, "java/lang/Short", result);
+  } else if (strcmp(className, "I") == 0) {
+    return getTypeField(env, "java/lang/Integer", result);
+  } else if (strcmp(className, "J") == 0) {
+    return getTypeField(env, "java/lang/Long", result);
+  } else if (strcmp(className, "F") == 0) {
+    return getTypeField(env, "java/lang/Float", result);
+  } else if (strcmp(className, "D") == 0) {
+    return getTypeField(env, "java/lang/Double", result);
+  } else {
+    jclass valueClass = (*env)->FindClass(env, className);
+    if (valueClass == NULL) {
+      fprintf(stderr, "FindClass(%s) failed\n", className);
+      return JNI_ERR;
+    }
+    *result = valueClass;
+  }
+  return JNI_OK;
+}
+
+jint newValueDescriptor(JNIEnv *env, const char *fieldType, const char *fieldName, jobject annotations, jobject *result) {
+
+  jclass valueClass;
+  jint valueClass_result = resolveType(env, fieldType, &valueClass);
+  if (valueClass_result != JNI_OK) {
+    fprintf(stderr, "FindClass(%s) failed\n", fieldType);
+    return JNI_ERR;
+  }
+
+  jstring fieldString = (*env)->NewStringUTF(env, fieldName);
+  if (fieldString == NULL) {
+    fprintf(stderr, "NewStringUTF(%s) failed\n", fieldName);
+    return JNI_ERR;
+  }
+
+  jclass valueDescriptionClass = (*env)->FindClass(env, "jdk/jfr/ValueDescriptor");
+  if (valueDescriptionClass == NULL) {
+    fprintf(stderr, "FindClass(jdk/jfr/ValueDescriptor) failed\n");
+    return JNI_ERR;
+  }
+  jmethodID valueDescriptorConstructor = (*env)->GetMethodID(env, valueDescriptionClass,
+                                                                  "<init>", "(Ljava/lang/Class;Ljava/lang/String;Ljava/util/List;)V");
+  if (valueDescriptorConstructor == NULL) {
+    fprintf(stderr, "GetMethodID(jdk/jfr/AnnotationElement#<init>) failed\n");
+    return JNI_ERR;
+  }
+
+  jobject valueDescriptor = (*env)->NewObject(env, valueDescriptionClass, valueDescriptorConstructor,
+                                                   valueClass, fieldString, annotations);
+  if (valueDescriptor == NULL) {
+    fprintf(stderr, "new ValueDescriptor(%s, %s failed\n", fieldType, fieldName);
+    return JNI_ERR;
+  }
+  *result = valueDescriptor;
+  (*env)->DeleteLocalRef(env, valueClass);
+  (*env)->DeleteLocalRef(env, fieldString);
+  (*env)->DeleteLocalRef(env, valueDescriptionClass);
+  // valueDescriptorConstructor jmethodID does not need to be freed
+  return JNI_OK;
+}
+
+jint getValueDescriptors(JNIEnv *env, const struct EventTypeSpec *spec, jobject *result) {
+
+  jobject *descriptors = calloc((size_t) spec->fieldCount, sizeof(jobject));
+  if (descriptors == NULL) {
+    fprintf(stderr, "calloc() failed\n");
+    return JNI_ERR;
+  }
+
+  for (jsize i = 0; i < spec->fieldCount; i++) {
+    const struct EventFieldSpec *field = &spec->fields[i];
+
+    jobject annotations;
+    jint annotations_result = newAnnotationElements(env, field, &annotations);
+    if (annotations_result != JNI_OK) {
+      fprintf(stderr, "List<AnnotationElement> %s  failed\n", field->label);
+      free(descriptors);
+      return JNI_ERR;
+    }
+
+    jint descriptor_result = newValueDescriptor(env, field->type, field->name, annotations, &descriptors[i]);
+    (*env)->DeleteLocalRef(env, annotations);
+    if (descriptor_result != JNI_OK) {
+      fprintf(stderr, "new ValueDescriptor(%s, %s  failed\n", field->type, field->name);
+      free(descriptors);
+      return JNI_ERR;
+    }
+  }
+
+  // List.of(descriptors)
+
+  jint return_value = newList(env, descriptors, spec->fieldCount, result);
+  for (jsize i = 0; i < spec->fieldCount; i++) {
+    (*env)->DeleteLocalRef(env, descriptors[i]);
+  }
+  free(descriptors);
+  return return_value;
+}
+
+jint newEventFactory(JNIEnv *env, const struct EventTypeSpec *spec, jobject *result) {
+  jobject eventAnnotations;
+  jobject valueDescriptors;
+
+  jclass eventFactoryClass = (*env)->FindClass(env, "jdk/jfr/EventFactory");
+  if (eventFactoryClass == NULL) {
+    fprintf(stderr, "FindClass(jdk/jfr/EventFactory) failed\n");
+    return JNI_ERR;
+  }
+  jmethodID createMethod = (*env)->GetStaticMethodID(env, eventFactoryClass,
+                                                    "create", "(Ljava/util/List;Ljava/util/List;)Ljdk/jfr/EventFactory;");
+  if (createMethod == NULL) {
+    fprintf(stderr, "GetMethodID(jdk/jfr/EventFactory#create) failed\n");
+    return JNI_ERR;
+  }
+
+  jint eventAnnotationsResult = getEventAnnotations(env, spec, &eventAnnotations);
+  if (eventAnnotationsResult != JNI_OK) {
+    fprintf(stderr, "getEventAnnotations() failed\n");
+    return JNI_ERR;
+  }
+
+  jint valueDescriptorsResult = getValueDescriptors(env, spec, &valueDescriptors);
+  if (valueDescriptorsResult != JNI_OK) {
+    fprintf(stderr, "getValueDescriptors() failed\n");
+    (*env)->DeleteLocalRef(env, eventAnnotations);
+    return JNI_ERR;
+  }
+
+  jobject localEventFactory = (*env)->CallStaticObjectMethod(env, eventFactoryClass, createMethod,
+                                                                  eventAnnotations, valueDescriptors);
+  if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
+    fprintf(stderr, "EventFactory.create(%s) threw\n", spec->name);
+    return JNI_ERR;
+  }
+
+  (*env)->DeleteLocalRef(env, eventAnnotations);
+  (*env)->DeleteLocalRef(env, valueDescriptors);
+
+  *result = (*env)->NewGlobalRef(env, localEventFactory);
+
+  (*env)->DeleteLocalRef(env, eventFactoryClass);
+  (*env)->DeleteLocalRef(env, localEventFactory);
+
+  return JNI_OK;
+}
@@ -0,0 +1,45 @@
+#ifndef JFR_EVENT_FACTORY_H
+#define JFR_EVENT_FACTORY_H
+
+#include <jni.h>
+
+// description of a single field of a JFR event, translated into a jdk.jfr.ValueDescriptor
+struct EventFieldSpec {
+  // primitive type descriptor like "Z" or "J", or a class name like "java/lang/String"
+  const char *type;
+  const char *name;
+  const char *label;
+  const char *description;
+  // optional additional annotation, eg. "jdk/jfr/Timespan", may be NULL
+  const char *annotationType;
+  // String value of the additional annotation, eg. "NANOSECONDS", NULL for annotations without value like "jdk/jfr/Percentage"
+  const char *annotationValue;
+};
+
+// description of a JFR event type, translated into a jdk.jfr.EventFactory
+struct EventTypeSpec {
+  // value of @Name
+  const char *name;
+  // value of @Label
+  const char *label;
+  // value of @Description
+  const char *description;
+  const struct EventFieldSpec *fields;
+  jsize fieldCount;
+  // whether @StackTrace(false) is added so that JFR does not walk the stack on commit
+  jboolean disableStackTrace;
+};
+
+// creates a new jdk.jfr.EventFactory for the given event type
+// result is a JNI global reference
+jint newEventFactory(JNIEnv *env, const struct EventTypeSpec *spec, jobject *result);
+
+// value may be NULL for annotations without value
+jint newAnnotationElement(JNIEnv *env, const char *annotationTypeClassName, const char *value, jobject *result);
+
+// List.of(elements)
+jint newList(JNIEnv *env, jobject *elements, jsize count, jobject *result);
+
+jint getBooleanField(JNIEnv *env, const char *fieldName, jobject *result);
+
+#endif
@@ -0,0 +1,194 @@
+#include <jni.h>
+#include <jvmti.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "agent-calls.h"
+#include "clock.h"
+#include "jni-copies.h"
+#include "thread-state.h"
+
+
+#define COPY_FUNCTION_NAMES(Name, type) \
+  "Get" #Name "ArrayElements", \
+  "Release" #Name "ArrayElements", \
+  "Get" #Name "ArrayRegion", \
+  "Set" #Name "ArrayRegion",
+
+// indexed by enum CopyFunction
+static const char *copyFunctionNames[COPY_FUNCTION_COUNT] = {
+  PRIMITIVE_TYPES(COPY_FUNCTION_NAMES)
+  "GetStringChars",
+  "ReleaseStringChars",
+  "GetStringUTFChars",
+  "ReleaseStringUTFChars"
+};
+
+#undef COPY_FUNCTION_NAMES
+
+// JNI global references
+static jstring copyFunctionNameStrings[COPY_FUNCTION_COUNT];
+
+static jvmtiEnv *copiesJvmti = NULL;
+static const jniNativeInterface *originalFunctions = NULL;
+static CopyListener copyListener = NULL;
+
+void copyCountersMerge(struct CopyCounters *counters, struct CopyTotals *totals) {
+  uint64_t calls = atomic_load_explicit(&counters->calls, memory_order_relaxed);
+  uint64_t bytes = atomic_load_explicit(&counters->bytes, memory_order_relaxed);
+  uint64_t copies = atomic_load_explicit(&counters->copies, memory_order_relaxed);
+  uint64_t nanos = atomic_load_explicit(&counters->nanos, memory_order_relaxed);
+  totals->calls += calls - counters->merged.calls;
+  totals->bytes += bytes - counters->merged.bytes;
+  totals->copies += copies - counters->merged.copies;
+  totals->nanos += nanos - counters->merged.nanos;
+  counters->merged.calls = calls;
+  counters->merged.bytes = bytes;
+  counters->merged.copies = copies;
+  counters->merged.nanos = nanos;
+}
+
+static inline void recordCopy(JNIEnv *env, jint function, jlong bytes, jboolean copied, jlong nanos) {
+  if (!agentCallEnter()) {
+    // detaching, the thread states and events may already be released
+    return;
+  }
+  // eg. ArrayIndexOutOfBoundsException, nothing was copied
+  if (!(*env)->ExceptionCheck(env)) {
+    struct ThreadState *state = getThreadState(copiesJvmti, env);
+    if (state != NULL) {
+      copyCountersRecord(&state->copies[function], bytes, copied, nanos);
+    }
+    if (copyListener != NULL) {
+      copyListener(env, function, bytes, copied, nanos);
+    }
+  }
+  agentCallExit();
+}
+
+// Get<Type>ArrayElements, Release<Type>ArrayElements, Get<Type>ArrayRegion and Set<Type>ArrayRegion
+// copies made by Get<Type>ArrayElements are counted, copying back on release is not
+#define ARRAY_INTERCEPTORS(Name, type) \
+  type * JNICALL RedirectedGet##Name##ArrayElements(JNIEnv *env, type##Array array, jboolean *isCopy) { \
+    jboolean witness = JNI_FALSE; \
+    jboolean *actualCopy = isCopy != NULL ? isCopy : &witness; \
+    jlong startNanos = nanoTime(); \
+    type *elems = originalFunctions->Get##Name##ArrayElements(env, array, actualCopy); \
+    jlong nanos = nanoTime() - startNanos; \
+    if (elems != NULL) { \
+      /* the original function, the length lookup is not a call of the application */ \
+      jlong bytes = *actualCopy ? (jlong) originalFunctions->GetArrayLength(env, array) * (jlong) sizeof(type) : 0L; \
+      recordCopy(env, COPY_GET_##Name##_ARRAY_ELEMENTS, bytes, *actualCopy, nanos); \
+    } \
+    return elems; \
+  } \
+  \
+  void JNICALL RedirectedRelease##Name##ArrayElements(JNIEnv *env, type##Array array, type *elems, jint mode) { \
+    jlong startNanos = nanoTime(); \
+    originalFunctions->Release##Name##ArrayElements(env, array, elems, mode); \
+    recordCopy(env, COPY_RELEASE_##Name##_ARRAY_ELEMENTS, 0L, JNI_FALSE, nanoTime() - startNanos); \
+  } \
+  \
+  void JNICALL RedirectedGet##Name##ArrayRegion(JNIEnv *env, type##Array array, jsize start, jsize len, type *buf) { \
+    jlong startNanos = nanoTime(); \
+    originalFunctions->Get##Name##ArrayRegion(env, array, start, len, buf); \
+    recordCopy(env, COPY_GET_##Name##_ARRAY_REGION, (jlong) len * (jlong) sizeof(type), JNI_TRUE, nanoTime() - startNanos); \
+  } \
+  \
+  void JNICALL RedirectedSet##Name##ArrayRegion(JNIEnv *env, type##Array array, jsize start, jsize len, const type *buf) { \
+    jlong startNanos = nanoTime(); \
+    originalFunctions->Set##Name##ArrayRegion(env, array, start, len, buf); \
+    recordCopy(env, COPY_SET_##Name##_ARRAY_REGION, (jlong) len * (jlong) sizeof(type), JNI_TRUE, nanoTime() - startNanos); \
+  }
+
+PRIMITIVE_TYPES(ARRAY_INTERCEPTORS)
+
+#undef ARRAY_INTERCEPTORS
+
+const jchar * JNICALL RedirectedGetStringChars(JNIEnv *env, jstring string, jboolean *isCopy) {
+  jboolean witness = JNI_FALSE;
+  jboolean *actualCopy = isCopy != NULL ? isCopy : &witness;
+  jlong startNanos = nanoTime();
+  const jchar *chars = originalFunctions->GetStringChars(env, string, actualCopy);
+  jlong nanos = nanoTime() - startNanos;
+  if (chars != NULL) {
+    // the original function, the length lookup is not a call of the application
+    jlong bytes = *actualCopy ? (jlong) originalFunctions->GetStringLength(env, string) * (jlong) sizeof(jchar) : 0L;
+    recordCopy(env, COPY_GET_STRING_CHARS, bytes, *actualCopy, nanos);
+  }
+  return chars;
+}
+
+void JNICALL RedirectedReleaseStringChars(JNIEnv *env, jstring string, const jchar *chars) {
+  jlong startNanos = nanoTime();
+  originalFunctions->ReleaseStringChars(env, string, chars);
+  recordCopy(env, COPY_RELEASE_STRING_CHARS, 0L, JNI_FALSE, nanoTime() - startNanos);
+}
+
+const char * JNICALL RedirectedGetStringUTFChars(JNIEnv *env, jstring string, jboolean *isCopy) {
+  jboolean witness = JNI_FALSE;
+  jboolean *actualCopy = isCopy != NULL ? isCopy : &witness;
+  jlong startNanos = nanoTime();
+  const char *utf = originalFunctions->GetStringUTFChars(env, string, actualCopy);
+  jlong nanos = nanoTime() - startNanos;
+  if (utf != NULL) {
+    // modified UTF-8 never contains a 0 byte, no need to call GetStringUTFLength
+    jlong bytes = *actualCopy ? (jlong) strlen(utf) : 0L;
+    recordCopy(env, COPY_GET_STRING_UTF_CHARS, bytes, *actualCopy, nanos);
+  }
+  return utf;
+}
+
+void JNICALL RedirectedReleaseStringUTFChars(JNIEnv *env, jstring string, const char *utf) {
+  jlong startNanos = nanoTime();
+  originalFunctions->ReleaseStringUTFChars(env, string, utf);
+  recordCopy(env, COPY_RELEASE_STRING_UTF_CHARS, 0L, JNI_FALSE, nanoTime() - startNanos);
+}
+
+#define REDIRECT_ARRAY_FUNCTIONS(Name, type) \
+  redirected->Get##Name##ArrayElements = RedirectedGet##Name##ArrayElements; \
+  redirected->Release##Name##ArrayElements = RedirectedRelease##Name##ArrayElements; \
+  redirected->Get##Name##ArrayRegion = RedirectedGet##Name##ArrayRegion; \
+  redirected->Set##Name##ArrayRegion = RedirectedSet##Name##ArrayRegion;
+
+void redirectJniCopies(jvmtiEnv *jvmti, const jniNativeInterface *original, jniNativeInterface *redirected, CopyListener listener) {
+  copiesJvmti = jvmti;
+  originalFunctions = original;
+  copyListener = listener;
+
+  PRIMITIVE_TYPES(REDIRECT_ARRAY_FUNCTIONS)
+  redirected->GetStringChars = RedirectedGetStringChars;
+  redirected->ReleaseStringChars = RedirectedReleaseStringChars;
+  redirected->GetStringUTFChars = RedirectedGetStringUTFChars;
+  redirected->ReleaseStringUTFChars = RedirectedReleaseStringUTFChars;
+}
+
+#undef REDIRECT_ARRAY_FUNCTIONS
+
+jint jniCopiesInit(JNIEnv *env) {
+  for (jint i = 0; i < COPY_FUNCTION_COUNT; i++) {
+    jstring name = (*env)->NewStringUTF(env, copyFunctionNames[i]);
+    if (name == NULL) {
+      fprintf(stderr, "NewStringUTF(%s) failed\n", copyFunctionNames[i]);
+      return JNI_ERR;
+    }
+    copyFunctionNameStrings[i] = (*env)->NewGlobalRef(env, name);
+    (*env)->DeleteLocalRef(env, name);
+  }
+  return JNI_OK;
+}
+
+void jniCopiesDestroy(JNIEnv *env) {
+  for (jint i = 0; i < COPY_FUNCTION_COUNT; i++) {
+    if (copyFunctionNameStrings[i] != NULL) {
+      (*env)->DeleteGlobalRef(env, copyFunctionNameStrings[i]);
+      copyFunctionNameStrings[i] = NULL;
+    }
+  }
+}
+
+jstring copyFunctionName(jint function) {
+  return copyFunctionNameStrings[function];
+}
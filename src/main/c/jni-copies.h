@@ -0,0 +1,89 @@
+#ifndef JNI_COPIES_H
+#define JNI_COPIES_H
+
+#include <jni.h>
+#include <jvmti.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// X-macro of the primitive types, X(Name, type) where Name is used in the JNI function names
+#define PRIMITIVE_TYPES(X) \
+  X(Boolean, jboolean) \
+  X(Byte, jbyte) \
+  X(Char, jchar) \
+  X(Short, jshort) \
+  X(Int, jint) \
+  X(Long, jlong) \
+  X(Float, jfloat) \
+  X(Double, jdouble)
+
+#define COPY_FUNCTION_IDS(Name, type) \
+  COPY_GET_##Name##_ARRAY_ELEMENTS, \
+  COPY_RELEASE_##Name##_ARRAY_ELEMENTS, \
+  COPY_GET_##Name##_ARRAY_REGION, \
+  COPY_SET_##Name##_ARRAY_REGION,
+
+// the intercepted JNI functions that copy memory
+enum CopyFunction {
+  PRIMITIVE_TYPES(COPY_FUNCTION_IDS)
+  COPY_GET_STRING_CHARS,
+  COPY_RELEASE_STRING_CHARS,
+  COPY_GET_STRING_UTF_CHARS,
+  COPY_RELEASE_STRING_UTF_CHARS,
+  COPY_FUNCTION_COUNT
+};
+
+#undef COPY_FUNCTION_IDS
+
+// counters of a single function summed up since the last report
+struct CopyTotals {
+  uint64_t calls;
+  // bytes copied into or out of the Java heap
+  uint64_t bytes;
+  // number of calls that made a copy
+  uint64_t copies;
+  uint64_t nanos;
+};
+
+// counters of a single function of a single thread, written by the owning thread and merged by the reporter thread
+struct CopyCounters {
+  _Atomic uint64_t calls;
+  _Atomic uint64_t bytes;
+  _Atomic uint64_t copies;
+  _Atomic uint64_t nanos;
+  // values at the last merge, only accessed by the reporter thread
+  struct CopyTotals merged;
+};
+
+static inline void incrementCounter(_Atomic uint64_t *counter, uint64_t value) {
+  // single writer, no need for an atomic read-modify-write
+  atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+static inline void copyCountersRecord(struct CopyCounters *counters, jlong bytes, jboolean copied, jlong nanos) {
+  incrementCounter(&counters->calls, 1);
+  incrementCounter(&counters->bytes, (uint64_t) bytes);
+  incrementCounter(&counters->copies, copied ? 1 : 0);
+  incrementCounter(&counters->nanos, (uint64_t) nanos);
+}
+
+// adds the values recorded since the last merge to totals
+void copyCountersMerge(struct CopyCounters *counters, struct CopyTotals *totals);
+
+// called after every intercepted call on the calling thread, may call JNI
+typedef void (*CopyListener)(JNIEnv *env, jint function, jlong bytes, jboolean copied, jlong nanos);
+
+// replaces the copying functions in redirected, calls go to original, listener may be NULL
+void redirectJniCopies(jvmtiEnv *jvmti, const jniNativeInterface *original, jniNativeInterface *redirected, CopyListener listener);
+
+// creates the function names
+jint jniCopiesInit(JNIEnv *env);
+
+// deletes the global references created by jniCopiesInit
+void jniCopiesDestroy(JNIEnv *env);
+
+// name of the JNI function like "GetIntArrayRegion"
+// JNI global reference
+jstring copyFunctionName(jint function);
+
+#endif
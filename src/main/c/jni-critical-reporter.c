@@ -1,22 +1,111 @@
 #include <jni.h>
 #include <jvmti.h>
+#include <stdatomic.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+#include "agent-calls.h"
+#include "agent-options.h"
+#include "agent-thread.h"
+#include "array-types.h"
+#include "call-sites.h"
+#include "clock.h"
+#include "event-class.h"
+#include "gc-stalls.h"
+#include "governor.h"
+#include "histogram.h"
+#include "hot-arrays.h"
+#include "jfr-event-factory.h"
+#include "jni-copies.h"
+#include "jni-transitions.h"
+#include "native-libraries.h"
+#include "probes.h"
+#include "ring-buffer.h"
+#include "stack-traces.h"
+#include "thread-state.h"
+#include "trace-file.h"
+
+// maximum number of records drained from a ring buffer at once
+#define FLUSH_BATCH_SIZE 256
+// maximum number of nested criticals tracked per thread, deeper criticals are only counted
+#define MAX_CRITICAL_DEPTH 16
+// maximum number of released criticals per thread waiting for the outermost critical to be released
+#define MAX_PENDING_CRITICALS 64
+// maximum number of event types that can cause the JNI functions to be redirected
+#define MAX_INSTALL_EVENT_TYPES 7
+// maximum length of a formatted stack
+#define STACK_NAME_LENGTH 16384
+// binary name of the generated class of com.github.marschall.jnicriticalreporter.Event
+#define CRITICAL_EVENT_CLASS_NAME "com/github/marschall/jnicriticalreporter/CriticalEvent"
+
 
 // global cached JNI data to reduce lookup time
 struct JfrInfo {
-  // our instance of jdk.jfr.EventFactory
+  // our instance of jdk.jfr.EventFactory, only if criticalEventClass could not be defined
   // JNI global reference
   jobject eventFactory;
+  // jdk.jfr.EventFactory for buffer overflows, only in async mode
+  // JNI global reference
+  jobject bufferOverflowFactory;
+  // jdk.jfr.EventFactory for call site summaries, only in aggregate mode
+  // JNI global reference
+  jobject callSiteSummaryFactory;
+  // jdk.jfr.EventFactory for hold time histograms, only if enabled
+  // JNI global reference
+  jobject holdTimeHistogramFactory;
+  // jdk.jfr.EventFactory for GC stalls, only if enabled
+  // JNI global reference
+  jobject gcStallFactory;
+  // jdk.jfr.EventFactory for criticals held during a GC, only if enabled
+  // JNI global reference
+  jobject gcStallHolderFactory;
+  // jdk.jfr.EventFactory for calls of copying JNI functions, only if enabled in sync mode
+  // JNI global reference
+  jobject copyFactory;
+  // jdk.jfr.EventFactory for copying JNI function summaries, only if enabled
+  // JNI global reference
+  jobject copySummaryFactory;
+  // jdk.jfr.EventFactory for interned stacks, only if the agent captures stacks
+  // JNI global reference
+  jobject stackDefinitionFactory;
+  // jdk.jfr.EventFactory for the time spent in the agent, only if enabled
+  // JNI global reference
+  jobject overheadFactory;
+  // jdk.jfr.EventFactory for criticals still held after the watchdog threshold, only if enabled
+  // JNI global reference
+  jobject longHeldFactory;
+  // jdk.jfr.EventFactory for changes of the sampling interval by the governor, only with a budget
+  // JNI global reference
+  jobject samplingRateChangeFactory;
+  // jdk.jfr.EventFactory for the arrays pinned the longest, only if enabled
+  // JNI global reference
+  jobject hotArrayFactory;
+  // jdk.jfr.EventFactory for the calls of all JNI functions, only with transitions
+  // JNI global reference
+  jobject transitionProfileFactory;
+  // jdk.jfr.EventType of the events that need the JNI functions to be redirected, only with onDemand
+  // JNI global references
+  jobject installEventTypes[MAX_INSTALL_EVENT_TYPES];
+  jint installEventTypeCount;
+  // jdk.jfr.EventType#isEnabled()
+  jmethodID isEnabledMethod;
   // jdk.jfr.EventFactory#newEvent()
   jmethodID newEventMethod;
   // jdk.jfr.Event#set(int, java.lang.Object)
   jmethodID setMethod;
-  // jdk.jfr.Event#begin()
-  jmethodID beginMethod;
   // jdk.jfr.Event#commit()
   jmethodID commitMethod;
+  // java.lang.Long
+  // JNI global reference
+  jclass longClass;
+  // java.lang.Long#valueOf(long)
+  jmethodID longValueOfMethod;
+  // java.lang.Double
+  // JNI global reference
+  jclass doubleClass;
+  // java.lang.Double#valueOf(double)
+  jmethodID doubleValueOfMethod;
   // Boolean.TRUE
   jobject trueObject;
   // Boolean.FALSE
@@ -25,366 +114,551 @@ struct JfrInfo {
   jstring getStringCritical;
   // "GetPrimitiveArrayCritical"
   jstring getPrimitiveArrayCritical;
+  // "other", the call site of the criticals that did not fit into the call site table
+  jstring otherCallSite;
 };
 
-// thread local info about the current JNI critical
+// thread local info about a held JNI critical
 // need for committing the event
 struct CallInfo {
-  // event started before Get*Critical
-  // JNI global reference
-  jobject event;
+  // whether the critical is sampled and timed
+  jboolean recorded;
+  // nesting depth, 1 for the outermost critical
+  jint depth;
+  // pointer returned by Get*Critical, identifies the critical on release
+  const void *carray;
+  // nanoTime() before Get*Critical
+  jlong startNanos;
+  // nanoTime() after Get*Critical returned
+  jlong acquiredNanos;
+  jint method;
+  // native return address of Get*Critical
+  void *callSite;
+  // enum StringCoder, only read in aggregate mode, reportPendingCriticals reads it otherwise
+  jint coder;
+  // the string or array, JNI local reference
+  jobject object;
   jboolean *isCopy;
   jboolean witness;
 };
 
-jniNativeInterface *originalJNIFunctions = NULL;
-jniNativeInterface *redirectedJNIFunctions = NULL;
-struct JfrInfo jfrInfo;
+// a released critical waiting for all criticals of the thread to be released
+struct PendingCritical {
+  struct CriticalRecord record;
+  // the string or array, JNI local reference
+  // still valid, no JNI calls are possible between the outermost Get*Critical and Release*Critical
+  jobject object;
+};
 
-//thread_local
-// __declspec(thread)
-__thread int criticals = 0;
-__thread struct CallInfo callInfo;
+// field indices of com.github.marschall.jnicriticalreporter.Event, have to match criticalEventFields
+enum CriticalEventField {
+  IS_COPY_FIELD = 0,
+  METHOD_NAME_FIELD = 1,
+  HOLD_TIME_FIELD = 2,
+  CRITICAL_START_TIME_FIELD = 3,
+  CRITICAL_THREAD_FIELD = 4,
+  LENGTH_FIELD = 5,
+  ELEMENT_TYPE_FIELD = 6,
+  BYTES_FIELD = 7,
+  DEPTH_FIELD = 8,
+  NESTED_CRITICALS_FIELD = 9,
+  MAX_DEPTH_FIELD = 10,
+  STACK_ID_FIELD = 11,
+  ACQUIRE_TIME_FIELD = 12,
+  NATIVE_LIBRARY_FIELD = 13,
+  CALL_SITE_FIELD = 14,
+  STRING_CODER_FIELD = 15
+};
 
+static const struct EventFieldSpec criticalEventFields[] = {
+  { "Z", "isCopy", "IsCopy", "Whether the memory was copied", NULL, NULL },
+  { "java/lang/String", "methodName", "Method Name", "Name of the JNI critical method", NULL, NULL },
+  { "J", "holdTime", "Hold Time", "Time between returning from Get*Critical and returning from Release*Critical",
+    "jdk/jfr/Timespan", "NANOSECONDS" },
+  { "J", "criticalStartTime", "Critical Start Time", "Time Get*Critical was called",
+    "jdk/jfr/Timestamp", "MILLISECONDS_SINCE_EPOCH" },
+  { "java/lang/Thread", "criticalThread", "Critical Thread", "Thread that held the critical, only set in async mode", NULL, NULL },
+  { "J", "length", "Length", "Number of elements of the array or characters of the string", NULL, NULL },
+  { "java/lang/String", "elementType", "Element Type", "Primitive type of the elements, char for strings", NULL, NULL },
+  { "J", "bytes", "Bytes", "Size of the memory pinned or copied", "jdk/jfr/DataAmount", "BYTES" },
+  { "J", "depth", "Depth", "Nesting depth, 1 for the outermost critical", NULL, NULL },
+  { "J", "nestedCriticals", "Nested Criticals", "Number of criticals acquired while the outermost critical was held", NULL, NULL },
+  { "J", "maxDepth", "Max Depth", "Maximum nesting depth while the outermost critical was held", NULL, NULL },
+  { "J", "stackId", "Stack ID", "Stack captured by the agent, see StackDefinition, 0 if the stack trace is recorded by JFR", NULL, NULL },
+  { "J", "acquireTime", "Acquire Time", "Time spent in Get*Critical, includes waiting for a garbage collection to finish",
+    "jdk/jfr/Timespan", "NANOSECONDS" },
+  { "java/lang/String", "nativeLibrary", "Native Library", "File name of the shared object calling the JNI critical method", NULL, NULL },
+  { "java/lang/String", "callSite", "Call Site", "Native code calling the JNI critical method", NULL, NULL },
+  { "java/lang/String", "stringCoder", "String Coder",
+    "LATIN1 or UTF16, GetStringCritical always copies LATIN1 strings, only set for GetStringCritical", NULL, NULL }
+};
 
-jint newAnnotationElement(JNIEnv *env, const char *annotationTypeClassName, const char *value, jobject *result) {
-  // new AnnotationElement(annotationTypeClassName.class, value)
-  jclass annotationTypeClass = (*env)->FindClass(env, annotationTypeClassName);
-  if (annotationTypeClass == NULL) {
-    fprintf(stderr, "FindClass(%s) failed\n", annotationTypeClassName);
-    return JNI_ERR;
-  }
+static const struct EventTypeSpec criticalEventType = {
+  .name = "com.github.marschall.jnicriticalreporter.Event",
+  .label = "JNI Critical",
+  .description = "Lists invocation of JNI critical methods",
+  .fields = criticalEventFields,
+  .fieldCount = sizeof(criticalEventFields) / sizeof(criticalEventFields[0]),
+  // set when the stack is captured by the agent, see stacks
+  .disableStackTrace = JNI_FALSE
+};
 
-  jstring valueString = (*env)->NewStringUTF(env, value);
-  if (valueString == NULL) {
-    fprintf(stderr, "NewStringUTF(%s) failed\n", value);
-    return JNI_ERR;
-  }
+// field indices of com.github.marschall.jnicriticalreporter.BufferOverflow, have to match bufferOverflowFields
+enum BufferOverflowField {
+  DROPPED_RECORDS_FIELD = 0,
+  OVERFLOW_THREAD_FIELD = 1
+};
 
-  jclass annotationElementClass = (*env)->FindClass(env, "jdk/jfr/AnnotationElement");
-  if (annotationElementClass == NULL) {
-    fprintf(stderr, "FindClass(jdk/jfr/AnnotationElement) failed\n");
-    return JNI_ERR;
-  }
-  jmethodID annotationElementConstructor = (*env)->GetMethodID(env, annotationElementClass,
-                                                                    "<init>", "(Ljava/lang/Class;Ljava/lang/Object;)V");
-  if (annotationElementConstructor == NULL) {
-    fprintf(stderr, "GetMethodID(jdk/jfr/AnnotationElement#<init>) failed\n");
-    return JNI_ERR;
-  }
+static const struct EventFieldSpec bufferOverflowFields[] = {
+  { "J", "droppedRecords", "Dropped Records", "Number of criticals not reported because the buffer was full", NULL, NULL },
+  { "java/lang/Thread", "criticalThread", "Critical Thread", "Thread owning the buffer", NULL, NULL }
+};
 
-  jobject annotationElement = (*env)->NewObject(env, annotationElementClass, annotationElementConstructor,
-                                                     annotationTypeClass, valueString);
-  if (annotationElement == NULL) {
-    fprintf(stderr, "new %s() failed\n", annotationTypeClassName);
-    return JNI_ERR;
-  }
-  *result = annotationElement;
-  // annotationElementConstructor jmethodID does not need to be freed
-  (*env)->DeleteLocalRef(env, annotationElementClass);
-  (*env)->DeleteLocalRef(env, annotationTypeClass);
-  (*env)->DeleteLocalRef(env, valueString);
-  return JNI_OK;
-}
+static const struct EventTypeSpec bufferOverflowEventType = {
+  .name = "com.github.marschall.jnicriticalreporter.BufferOverflow",
+  .label = "JNI Critical Buffer Overflow",
+  .description = "JNI criticals dropped because the per-thread buffer was full",
+  .fields = bufferOverflowFields,
+  .fieldCount = sizeof(bufferOverflowFields) / sizeof(bufferOverflowFields[0]),
+  .disableStackTrace = JNI_FALSE
+};
 
-jint getEventAnnotations(JNIEnv *env, jobject *result) {
+// field indices of com.github.marschall.jnicriticalreporter.CallSiteSummary, have to match callSiteSummaryFields
+enum CallSiteSummaryField {
+  SUMMARY_METHOD_NAME_FIELD = 0,
+  SUMMARY_CALL_SITE_FIELD = 1,
+  SUMMARY_COUNT_FIELD = 2,
+  SUMMARY_TOTAL_TIME_FIELD = 3,
+  SUMMARY_MAX_TIME_FIELD = 4,
+  SUMMARY_P99_TIME_FIELD = 5,
+  SUMMARY_COPIES_FIELD = 6,
+  SUMMARY_NATIVE_LIBRARY_FIELD = 7,
+  SUMMARY_COPY_RATIO_FIELD = 8,
+  SUMMARY_LATIN1_STRINGS_FIELD = 9
+};
 
-  // String[] category = { "JNI" };
-  jstring categoryString = (*env)->NewStringUTF(env, "JNI");
-  if (categoryString == NULL) {
-    fprintf(stderr, "NewStringUTF(JNI) failed\n");
-    return JNI_ERR;
-  }
-  jclass stringClass = (*env)->FindClass(env, "java/lang/String");
-  if (stringClass == NULL) {
-    fprintf(stderr, "FindClass(java/lang/String) failed\n");
-    return JNI_ERR;
-  }
-  jobjectArray categoryArray = (*env)->NewObjectArray(env, 1, stringClass, categoryString);
-  if (categoryArray == NULL) {
-    fprintf(stderr, "NewObjectArray(1, java/lang/String) failed\n");
-    return JNI_ERR;
-  }
-  (*env)->DeleteLocalRef(env, categoryString);
-  (*env)->DeleteLocalRef(env, stringClass);
+static const struct EventFieldSpec callSiteSummaryFields[] = {
+  { "java/lang/String", "methodName", "Method Name", "Name of the JNI critical method", NULL, NULL },
+  { "java/lang/String", "callSite", "Call Site", "Native code calling the JNI critical method", NULL, NULL },
+  { "J", "count", "Count", "Number of sampled criticals in the period", NULL, NULL },
+  { "J", "totalTime", "Total Time", "Sum of the hold times", "jdk/jfr/Timespan", "NANOSECONDS" },
+  { "J", "maxTime", "Max Time", "Longest hold time", "jdk/jfr/Timespan", "NANOSECONDS" },
+  { "J", "p99Time", "P99 Time", "99th percentile of the hold times", "jdk/jfr/Timespan", "NANOSECONDS" },
+  { "J", "copies", "Copies", "Number of criticals where the memory was copied", NULL, NULL },
+  { "java/lang/String", "nativeLibrary", "Native Library", "File name of the shared object calling the JNI critical method", NULL, NULL },
+  { "D", "copyRatio", "Copy Ratio", "Fraction of the criticals where the memory was copied, 1 if the copy is never avoided",
+    "jdk/jfr/Percentage", NULL },
+  { "J", "latin1Strings", "LATIN1 Strings", "Number of GetStringCritical calls on LATIN1 strings, these are always copied", NULL, NULL }
+};
 
-  jobject nameElement;
-  jint name_result = newAnnotationElement(env, "jdk/jfr/Name", "com.github.marschall.jnicriticalreporter.Event", &nameElement);
-  if (name_result != JNI_OK) {
-    fprintf(stderr, "new AnnotationElement(Name.class failed\n");
-    return JNI_ERR;
-  }
+static const struct EventTypeSpec callSiteSummaryEventType = {
+  .name = "com.github.marschall.jnicriticalreporter.CallSiteSummary",
+  .label = "JNI Critical Call Site Summary",
+  .description = "JNI criticals aggregated by native call site",
+  .fields = callSiteSummaryFields,
+  .fieldCount = sizeof(callSiteSummaryFields) / sizeof(callSiteSummaryFields[0]),
+  .disableStackTrace = JNI_FALSE
+};
 
-  jobject labelElement;
-  jint label_result = newAnnotationElement(env, "jdk/jfr/Label", "JNI Critical", &labelElement);
-  if (label_result != JNI_OK) {
-    fprintf(stderr, "new AnnotationElement(Label.class failed\n");
-    return JNI_ERR;
-  }
+// field indices of com.github.marschall.jnicriticalreporter.HoldTimeHistogram, have to match holdTimeHistogramFields
+enum HoldTimeHistogramField {
+  HISTOGRAM_METHOD_NAME_FIELD = 0,
+  HISTOGRAM_COUNT_FIELD = 1,
+  HISTOGRAM_TOTAL_TIME_FIELD = 2,
+  HISTOGRAM_P50_TIME_FIELD = 3,
+  HISTOGRAM_P90_TIME_FIELD = 4,
+  HISTOGRAM_P99_TIME_FIELD = 5,
+  HISTOGRAM_P999_TIME_FIELD = 6,
+  HISTOGRAM_MAX_TIME_FIELD = 7
+};
 
-  jobject descriptionElement;
-  jint description_result = newAnnotationElement(env, "jdk/jfr/Description", "Lists invocation of JNI critical methods", &descriptionElement);
-  if (description_result != JNI_OK) {
-    fprintf(stderr, "new AnnotationElement(Description.class failed\n");
-    return JNI_ERR;
-  }
+static const struct EventFieldSpec holdTimeHistogramFields[] = {
+  { "java/lang/String", "methodName", "Method Name", "Name of the JNI critical method", NULL, NULL },
+  { "J", "count", "Count", "Number of sampled criticals in the period", NULL, NULL },
+  { "J", "totalTime", "Total Time", "Sum of the hold times", "jdk/jfr/Timespan", "NANOSECONDS" },
+  { "J", "p50Time", "P50 Time", "Median of the hold times", "jdk/jfr/Timespan", "NANOSECONDS" },
+  { "J", "p90Time", "P90 Time", "90th percentile of the hold times", "jdk/jfr/Timespan", "NANOSECONDS" },
+  { "J", "p99Time", "P99 Time", "99th percentile of the hold times", "jdk/jfr/Timespan", "NANOSECONDS" },
+  { "J", "p999Time", "P99.9 Time", "99.9th percentile of the hold times", "jdk/jfr/Timespan", "NANOSECONDS" },
+  { "J", "maxTime", "Max Time", "Upper bound of the longest hold time", "jdk/jfr/Timespan", "NANOSECONDS" }
+};
 
-  // new AnnotationElement
-  jclass categoryClass = (*env)->FindClass(env, "jdk/jfr/Category");
-  if (categoryClass == NULL) {
-    fprintf(stderr, "FindClass(jdk/jfr/Category) failed\n");
-    return JNI_ERR;
-  }
-  jclass annotationElementClass = (*env)->FindClass(env, "jdk/jfr/AnnotationElement");
-  if (annotationElementClass == NULL) {
-    fprintf(stderr, "FindClass(jdk/jfr/AnnotationElement) failed\n");
-    return JNI_ERR;
-  }
-  jmethodID annotationElementConstructor = (*env)->GetMethodID(env, annotationElementClass,
-                                                               "<init>", "(Ljava/lang/Class;Ljava/lang/Object;)V");
-  if (annotationElementConstructor == NULL) {
-    fprintf(stderr, "GetMethodID(jdk/jfr/AnnotationElement#<init>) failed\n");
-    return JNI_ERR;
-  }
-  jobject categoryElement = (*env)->NewObject(env, annotationElementClass, annotationElementConstructor,
-                                                   categoryClass, categoryArray);
-  if (categoryElement == NULL) {
-    fprintf(stderr, "NewObject failed\n");
-    return JNI_ERR;
-  }
+static const struct EventTypeSpec holdTimeHistogramEventType = {
+  .name = "com.github.marschall.jnicriticalreporter.HoldTimeHistogram",
+  .label = "JNI Critical Hold Time Histogram",
+  .description = "Distribution of JNI critical hold times, percentiles are bucket upper bounds",
+  .fields = holdTimeHistogramFields,
+  .fieldCount = sizeof(holdTimeHistogramFields) / sizeof(holdTimeHistogramFields[0]),
+  .disableStackTrace = JNI_FALSE
+};
 
-  (*env)->DeleteLocalRef(env, categoryClass);
-  (*env)->DeleteLocalRef(env, categoryArray);
-  (*env)->DeleteLocalRef(env, annotationElementClass);
+// field indices of com.github.marschall.jnicriticalreporter.GCLockerStall, have to match gcStallFields
+enum GcStallField {
+  STALL_GC_START_TIME_FIELD = 0,
+  STALL_GC_DURATION_FIELD = 1,
+  STALL_IN_FLIGHT_CRITICALS_FIELD = 2,
+  STALL_BLOCKING_THREAD_FIELD = 3,
+  STALL_BLOCKING_METHOD_NAME_FIELD = 4,
+  STALL_BLOCKING_HOLD_TIME_FIELD = 5,
+  STALL_RELEASE_TO_GC_TIME_FIELD = 6
+};
 
-  // List.of
+static const struct EventFieldSpec gcStallFields[] = {
+  { "J", "gcStartTime", "GC Start Time", "Time the garbage collection started", "jdk/jfr/Timestamp", "MILLISECONDS_SINCE_EPOCH" },
+  { "J", "gcDuration", "GC Duration", "Duration of the garbage collection", "jdk/jfr/Timespan", "NANOSECONDS" },
+  { "J", "inFlightCriticals", "In-Flight Criticals", "Number of criticals held when the garbage collection started", NULL, NULL },
+  { "java/lang/Thread", "blockingThread", "Blocking Thread", "Thread that released the last critical before the garbage collection started", NULL, NULL },
+  { "java/lang/String", "blockingMethodName", "Blocking Method Name", "Name of the JNI critical method released last", NULL, NULL },
+  { "J", "blockingHoldTime", "Blocking Hold Time", "Hold time of the critical released last, upper bound of the time the garbage collection was delayed",
+    "jdk/jfr/Timespan", "NANOSECONDS" },
+  { "J", "releaseToGcTime", "Release to GC Time", "Time between releasing the last critical and the start of the garbage collection",
+    "jdk/jfr/Timespan", "NANOSECONDS" }
+};
 
-  jclass listClass = (*env)->FindClass(env, "java/util/List");
-  if (listClass == NULL) {
-    fprintf(stderr, "FindClass(java/util/List) failed\n");
-    return JNI_ERR;
-  }
-  jmethodID listOfMethod = (*env)->GetStaticMethodID(env, listClass,
-                                                     "of", "(Ljava/lang/Object;Ljava/lang/Object;Ljava/lang/Object;Ljava/lang/Object;)Ljava/util/List;");
-  if (listOfMethod == NULL) {
-    fprintf(stderr, "GetMethodID(List#of(Object, Object, Object, Object)) failed\n");
-    return JNI_ERR;
-  }
-  jobject listOfAnnoationElement = (*env)->CallStaticObjectMethod(env, listClass, listOfMethod,
-                                                                       nameElement, labelElement, descriptionElement, categoryElement);
-  if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
-    fprintf(stderr, "List.of() threw\n");
-    return JNI_ERR;
-  }
-  *result = listOfAnnoationElement;
-  (*env)->DeleteLocalRef(env, nameElement);
-  (*env)->DeleteLocalRef(env, labelElement);
-  (*env)->DeleteLocalRef(env, descriptionElement);
-  (*env)->DeleteLocalRef(env, categoryElement);
-  (*env)->DeleteLocalRef(env, listClass);
-  return JNI_OK;
-}
+static const struct EventTypeSpec gcStallEventType = {
+  .name = "com.github.marschall.jnicriticalreporter.GCLockerStall",
+  .label = "JNI Critical GC Stall",
+  .description = "Garbage collection started right after the last critical was released or while criticals were held",
+  .fields = gcStallFields,
+  .fieldCount = sizeof(gcStallFields) / sizeof(gcStallFields[0]),
+  .disableStackTrace = JNI_FALSE
+};
 
-jint newListOf2(JNIEnv *env, jobject first, jobject second, jobject *result) {
-   // return List.of(first, second)
+// field indices of com.github.marschall.jnicriticalreporter.GCLockerHolder, have to match gcStallHolderFields
+enum GcStallHolderField {
+  HOLDER_GC_START_TIME_FIELD = 0,
+  HOLDER_THREAD_FIELD = 1,
+  HOLDER_METHOD_NAME_FIELD = 2,
+  HOLDER_HELD_TIME_FIELD = 3
+};
 
-  jclass listClass = (*env)->FindClass(env, "java/util/List");
-  if (listClass == NULL) {
-    fprintf(stderr, "FindClass(java/util/List) failed\n");
-    return JNI_ERR;
-  }
-  jmethodID listOfMethod = (*env)->GetStaticMethodID(env, listClass,
-                                                     "of", "(Ljava/lang/Object;Ljava/lang/Object;)Ljava/util/List;");
-  if (listOfMethod == NULL) {
-    fprintf(stderr, "GetMethodID(List#of(Object, Object)) failed\n");
-    return JNI_ERR;
-  }
-  jobject list = (*env)->CallStaticObjectMethod(env, listClass, listOfMethod,
-                                                                   first, second);
-  if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
-    fprintf(stderr, "List.of() threw\n");
-    return JNI_ERR;
-  }
-  // listOfMethod jmethodID does not need to be freed
-  (*env)->DeleteLocalRef(env, listClass);
+static const struct EventFieldSpec gcStallHolderFields[] = {
+  { "J", "gcStartTime", "GC Start Time", "Time the garbage collection started", "jdk/jfr/Timestamp", "MILLISECONDS_SINCE_EPOCH" },
+  { "java/lang/Thread", "criticalThread", "Critical Thread", "Thread holding the critical", NULL, NULL },
+  { "java/lang/String", "methodName", "Method Name", "Name of the JNI critical method", NULL, NULL },
+  { "J", "heldTime", "Held Time", "How long the critical had been held when the garbage collection started", "jdk/jfr/Timespan", "NANOSECONDS" }
+};
 
-  *result = list;
-  return JNI_OK;
-}
+static const struct EventTypeSpec gcStallHolderEventType = {
+  .name = "com.github.marschall.jnicriticalreporter.GCLockerHolder",
+  .label = "JNI Critical Held During GC",
+  .description = "Critical held by a thread when a garbage collection started",
+  .fields = gcStallHolderFields,
+  .fieldCount = sizeof(gcStallHolderFields) / sizeof(gcStallHolderFields[0]),
+  .disableStackTrace = JNI_FALSE
+};
 
-jint newAnnotationElements(JNIEnv *env, const char *label, const char *description, jobject *result) {
-   // return List.of(
-  // new AnnotationElement(Label.class, label)
-  // new AnnotationElement(Description.class, description)
+// field indices of com.github.marschall.jnicriticalreporter.Copy, have to match copyFields
+enum CopyField {
+  COPY_FUNCTION_NAME_FIELD = 0,
+  COPY_BYTES_FIELD = 1,
+  COPY_IS_COPY_FIELD = 2,
+  COPY_TIME_FIELD = 3
+};
 
-  jobject labelElement;
-  jint label_result = newAnnotationElement(env, "jdk/jfr/Label", label, &labelElement);
-  if (label_result != JNI_OK) {
-    fprintf(stderr, "new AnnotationElement(Label.class failed\n");
-    return JNI_ERR;
-  }
-  jobject descriptionElement;
-  jint description_result = newAnnotationElement(env, "jdk/jfr/Description", description, &descriptionElement);
-  if (description_result != JNI_OK) {
-    fprintf(stderr, "new AnnotationElement(Description.class failed\n");
-    return JNI_ERR;
-  }
+static const struct EventFieldSpec copyFields[] = {
+  { "java/lang/String", "functionName", "Function Name", "Name of the JNI function", NULL, NULL },
+  { "J", "bytes", "Bytes", "Number of bytes copied into or out of the Java heap", "jdk/jfr/DataAmount", "BYTES" },
+  { "Z", "isCopy", "IsCopy", "Whether the memory was copied", NULL, NULL },
+  { "J", "copyTime", "Copy Time", "Time spent in the JNI function", "jdk/jfr/Timespan", "NANOSECONDS" }
+};
 
-  // List.of(labelElement, descriptionElement)
+static const struct EventTypeSpec copyEventType = {
+  .name = "com.github.marschall.jnicriticalreporter.Copy",
+  .label = "JNI Copy",
+  .description = "Call of a JNI function that copies array or string contents",
+  .fields = copyFields,
+  .fieldCount = sizeof(copyFields) / sizeof(copyFields[0]),
+  .disableStackTrace = JNI_FALSE
+};
 
-  jint return_value = newListOf2(env, labelElement, descriptionElement, result);
-  (*env)->DeleteLocalRef(env, labelElement);
-  (*env)->DeleteLocalRef(env, descriptionElement);
-  return return_value;
-}
+// field indices of com.github.marschall.jnicriticalreporter.CopySummary, have to match copySummaryFields
+enum CopySummaryField {
+  COPY_SUMMARY_FUNCTION_NAME_FIELD = 0,
+  COPY_SUMMARY_CALLS_FIELD = 1,
+  COPY_SUMMARY_BYTES_FIELD = 2,
+  COPY_SUMMARY_COPIES_FIELD = 3,
+  COPY_SUMMARY_TOTAL_TIME_FIELD = 4
+};
 
-jint getBooleanField(JNIEnv *env, const char *fieldName, jobject *result) {
+static const struct EventFieldSpec copySummaryFields[] = {
+  { "java/lang/String", "functionName", "Function Name", "Name of the JNI function", NULL, NULL },
+  { "J", "calls", "Calls", "Number of calls in the period", NULL, NULL },
+  { "J", "bytes", "Bytes", "Number of bytes copied into or out of the Java heap", "jdk/jfr/DataAmount", "BYTES" },
+  { "J", "copies", "Copies", "Number of calls that made a copy", NULL, NULL },
+  { "J", "totalTime", "Total Time", "Time spent in the JNI function", "jdk/jfr/Timespan", "NANOSECONDS" }
+};
 
-  jclass clazz = (*env)->FindClass(env, "java/lang/Boolean");
-  if (clazz == NULL) {
-    fprintf(stderr, "FindClass(java/lang/Boolean) failed\n");
-    return JNI_ERR;
-  }
-  jfieldID typeField = (*env)->GetStaticFieldID(env, clazz, fieldName, "Ljava/lang/Boolean;");
-  if (typeField == NULL) {
-    fprintf(stderr, "GetStaticFieldID(%s#TYPE) failed\n", fieldName);
-    return JNI_ERR;
-  }
-  jobject fieldValue = (*env)->GetStaticObjectField(env, clazz, typeField);
-  (*env)->DeleteLocalRef(env, clazz);
-  *result = fieldValue;
-  return JNI_OK;
-}
+static const struct EventTypeSpec copySummaryEventType = {
+  .name = "com.github.marschall.jnicriticalreporter.CopySummary",
+  .label = "JNI Copy Summary",
+  .description = "Calls of JNI functions that copy array or string contents aggregated by function",
+  .fields = copySummaryFields,
+  .fieldCount = sizeof(copySummaryFields) / sizeof(copySummaryFields[0]),
+  .disableStackTrace = JNI_FALSE
+};
 
-jint getTypeField(JNIEnv *env, const char *className, jclass *result) {
+// field indices of com.github.marschall.jnicriticalreporter.StackDefinition, have to match stackDefinitionFields
+enum StackDefinitionField {
+  STACK_DEFINITION_ID_FIELD = 0,
+  STACK_DEFINITION_FRAMES_FIELD = 1
+};
 
-  jclass clazz = (*env)->FindClass(env, className);
-  if (clazz == NULL) {
-    fprintf(stderr, "FindClass(%s) failed\n", className);
-    return JNI_ERR;
-  }
-  jfieldID typeField = (*env)->GetStaticFieldID(env, clazz, "TYPE", "Ljava/lang/Class;");
-  if (typeField == NULL) {
-    fprintf(stderr, "GetStaticFieldID(%s#TYPE) failed\n", className);
-    return JNI_ERR;
-  }
-  jobject fieldValue = (*env)->GetStaticObjectField(env, clazz, typeField);
-  (*env)->DeleteLocalRef(env, clazz);
-  *result = fieldValue;
-  return JNI_OK;
-}
+static const struct EventFieldSpec stackDefinitionFields[] = {
+  { "J", "stackId", "Stack ID", "Value of the stackId field of the events", NULL, NULL },
+  { "java/lang/String", "frames", "Frames", "Java frames, top frame first, one per line", NULL, NULL }
+};
 
-jint resolveType(JNIEnv *env, const char *className, jclass *result) {
-  if (strcmp(className, "Z") == 0) {
-    return getTypeField(env, "java/lang/Boolean", result);
-  } else if (strcmp(className, "B") == 0) {
-    return getTypeField(env, "java/lang/Byte", result);
-  } else if (strcmp(className, "C") == 0) {
-    return getTypeField(env, "java/lang/Character", result);
-  } else if (strcmp(className, "S") == 0) {
-    return getTypeField(env, "java/lang/Short", result);
-  } else if (strcmp(className, "I") == 0) {
-    return getTypeField(env, "java/lang/Integer", result);
-  } else if (strcmp(className, "J") == 0) {
-    return getTypeField(env, "java/lang/Long", result);
-  } else if (strcmp(className, "F") == 0) {
-    return getTypeField(env, "java/lang/Float", result);
-  } else if (strcmp(className, "D") == 0) {
-    return getTypeField(env, "java/lang/Double", result);
-  } else {
-    jclass valueClass = (*env)->FindClass(env, className);
-    if (valueClass == NULL) {
-      fprintf(stderr, "FindClass(%s) failed\n", className);
-      return JNI_ERR;
-    }
-    *result = valueClass;
-  }
-  return JNI_OK;
-}
+static const struct EventTypeSpec stackDefinitionEventType = {
+  .name = "com.github.marschall.jnicriticalreporter.StackDefinition",
+  .label = "JNI Critical Stack Definition",
+  .description = "Stack interned by the agent, defined again every period for recordings started since",
+  .fields = stackDefinitionFields,
+  .fieldCount = sizeof(stackDefinitionFields) / sizeof(stackDefinitionFields[0]),
+  .disableStackTrace = JNI_TRUE
+};
 
-jint newValueDescriptor(JNIEnv *env, const char *fieldType, const char *fieldName, jobject annotations, jobject *result) {
+// field indices of com.github.marschall.jnicriticalreporter.AgentOverhead, have to match overheadFields
+enum OverheadField {
+  OVERHEAD_THREAD_FIELD = 0,
+  OVERHEAD_CALLS_FIELD = 1,
+  OVERHEAD_TIME_FIELD = 2
+};
 
-  jclass valueClass;
-  jint valueClass_result = resolveType(env, fieldType, &valueClass);
-  if (valueClass_result != JNI_OK) {
-    fprintf(stderr, "FindClass(%s) failed\n", fieldType);
-    return JNI_ERR;
-  }
+static const struct EventFieldSpec overheadFields[] = {
+  { "java/lang/Thread", "criticalThread", "Critical Thread", "Thread that called the JNI critical methods", NULL, NULL },
+  { "J", "calls", "Calls", "Number of calls of redirected JNI critical methods in the period", NULL, NULL },
+  { "J", "overheadTime", "Overhead Time", "Time spent in the agent outside of the original JNI functions, including committing events",
+    "jdk/jfr/Timespan", "NANOSECONDS" }
+};
 
-  jstring fieldString = (*env)->NewStringUTF(env, fieldName);
-  if (fieldString == NULL) {
-    fprintf(stderr, "NewStringUTF(%s) failed\n", fieldName);
-    return JNI_ERR;
-  }
+static const struct EventTypeSpec overheadEventType = {
+  .name = "com.github.marschall.jnicriticalreporter.AgentOverhead",
+  .label = "JNI Critical Agent Overhead",
+  .description = "Time a thread spent in the agent while calling JNI critical methods",
+  .fields = overheadFields,
+  .fieldCount = sizeof(overheadFields) / sizeof(overheadFields[0]),
+  .disableStackTrace = JNI_TRUE
+};
 
-  jclass valueDescriptionClass = (*env)->FindClass(env, "jdk/jfr/ValueDescriptor");
-  if (valueDescriptionClass == NULL) {
-    fprintf(stderr, "FindClass(jdk/jfr/ValueDescriptor) failed\n");
-    return JNI_ERR;
-  }
-  jmethodID valueDescriptorConstructor = (*env)->GetMethodID(env, valueDescriptionClass,
-                                                                  "<init>", "(Ljava/lang/Class;Ljava/lang/String;Ljava/util/List;)V");
-  if (valueDescriptorConstructor == NULL) {
-    fprintf(stderr, "GetMethodID(jdk/jfr/AnnotationElement#<init>) failed\n");
-    return JNI_ERR;
-  }
+// field indices of com.github.marschall.jnicriticalreporter.LongHeldCritical, have to match longHeldFields
+enum LongHeldField {
+  LONG_HELD_THREAD_FIELD = 0,
+  LONG_HELD_METHOD_NAME_FIELD = 1,
+  LONG_HELD_START_TIME_FIELD = 2,
+  LONG_HELD_HELD_TIME_FIELD = 3,
+  LONG_HELD_FRAMES_FIELD = 4
+};
 
-  jobject valueDescriptor = (*env)->NewObject(env, valueDescriptionClass, valueDescriptorConstructor,
-                                                   valueClass, fieldString, annotations);
-  if (valueDescriptor == NULL) {
-    fprintf(stderr, "new ValueDescriptor(%s, %s failed\n", fieldType, fieldName);
-    return JNI_ERR;
-  }
-  *result = valueDescriptor;
-  (*env)->DeleteLocalRef(env, valueClass);
-  (*env)->DeleteLocalRef(env, fieldString);
-  (*env)->DeleteLocalRef(env, valueDescriptionClass);
-  // valueDescriptorConstructor jmethodID does not need to be freed
-  return JNI_OK;
-}
+static const struct EventFieldSpec longHeldFields[] = {
+  { "java/lang/Thread", "criticalThread", "Critical Thread", "Thread holding the critical", NULL, NULL },
+  { "java/lang/String", "methodName", "Method Name", "Name of the JNI critical method", NULL, NULL },
+  { "J", "criticalStartTime", "Critical Start Time", "Time the critical was entered", "jdk/jfr/Timestamp", "MILLISECONDS_SINCE_EPOCH" },
+  { "J", "heldTime", "Held Time", "How long the critical had been held when the watchdog noticed it", "jdk/jfr/Timespan", "NANOSECONDS" },
+  { "java/lang/String", "frames", "Frames", "Java frames of the thread holding the critical, one per line, top frame first", NULL, NULL }
+};
 
-jint getValueDescriptors(JNIEnv *env, jobject *result) {
+static const struct EventTypeSpec longHeldEventType = {
+  .name = "com.github.marschall.jnicriticalreporter.LongHeldCritical",
+  .label = "JNI Critical Held Too Long",
+  .description = "Critical still held by a thread after the watchdog threshold",
+  .fields = longHeldFields,
+  .fieldCount = sizeof(longHeldFields) / sizeof(longHeldFields[0]),
+  // the stack of the watchdog thread is of no interest
+  .disableStackTrace = JNI_TRUE
+};
 
-  jobject isCopyAnnotations;
-  jint isCopy_result = newAnnotationElements(env, "IsCopy", "Whether the memory was copied", &isCopyAnnotations);
-  if (isCopy_result != JNI_OK) {
-    fprintf(stderr, "List<AnnotationElement> IsCopy  failed\n");
-    return JNI_ERR;
-  }
+// field indices of com.github.marschall.jnicriticalreporter.SamplingRateChange, have to match samplingRateChangeFields
+enum SamplingRateChangeField {
+  RATE_PREVIOUS_INTERVAL_FIELD = 0,
+  RATE_INTERVAL_FIELD = 1,
+  RATE_OVERHEAD_FIELD = 2,
+  RATE_BUDGET_FIELD = 3
+};
 
-  jobject methodNameAnnotations;
-  jint methodName_result = newAnnotationElements(env, "IsCopy", "Whether the memory was copied", &methodNameAnnotations);
-  if (methodName_result != JNI_OK) {
-    fprintf(stderr, "List<AnnotationElement> MethodName  failed\n");
-    return JNI_ERR;
-  }
+static const struct EventFieldSpec samplingRateChangeFields[] = {
+  { "J", "previousSampleInterval", "Previous Sample Interval", "Every n-th critical of a thread was recorded before the change", NULL, NULL },
+  { "J", "sampleInterval", "Sample Interval", "Every n-th critical of a thread is recorded from now on", NULL, NULL },
+  { "D", "overhead", "Overhead", "Time spent in the agent relative to the CPU time of the process since the last adjustment",
+    "jdk/jfr/Percentage", NULL },
+  { "D", "budget", "Budget", "Maximum time spent in the agent relative to the CPU time of the process", "jdk/jfr/Percentage", NULL }
+};
 
-  jobject isCopyDescriptor;
-  jint isCopyDescriptor_result = newValueDescriptor(env, "Z", "isCopy", isCopyAnnotations, &isCopyDescriptor);
-  if (isCopyDescriptor_result != JNI_OK) {
-    fprintf(stderr, "new ValueDescriptor(boolean.class, isCopy  failed\n");
-    return JNI_ERR;
-  }
+static const struct EventTypeSpec samplingRateChangeEventType = {
+  .name = "com.github.marschall.jnicriticalreporter.SamplingRateChange",
+  .label = "JNI Critical Sampling Rate Change",
+  .description = "The governor changed the sampling interval to keep the agent within its CPU budget",
+  .fields = samplingRateChangeFields,
+  .fieldCount = sizeof(samplingRateChangeFields) / sizeof(samplingRateChangeFields[0]),
+  .disableStackTrace = JNI_TRUE
+};
 
-  jobject methodNameDescriptor;
-  jint methodNameDescriptor_result = newValueDescriptor(env, "java/lang/String", "methodName", methodNameAnnotations, &methodNameDescriptor);
-  if (methodNameDescriptor_result != JNI_OK) {
-    fprintf(stderr, "new ValueDescriptor(String.class, methodName  failed\n");
-    return JNI_ERR;
-  }
+// field indices of com.github.marschall.jnicriticalreporter.HotPinnedArray, have to match hotArrayFields
+enum HotArrayField {
+  HOT_RANK_FIELD = 0,
+  HOT_PINS_FIELD = 1,
+  HOT_HOLD_TIME_FIELD = 2,
+  HOT_LENGTH_FIELD = 3,
+  HOT_ELEMENT_TYPE_FIELD = 4,
+  HOT_BYTES_FIELD = 5,
+  HOT_FIRST_PIN_TIME_FIELD = 6,
+  HOT_STACK_ID_FIELD = 7,
+  HOT_FRAMES_FIELD = 8
+};
 
-  // List.of(isCopyDescriptor, methodNameDescriptor)
+static const struct EventFieldSpec hotArrayFields[] = {
+  { "J", "rank", "Rank", "1 for the array with the longest cumulative hold time", NULL, NULL },
+  { "J", "pins", "Pins", "Number of outermost criticals that pinned the array since it was first pinned", NULL, NULL },
+  { "J", "holdTime", "Hold Time", "Sum of the hold times since the array was first pinned", "jdk/jfr/Timespan", "NANOSECONDS" },
+  { "J", "length", "Length", "Number of elements of the array", NULL, NULL },
+  { "java/lang/String", "elementType", "Element Type", "Primitive type of the elements", NULL, NULL },
+  { "J", "bytes", "Bytes", "Size of the array", "jdk/jfr/DataAmount", "BYTES" },
+  { "J", "firstPinTime", "First Pin Time", "Time the array was pinned the first time", "jdk/jfr/Timestamp", "MILLISECONDS_SINCE_EPOCH" },
+  { "J", "stackId", "Stack ID", "Stack of the first pin, see StackDefinition, 0 if unknown", NULL, NULL },
+  { "java/lang/String", "frames", "Frames", "Java frames of the first pin, one per line, top frame first", NULL, NULL }
+};
 
-  jint return_value = newListOf2(env, isCopyDescriptor, methodNameDescriptor, result);
-  (*env)->DeleteLocalRef(env, isCopyAnnotations);
-  (*env)->DeleteLocalRef(env, methodNameAnnotations);
-  (*env)->DeleteLocalRef(env, isCopyDescriptor);
-  (*env)->DeleteLocalRef(env, methodNameDescriptor);
-  return return_value;
-}
+static const struct EventTypeSpec hotArrayEventType = {
+  .name = "com.github.marschall.jnicriticalreporter.HotPinnedArray",
+  .label = "JNI Critical Hot Pinned Array",
+  .description = "Array pinned by JNI criticals with one of the longest cumulative hold times, a candidate for off-heap memory",
+  .fields = hotArrayFields,
+  .fieldCount = sizeof(hotArrayFields) / sizeof(hotArrayFields[0]),
+  .disableStackTrace = JNI_TRUE
+};
+
+// field indices of com.github.marschall.jnicriticalreporter.TransitionProfile, have to match transitionProfileFields
+enum TransitionProfileField {
+  TRANSITION_RANK_FIELD = 0,
+  TRANSITION_FUNCTION_NAME_FIELD = 1,
+  TRANSITION_CALLS_FIELD = 2,
+  TRANSITION_TIMED_CALLS_FIELD = 3,
+  TRANSITION_TIMED_TIME_FIELD = 4,
+  TRANSITION_TOTAL_TIME_FIELD = 5
+};
+
+static const struct EventFieldSpec transitionProfileFields[] = {
+  { "J", "rank", "Rank", "1 for the function with the highest total time in the period, by calls if no call was timed", NULL, NULL },
+  { "java/lang/String", "functionName", "Function Name", "Name of the JNI function", NULL, NULL },
+  { "J", "calls", "Calls", "Number of calls in the period, including the calls made by JNI functions", NULL, NULL },
+  { "J", "timedCalls", "Timed Calls", "Number of calls whose time was measured", NULL, NULL },
+  { "J", "timedTime", "Timed Time", "Time spent in the timed calls, including nested calls", "jdk/jfr/Timespan", "NANOSECONDS" },
+  { "J", "totalTime", "Total Time", "Estimated time spent in all calls, timedTime scaled by calls / timedCalls", "jdk/jfr/Timespan", "NANOSECONDS" }
+};
+
+static const struct EventTypeSpec transitionProfileEventType = {
+  .name = "com.github.marschall.jnicriticalreporter.TransitionProfile",
+  .label = "JNI Transition Profile",
+  .description = "Calls of a JNI function from native code aggregated over all threads",
+  .fields = transitionProfileFields,
+  .fieldCount = sizeof(transitionProfileFields) / sizeof(transitionProfileFields[0]),
+  .disableStackTrace = JNI_TRUE
+};
+
+jvmtiEnv *agentJvmti = NULL;
+jniNativeInterface *originalJNIFunctions = NULL;
+jniNativeInterface *redirectedJNIFunctions = NULL;
+// installed instead of the original table while criticals are not redirected, only counts the depth
+// once an agent table was installed the original table is never installed again
+jniNativeInterface *idleJNIFunctions = NULL;
+// whether the agent was loaded at startup, every thread started after the first table was installed
+jboolean loadedAtStartup = JNI_FALSE;
+// whether threads running when the agent was attached may not have been seen outside of native code yet
+// only accessed by the reporter thread and Agent_OnAttach
+jboolean uncountedThreads = JNI_FALSE;
+// JVMTI thread local storage of threads whose criticals all went through an agent table
+char depthCountedMarker;
+// whether redirectedJNIFunctions is installed, only accessed by the reporter thread when onDemand
+jboolean installed = JNI_FALSE;
+// whether the agent was loaded or attached and not detached since, only accessed by Agent_OnLoad and Agent_OnAttach
+jboolean attached = JNI_FALSE;
+struct JfrInfo jfrInfo;
+// set once jfrInfo is complete, with lazy=true by the reporter thread after the VM started
+// application threads load it with acquire before they read jfrInfo
+_Atomic jboolean jfrInfoReady = JNI_FALSE;
+// set by the idle table once a critical was acquired, with lazy=true the events are defined then
+_Atomic jboolean idleCriticalSeen = JNI_FALSE;
+// whether jdk.jfr.FlightRecorder could not be found, only accessed by the reporter thread
+jboolean flightRecorderMissing = JNI_FALSE;
+// whether the reporter thread tried to define the events with lazy=true, only accessed by the reporter thread
+jboolean lazyAttempted = JNI_FALSE;
+// JNI global reference, NULL until looked up by the reporter thread with lazy=true
+jclass flightRecorderClass = NULL;
+// static boolean jdk.jfr.FlightRecorder.isInitialized()
+jmethodID isFlightRecorderInitializedMethod = NULL;
+// generated subclass of jdk.jfr.Event with primitive fields, NULL if the event factory is used instead
+// a class can only be defined once, kept when detaching
+// JNI global reference
+jclass criticalEventClass = NULL;
+// static void emit(...) of criticalEventClass, parameters in the order of criticalEventFields
+jmethodID emitCriticalEventMethod = NULL;
+
+// nanoTime() when periodic events are committed the next time
+jlong nextPeriodNanos = 0L;
+// hold time histograms of all threads merged for the current period, indexed by enum CriticalMethod
+// only accessed by the reporter thread
+uint64_t holdTimeCounts[2][HISTOGRAM_BUCKETS];
+// formatted interned stacks indexed by stack id - 1, NULL if not defined yet, only accessed by the reporter thread
+// JNI global references
+jstring stackDefinitions[STACK_TABLE_CAPACITY];
+
+void reporterTick(jvmtiEnv *jvmti, JNIEnv *env);
+
+struct AgentThread reporterThread = {
+  .name = "JNI Critical Reporter",
+  .tick = &reporterTick
+};
 
-jint lookupEventFactoryMethods(JNIEnv *env, jclass eventFactoryClass) {
+void watchdogTick(jvmtiEnv *jvmti, JNIEnv *env);
+
+struct AgentThread watchdogThread = {
+  .name = "JNI Critical Watchdog",
+  .tick = &watchdogTick
+};
+
+void governorTick(jvmtiEnv *jvmti, JNIEnv *env);
+
+struct AgentThread governorThread = {
+  .name = "JNI Critical Governor",
+  .tick = &governorTick
+};
+
+//thread_local
+// __declspec(thread)
+// number of criticals currently held, including the ones not tracked
+// counted by the idle table as well so that the depth survives swapping the tables
+__thread int criticals = 0;
+// whether criticals includes every critical of the thread, only false for threads running before the agent was attached
+__thread jboolean depthKnown = JNI_FALSE;
+// whether the outermost critical was entered through the redirected table and published by enterOutermost
+__thread jboolean outermostTracked = JNI_FALSE;
+// tracked criticals currently held, outermost first
+__thread struct CallInfo frames[MAX_CRITICAL_DEPTH];
+__thread jint frameCount = 0;
+// number of criticals acquired while the outermost critical is held
+__thread jint nestedCriticals = 0;
+// maximum value of criticals while the outermost critical is held
+__thread jint maxDepth = 0;
+// released criticals that are reported once the outermost critical is released
+__thread struct PendingCritical pendingCriticals[MAX_PENDING_CRITICALS];
+__thread jint pendingCount = 0;
+// criticals skipped since the last sampled one
+__thread jint unsampledCriticals = 0;
+// calls of copying JNI functions skipped since the last sampled one
+__thread jint unsampledCopies = 0;
+// entry of the array pinned by the outermost critical, HOT_ARRAY_NONE if not tracked
+__thread jint pinnedEntry = HOT_ARRAY_NONE;
+// nanoTime() after the outermost critical pinning pinnedEntry was acquired
+__thread jlong pinnedNanos = 0L;
+
+
+jint lookupEventFactoryMethods(JNIEnv *env) {
 
+  jclass eventFactoryClass = (*env)->FindClass(env, "jdk/jfr/EventFactory");
+  if (eventFactoryClass == NULL) {
+    fprintf(stderr, "FindClass(jdk/jfr/EventFactory) failed\n");
+    return JNI_ERR;
+  }
   jclass eventClass = (*env)->FindClass(env, "jdk/jfr/Event");
   if (eventClass == NULL) {
     fprintf(stderr, "FindClass(jdk/jfr/Event) failed\n");
@@ -400,11 +674,6 @@ jint lookupEventFactoryMethods(JNIEnv *env, jclass eventFactoryClass) {
      fprintf(stderr, "GetMethodID(set) failed\n");
     return JNI_ERR;
   }
-  jmethodID beginMethod = (*env)->GetMethodID(env, eventClass, "begin", "()V");
-  if (beginMethod == NULL) {
-     fprintf(stderr, "GetMethodID(begin) failed\n");
-    return JNI_ERR;
-  }
   jmethodID commitMethod = (*env)->GetMethodID(env, eventClass, "commit", "()V");
   if (commitMethod == NULL) {
      fprintf(stderr, "GetMethodID(commit) failed\n");
@@ -413,9 +682,34 @@ jint lookupEventFactoryMethods(JNIEnv *env, jclass eventFactoryClass) {
 
   jfrInfo.newEventMethod = newEventMethod;
   jfrInfo.setMethod = setMethod;
-  jfrInfo.beginMethod = beginMethod;
   jfrInfo.commitMethod = commitMethod;
 
+  jclass longClass = (*env)->FindClass(env, "java/lang/Long");
+  if (longClass == NULL) {
+    fprintf(stderr, "FindClass(java/lang/Long) failed\n");
+    return JNI_ERR;
+  }
+  jmethodID longValueOfMethod = (*env)->GetStaticMethodID(env, longClass, "valueOf", "(J)Ljava/lang/Long;");
+  if (longValueOfMethod == NULL) {
+     fprintf(stderr, "GetStaticMethodID(Long#valueOf) failed\n");
+    return JNI_ERR;
+  }
+  jfrInfo.longClass = (*env)->NewGlobalRef(env, longClass);
+  jfrInfo.longValueOfMethod = longValueOfMethod;
+
+  jclass doubleClass = (*env)->FindClass(env, "java/lang/Double");
+  if (doubleClass == NULL) {
+    fprintf(stderr, "FindClass(java/lang/Double) failed\n");
+    return JNI_ERR;
+  }
+  jmethodID doubleValueOfMethod = (*env)->GetStaticMethodID(env, doubleClass, "valueOf", "(D)Ljava/lang/Double;");
+  if (doubleValueOfMethod == NULL) {
+     fprintf(stderr, "GetStaticMethodID(Double#valueOf) failed\n");
+    return JNI_ERR;
+  }
+  jfrInfo.doubleClass = (*env)->NewGlobalRef(env, doubleClass);
+  jfrInfo.doubleValueOfMethod = doubleValueOfMethod;
+
   jobject trueObject;
   jint getTrue_result = getBooleanField(env, "TRUE", &trueObject);
   if (getTrue_result != JNI_OK) {
@@ -446,184 +740,1635 @@ jint lookupEventFactoryMethods(JNIEnv *env, jclass eventFactoryClass) {
   }
   jfrInfo.getPrimitiveArrayCritical = (*env)->NewGlobalRef(env, getPrimitiveArrayCritical);
 
+  jstring otherCallSite = (*env)->NewStringUTF(env, "other");
+  if (otherCallSite == NULL) {
+    fprintf(stderr, "NewStringUTF(other) failed\n");
+    return JNI_ERR;
+  }
+  jfrInfo.otherCallSite = (*env)->NewGlobalRef(env, otherCallSite);
+
   (*env)->DeleteLocalRef(env, eventClass);
+  (*env)->DeleteLocalRef(env, eventFactoryClass);
+  (*env)->DeleteLocalRef(env, longClass);
+  (*env)->DeleteLocalRef(env, doubleClass);
+  (*env)->DeleteLocalRef(env, trueObject);
+  (*env)->DeleteLocalRef(env, falseObject);
+  (*env)->DeleteLocalRef(env, getStringCritical);
+  (*env)->DeleteLocalRef(env, getPrimitiveArrayCritical);
+  (*env)->DeleteLocalRef(env, otherCallSite);
 
   return JNI_OK;
 }
 
-jint createEventFactory(JNIEnv *env) {
-  jobject eventAnnotations;
-  jobject valueDescriptors;
+jint addInstallEventType(JNIEnv *env, jobject eventFactory, jmethodID getEventTypeMethod) {
+  // eventFactory.getEventType()
+  jobject eventType = (*env)->CallObjectMethod(env, eventFactory, getEventTypeMethod);
+  if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
+    fprintf(stderr, "EventFactory#getEventType threw\n");
+    (*env)->ExceptionClear(env);
+    return JNI_ERR;
+  }
+  jfrInfo.installEventTypes[jfrInfo.installEventTypeCount] = (*env)->NewGlobalRef(env, eventType);
+  jfrInfo.installEventTypeCount += 1;
+  (*env)->DeleteLocalRef(env, eventType);
+  return JNI_OK;
+}
+
+jint addEventClassInstallEventType(JNIEnv *env, jclass eventTypeClass, jclass eventClass) {
+  jmethodID getEventTypeMethod = (*env)->GetStaticMethodID(env, eventTypeClass, "getEventType", "(Ljava/lang/Class;)Ljdk/jfr/EventType;");
+  if (getEventTypeMethod == NULL) {
+     fprintf(stderr, "GetStaticMethodID(EventType#getEventType) failed\n");
+    return JNI_ERR;
+  }
+  // EventType.getEventType(eventClass)
+  jobject eventType = (*env)->CallStaticObjectMethod(env, eventTypeClass, getEventTypeMethod, eventClass);
+  if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
+    fprintf(stderr, "EventType.getEventType threw\n");
+    (*env)->ExceptionClear(env);
+    return JNI_ERR;
+  }
+  jfrInfo.installEventTypes[jfrInfo.installEventTypeCount] = (*env)->NewGlobalRef(env, eventType);
+  jfrInfo.installEventTypeCount += 1;
+  (*env)->DeleteLocalRef(env, eventType);
+  return JNI_OK;
+}
 
+jint lookupInstallEventTypes(JNIEnv *env) {
   jclass eventFactoryClass = (*env)->FindClass(env, "jdk/jfr/EventFactory");
   if (eventFactoryClass == NULL) {
     fprintf(stderr, "FindClass(jdk/jfr/EventFactory) failed\n");
     return JNI_ERR;
   }
-  jmethodID createMethod = (*env)->GetStaticMethodID(env, eventFactoryClass,
-                                                    "create", "(Ljava/util/List;Ljava/util/List;)Ljdk/jfr/EventFactory;");
-  if (createMethod == NULL) {
-    fprintf(stderr, "GetMethodID(jdk/jfr/EventFactory#create) failed\n");
+  jclass eventTypeClass = (*env)->FindClass(env, "jdk/jfr/EventType");
+  if (eventTypeClass == NULL) {
+    fprintf(stderr, "FindClass(jdk/jfr/EventType) failed\n");
     return JNI_ERR;
   }
-
-  jint eventAnnotationsResult = getEventAnnotations(env, &eventAnnotations);
-  if (eventAnnotationsResult != JNI_OK) {
-    fprintf(stderr, "getEventAnnotations() failed\n");
+  jmethodID getEventTypeMethod = (*env)->GetMethodID(env, eventFactoryClass, "getEventType", "()Ljdk/jfr/EventType;");
+  if (getEventTypeMethod == NULL) {
+     fprintf(stderr, "GetMethodID(getEventType) failed\n");
     return JNI_ERR;
   }
-
-  jint valueDescriptorsResult = getValueDescriptors(env, &valueDescriptors);
-  if (valueDescriptorsResult != JNI_OK) {
-    fprintf(stderr, "getValueDescriptors() failed\n");
-    (*env)->DeleteLocalRef(env, eventAnnotations);
+  jmethodID isEnabledMethod = (*env)->GetMethodID(env, eventTypeClass, "isEnabled", "()Z");
+  if (isEnabledMethod == NULL) {
+     fprintf(stderr, "GetMethodID(isEnabled) failed\n");
     return JNI_ERR;
   }
+  jfrInfo.isEnabledMethod = isEnabledMethod;
 
-  jobject localEventFactory = (*env)->CallStaticObjectMethod(env, eventFactoryClass, createMethod,
-                                                                  eventAnnotations, valueDescriptors);
-  if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
-    fprintf(stderr, "EventFactory.create() threw\n");
-    return JNI_ERR;
+  // the event types fed by the redirected functions
+  jint result = JNI_OK;
+  if (agentOptions.mode == MODE_AGGREGATE) {
+    result = addInstallEventType(env, jfrInfo.callSiteSummaryFactory, getEventTypeMethod);
+  } else if (criticalEventClass != NULL) {
+    result = addEventClassInstallEventType(env, eventTypeClass, criticalEventClass);
+  } else {
+    result = addInstallEventType(env, jfrInfo.eventFactory, getEventTypeMethod);
   }
-
-  (*env)->DeleteLocalRef(env, eventAnnotations);
-  (*env)->DeleteLocalRef(env, valueDescriptors);
-
-  jfrInfo.eventFactory = (*env)->NewGlobalRef(env, localEventFactory);
-  jint lookupEventFactoryMethodsResult = lookupEventFactoryMethods(env, eventFactoryClass);
-  if (lookupEventFactoryMethodsResult != JNI_OK) {
-    fprintf(stderr, "lookupEventFactoryMethods() failed\n");
-    return JNI_ERR;
+  if (result == JNI_OK && agentOptions.histogram) {
+    result = addInstallEventType(env, jfrInfo.holdTimeHistogramFactory, getEventTypeMethod);
+  }
+  if (result == JNI_OK && agentOptions.gcStalls) {
+    result = addInstallEventType(env, jfrInfo.gcStallFactory, getEventTypeMethod);
+  }
+  if (result == JNI_OK && agentOptions.copies) {
+    result = addInstallEventType(env, jfrInfo.copySummaryFactory, getEventTypeMethod);
+  }
+  if (result == JNI_OK && agentOptions.watchdogNanos > 0) {
+    result = addInstallEventType(env, jfrInfo.longHeldFactory, getEventTypeMethod);
+  }
+  if (result == JNI_OK && agentOptions.hotArrays > 0) {
+    result = addInstallEventType(env, jfrInfo.hotArrayFactory, getEventTypeMethod);
+  }
+  if (result == JNI_OK && agentOptions.transitions) {
+    result = addInstallEventType(env, jfrInfo.transitionProfileFactory, getEventTypeMethod);
   }
 
   (*env)->DeleteLocalRef(env, eventFactoryClass);
-  (*env)->DeleteLocalRef(env, localEventFactory);
-
-  return JNI_OK;
+  (*env)->DeleteLocalRef(env, eventTypeClass);
+  return result;
 }
 
-void beginEvent(JNIEnv *env, jstring methodName) {
-  // eventFactory.newEvent()
-  jobject event = (*env)->CallObjectMethod(env, jfrInfo.eventFactory, jfrInfo.newEventMethod);
-  if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
-    callInfo.event = NULL;
-    fprintf(stderr, "EventFactory#newEvent threw\n");
-    return;
+jint createEventFactory(JNIEnv *env) {
+  // probes and trace mode don't touch jdk.jfr so that they also work when JFR is not available
+  if (agentOptions.mode == MODE_PROBES) {
+    return JNI_OK;
+  }
+  if (agentOptions.mode == MODE_TRACE) {
+    return arrayTypesInit(env);
+  }
+  struct EventTypeSpec eventType = criticalEventType;
+  // JFR does not have to walk the stack if we capture it ourselves
+  eventType.disableStackTrace = agentOptions.stackDepth > 0;
+  if (criticalEventClass == NULL
+      && defineEventClass(env, &eventType, CRITICAL_EVENT_CLASS_NAME, &criticalEventClass, &emitCriticalEventMethod) != JNI_OK) {
+    // fall back to the event factory
+    (*env)->ExceptionClear(env);
+    criticalEventClass = NULL;
+  }
+  if (criticalEventClass == NULL) {
+    jint eventFactoryResult = newEventFactory(env, &eventType, &jfrInfo.eventFactory);
+    if (eventFactoryResult != JNI_OK) {
+      fprintf(stderr, "newEventFactory(%s) failed\n", criticalEventType.name);
+      return JNI_ERR;
+    }
   }
 
-  // event.set(1, "GetPrimitiveArrayCritical");
-  jint nameElementIndex = 1;
-  (*env)->CallVoidMethod(env, event, jfrInfo.setMethod, nameElementIndex, methodName);
-  if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
-    callInfo.event = NULL;
-    fprintf(stderr, "Eventy#set threw\n");
-    return;
+  if (agentOptions.overhead) {
+    jint overheadResult = newEventFactory(env, &overheadEventType, &jfrInfo.overheadFactory);
+    if (overheadResult != JNI_OK) {
+      fprintf(stderr, "newEventFactory(%s) failed\n", overheadEventType.name);
+      return JNI_ERR;
+    }
   }
 
-  // event.begin();
-  (*env)->CallVoidMethod(env, event, jfrInfo.beginMethod);
-  if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
-    callInfo.event = NULL;
-    fprintf(stderr, "Event#begin threw\n");
-    return;
+  if (agentOptions.stackDepth > 0) {
+    jint stackDefinitionResult = newEventFactory(env, &stackDefinitionEventType, &jfrInfo.stackDefinitionFactory);
+    if (stackDefinitionResult != JNI_OK) {
+      fprintf(stderr, "newEventFactory(%s) failed\n", stackDefinitionEventType.name);
+      return JNI_ERR;
+    }
   }
 
-  callInfo.event = (*env)->NewGlobalRef(env, event);
-  (*env)->DeleteLocalRef(env, event);
-}
-
-
-void endEvent(JNIEnv *env, jobject wasCopy) {
-  jobject event = callInfo.event;
-  if (event != NULL) {
-    // event.set(0, true)
-    jint nameElementIndex = 0;
-    (*env)->CallVoidMethod(env, event, jfrInfo.setMethod, nameElementIndex, wasCopy);
-    if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
-      callInfo.event = NULL;
-      fprintf(stderr, "Eventy#set threw\n");
-      return;
+  if (agentOptions.mode == MODE_AGGREGATE) {
+    jint callSiteSummaryResult = newEventFactory(env, &callSiteSummaryEventType, &jfrInfo.callSiteSummaryFactory);
+    if (callSiteSummaryResult != JNI_OK) {
+      fprintf(stderr, "newEventFactory(%s) failed\n", callSiteSummaryEventType.name);
+      return JNI_ERR;
     }
-    // event.commit();
-    (*env)->CallVoidMethod(env, event, jfrInfo.commitMethod);
-    if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
-      callInfo.event = NULL;
-      fprintf(stderr, "Event#commit threw\n");
-      return;
+  }
+
+  if (agentOptions.histogram) {
+    jint holdTimeHistogramResult = newEventFactory(env, &holdTimeHistogramEventType, &jfrInfo.holdTimeHistogramFactory);
+    if (holdTimeHistogramResult != JNI_OK) {
+      fprintf(stderr, "newEventFactory(%s) failed\n", holdTimeHistogramEventType.name);
+      return JNI_ERR;
     }
-    (*env)->DeleteGlobalRef(env, event);
   }
-}
 
-const jchar * RedirectedGetStringCritical(JNIEnv *env, jstring string, jboolean *isCopy) {
+  if (agentOptions.gcStalls) {
+    jint gcStallResult = newEventFactory(env, &gcStallEventType, &jfrInfo.gcStallFactory);
+    if (gcStallResult != JNI_OK) {
+      fprintf(stderr, "newEventFactory(%s) failed\n", gcStallEventType.name);
+      return JNI_ERR;
+    }
+    jint gcStallHolderResult = newEventFactory(env, &gcStallHolderEventType, &jfrInfo.gcStallHolderFactory);
+    if (gcStallHolderResult != JNI_OK) {
+      fprintf(stderr, "newEventFactory(%s) failed\n", gcStallHolderEventType.name);
+      return JNI_ERR;
+    }
+  }
+
+  if (agentOptions.watchdogNanos > 0) {
+    jint longHeldResult = newEventFactory(env, &longHeldEventType, &jfrInfo.longHeldFactory);
+    if (longHeldResult != JNI_OK) {
+      fprintf(stderr, "newEventFactory(%s) failed\n", longHeldEventType.name);
+      return JNI_ERR;
+    }
+  }
+
+  if (agentOptions.hotArrays > 0) {
+    jint hotArrayResult = newEventFactory(env, &hotArrayEventType, &jfrInfo.hotArrayFactory);
+    if (hotArrayResult != JNI_OK) {
+      fprintf(stderr, "newEventFactory(%s) failed\n", hotArrayEventType.name);
+      return JNI_ERR;
+    }
+  }
+
+  if (agentOptions.transitions) {
+    jint transitionProfileResult = newEventFactory(env, &transitionProfileEventType, &jfrInfo.transitionProfileFactory);
+    if (transitionProfileResult != JNI_OK) {
+      fprintf(stderr, "newEventFactory(%s) failed\n", transitionProfileEventType.name);
+      return JNI_ERR;
+    }
+  }
+
+  if (agentOptions.budget > 0.0) {
+    jint samplingRateChangeResult = newEventFactory(env, &samplingRateChangeEventType, &jfrInfo.samplingRateChangeFactory);
+    if (samplingRateChangeResult != JNI_OK) {
+      fprintf(stderr, "newEventFactory(%s) failed\n", samplingRateChangeEventType.name);
+      return JNI_ERR;
+    }
+  }
+
+  if (agentOptions.copies) {
+    jint copySummaryResult = newEventFactory(env, &copySummaryEventType, &jfrInfo.copySummaryFactory);
+    if (copySummaryResult != JNI_OK) {
+      fprintf(stderr, "newEventFactory(%s) failed\n", copySummaryEventType.name);
+      return JNI_ERR;
+    }
+    if (agentOptions.mode == MODE_SYNC) {
+      jint copyResult = newEventFactory(env, &copyEventType, &jfrInfo.copyFactory);
+      if (copyResult != JNI_OK) {
+        fprintf(stderr, "newEventFactory(%s) failed\n", copyEventType.name);
+        return JNI_ERR;
+      }
+    }
+    if (jniCopiesInit(env) != JNI_OK) {
+      fprintf(stderr, "jniCopiesInit() failed\n");
+      return JNI_ERR;
+    }
+  }
+
+  if (agentOptions.mode == MODE_ASYNC) {
+    jint bufferOverflowResult = newEventFactory(env, &bufferOverflowEventType, &jfrInfo.bufferOverflowFactory);
+    if (bufferOverflowResult != JNI_OK) {
+      fprintf(stderr, "newEventFactory(%s) failed\n", bufferOverflowEventType.name);
+      return JNI_ERR;
+    }
+  }
+
+  jint lookupEventFactoryMethodsResult = lookupEventFactoryMethods(env);
+  if (lookupEventFactoryMethodsResult != JNI_OK) {
+    fprintf(stderr, "lookupEventFactoryMethods() failed\n");
+    return JNI_ERR;
+  }
+
+  if (agentOptions.onDemand && lookupInstallEventTypes(env) != JNI_OK) {
+    fprintf(stderr, "lookupInstallEventTypes() failed\n");
+    return JNI_ERR;
+  }
+
+  if (arrayTypesInit(env) != JNI_OK) {
+    fprintf(stderr, "arrayTypesInit() failed\n");
+    return JNI_ERR;
+  }
+
+  return JNI_OK;
+}
+
+jobject newEvent(JNIEnv *env, jobject eventFactory) {
+  // eventFactory.newEvent()
+  jobject event = (*env)->CallObjectMethod(env, eventFactory, jfrInfo.newEventMethod);
+  if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
+    fprintf(stderr, "EventFactory#newEvent threw\n");
+    (*env)->ExceptionClear(env);
+    return NULL;
+  }
+  return event;
+}
+
+jboolean setEventField(JNIEnv *env, jobject event, jint index, jobject value) {
+  // event.set(index, value);
+  (*env)->CallVoidMethod(env, event, jfrInfo.setMethod, index, value);
+  if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
+    fprintf(stderr, "Eventy#set threw\n");
+    (*env)->ExceptionClear(env);
+    return JNI_FALSE;
+  }
+  return JNI_TRUE;
+}
+
+jboolean setLongEventField(JNIEnv *env, jobject event, jint index, jlong value) {
+  // event.set(index, Long.valueOf(value));
+  jobject boxed = (*env)->CallStaticObjectMethod(env, jfrInfo.longClass, jfrInfo.longValueOfMethod, value);
+  if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
+    fprintf(stderr, "Long#valueOf threw\n");
+    (*env)->ExceptionClear(env);
+    return JNI_FALSE;
+  }
+  jboolean result = setEventField(env, event, index, boxed);
+  (*env)->DeleteLocalRef(env, boxed);
+  return result;
+}
+
+jboolean setDoubleEventField(JNIEnv *env, jobject event, jint index, jdouble value) {
+  // event.set(index, Double.valueOf(value));
+  jobject boxed = (*env)->CallStaticObjectMethod(env, jfrInfo.doubleClass, jfrInfo.doubleValueOfMethod, value);
+  if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
+    fprintf(stderr, "Double#valueOf threw\n");
+    (*env)->ExceptionClear(env);
+    return JNI_FALSE;
+  }
+  jboolean result = setEventField(env, event, index, boxed);
+  (*env)->DeleteLocalRef(env, boxed);
+  return result;
+}
+
+void commitEvent(JNIEnv *env, jobject event) {
+  // event.commit();
+  (*env)->CallVoidMethod(env, event, jfrInfo.commitMethod);
+  if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
+    fprintf(stderr, "Event#commit threw\n");
+    (*env)->ExceptionClear(env);
+  }
+}
+
+// a single upcall into the generated event class, no boxing and no event object visible to JNI
+void emitCriticalEvent(JNIEnv *env, const struct CriticalRecord *record, jthread thread) {
+  jvalue args[sizeof(criticalEventFields) / sizeof(criticalEventFields[0])];
+  args[IS_COPY_FIELD].z = record->isCopy;
+  args[METHOD_NAME_FIELD].l = record->method == GET_STRING_CRITICAL ? jfrInfo.getStringCritical : jfrInfo.getPrimitiveArrayCritical;
+  args[HOLD_TIME_FIELD].j = record->endNanos - record->acquiredNanos;
+  args[CRITICAL_START_TIME_FIELD].j = nanoTimeToEpochMillis(record->startNanos);
+  args[CRITICAL_THREAD_FIELD].l = thread;
+  args[LENGTH_FIELD].j = record->length;
+  args[ELEMENT_TYPE_FIELD].l = arrayTypeName(record->elementType);
+  args[BYTES_FIELD].j = (jlong) record->length * arrayTypeElementSize(record->elementType);
+  args[DEPTH_FIELD].j = record->depth;
+  args[NESTED_CRITICALS_FIELD].j = record->nestedCriticals;
+  args[MAX_DEPTH_FIELD].j = record->maxDepth;
+  args[STACK_ID_FIELD].j = record->stackId;
+  args[ACQUIRE_TIME_FIELD].j = record->acquiredNanos - record->startNanos;
+  args[NATIVE_LIBRARY_FIELD].l = nativeLibraryString(env, nativeLibraryOf(record->callSite));
+  args[CALL_SITE_FIELD].l = callSiteString(env, record->callSite);
+  args[STRING_CODER_FIELD].l = stringCoderName(record->coder);
+  (*env)->CallStaticVoidMethodA(env, criticalEventClass, emitCriticalEventMethod, args);
+  if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
+    fprintf(stderr, "CriticalEvent#emit threw\n");
+    (*env)->ExceptionClear(env);
+  }
+}
+
+// thread is NULL when called on the thread that held the critical
+void commitCriticalEvent(JNIEnv *env, const struct CriticalRecord *record, jthread thread) {
+  if (criticalEventClass != NULL) {
+    emitCriticalEvent(env, record, thread);
+    return;
+  }
+  jobject event = newEvent(env, jfrInfo.eventFactory);
+  if (event == NULL) {
+    return;
+  }
+
+  jobject wasCopyObject = record->isCopy == JNI_TRUE ? jfrInfo.trueObject : jfrInfo.falseObject;
+  jstring methodName = record->method == GET_STRING_CRITICAL ? jfrInfo.getStringCritical : jfrInfo.getPrimitiveArrayCritical;
+  jstring elementType = arrayTypeName(record->elementType);
+  jstring nativeLibrary = nativeLibraryString(env, nativeLibraryOf(record->callSite));
+  jstring callSite = callSiteString(env, record->callSite);
+  jstring coder = stringCoderName(record->coder);
+  if (setEventField(env, event, IS_COPY_FIELD, wasCopyObject)
+      && setEventField(env, event, METHOD_NAME_FIELD, methodName)
+      && setLongEventField(env, event, HOLD_TIME_FIELD, record->endNanos - record->acquiredNanos)
+      && setLongEventField(env, event, CRITICAL_START_TIME_FIELD, nanoTimeToEpochMillis(record->startNanos))
+      && (thread == NULL || setEventField(env, event, CRITICAL_THREAD_FIELD, thread))
+      && setLongEventField(env, event, LENGTH_FIELD, record->length)
+      && (elementType == NULL || setEventField(env, event, ELEMENT_TYPE_FIELD, elementType))
+      && setLongEventField(env, event, BYTES_FIELD, (jlong) record->length * arrayTypeElementSize(record->elementType))
+      && setLongEventField(env, event, DEPTH_FIELD, record->depth)
+      && setLongEventField(env, event, NESTED_CRITICALS_FIELD, record->nestedCriticals)
+      && setLongEventField(env, event, MAX_DEPTH_FIELD, record->maxDepth)
+      && (record->stackId == STACK_ID_UNKNOWN || setLongEventField(env, event, STACK_ID_FIELD, record->stackId))
+      && setLongEventField(env, event, ACQUIRE_TIME_FIELD, record->acquiredNanos - record->startNanos)
+      && (nativeLibrary == NULL || setEventField(env, event, NATIVE_LIBRARY_FIELD, nativeLibrary))
+      && (callSite == NULL || setEventField(env, event, CALL_SITE_FIELD, callSite))
+      && (coder == NULL || setEventField(env, event, STRING_CODER_FIELD, coder))) {
+    commitEvent(env, event);
+  }
+  (*env)->DeleteLocalRef(env, event);
+}
+
+void commitBufferOverflowEvent(JNIEnv *env, jlong droppedRecords, jthread thread) {
+  jobject event = newEvent(env, jfrInfo.bufferOverflowFactory);
+  if (event == NULL) {
+    return;
+  }
+  if (setLongEventField(env, event, DROPPED_RECORDS_FIELD, droppedRecords)
+      && setEventField(env, event, OVERFLOW_THREAD_FIELD, thread)) {
+    commitEvent(env, event);
+  }
+  (*env)->DeleteLocalRef(env, event);
+}
+
+void flushRingBuffer(JNIEnv *env, struct ThreadState *state) {
+  struct CriticalRecord batch[FLUSH_BATCH_SIZE];
+  struct RingBuffer *ring = &state->ring;
+
+  // don't chase a producer that is faster than us forever
+  uint64_t remaining = ring->mask + 1;
+  jint count;
+  do {
+    count = ringBufferDrain(ring, batch, FLUSH_BATCH_SIZE);
+    for (jint i = 0; i < count; i++) {
+      commitCriticalEvent(env, &batch[i], state->thread);
+    }
+    remaining -= (uint64_t) count;
+  } while (count == FLUSH_BATCH_SIZE && remaining > 0);
+
+  uint64_t dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+  if (dropped != ring->reportedDropped) {
+    commitBufferOverflowEvent(env, (jlong) (dropped - ring->reportedDropped), state->thread);
+    ring->reportedDropped = dropped;
+  }
+}
+
+// whether the time spent in the agent is measured, for the overhead events or the governor
+static inline jboolean measuresOverhead(void) {
+  return agentOptions.overhead || agentOptions.budget > 0.0;
+}
+
+static inline jboolean usesThreadStates(void) {
+  return agentOptions.mode == MODE_ASYNC || agentOptions.histogram || agentOptions.gcStalls || agentOptions.copies
+      || measuresOverhead() || agentOptions.watchdogNanos > 0;
+}
+
+void commitOverheadEvent(JNIEnv *env, jobject thread, jlong calls, jlong nanos) {
+  jobject event = newEvent(env, jfrInfo.overheadFactory);
+  if (event == NULL) {
+    return;
+  }
+  if ((thread == NULL || setEventField(env, event, OVERHEAD_THREAD_FIELD, thread))
+      && setLongEventField(env, event, OVERHEAD_CALLS_FIELD, calls)
+      && setLongEventField(env, event, OVERHEAD_TIME_FIELD, nanos)) {
+    commitEvent(env, event);
+  }
+  (*env)->DeleteLocalRef(env, event);
+}
+
+// reports the overhead of the thread since the last report
+void reportOverhead(JNIEnv *env, struct ThreadState *state) {
+  struct OverheadCounters *counters = &state->overhead;
+  uint64_t calls = atomic_load_explicit(&counters->calls, memory_order_relaxed);
+  uint64_t nanos = atomic_load_explicit(&counters->nanos, memory_order_relaxed);
+  if (calls != counters->reportedCalls) {
+    commitOverheadEvent(env, state->thread, (jlong) (calls - counters->reportedCalls), (jlong) (nanos - counters->reportedNanos));
+  }
+  counters->reportedCalls = calls;
+  counters->reportedNanos = nanos;
+}
+
+void reportOverheads(JNIEnv *env) {
+  for (struct ThreadState *state = firstThreadState(); state != NULL; state = state->next) {
+    if (atomic_load_explicit(&state->status, memory_order_acquire) != THREAD_STATE_FREE) {
+      reportOverhead(env, state);
+    }
+  }
+}
+
+// drains the ring buffers and releases the states of ended threads
+void flushThreadStates(jvmtiEnv *jvmti, JNIEnv *env) {
+  for (struct ThreadState *state = firstThreadState(); state != NULL; state = state->next) {
+    int status = atomic_load_explicit(&state->status, memory_order_acquire);
+    if (status == THREAD_STATE_FREE) {
+      continue;
+    }
+    if (agentOptions.mode == MODE_ASYNC) {
+      flushRingBuffer(env, state);
+    }
+    if (status == THREAD_STATE_RETIRED) {
+      if (agentOptions.overhead) {
+        // while the thread reference is still valid
+        reportOverhead(env, state);
+      }
+      // histograms survive the release, they are cumulative and merged by difference
+      // the owning thread ended before we started draining, nothing more can arrive
+      releaseThreadState(env, state);
+    }
+  }
+}
+
+void commitCallSiteSummaryEvent(JNIEnv *env, const struct CallSiteSnapshot *snapshot, jstring callSite) {
+  jobject event = newEvent(env, jfrInfo.callSiteSummaryFactory);
+  if (event == NULL) {
+    return;
+  }
+  jstring methodName = NULL;
+  if (snapshot->method == GET_STRING_CRITICAL) {
+    methodName = jfrInfo.getStringCritical;
+  } else if (snapshot->method == GET_PRIMITIVE_ARRAY_CRITICAL) {
+    methodName = jfrInfo.getPrimitiveArrayCritical;
+  }
+  jstring nativeLibrary = snapshot->address != NULL ? nativeLibraryString(env, nativeLibraryOf(snapshot->address)) : NULL;
+  if ((methodName == NULL || setEventField(env, event, SUMMARY_METHOD_NAME_FIELD, methodName))
+      && setEventField(env, event, SUMMARY_CALL_SITE_FIELD, callSite)
+      && setLongEventField(env, event, SUMMARY_COUNT_FIELD, (jlong) snapshot->count)
+      && setLongEventField(env, event, SUMMARY_TOTAL_TIME_FIELD, (jlong) snapshot->totalNanos)
+      && setLongEventField(env, event, SUMMARY_MAX_TIME_FIELD, (jlong) snapshot->maxNanos)
+      && setLongEventField(env, event, SUMMARY_P99_TIME_FIELD, snapshot->p99Nanos)
+      && setLongEventField(env, event, SUMMARY_COPIES_FIELD, (jlong) snapshot->copies)
+      && (nativeLibrary == NULL || setEventField(env, event, SUMMARY_NATIVE_LIBRARY_FIELD, nativeLibrary))
+      && setDoubleEventField(env, event, SUMMARY_COPY_RATIO_FIELD, (jdouble) snapshot->copies / (jdouble) snapshot->count)
+      && setLongEventField(env, event, SUMMARY_LATIN1_STRINGS_FIELD, (jlong) snapshot->latin1Strings)) {
+    commitEvent(env, event);
+  }
+  (*env)->DeleteLocalRef(env, event);
+}
+
+void reportCallSites(JNIEnv *env) {
+  jint capacity = callSitesCapacity();
+  for (jint i = 0; i < capacity; i++) {
+    struct CallSiteSnapshot snapshot;
+    if (callSiteSnapshot(i, &snapshot)) {
+      if (snapshot.address == NULL) {
+        commitCallSiteSummaryEvent(env, &snapshot, jfrInfo.otherCallSite);
+        continue;
+      }
+      jstring callSite = callSiteString(env, snapshot.address);
+      if (callSite != NULL) {
+        commitCallSiteSummaryEvent(env, &snapshot, callSite);
+        continue;
+      }
+      // more call sites than the cache of callSiteString holds, formatted again every period
+      char name[CALL_SITE_NAME_LENGTH];
+      callSiteName(snapshot.address, name, sizeof(name));
+      jstring nameString = (*env)->NewStringUTF(env, name);
+      if (nameString == NULL) {
+        fprintf(stderr, "NewStringUTF(%s) failed\n", name);
+        (*env)->ExceptionClear(env);
+        continue;
+      }
+      commitCallSiteSummaryEvent(env, &snapshot, nameString);
+      (*env)->DeleteLocalRef(env, nameString);
+    }
+  }
+}
+
+void commitHoldTimeHistogramEvent(JNIEnv *env, jstring methodName, const uint64_t *counts, uint64_t totalNanos) {
+  uint64_t count = 0;
+  for (jint bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+    count += counts[bucket];
+  }
+  if (count == 0) {
+    return;
+  }
+  jobject event = newEvent(env, jfrInfo.holdTimeHistogramFactory);
+  if (event == NULL) {
+    return;
+  }
+  if (setEventField(env, event, HISTOGRAM_METHOD_NAME_FIELD, methodName)
+      && setLongEventField(env, event, HISTOGRAM_COUNT_FIELD, (jlong) count)
+      && setLongEventField(env, event, HISTOGRAM_TOTAL_TIME_FIELD, (jlong) totalNanos)
+      && setLongEventField(env, event, HISTOGRAM_P50_TIME_FIELD, histogramPercentile(counts, count, 0.5))
+      && setLongEventField(env, event, HISTOGRAM_P90_TIME_FIELD, histogramPercentile(counts, count, 0.9))
+      && setLongEventField(env, event, HISTOGRAM_P99_TIME_FIELD, histogramPercentile(counts, count, 0.99))
+      && setLongEventField(env, event, HISTOGRAM_P999_TIME_FIELD, histogramPercentile(counts, count, 0.999))
+      && setLongEventField(env, event, HISTOGRAM_MAX_TIME_FIELD, histogramPercentile(counts, count, 1.0))) {
+    commitEvent(env, event);
+  }
+  (*env)->DeleteLocalRef(env, event);
+}
+
+void reportHoldTimeHistograms(JNIEnv *env) {
+  uint64_t totalNanos[2] = { 0, 0 };
+  memset(holdTimeCounts, 0, sizeof(holdTimeCounts));
+  // free states are included, they may contain values recorded by a thread that ended during the period
+  for (struct ThreadState *state = firstThreadState(); state != NULL; state = state->next) {
+    histogramShardMerge(&state->histograms[GET_STRING_CRITICAL], holdTimeCounts[GET_STRING_CRITICAL], &totalNanos[GET_STRING_CRITICAL]);
+    histogramShardMerge(&state->histograms[GET_PRIMITIVE_ARRAY_CRITICAL], holdTimeCounts[GET_PRIMITIVE_ARRAY_CRITICAL], &totalNanos[GET_PRIMITIVE_ARRAY_CRITICAL]);
+  }
+  commitHoldTimeHistogramEvent(env, jfrInfo.getStringCritical, holdTimeCounts[GET_STRING_CRITICAL], totalNanos[GET_STRING_CRITICAL]);
+  commitHoldTimeHistogramEvent(env, jfrInfo.getPrimitiveArrayCritical, holdTimeCounts[GET_PRIMITIVE_ARRAY_CRITICAL], totalNanos[GET_PRIMITIVE_ARRAY_CRITICAL]);
+}
+
+jstring getMethodName(jint method) {
+  return method == GET_STRING_CRITICAL ? jfrInfo.getStringCritical : jfrInfo.getPrimitiveArrayCritical;
+}
+
+// NULL if the thread ended and its state has been reused since
+jobject getHolderThread(const struct CriticalHolder *holder) {
+  struct ThreadState *state = holder->state;
+  // states are only released by the reporter thread so this can't change while we use the reference
+  if (state == NULL
+      || atomic_load_explicit(&state->generation, memory_order_relaxed) != holder->generation
+      || atomic_load_explicit(&state->status, memory_order_acquire) == THREAD_STATE_FREE) {
+    return NULL;
+  }
+  return state->thread;
+}
+
+void commitGcStallEvent(JNIEnv *env, const struct GcStallSnapshot *snapshot) {
+  jobject event = newEvent(env, jfrInfo.gcStallFactory);
+  if (event == NULL) {
+    return;
+  }
+  jboolean success = setLongEventField(env, event, STALL_GC_START_TIME_FIELD, nanoTimeToEpochMillis(snapshot->gcStartNanos))
+      && setLongEventField(env, event, STALL_GC_DURATION_FIELD, snapshot->gcEndNanos - snapshot->gcStartNanos)
+      && setLongEventField(env, event, STALL_IN_FLIGHT_CRITICALS_FIELD, snapshot->inFlightCriticals);
+  const struct CriticalHolder *lastRelease = &snapshot->lastRelease;
+  if (success && lastRelease->endNanos != 0L) {
+    jobject thread = getHolderThread(lastRelease);
+    success = (thread == NULL || setEventField(env, event, STALL_BLOCKING_THREAD_FIELD, thread))
+      && (lastRelease->state == NULL || setEventField(env, event, STALL_BLOCKING_METHOD_NAME_FIELD, getMethodName(lastRelease->method)))
+      && (lastRelease->startNanos == 0L || setLongEventField(env, event, STALL_BLOCKING_HOLD_TIME_FIELD, lastRelease->endNanos - lastRelease->startNanos))
+      && setLongEventField(env, event, STALL_RELEASE_TO_GC_TIME_FIELD, snapshot->gcStartNanos - lastRelease->endNanos);
+  }
+  if (success) {
+    commitEvent(env, event);
+  }
+  (*env)->DeleteLocalRef(env, event);
+}
+
+void commitGcStallHolderEvent(JNIEnv *env, const struct GcStallSnapshot *snapshot, const struct CriticalHolder *holder) {
+  jobject event = newEvent(env, jfrInfo.gcStallHolderFactory);
+  if (event == NULL) {
+    return;
+  }
+  jobject thread = getHolderThread(holder);
+  if (setLongEventField(env, event, HOLDER_GC_START_TIME_FIELD, nanoTimeToEpochMillis(snapshot->gcStartNanos))
+      && (thread == NULL || setEventField(env, event, HOLDER_THREAD_FIELD, thread))
+      && setEventField(env, event, HOLDER_METHOD_NAME_FIELD, getMethodName(holder->method))
+      && setLongEventField(env, event, HOLDER_HELD_TIME_FIELD, snapshot->gcStartNanos - holder->startNanos)) {
+    commitEvent(env, event);
+  }
+  (*env)->DeleteLocalRef(env, event);
+}
+
+void reportGcStalls(JNIEnv *env) {
+  struct GcStallSnapshot snapshot;
+  while (gcStallsPoll(&snapshot)) {
+    commitGcStallEvent(env, &snapshot);
+    for (jint i = 0; i < snapshot.holderCount; i++) {
+      commitGcStallHolderEvent(env, &snapshot, &snapshot.holders[i]);
+    }
+  }
+}
+
+void commitCopySummaryEvent(JNIEnv *env, jint function, const struct CopyTotals *totals) {
+  jobject event = newEvent(env, jfrInfo.copySummaryFactory);
+  if (event == NULL) {
+    return;
+  }
+  if (setEventField(env, event, COPY_SUMMARY_FUNCTION_NAME_FIELD, copyFunctionName(function))
+      && setLongEventField(env, event, COPY_SUMMARY_CALLS_FIELD, (jlong) totals->calls)
+      && setLongEventField(env, event, COPY_SUMMARY_BYTES_FIELD, (jlong) totals->bytes)
+      && setLongEventField(env, event, COPY_SUMMARY_COPIES_FIELD, (jlong) totals->copies)
+      && setLongEventField(env, event, COPY_SUMMARY_TOTAL_TIME_FIELD, (jlong) totals->nanos)) {
+    commitEvent(env, event);
+  }
+  (*env)->DeleteLocalRef(env, event);
+}
+
+void reportCopies(JNIEnv *env) {
+  struct CopyTotals totals[COPY_FUNCTION_COUNT];
+  memset(totals, 0, sizeof(totals));
+  // free states are included, they may contain values recorded by a thread that ended during the period
+  for (struct ThreadState *state = firstThreadState(); state != NULL; state = state->next) {
+    for (jint i = 0; i < COPY_FUNCTION_COUNT; i++) {
+      copyCountersMerge(&state->copies[i], &totals[i]);
+    }
+  }
+  for (jint i = 0; i < COPY_FUNCTION_COUNT; i++) {
+    if (totals[i].calls > 0) {
+      commitCopySummaryEvent(env, i, &totals[i]);
+    }
+  }
+}
+
+// a function with its totals for ranking
+struct RankedTransition {
+  jint function;
+  jlong estimatedNanos;
+  struct TransitionTotals totals;
+};
+
+static int compareRankedTransitions(const void *a, const void *b) {
+  const struct RankedTransition *left = a;
+  const struct RankedTransition *right = b;
+  // descending
+  if (left->estimatedNanos != right->estimatedNanos) {
+    return left->estimatedNanos < right->estimatedNanos ? 1 : -1;
+  }
+  if (left->totals.calls != right->totals.calls) {
+    return left->totals.calls < right->totals.calls ? 1 : -1;
+  }
+  return left->function - right->function;
+}
+
+void commitTransitionProfileEvent(JNIEnv *env, jint rank, const struct RankedTransition *ranked) {
+  jobject event = newEvent(env, jfrInfo.transitionProfileFactory);
+  if (event == NULL) {
+    return;
+  }
+  jstring functionName = (*env)->NewStringUTF(env, transitionFunctionName(ranked->function));
+  if (functionName == NULL) {
+    fprintf(stderr, "NewStringUTF(%s) failed\n", transitionFunctionName(ranked->function));
+    (*env)->ExceptionClear(env);
+    (*env)->DeleteLocalRef(env, event);
+    return;
+  }
+  if (setLongEventField(env, event, TRANSITION_RANK_FIELD, rank)
+      && setEventField(env, event, TRANSITION_FUNCTION_NAME_FIELD, functionName)
+      && setLongEventField(env, event, TRANSITION_CALLS_FIELD, (jlong) ranked->totals.calls)
+      && setLongEventField(env, event, TRANSITION_TIMED_CALLS_FIELD, (jlong) ranked->totals.timedCalls)
+      && setLongEventField(env, event, TRANSITION_TIMED_TIME_FIELD, (jlong) ranked->totals.timedNanos)
+      && setLongEventField(env, event, TRANSITION_TOTAL_TIME_FIELD, ranked->estimatedNanos)) {
+    commitEvent(env, event);
+  }
+  (*env)->DeleteLocalRef(env, functionName);
+  (*env)->DeleteLocalRef(env, event);
+}
+
+void reportTransitions(JNIEnv *env) {
+  struct TransitionTotals totals[TRANSITION_FUNCTION_COUNT];
+  memset(totals, 0, sizeof(totals));
+  transitionsMerge(totals);
+  struct RankedTransition ranked[TRANSITION_FUNCTION_COUNT];
+  jint count = 0;
+  for (jint i = 0; i < TRANSITION_FUNCTION_COUNT; i++) {
+    if (totals[i].calls > 0) {
+      ranked[count].function = i;
+      ranked[count].totals = totals[i];
+      ranked[count].estimatedNanos = totals[i].timedCalls > 0
+          ? (jlong) ((double) totals[i].timedNanos * ((double) totals[i].calls / (double) totals[i].timedCalls))
+          : 0L;
+      count += 1;
+    }
+  }
+  qsort(ranked, (size_t) count, sizeof(struct RankedTransition), compareRankedTransitions);
+  for (jint i = 0; i < count; i++) {
+    commitTransitionProfileEvent(env, i + 1, &ranked[i]);
+  }
+}
+
+void commitStackDefinitionEvent(JNIEnv *env, jint stackId, jstring frames) {
+  jobject event = newEvent(env, jfrInfo.stackDefinitionFactory);
+  if (event == NULL) {
+    return;
+  }
+  if (setLongEventField(env, event, STACK_DEFINITION_ID_FIELD, stackId)
+      && setEventField(env, event, STACK_DEFINITION_FRAMES_FIELD, frames)) {
+    commitEvent(env, event);
+  }
+  (*env)->DeleteLocalRef(env, event);
+}
+
+// defines the stacks interned since the last call, all stacks if all is true
+void reportStackDefinitions(jvmtiEnv *jvmti, JNIEnv *env, jboolean all) {
+  for (jint i = 0; i < STACK_TABLE_CAPACITY; i++) {
+    if (stackDefinitions[i] != NULL) {
+      if (all) {
+        commitStackDefinitionEvent(env, i + 1, stackDefinitions[i]);
+      }
+      continue;
+    }
+    const struct StackFrames *stack = internedStack(i + 1);
+    if (stack == NULL) {
+      continue;
+    }
+    char frames[STACK_NAME_LENGTH];
+    formatStack(jvmti, env, stack, frames, sizeof(frames));
+    jstring framesString = (*env)->NewStringUTF(env, frames);
+    if (framesString == NULL) {
+      fprintf(stderr, "NewStringUTF(frames) failed\n");
+      (*env)->ExceptionClear(env);
+      continue;
+    }
+    stackDefinitions[i] = (*env)->NewGlobalRef(env, framesString);
+    (*env)->DeleteLocalRef(env, framesString);
+    commitStackDefinitionEvent(env, i + 1, stackDefinitions[i]);
+  }
+}
+
+void commitLongHeldEvent(jvmtiEnv *jvmti, JNIEnv *env, jobject thread, jint method, jlong startNanos, jlong heldNanos) {
+  jobject event = newEvent(env, jfrInfo.longHeldFactory);
+  if (event == NULL) {
+    return;
+  }
+  // the holder is in native code, its Java frames are the ones it had when it entered the critical
+  jvmtiFrameInfo frames[MAX_STACK_DEPTH];
+  jint depth = 0;
+  jint maxDepth = agentOptions.stackDepth > 0 ? agentOptions.stackDepth : MAX_STACK_DEPTH;
+  jvmtiError tiErr = (*jvmti)->GetStackTrace(jvmti, thread, 0, maxDepth, frames, &depth);
+  if (tiErr != JVMTI_ERROR_NONE) {
+    depth = 0;
+  }
+  char formatted[STACK_NAME_LENGTH];
+  formatFrames(jvmti, env, frames, depth, formatted, sizeof(formatted));
+  jstring framesString = (*env)->NewStringUTF(env, formatted);
+  if (framesString == NULL) {
+    fprintf(stderr, "NewStringUTF(frames) failed\n");
+    (*env)->ExceptionClear(env);
+  }
+  if (setEventField(env, event, LONG_HELD_THREAD_FIELD, thread)
+      && setEventField(env, event, LONG_HELD_METHOD_NAME_FIELD, getMethodName(method))
+      && setLongEventField(env, event, LONG_HELD_START_TIME_FIELD, nanoTimeToEpochMillis(startNanos))
+      && setLongEventField(env, event, LONG_HELD_HELD_TIME_FIELD, heldNanos)
+      && (framesString == NULL || setEventField(env, event, LONG_HELD_FRAMES_FIELD, framesString))) {
+    commitEvent(env, event);
+  }
+  if (framesString != NULL) {
+    (*env)->DeleteLocalRef(env, framesString);
+  }
+  (*env)->DeleteLocalRef(env, event);
+}
+
+// reports every critical held longer than the watchdog threshold once, while it is still held
+void watchdogTick(jvmtiEnv *jvmti, JNIEnv *env) {
+  jlong now = nanoTime();
+  for (struct ThreadState *state = firstThreadState(); state != NULL; state = state->next) {
+    jlong startNanos = atomic_load_explicit(&state->inFlight.startNanos, memory_order_acquire);
+    if (startNanos == 0L || startNanos == state->watchdogReportedNanos || now - startNanos < agentOptions.watchdogNanos) {
+      continue;
+    }
+    jint method = atomic_load_explicit(&state->inFlight.method, memory_order_relaxed);
+    jobject thread = newThreadLocalRef(env, state);
+    // the critical may have been released and a new one entered while we looked
+    if (thread != NULL && atomic_load_explicit(&state->inFlight.startNanos, memory_order_acquire) == startNanos) {
+      state->watchdogReportedNanos = startNanos;
+      commitLongHeldEvent(jvmti, env, thread, method, startNanos, now - startNanos);
+    }
+    if (thread != NULL) {
+      (*env)->DeleteLocalRef(env, thread);
+    }
+  }
+}
+
+void commitSamplingRateChangeEvent(JNIEnv *env, const struct GovernorDecision *decision) {
+  jobject event = newEvent(env, jfrInfo.samplingRateChangeFactory);
+  if (event == NULL) {
+    return;
+  }
+  if (setLongEventField(env, event, RATE_PREVIOUS_INTERVAL_FIELD, decision->previousInterval)
+      && setLongEventField(env, event, RATE_INTERVAL_FIELD, decision->interval)
+      && setDoubleEventField(env, event, RATE_OVERHEAD_FIELD, decision->overhead)
+      && setDoubleEventField(env, event, RATE_BUDGET_FIELD, agentOptions.budget)) {
+    commitEvent(env, event);
+  }
+  (*env)->DeleteLocalRef(env, event);
+}
+
+// sums the time all threads spent in the agent since the last tick and adjusts the sampling interval
+void governorTick(jvmtiEnv *jvmti, JNIEnv *env) {
+  uint64_t agentNanos = 0;
+  for (struct ThreadState *state = firstThreadState(); state != NULL; state = state->next) {
+    struct OverheadCounters *counters = &state->overhead;
+    uint64_t nanos = atomic_load_explicit(&counters->nanos, memory_order_relaxed);
+    // the counters start from 0 when the state is reused by a new thread
+    agentNanos += nanos >= counters->governedNanos ? nanos - counters->governedNanos : nanos;
+    counters->governedNanos = nanos;
+  }
+  struct GovernorDecision decision;
+  if (governorAdjust(agentNanos, agentOptions.budget, &decision)) {
+    commitSamplingRateChangeEvent(env, &decision);
+  }
+}
+
+void commitHotArrayEvent(jvmtiEnv *jvmti, JNIEnv *env, jint rank, const struct HotArraySnapshot *snapshot) {
+  jobject event = newEvent(env, jfrInfo.hotArrayFactory);
+  if (event == NULL) {
+    return;
+  }
+  const struct HotArray *hot = hotArray(snapshot->entry);
+  jstring framesString = NULL;
+  const struct StackFrames *stack = hot->stackId != STACK_ID_UNKNOWN ? internedStack(hot->stackId) : NULL;
+  if (stack != NULL) {
+    char formatted[STACK_NAME_LENGTH];
+    formatStack(jvmti, env, stack, formatted, sizeof(formatted));
+    framesString = (*env)->NewStringUTF(env, formatted);
+    if (framesString == NULL) {
+      fprintf(stderr, "NewStringUTF(frames) failed\n");
+      (*env)->ExceptionClear(env);
+    }
+  }
+  jstring elementType = arrayTypeName(hot->elementType);
+  if (setLongEventField(env, event, HOT_RANK_FIELD, rank)
+      && setLongEventField(env, event, HOT_PINS_FIELD, (jlong) snapshot->pins)
+      && setLongEventField(env, event, HOT_HOLD_TIME_FIELD, (jlong) snapshot->holdNanos)
+      && setLongEventField(env, event, HOT_LENGTH_FIELD, hot->length)
+      && (elementType == NULL || setEventField(env, event, HOT_ELEMENT_TYPE_FIELD, elementType))
+      && setLongEventField(env, event, HOT_BYTES_FIELD, (jlong) hot->length * arrayTypeElementSize(hot->elementType))
+      && setLongEventField(env, event, HOT_FIRST_PIN_TIME_FIELD, nanoTimeToEpochMillis(hot->firstPinNanos))
+      && setLongEventField(env, event, HOT_STACK_ID_FIELD, hot->stackId)
+      && (framesString == NULL || setEventField(env, event, HOT_FRAMES_FIELD, framesString))) {
+    commitEvent(env, event);
+  }
+  if (framesString != NULL) {
+    (*env)->DeleteLocalRef(env, framesString);
+  }
+  (*env)->DeleteLocalRef(env, event);
+}
+
+// reports the live arrays with the longest cumulative hold time, arrays freed by the GC are forgotten first
+void reportHotArrays(jvmtiEnv *jvmti, JNIEnv *env) {
+  hotArraysReclaim();
+  struct HotArraySnapshot top[MAX_HOT_ARRAYS];
+  jint count = hotArraysTop(top, agentOptions.hotArrays);
+  for (jint i = 0; i < count; i++) {
+    commitHotArrayEvent(jvmti, env, i + 1, &top[i]);
+  }
+}
+
+void reportPeriodicEvents(JNIEnv *env) {
+  if (agentOptions.mode == MODE_AGGREGATE) {
+    reportCallSites(env);
+  }
+  if (agentOptions.histogram) {
+    reportHoldTimeHistograms(env);
+  }
+  if (agentOptions.copies) {
+    reportCopies(env);
+  }
+  if (agentOptions.overhead) {
+    reportOverheads(env);
+  }
+  if (agentOptions.hotArrays > 0) {
+    reportHotArrays(agentJvmti, env);
+  }
+  if (agentOptions.transitions) {
+    reportTransitions(env);
+  }
+}
+
+jint installRedirection(jvmtiEnv *jvmti) {
+  jvmtiError tiErr = (*jvmti)->SetJNIFunctionTable(jvmti, redirectedJNIFunctions);
+  if (tiErr != JVMTI_ERROR_NONE) {
+    fprintf(stderr, "SetJNIFunctionTable (JVMTI) failed with error(%d)\n", tiErr);
+    return JNI_ERR;
+  }
+  return JNI_OK;
+}
+
+// installs the idle table, criticals held at this point are released through it and counted
+jint uninstallRedirection(jvmtiEnv *jvmti) {
+  jvmtiError tiErr = (*jvmti)->SetJNIFunctionTable(jvmti, idleJNIFunctions);
+  if (tiErr != JVMTI_ERROR_NONE) {
+    fprintf(stderr, "SetJNIFunctionTable (JVMTI) failed with error(%d)\n", tiErr);
+    return JNI_ERR;
+  }
+  return JNI_OK;
+}
+
+jboolean isAnyInstallEventTypeEnabled(JNIEnv *env) {
+  for (jint i = 0; i < jfrInfo.installEventTypeCount; i++) {
+    // eventType.isEnabled(), true if at least one running recording has the event enabled
+    jboolean enabled = (*env)->CallBooleanMethod(env, jfrInfo.installEventTypes[i], jfrInfo.isEnabledMethod);
+    if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
+      fprintf(stderr, "EventType#isEnabled threw\n");
+      (*env)->ExceptionClear(env);
+      return JNI_FALSE;
+    }
+    if (enabled) {
+      return JNI_TRUE;
+    }
+  }
+  return JNI_FALSE;
+}
+
+// installs the redirection if a recording has one of our events enabled, removes it otherwise
+void updateRedirection(jvmtiEnv *jvmti, JNIEnv *env) {
+  jboolean enabled = isAnyInstallEventTypeEnabled(env);
+  if (enabled && !installed) {
+    installed = installRedirection(jvmti) == JNI_OK;
+  } else if (!enabled && installed) {
+    installed = uninstallRedirection(jvmti) != JNI_OK;
+  }
+}
+
+// jdk.jfr.FlightRecorder.isInitialized(), true once a recording was started, does not initialize JFR itself
+jboolean isFlightRecorderInitialized(JNIEnv *env) {
+  if (flightRecorderMissing) {
+    return JNI_FALSE;
+  }
+  if (flightRecorderClass == NULL) {
+    // not looked up again, jdk.jfr does not appear later
+    flightRecorderMissing = JNI_TRUE;
+    jclass localClass = (*env)->FindClass(env, "jdk/jfr/FlightRecorder");
+    if (localClass == NULL) {
+      (*env)->ExceptionClear(env);
+      return JNI_FALSE;
+    }
+    jmethodID isInitializedMethod = (*env)->GetStaticMethodID(env, localClass, "isInitialized", "()Z");
+    if (isInitializedMethod == NULL) {
+      (*env)->ExceptionClear(env);
+      (*env)->DeleteLocalRef(env, localClass);
+      return JNI_FALSE;
+    }
+    isFlightRecorderInitializedMethod = isInitializedMethod;
+    flightRecorderClass = (*env)->NewGlobalRef(env, localClass);
+    (*env)->DeleteLocalRef(env, localClass);
+    if (flightRecorderClass == NULL) {
+      return JNI_FALSE;
+    }
+    flightRecorderMissing = JNI_FALSE;
+  }
+  jboolean initialized = (*env)->CallStaticBooleanMethod(env, flightRecorderClass, isFlightRecorderInitializedMethod);
+  if ((*env)->ExceptionCheck(env) == JNI_TRUE) {
+    (*env)->ExceptionClear(env);
+    return JNI_FALSE;
+  }
+  return initialized;
+}
+
+jint initializeReporting(jvmtiEnv *jvmti, JNIEnv *env);
+jint startMonitoring(jvmtiEnv *jvmti, JNIEnv *env);
+
+// lazy=true, defines the events once a critical was seen or JFR was initialized, attempted only once
+jboolean initializeLazily(jvmtiEnv *jvmti, JNIEnv *env) {
+  if (lazyAttempted) {
+    return JNI_FALSE;
+  }
+  if (!atomic_load_explicit(&idleCriticalSeen, memory_order_relaxed) && !isFlightRecorderInitialized(env)) {
+    return JNI_FALSE;
+  }
+  lazyAttempted = JNI_TRUE;
+  if (initializeReporting(jvmti, env) != JNI_OK) {
+    fprintf(stderr, "defining the events failed, criticals are not reported\n");
+    return JNI_FALSE;
+  }
+  return startMonitoring(jvmti, env) == JNI_OK;
+}
+
+// marks the threads that were running when the agent was attached once they are seen outside of native code
+// from then on all their criticals went through an agent table, a critical can only be held in native code
+void markCountedThreads(jvmtiEnv *jvmti, JNIEnv *env) {
+  jint threadCount;
+  jthread *threads;
+  jvmtiError tiErr = (*jvmti)->GetAllThreads(jvmti, &threadCount, &threads);
+  if (tiErr != JVMTI_ERROR_NONE) {
+    fprintf(stderr, "GetAllThreads (JVMTI) failed with error(%d)\n", tiErr);
+    return;
+  }
+  jboolean uncounted = JNI_FALSE;
+  for (jint i = 0; i < threadCount; i++) {
+    void *data = NULL;
+    jint state = 0;
+    if ((*jvmti)->GetThreadLocalStorage(jvmti, threads[i], &data) == JVMTI_ERROR_NONE && data == NULL) {
+      if ((*jvmti)->GetThreadState(jvmti, threads[i], &state) == JVMTI_ERROR_NONE
+          && (state & JVMTI_THREAD_STATE_IN_NATIVE) == 0) {
+        (*jvmti)->SetThreadLocalStorage(jvmti, threads[i], &depthCountedMarker);
+      } else {
+        uncounted = JNI_TRUE;
+      }
+    }
+    (*env)->DeleteLocalRef(env, threads[i]);
+  }
+  (*jvmti)->Deallocate(jvmti, (unsigned char *) threads);
+  uncountedThreads = uncounted;
+}
+
+void reporterTick(jvmtiEnv *jvmti, JNIEnv *env) {
+  if (uncountedThreads) {
+    markCountedThreads(jvmti, env);
+  }
+  if (!atomic_load_explicit(&jfrInfoReady, memory_order_acquire)
+      && (!agentOptions.lazy || !initializeLazily(jvmti, env))) {
+    // nothing can be reported without the events
+    return;
+  }
+  if (agentOptions.onDemand) {
+    updateRedirection(jvmti, env);
+  }
+  // before flushThreadStates, thread states of holders must not be released before they are reported
+  if (agentOptions.gcStalls) {
+    reportGcStalls(env);
+  }
+  if (usesThreadStates()) {
+    flushThreadStates(jvmti, env);
+  }
+  jlong now = nanoTime();
+  jboolean periodic = now >= nextPeriodNanos;
+  if (agentOptions.stackDepth > 0) {
+    // every period all stacks are defined again so that recordings started later can resolve them
+    reportStackDefinitions(jvmti, env, periodic);
+  }
+  if (periodic) {
+    reportPeriodicEvents(env);
+    nextPeriodNanos = now + agentOptions.periodMillis * 1000000L;
+  }
+}
+
+// whether the critical entered from the native return address passes the libraries and excludeLibraries options
+static inline jboolean isLibraryReported(void *callSite) {
+  if (agentOptions.libraryCount == 0 && agentOptions.excludedLibraryCount == 0) {
+    return JNI_TRUE;
+  }
+  return nativeLibraryReported(nativeLibraryOf(callSite));
+}
+
+// whether the current call is the sampled one, unsampled counts the calls of the thread skipped since the last one
+static inline jboolean isNextSample(jint *unsampled) {
+  // raised by the governor if the agent exceeds its budget
+  jint interval = atomic_load_explicit(&governedSampleInterval, memory_order_relaxed);
+  if (interval > 1) {
+    *unsampled += 1;
+    if (*unsampled < interval) {
+      return JNI_FALSE;
+    }
+    *unsampled = 0;
+  }
+  return JNI_TRUE;
+}
+
+static inline jboolean isSampled(jint method) {
+  if ((agentOptions.methods & (1 << method)) == 0) {
+    return JNI_FALSE;
+  }
+  return isNextSample(&unsampledCriticals);
+}
+
+// publishes the outermost critical for GC stalls and the watchdog, independent of sampling
+static inline void enterOutermost(struct ThreadState *state, jint method) {
+  outermostTracked = JNI_TRUE;
+  if (agentOptions.gcStalls) {
+    // every critical can delay a garbage collection
+    gcStallsEnter(state, method, nanoTime());
+  } else if (agentOptions.watchdogNanos > 0 && state != NULL) {
+    inFlightEnter(&state->inFlight, method, nanoTime());
+  }
+}
+
+// called once the outermost critical was released, endNanos is only needed for GC stalls
+static inline void exitOutermost(jlong endNanos) {
+  if (!outermostTracked) {
+    // acquired through the idle table or before the agent was attached
+    return;
+  }
+  outermostTracked = JNI_FALSE;
+  if (agentOptions.gcStalls) {
+    gcStallsExit(currentThreadState, endNanos);
+  } else if (agentOptions.watchdogNanos > 0 && currentThreadState != NULL) {
+    inFlightExit(&currentThreadState->inFlight);
+  }
+}
+
+// forgets all criticals of the thread without recording them, makes no JNI calls
+void discardCriticals(void) {
+  if (outermostTracked && agentOptions.gcStalls) {
+    gcStallsAbandon(currentThreadState);
+  } else if (outermostTracked && agentOptions.watchdogNanos > 0 && currentThreadState != NULL) {
+    inFlightExit(&currentThreadState->inFlight);
+  }
+  outermostTracked = JNI_FALSE;
+  criticals = 0;
+  frameCount = 0;
+  pendingCount = 0;
+  pinnedEntry = HOT_ARRAY_NONE;
+}
+
+// whether every critical of the current thread went through an agent table
+static jboolean isDepthCounted(void) {
+  if (loadedAtStartup) {
+    return JNI_TRUE;
+  }
+  void *data = NULL;
+  // does not transition into the VM, allowed while a critical acquired through the original table may be held
+  jvmtiError tiErr = (*agentJvmti)->GetThreadLocalStorage(agentJvmti, NULL, &data);
+  return tiErr == JVMTI_ERROR_NONE && data != NULL;
+}
+
+jboolean *beginCritical(JNIEnv *env, jint method, jobject object, jboolean *isCopy, void *callSite) {
   criticals += 1;
-  jboolean *actualCopy;
+  jboolean recorded;
   if (criticals == 1) {
-    if (isCopy == NULL) {
-      // always request the information whether a copy was made
-      actualCopy = &callInfo.witness;
-    } else {
-      actualCopy = isCopy;
+    if (!depthKnown) {
+      depthKnown = isDepthCounted();
+    }
+    if (!depthKnown) {
+      // may be nested in a critical acquired before the agent was attached, no JNI calls are allowed
+      return isCopy;
+    }
+    // no JNI calls are allowed once the critical is held, acquire the thread state now
+    struct ThreadState *state = NULL;
+    if (usesThreadStates()) {
+      state = getThreadState(agentJvmti, env);
+    }
+    enterOutermost(state, method);
+    if (agentOptions.hotArrays > 0 && method == GET_PRIMITIVE_ARRAY_CRITICAL) {
+      // every pin counts, independent of sampling
+      pinnedEntry = hotArraysPin(agentJvmti, env, object);
+    }
+    nestedCriticals = 0;
+    maxDepth = 1;
+    // probes mode only fires the probes, filtered libraries do not count towards the sample interval
+    recorded = agentOptions.mode != MODE_PROBES && isLibraryReported(callSite) && isSampled(method);
+  } else {
+    nestedCriticals += 1;
+    if (criticals > maxDepth) {
+      maxDepth = criticals;
+    }
+    // nested criticals are recorded together with the outermost one
+    recorded = agentOptions.nested && frameCount > 0 && frames[0].recorded
+        && (agentOptions.methods & (1 << method)) != 0 && isLibraryReported(callSite);
+  }
+  if (frameCount == MAX_CRITICAL_DEPTH) {
+    // too deeply nested, only counted
+    return isCopy;
+  }
+
+  struct CallInfo *frame = &frames[frameCount];
+  frameCount += 1;
+  frame->recorded = recorded;
+  frame->depth = criticals;
+  frame->carray = NULL;
+  if (!recorded) {
+    // neither timed nor reported, don't touch isCopy
+    return isCopy;
+  }
+  if (isCopy == NULL) {
+    // always request the information whether a copy was made
+    frame->isCopy = &frame->witness;
+  } else {
+    frame->isCopy = isCopy;
+  }
+  frame->method = method;
+  frame->callSite = callSite;
+  frame->object = object;
+  frame->coder = STRING_CODER_UNKNOWN;
+  if (agentOptions.mode == MODE_AGGREGATE && method == GET_STRING_CRITICAL && criticals == 1) {
+    // aggregate mode records on release, read the coder while JNI calls are still allowed
+    frame->coder = stringCoder(env, object);
+  }
+  return frame->isCopy;
+}
+
+// nanoTime() when the agent measures its own overhead, 0 otherwise
+static inline jlong overheadStart(void) {
+  return measuresOverhead() ? nanoTime() : 0L;
+}
+
+// adds the time since sinceNanos minus the time spent in the original function to the overhead of the thread
+static inline void overheadEnd(jlong sinceNanos, jlong originalNanos) {
+  struct ThreadState *state = currentThreadState;
+  if (state != NULL) {
+    overheadCountersRecord(&state->overhead, nanoTime() - sinceNanos - originalNanos);
+  }
+}
+
+// whether the critical entered by beginCritical is timed, taken right before Get*Critical
+static inline jboolean isAcquireTimed(void) {
+  return measuresOverhead() || (criticals == 1 && pinnedEntry != HOT_ARRAY_NONE)
+      || (frameCount > 0 && frames[frameCount - 1].depth == criticals && frames[frameCount - 1].recorded);
+}
+
+// whether the time after Release*Critical is needed, nested criticals are only recorded if the outermost one is
+static inline jboolean isReleaseTimed(void) {
+  return measuresOverhead() || agentOptions.gcStalls || pinnedEntry != HOT_ARRAY_NONE || (frameCount > 0 && frames[0].recorded);
+}
+
+// called right after Get*Critical returned, startNanos is 0 if not timed, returns the time the critical was acquired
+static inline jlong acquiredCritical(const void *carray, jlong startNanos, jlong entryNanos) {
+  jlong acquiredNanos = startNanos != 0L ? nanoTime() : 0L;
+  struct CallInfo *frame = NULL;
+  if (frameCount > 0 && frames[frameCount - 1].depth == criticals) {
+    frame = &frames[frameCount - 1];
+  }
+  if (carray != NULL) {
+    if (frame != NULL) {
+      frame->carray = carray;
+      frame->startNanos = startNanos;
+      frame->acquiredNanos = acquiredNanos;
+    }
+    if (criticals == 1) {
+      pinnedNanos = acquiredNanos;
     }
-    callInfo.isCopy = actualCopy;
-    beginEvent(env, jfrInfo.getStringCritical);
   } else {
-   // since we don't create an event, we don't really care about whether a copy was made or not
-    actualCopy = isCopy;
+    // failed, there will be no release
+    if (frame != NULL) {
+      frameCount -= 1;
+    }
+    criticals -= 1;
+    if (criticals == 0) {
+      exitOutermost(agentOptions.gcStalls && outermostTracked ? nanoTime() : 0L);
+      // the array was not pinned
+      pinnedEntry = HOT_ARRAY_NONE;
+    }
+  }
+  if (measuresOverhead()) {
+    overheadEnd(entryNanos, acquiredNanos - startNanos);
+  }
+  return acquiredNanos;
+}
+
+// criticals are usually released in reverse order but JNI does not require it
+static inline jint findFrame(const void *carray) {
+  for (jint i = frameCount - 1; i >= 0; i--) {
+    if (frames[i].carray == carray) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// records a released critical, events are only created once all criticals are released
+void finishFrame(const struct CallInfo *frame, jlong endNanos) {
+  jlong holdNanos = endNanos - frame->acquiredNanos;
+  struct ThreadState *state = currentThreadState;
+  if (agentOptions.histogram && state != NULL) {
+    histogramShardRecord(&state->histograms[frame->method], holdNanos);
+  }
+  if (agentOptions.mode == MODE_AGGREGATE) {
+    // the threshold does not apply, the summary covers all sampled criticals
+    struct CallSite *site = findCallSite(frame->callSite, frame->method);
+    callSiteRecord(site, holdNanos, *frame->isCopy, frame->coder);
+    return;
+  }
+  if (holdNanos < agentOptions.thresholdNanos) {
+    return;
+  }
+  // keep a slot for the outermost critical
+  jint capacity = frame->depth == 1 ? MAX_PENDING_CRITICALS : MAX_PENDING_CRITICALS - 1;
+  if (pendingCount >= capacity) {
+    return;
+  }
+  struct PendingCritical *pending = &pendingCriticals[pendingCount];
+  pendingCount += 1;
+  pending->object = frame->object;
+  struct CriticalRecord *record = &pending->record;
+  record->startNanos = frame->startNanos;
+  record->acquiredNanos = frame->acquiredNanos;
+  record->endNanos = endNanos;
+  record->callSite = frame->callSite;
+  record->method = frame->method;
+  record->isCopy = *frame->isCopy;
+  record->depth = frame->depth;
+}
+
+// reports the released criticals, no critical is held any more so JNI calls are allowed
+void reportPendingCriticals(JNIEnv *env) {
+  struct ThreadState *state = currentThreadState;
+  // still inside Release*Critical, the Java frames are the same as while the criticals were held
+  jint stackId = STACK_ID_UNKNOWN;
+  if (agentOptions.stackDepth > 0) {
+    stackId = captureStack(agentJvmti, agentOptions.stackDepth);
+  }
+  for (jint i = 0; i < pendingCount; i++) {
+    struct CriticalRecord *record = &pendingCriticals[i].record;
+    jobject object = pendingCriticals[i].object;
+    if (record->method == GET_STRING_CRITICAL) {
+      record->length = (*env)->GetStringLength(env, object);
+      record->elementType = ARRAY_TYPE_CHAR;
+      record->coder = (jbyte) stringCoder(env, object);
+    } else {
+      record->length = (*env)->GetArrayLength(env, object);
+      record->elementType = arrayType(env, object);
+      record->coder = STRING_CODER_UNKNOWN;
+    }
+    if (record->depth == 1) {
+      record->nestedCriticals = nestedCriticals;
+      record->maxDepth = maxDepth;
+    } else {
+      record->nestedCriticals = 0;
+      record->maxDepth = 0;
+    }
+    record->stackId = stackId;
+
+    if (agentOptions.mode == MODE_ASYNC) {
+      if (state != NULL) {
+        ringBufferOffer(&state->ring, record);
+      }
+    } else if (agentOptions.mode == MODE_TRACE) {
+      traceFileWrite(agentJvmti, env, record);
+    } else {
+      commitCriticalEvent(env, record, NULL);
+    }
+  }
+  pendingCount = 0;
+}
+
+static inline void removeFrame(jint index) {
+  frameCount -= 1;
+  for (jint i = index; i < frameCount; i++) {
+    frames[i] = frames[i + 1];
+  }
+}
+
+// called right after Release*Critical returned, releasedNanos is 0 if not timed
+void endCritical(JNIEnv *env, const void *carray, jlong releasedNanos) {
+  if (criticals == 0) {
+    // acquired before the agent was attached
+    discardCriticals();
+    return;
+  }
+  jint index = findFrame(carray);
+  if (index >= 0) {
+    const struct CallInfo *frame = &frames[index];
+    if (frame->recorded) {
+      // not timed if the outermost critical was released first
+      finishFrame(frame, releasedNanos != 0L ? releasedNanos : nanoTime());
+    }
+    removeFrame(index);
+  }
+  criticals -= 1;
+  if (criticals == 0) {
+    exitOutermost(releasedNanos);
+    if (pinnedEntry != HOT_ARRAY_NONE) {
+      hotArraysRecord(pinnedEntry, (releasedNanos != 0L ? releasedNanos : nanoTime()) - pinnedNanos);
+      pinnedEntry = HOT_ARRAY_NONE;
+    }
+    if (pendingCount > 0) {
+      // inside an agent call, detachAgent waits for it before the global references are deleted
+      if (atomic_load_explicit(&jfrInfoReady, memory_order_acquire)) {
+        reportPendingCriticals(env);
+      } else {
+        pendingCount = 0;
+      }
+    }
+  }
+}
+
+void commitCopyEvent(JNIEnv *env, jint function, jlong bytes, jboolean copied, jlong nanos) {
+  jobject event = newEvent(env, jfrInfo.copyFactory);
+  if (event == NULL) {
+    return;
+  }
+  if (setEventField(env, event, COPY_FUNCTION_NAME_FIELD, copyFunctionName(function))
+      && setLongEventField(env, event, COPY_BYTES_FIELD, bytes)
+      && setEventField(env, event, COPY_IS_COPY_FIELD, copied ? jfrInfo.trueObject : jfrInfo.falseObject)
+      && setLongEventField(env, event, COPY_TIME_FIELD, nanos)) {
+    commitEvent(env, event);
+  }
+  (*env)->DeleteLocalRef(env, event);
+}
+
+// CopyListener in sync mode, sample and threshold apply the same way as for criticals
+void reportCopy(JNIEnv *env, jint function, jlong bytes, jboolean copied, jlong nanos) {
+  if (!isNextSample(&unsampledCopies)) {
+    return;
+  }
+  if (nanos < agentOptions.thresholdNanos) {
+    return;
+  }
+  // called inside an agent call of the copy interceptor
+  if (atomic_load_explicit(&jfrInfoReady, memory_order_acquire)) {
+    commitCopyEvent(env, function, bytes, copied, nanos);
+  }
+}
+
+// number of criticals still held once the one being released is released
+static inline jint depthAfterRelease(void) {
+  return criticals > 0 ? criticals - 1 : 0;
+}
+
+// the idle table only counts the depth, a critical acquired through the redirected table may be held
+// no JNI calls are made and nothing is recorded
+
+// with lazy=true the reporter thread defines the events once a critical was seen
+static inline void seenIdleCritical(void) {
+  // only the first critical writes, the idle table stays installed with onDemand
+  if (!atomic_load_explicit(&idleCriticalSeen, memory_order_relaxed)) {
+    atomic_store_explicit(&idleCriticalSeen, JNI_TRUE, memory_order_relaxed);
+  }
+}
+
+// a critical released through the idle table is forgotten
+static inline void forgetCritical(const void *carray) {
+  if (criticals <= 1) {
+    // the outermost critical or one acquired before the agent was attached
+    discardCriticals();
+    return;
+  }
+  jint index = findFrame(carray);
+  if (index >= 0) {
+    removeFrame(index);
+  }
+  criticals -= 1;
+}
+
+const jchar * IdleGetStringCritical(JNIEnv *env, jstring string, jboolean *isCopy) {
+  const jchar *carray = originalJNIFunctions->GetStringCritical(env, string, isCopy);
+  if (carray != NULL) {
+    criticals += 1;
+    seenIdleCritical();
+  }
+  return carray;
+}
+
+void IdleReleaseStringCritical(JNIEnv *env, jstring string, const jchar *carray) {
+  originalJNIFunctions->ReleaseStringCritical(env, string, carray);
+  forgetCritical(carray);
+}
+
+void * IdleGetPrimitiveArrayCritical(JNIEnv *env, jarray array, jboolean *isCopy) {
+  void *carray = originalJNIFunctions->GetPrimitiveArrayCritical(env, array, isCopy);
+  if (carray != NULL) {
+    criticals += 1;
+    seenIdleCritical();
   }
-  return originalJNIFunctions->GetStringCritical(env, string, actualCopy);
+  return carray;
 }
 
-void endJfrEvent(JNIEnv *env) {
-  jboolean wasCopy = *callInfo.isCopy;
-  jobject wasCopyObject = wasCopy == JNI_TRUE ? jfrInfo.trueObject : jfrInfo.falseObject;
-  endEvent(env, wasCopyObject);
+void IdleReleasePrimitiveArrayCritical(JNIEnv *env, jarray array, void *carray, jint mode) {
+  originalJNIFunctions->ReleasePrimitiveArrayCritical(env, array, carray, mode);
+  forgetCritical(carray);
+}
+
+// the timestamps are taken right around the original functions so that the acquire and hold time don't include the agent
+// the probes cost a NOP and a load of their semaphore unless a tracer is attached
+
+const jchar * RedirectedGetStringCritical(JNIEnv *env, jstring string, jboolean *isCopy) {
+  if (!agentCallEnter()) {
+    // detaching, the global references may already be deleted
+    return IdleGetStringCritical(env, string, isCopy);
+  }
+  jlong entryNanos = overheadStart();
+  jboolean probed = PROBE_ENABLED(get_string_critical);
+  jboolean *actualCopy = beginCritical(env, GET_STRING_CRITICAL, string, isCopy, __builtin_return_address(0));
+  jboolean probeCopy = JNI_FALSE;
+  jint length = -1;
+  jint depth = criticals;
+  if (probed) {
+    if (actualCopy == NULL) {
+      actualCopy = &probeCopy;
+    }
+    if (depth == 1 && outermostTracked) {
+      length = originalJNIFunctions->GetStringLength(env, string);
+    }
+  }
+  jlong startNanos = isAcquireTimed() || probed ? nanoTime() : 0L;
+  const jchar *carray = originalJNIFunctions->GetStringCritical(env, string, actualCopy);
+  jlong acquiredNanos = acquiredCritical(carray, startNanos, entryNanos);
+  if (probed) {
+    PROBE_GET_CRITICAL(get_string_critical, carray, length, *actualCopy, depth, startNanos, acquiredNanos);
+  }
+  agentCallExit();
+  return carray;
 }
 
 void RedirectedReleaseStringCritical(JNIEnv *env, jstring string, const jchar *carray) {
+  if (!agentCallEnter()) {
+    IdleReleaseStringCritical(env, string, carray);
+    return;
+  }
+  jboolean probed = PROBE_ENABLED(release_string_critical);
+  jboolean timed = isReleaseTimed() || probed;
   originalJNIFunctions->ReleaseStringCritical(env, string, carray);
-  if (criticals == 1) {
-    endJfrEvent(env);
+  jlong releasedNanos = timed ? nanoTime() : 0L;
+  if (probed) {
+    PROBE_RELEASE_CRITICAL(release_string_critical, carray, 0, depthAfterRelease(), releasedNanos);
   }
-  criticals -= 1;
+  endCritical(env, carray, releasedNanos);
+  if (measuresOverhead()) {
+    overheadEnd(releasedNanos, 0L);
+  }
+  agentCallExit();
 }
 
 void * RedirectedGetPrimitiveArrayCritical(JNIEnv *env, jarray array, jboolean *isCopy) {
-  criticals += 1;
-  jboolean *actualCopy;
-  if (criticals == 1) {
-    if (isCopy == NULL) {
-      // always request the information whether a copy was made
-      actualCopy = &callInfo.witness;
-    } else {
-      actualCopy = isCopy;
+  if (!agentCallEnter()) {
+    return IdleGetPrimitiveArrayCritical(env, array, isCopy);
+  }
+  jlong entryNanos = overheadStart();
+  jboolean probed = PROBE_ENABLED(get_primitive_array_critical);
+  jboolean *actualCopy = beginCritical(env, GET_PRIMITIVE_ARRAY_CRITICAL, array, isCopy, __builtin_return_address(0));
+  jboolean probeCopy = JNI_FALSE;
+  jint length = -1;
+  jint depth = criticals;
+  if (probed) {
+    if (actualCopy == NULL) {
+      actualCopy = &probeCopy;
     }
-    callInfo.isCopy = actualCopy;
-    beginEvent(env, jfrInfo.getPrimitiveArrayCritical);
-  } else {
-   // since we don't create an event, we don't really care about whether a copy was made or not
-    actualCopy = isCopy;
+    if (depth == 1 && outermostTracked) {
+      length = originalJNIFunctions->GetArrayLength(env, array);
+    }
+  }
+  jlong startNanos = isAcquireTimed() || probed ? nanoTime() : 0L;
+  void *carray = originalJNIFunctions->GetPrimitiveArrayCritical(env, array, actualCopy);
+  jlong acquiredNanos = acquiredCritical(carray, startNanos, entryNanos);
+  if (probed) {
+    PROBE_GET_CRITICAL(get_primitive_array_critical, carray, length, *actualCopy, depth, startNanos, acquiredNanos);
   }
-  return originalJNIFunctions->GetPrimitiveArrayCritical(env, array, isCopy);
+  agentCallExit();
+  return carray;
 }
 
 void RedirectedReleasePrimitiveArrayCritical(JNIEnv *env, jarray array, void *carray, jint mode) {
+  if (!agentCallEnter()) {
+    IdleReleasePrimitiveArrayCritical(env, array, carray, mode);
+    return;
+  }
+  jboolean probed = PROBE_ENABLED(release_primitive_array_critical);
+  jboolean timed = isReleaseTimed() || probed;
   originalJNIFunctions->ReleasePrimitiveArrayCritical(env, array, carray, mode);
-  if (criticals == 1) {
-    endJfrEvent(env);
+  jlong releasedNanos = timed ? nanoTime() : 0L;
+  if (probed) {
+    PROBE_RELEASE_CRITICAL(release_primitive_array_critical, carray, mode, depthAfterRelease(), releasedNanos);
   }
-  criticals -= 1;
+  endCritical(env, carray, releasedNanos);
+  if (measuresOverhead()) {
+    overheadEnd(releasedNanos, 0L);
+  }
+  agentCallExit();
 }
 
-jint redirectJniCriticals(jvmtiEnv *jvmti) {
-
+// copies the original table into the idle table, the original table is saved first
+jint createIdleTable(jvmtiEnv *jvmti) {
   jvmtiError tiErr = (*jvmti)->GetJNIFunctionTable(jvmti, &originalJNIFunctions);
   if (tiErr != JVMTI_ERROR_NONE) {
     fprintf(stderr, "GetJNIFunctionTable (JVMTI) failed with error(%d)\n", tiErr);
     return JNI_ERR;
   }
-  tiErr = (*jvmti)->GetJNIFunctionTable(jvmti, &redirectedJNIFunctions);
+  tiErr = (*jvmti)->GetJNIFunctionTable(jvmti, &idleJNIFunctions);
+  if (tiErr != JVMTI_ERROR_NONE) {
+    fprintf(stderr, "GetJNIFunctionTable (JVMTI) failed with error(%d)\n", tiErr);
+    return JNI_ERR;
+  }
+  idleJNIFunctions->GetStringCritical = IdleGetStringCritical;
+  idleJNIFunctions->ReleaseStringCritical = IdleReleaseStringCritical;
+  idleJNIFunctions->GetPrimitiveArrayCritical = IdleGetPrimitiveArrayCritical;
+  idleJNIFunctions->ReleasePrimitiveArrayCritical = IdleReleasePrimitiveArrayCritical;
+  return JNI_OK;
+}
+
+// lazy=true, installs the idle table at VM start instead of redirectJniCriticals
+jint installIdleTable(jvmtiEnv *jvmti) {
+  if (createIdleTable(jvmti) != JNI_OK) {
+    return JNI_ERR;
+  }
+  return uninstallRedirection(jvmti);
+}
+
+jint redirectJniCriticals(jvmtiEnv *jvmti) {
+  if (redirectedJNIFunctions != NULL) {
+    // attached again after detaching, the tables are still valid
+    return agentOptions.onDemand ? JNI_OK : installRedirection(jvmti);
+  }
+
+  // with lazy=true the idle table was installed at VM start
+  if (idleJNIFunctions == NULL && createIdleTable(jvmti) != JNI_OK) {
+    return JNI_ERR;
+  }
+  // a copy of the idle table only differs in the functions replaced below
+  jvmtiError tiErr = (*jvmti)->GetJNIFunctionTable(jvmti, &redirectedJNIFunctions);
   if (tiErr != JVMTI_ERROR_NONE) {
     fprintf(stderr, "GetJNIFunctionTable (JVMTI) failed with error(%d)\n", tiErr);
     return JNI_ERR;
@@ -633,63 +2378,432 @@ jint redirectJniCriticals(jvmtiEnv *jvmti) {
   redirectedJNIFunctions->ReleaseStringCritical = RedirectedReleaseStringCritical;
   redirectedJNIFunctions->GetPrimitiveArrayCritical = RedirectedGetPrimitiveArrayCritical;
   redirectedJNIFunctions->ReleasePrimitiveArrayCritical = RedirectedReleasePrimitiveArrayCritical;
+  if (agentOptions.copies) {
+    redirectJniCopies(jvmti, originalJNIFunctions, redirectedJNIFunctions, agentOptions.mode == MODE_SYNC ? &reportCopy : NULL);
+  }
+  // last, the wrappers forward to the functions redirected so far
+  if (agentOptions.transitions && redirectJniTransitions(redirectedJNIFunctions, agentOptions.transitionSample) != JNI_OK) {
+    return JNI_ERR;
+  }
 
-  tiErr = (*jvmti)->SetJNIFunctionTable(jvmti, redirectedJNIFunctions);
+  if (agentOptions.onDemand) {
+    // installed by the reporter thread once a recording has the event enabled, the idle table counts the depth until then
+    return uninstallRedirection(jvmti);
+  }
   //(*jvmti)->Deallocate(jvmti, (unsigned char*) redirectedJNIFunctions);
-  if (tiErr != JVMTI_ERROR_NONE) {
-    fprintf(stderr, "SetJNIFunctionTable (JVMTI) failed with error(%d)\n", tiErr);
+  return installRedirection(jvmti);
+
+}
+
+// defines the events and redirects the JNI functions
+jint initializeReporting(jvmtiEnv *jvmti, JNIEnv *env) {
+  if (createEventFactory(env) != JNI_OK) {
     return JNI_ERR;
   }
+  // before the redirected functions can read jfrInfo
+  atomic_store_explicit(&jfrInfoReady, JNI_TRUE, memory_order_release);
+  return redirectJniCriticals(jvmti);
+}
+
+void JNICALL cbVMStart(jvmtiEnv *jvmti_env, JNIEnv* jni_env) {
+  if (agentOptions.lazy) {
+    // no JFR classes are loaded during startup, the reporter thread defines the events later
+    installIdleTable(jvmti_env);
+    return;
+  }
+  initializeReporting(jvmti_env, jni_env);
+}
+
+// starts CriticalMonitor if it is on the class path, a failure does not prevent the events from being reported
+void startMonitor(JNIEnv *env) {
+  jclass monitorClass = (*env)->FindClass(env, "com/github/marschall/jnicriticalreporter/CriticalMonitor");
+  if (monitorClass == NULL) {
+    fprintf(stderr, "FindClass(com/github/marschall/jnicriticalreporter/CriticalMonitor) failed, is the jar on the class path?\n");
+    (*env)->ExceptionClear(env);
+    return;
+  }
+  jmethodID startMethod = (*env)->GetStaticMethodID(env, monitorClass, "start", "()Lcom/github/marschall/jnicriticalreporter/CriticalMonitor;");
+  if (startMethod == NULL) {
+    fprintf(stderr, "GetStaticMethodID(CriticalMonitor#start) failed\n");
+    (*env)->ExceptionClear(env);
+    (*env)->DeleteLocalRef(env, monitorClass);
+    return;
+  }
+  // the MBean server keeps the monitor alive
+  jobject monitor = (*env)->CallStaticObjectMethod(env, monitorClass, startMethod);
+  if ((*env)->ExceptionCheck(env)) {
+    fprintf(stderr, "CriticalMonitor.start() failed\n");
+    (*env)->ExceptionDescribe(env);
+    (*env)->ExceptionClear(env);
+  }
+  if (monitor != NULL) {
+    (*env)->DeleteLocalRef(env, monitor);
+  }
+  (*env)->DeleteLocalRef(env, monitorClass);
+}
+
+jint startReporting(jvmtiEnv *jvmti, JNIEnv *env) {
+  if (agentOptions.mode == MODE_ASYNC || agentOptions.mode == MODE_AGGREGATE || agentOptions.histogram || agentOptions.gcStalls || agentOptions.copies || agentOptions.onDemand
+      || agentOptions.stackDepth > 0 || measuresOverhead() || agentOptions.watchdogNanos > 0 || agentOptions.hotArrays > 0
+      || agentOptions.transitions || agentOptions.lazy || uncountedThreads) {
+    nextPeriodNanos = nanoTime() + agentOptions.periodMillis * 1000000L;
+    jboolean flushes = agentOptions.mode == MODE_ASYNC || agentOptions.gcStalls || agentOptions.onDemand || agentOptions.stackDepth > 0
+        || agentOptions.lazy || uncountedThreads;
+    if (flushes && agentOptions.flushIntervalMillis < agentOptions.periodMillis) {
+      reporterThread.intervalMillis = agentOptions.flushIntervalMillis;
+    } else {
+      reporterThread.intervalMillis = agentOptions.periodMillis;
+    }
+    if (startAgentThread(jvmti, env, &reporterThread) != JNI_OK) {
+      return JNI_ERR;
+    }
+  }
+  if (!atomic_load_explicit(&jfrInfoReady, memory_order_acquire)) {
+    // lazy=true, started by the reporter thread once the events are defined
+    return JNI_OK;
+  }
+  return startMonitoring(jvmti, env);
+}
+
+// starts the monitor and the threads that use jfrInfo
+jint startMonitoring(jvmtiEnv *jvmti, JNIEnv *env) {
+  if (agentOptions.jmx) {
+    startMonitor(env);
+  }
+  if (agentOptions.watchdogNanos > 0) {
+    watchdogThread.intervalMillis = agentOptions.watchdogIntervalMillis;
+    if (startAgentThread(jvmti, env, &watchdogThread) != JNI_OK) {
+      return JNI_ERR;
+    }
+  }
+  if (agentOptions.budget > 0.0) {
+    governorThread.intervalMillis = agentOptions.budgetIntervalMillis;
+    return startAgentThread(jvmti, env, &governorThread);
+  }
   return JNI_OK;
+}
 
+void JNICALL cbVMInit(jvmtiEnv *jvmti_env, JNIEnv* jni_env, jthread thread) {
+  // agent threads can only be started in the live phase
+  startReporting(jvmti_env, jni_env);
 }
 
-void JNICALL cbVMStart(jvmtiEnv *jvmti_env, JNIEnv* jni_env) {
-  createEventFactory(jni_env);
-  redirectJniCriticals(jvmti_env);
+void JNICALL cbVMDeath(jvmtiEnv *jvmti_env, JNIEnv* jni_env) {
+  stopAgentThread(jvmti_env, &governorThread);
+  stopAgentThread(jvmti_env, &watchdogThread);
+  stopAgentThread(jvmti_env, &reporterThread);
+  if (agentOptions.mode == MODE_TRACE) {
+    traceFileSync();
+  }
 }
 
-JNIEXPORT jint JNICALL Agent_OnLoad(JavaVM *jvm, char *options, void *reserved) {
+void JNICALL cbGarbageCollectionStart(jvmtiEnv *jvmti_env) {
+  gcStallsGcStart();
+}
+
+void JNICALL cbGarbageCollectionFinish(jvmtiEnv *jvmti_env) {
+  gcStallsGcFinish();
+}
+
+// when attached, threads started later can't hold a critical acquired through the original table
+void JNICALL cbThreadStart(jvmtiEnv *jvmti_env, JNIEnv* jni_env, jthread thread) {
+  (*jvmti_env)->SetThreadLocalStorage(jvmti_env, NULL, &depthCountedMarker);
+}
+
+void JNICALL cbThreadEnd(jvmtiEnv *jvmti_env, JNIEnv* jni_env, jthread thread) {
+  discardCriticals();
+  retireThreadState();
+  if (agentOptions.hotArrays > 0) {
+    hotArraysThreadEnd(jni_env);
+  }
+  if (agentOptions.transitions) {
+    transitionsThreadEnd();
+  }
+}
+
+void JNICALL cbObjectFree(jvmtiEnv *jvmti_env, jlong tag) {
+  hotArraysFree(tag);
+}
+
+// JVMTI events used after the VM started, GC events only with gcStalls, THREAD_END only with thread states
+jint setEventNotificationModes(jvmtiEnv *jvmti, jvmtiEventMode mode) {
+  jvmtiEvent events[] = { JVMTI_EVENT_VM_DEATH, JVMTI_EVENT_THREAD_START, JVMTI_EVENT_THREAD_END,
+                          JVMTI_EVENT_GARBAGE_COLLECTION_START, JVMTI_EVENT_GARBAGE_COLLECTION_FINISH,
+                          JVMTI_EVENT_OBJECT_FREE };
+  jboolean enabled[] = { JNI_TRUE, !loadedAtStartup, usesThreadStates() || agentOptions.hotArrays > 0 || agentOptions.transitions,
+                         agentOptions.gcStalls, agentOptions.gcStalls, agentOptions.hotArrays > 0 };
+  for (size_t i = 0; i < sizeof(events) / sizeof(events[0]); i++) {
+    if (!enabled[i]) {
+      continue;
+    }
+    jvmtiError error = (*jvmti)->SetEventNotificationMode(jvmti, mode, events[i], (jthread) NULL);
+    if (error != JVMTI_ERROR_NONE) {
+      fprintf(stderr, "SetEventNotificationMode (JVMTI) failed with error(%d)\n", error);
+      return JNI_ERR;
+    }
+  }
+  return JNI_OK;
+}
+
+// everything that is the same for Agent_OnLoad and Agent_OnAttach
+jint initAgent(jvmtiEnv *jvmti) {
   jvmtiEventCallbacks callbacks;
   jvmtiError          error;
-  jvmtiEnv            *jvmti;
-  
-  jint niErr = (*jvm)->GetEnv(jvm, (void**) &jvmti, JVMTI_VERSION_11);
-  if (niErr != JNI_OK) {
-    fprintf(stderr, "GetEnv (JVMTI) failed with error(%d)\n", niErr);
+
+  if (clockInit(agentOptions.clockSource) != JNI_OK) {
+    return JNI_ERR;
+  }
+  // the options may have changed when attaching again
+  nativeLibrariesApplyFilters();
+  governorInit(agentOptions.sampleInterval);
+  if (agentOptions.hotArrays > 0) {
+    hotArraysInit();
+  }
+  if (agentOptions.mode == MODE_AGGREGATE && callSitesInit(agentOptions.callSites) != JNI_OK) {
+    return JNI_ERR;
+  }
+  if (agentOptions.mode == MODE_TRACE
+      && traceFileOpen(agentOptions.traceFile[0] != '\0' ? agentOptions.traceFile : NULL, agentOptions.traceSize) != JNI_OK) {
     return JNI_ERR;
   }
 
   memset(&callbacks, 0, sizeof(callbacks));
   callbacks.VMStart = &cbVMStart;
+  callbacks.VMInit = &cbVMInit;
+  callbacks.VMDeath = &cbVMDeath;
+  callbacks.ThreadStart = &cbThreadStart;
+  callbacks.ThreadEnd = &cbThreadEnd;
+  callbacks.GarbageCollectionStart = &cbGarbageCollectionStart;
+  callbacks.GarbageCollectionFinish = &cbGarbageCollectionFinish;
+  callbacks.ObjectFree = &cbObjectFree;
+
+  if (agentOptions.gcStalls) {
+    jvmtiCapabilities capabilities;
+    memset(&capabilities, 0, sizeof(capabilities));
+    capabilities.can_generate_garbage_collection_events = 1;
+    error = (*jvmti)->AddCapabilities(jvmti, &capabilities);
+    if (error != JVMTI_ERROR_NONE) {
+      fprintf(stderr, "AddCapabilities (JVMTI) failed with error(%d)\n", error);
+      return JNI_ERR;
+    }
+  }
+
+  if (agentOptions.hotArrays > 0) {
+    jvmtiCapabilities capabilities;
+    memset(&capabilities, 0, sizeof(capabilities));
+    capabilities.can_tag_objects = 1;
+    capabilities.can_generate_object_free_events = 1;
+    error = (*jvmti)->AddCapabilities(jvmti, &capabilities);
+    if (error != JVMTI_ERROR_NONE) {
+      fprintf(stderr, "AddCapabilities (JVMTI) failed with error(%d)\n", error);
+      return JNI_ERR;
+    }
+  }
 
   error = (*jvmti)->SetEventCallbacks(jvmti, &callbacks, (jint) sizeof(callbacks));
   if (error != JVMTI_ERROR_NONE) {
-    fprintf(stderr, "SetEventCallbacks (JVMTI) failed with error(%d)\n", niErr);
+    fprintf(stderr, "SetEventCallbacks (JVMTI) failed with error(%d)\n", error);
     return JNI_ERR;
   }
-  error = (*jvmti)->SetEventNotificationMode(jvmti, JVMTI_ENABLE, JVMTI_EVENT_VM_START, (jthread) NULL);
-  if (error != JVMTI_ERROR_NONE) {
-    fprintf(stderr, "SetEventNotificationMode (JVMTI) failed with error(%d)\n", niErr);
+  return setEventNotificationModes(jvmti, JVMTI_ENABLE);
+}
+
+void deleteGlobalRef(JNIEnv *env, jobject *ref) {
+  if (*ref != NULL) {
+    (*env)->DeleteGlobalRef(env, *ref);
+    *ref = NULL;
+  }
+}
+
+void deleteGlobalRefs(JNIEnv *env) {
+  deleteGlobalRef(env, (jobject *) &flightRecorderClass);
+  deleteGlobalRef(env, &jfrInfo.eventFactory);
+  deleteGlobalRef(env, &jfrInfo.bufferOverflowFactory);
+  deleteGlobalRef(env, &jfrInfo.callSiteSummaryFactory);
+  deleteGlobalRef(env, &jfrInfo.holdTimeHistogramFactory);
+  deleteGlobalRef(env, &jfrInfo.gcStallFactory);
+  deleteGlobalRef(env, &jfrInfo.gcStallHolderFactory);
+  deleteGlobalRef(env, &jfrInfo.copyFactory);
+  deleteGlobalRef(env, &jfrInfo.copySummaryFactory);
+  deleteGlobalRef(env, &jfrInfo.stackDefinitionFactory);
+  deleteGlobalRef(env, &jfrInfo.overheadFactory);
+  deleteGlobalRef(env, &jfrInfo.longHeldFactory);
+  deleteGlobalRef(env, &jfrInfo.samplingRateChangeFactory);
+  deleteGlobalRef(env, &jfrInfo.hotArrayFactory);
+  deleteGlobalRef(env, &jfrInfo.transitionProfileFactory);
+  for (jint i = 0; i < jfrInfo.installEventTypeCount; i++) {
+    deleteGlobalRef(env, &jfrInfo.installEventTypes[i]);
+  }
+  deleteGlobalRef(env, (jobject *) &jfrInfo.longClass);
+  deleteGlobalRef(env, (jobject *) &jfrInfo.doubleClass);
+  deleteGlobalRef(env, &jfrInfo.trueObject);
+  deleteGlobalRef(env, &jfrInfo.falseObject);
+  deleteGlobalRef(env, (jobject *) &jfrInfo.getStringCritical);
+  deleteGlobalRef(env, (jobject *) &jfrInfo.getPrimitiveArrayCritical);
+  deleteGlobalRef(env, (jobject *) &jfrInfo.otherCallSite);
+  memset(&jfrInfo, 0, sizeof(jfrInfo));
+  arrayTypesDestroy(env);
+  jniCopiesDestroy(env);
+  nativeLibrariesDestroy(env);
+  callSiteStringsDestroy(env);
+  // the stacks stay interned, they are defined again when attaching again
+  for (jint i = 0; i < STACK_TABLE_CAPACITY; i++) {
+    deleteGlobalRef(env, (jobject *) &stackDefinitions[i]);
+  }
+  // the states stay in use by their threads, only the thread references are released
+  for (struct ThreadState *state = firstThreadState(); state != NULL; state = state->next) {
+    deleteGlobalRef(env, &state->thread);
+  }
+}
+
+// undoes Agent_OnAttach or Agent_OnLoad, called on the attach listener thread
+jint detachAgent(jvmtiEnv *jvmti, JNIEnv *env) {
+  // before installing the idle table so that onDemand does not install the redirected table again
+  stopAgentThread(jvmti, &governorThread);
+  stopAgentThread(jvmti, &watchdogThread);
+  stopAgentThread(jvmti, &reporterThread);
+  if (uninstallRedirection(jvmti) != JNI_OK) {
+    return JNI_ERR;
+  }
+  installed = JNI_FALSE;
+  if (setEventNotificationModes(jvmti, JVMTI_DISABLE) != JNI_OK) {
     return JNI_ERR;
   }
+  // threads that loaded a redirected function before the idle table was installed
+  // from now on they only forward to the original functions, the global references can be deleted
+  agentCallsClose();
+  // criticals still held are released through the idle table and never reported
+  if (agentOptions.hotArrays > 0) {
+    // ObjectFree is disabled, arrays freed while detached would stay live
+    hotArraysReset(jvmti, env);
+  }
+
+  // with lazy=true the events may not have been defined yet
+  if (atomic_load_explicit(&jfrInfoReady, memory_order_acquire)) {
+    if (usesThreadStates()) {
+      flushThreadStates(jvmti, env);
+    }
+    if (agentOptions.gcStalls) {
+      reportGcStalls(env);
+    }
+    reportPeriodicEvents(env);
+    if (agentOptions.stackDepth > 0) {
+      reportStackDefinitions(jvmti, env, JNI_FALSE);
+    }
+  }
+  if (agentOptions.mode == MODE_TRACE) {
+    // the file stays mapped, threads that passed the check may still append
+    traceFileSync();
+  }
+
+  // defined again when attaching again
+  atomic_store(&jfrInfoReady, JNI_FALSE);
+  deleteGlobalRefs(env);
+  attached = JNI_FALSE;
   return JNI_OK;
 }
 
-JNIEXPORT jint JNICALL Agent_OnAttach(JavaVM *jvm, char *options, void *reserved) {
+jboolean isReattachCompatible(const struct AgentOptions *options) {
+  // the generated event class can't be defined again with or without stack traces
+  if (criticalEventClass != NULL && (options->stackDepth > 0) != (agentOptions.stackDepth > 0)) {
+    return JNI_FALSE;
+  }
+  // the redirected function table is kept, the wrappers can't be added or removed
+  if (redirectedJNIFunctions != NULL && options->transitions != agentOptions.transitions) {
+    return JNI_FALSE;
+  }
+  // thread states, the call site table and the redirected function table are kept from the previous options
+  return firstThreadState() == NULL
+      || (options->mode == agentOptions.mode && options->bufferSize == agentOptions.bufferSize
+          && options->callSites == agentOptions.callSites && options->copies == agentOptions.copies);
+}
+
+JNIEXPORT jint JNICALL Agent_OnLoad(JavaVM *jvm, char *options, void *reserved) {
   jvmtiEnv *jvmti;
+
   jint niErr = (*jvm)->GetEnv(jvm, (void**) &jvmti, JVMTI_VERSION_11);
   if (niErr != JNI_OK) {
     fprintf(stderr, "GetEnv (JVMTI) failed with error(%d)\n", niErr);
     return JNI_ERR;
   }
-  return redirectJniCriticals(jvmti);
+  agentJvmti = jvmti;
+  // the first table is installed at VM start before any thread can hold a critical
+  loadedAtStartup = JNI_TRUE;
+
+  if (parseAgentOptions(options, &agentOptions) != JNI_OK) {
+    return JNI_ERR;
+  }
+  if (initAgent(jvmti) != JNI_OK) {
+    return JNI_ERR;
+  }
+  jvmtiEvent events[] = { JVMTI_EVENT_VM_START, JVMTI_EVENT_VM_INIT };
+  for (size_t i = 0; i < 2; i++) {
+    jvmtiError error = (*jvmti)->SetEventNotificationMode(jvmti, JVMTI_ENABLE, events[i], (jthread) NULL);
+    if (error != JVMTI_ERROR_NONE) {
+      fprintf(stderr, "SetEventNotificationMode (JVMTI) failed with error(%d)\n", error);
+      return JNI_ERR;
+    }
+  }
+  attached = JNI_TRUE;
+  return JNI_OK;
 }
 
-JNIEXPORT void JNICALL Agent_OnUnload(JavaVM *jvm) {
-  // jvmtiError Deallocate(jvmtiEnv* env, unsigned char* mem)
+// jcmd <pid> JVMTI.agent_load /path/to/libjni-critical-reporter.so [options|detach]
+JNIEXPORT jint JNICALL Agent_OnAttach(JavaVM *jvm, char *options, void *reserved) {
+  // loading the library again calls Agent_OnAttach again, keep using the first environment
+  jvmtiEnv *jvmti = agentJvmti;
+  if (jvmti == NULL) {
+    jint niErr = (*jvm)->GetEnv(jvm, (void**) &jvmti, JVMTI_VERSION_11);
+    if (niErr != JNI_OK) {
+      fprintf(stderr, "GetEnv (JVMTI) failed with error(%d)\n", niErr);
+      return JNI_ERR;
+    }
+    agentJvmti = jvmti;
+  }
+  JNIEnv *env;
+  jint niErr = (*jvm)->GetEnv(jvm, (void**) &env, JNI_VERSION_10);
+  if (niErr != JNI_OK) {
+    fprintf(stderr, "GetEnv (JNI) failed with error(%d)\n", niErr);
+    return JNI_ERR;
+  }
 
-  // if (eventFactory != NULL)
-  // (*env)->DeleteGlobalRef(env, eventFactory);
+  if (options != NULL && strcmp(options, "detach") == 0) {
+    if (!attached) {
+      fprintf(stderr, "agent is not attached\n");
+      return JNI_ERR;
+    }
+    return detachAgent(jvmti, env);
+  }
+  if (attached) {
+    fprintf(stderr, "agent is already attached, detach first\n");
+    return JNI_ERR;
+  }
+
+  struct AgentOptions newOptions;
+  if (parseAgentOptions(options, &newOptions) != JNI_OK) {
+    return JNI_ERR;
+  }
+  if (!isReattachCompatible(&newOptions)) {
+    fprintf(stderr, "mode, bufferSize, callSites, copies and transitions can not be changed and stacks can not be switched from or to jfr when attaching again\n");
+    return JNI_ERR;
+  }
+  agentOptions = newOptions;
+  agentCallsOpen();
+  // threads running now may hold criticals acquired through the original table, also after a detach
+  // as threads started while detached were not marked
+  uncountedThreads = !loadedAtStartup;
+
+  // lazy only applies to Agent_OnLoad, the VM is already running
+  if (initAgent(jvmti) != JNI_OK
+      || initializeReporting(jvmti, env) != JNI_OK
+      || startReporting(jvmti, env) != JNI_OK) {
+    return JNI_ERR;
+  }
+  attached = JNI_TRUE;
+  return JNI_OK;
 }
 
+JNIEXPORT void JNICALL Agent_OnUnload(JavaVM *jvm) {
+  // only called when the VM shuts down, JNI can no longer be used
+  // global references and native memory are reclaimed with the process
+}
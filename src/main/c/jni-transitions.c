@@ -0,0 +1,224 @@
+#include <jni.h>
+#include <jvmti.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "agent-calls.h"
+#include "clock.h"
+#include "jni-copies.h"
+#include "jni-transitions.h"
+
+
+#define TRANSITION_FUNCTION_NAME(kind, Name, type, parameters, arguments) #Name,
+
+// indexed by enum TransitionFunction
+static const char *transitionFunctionNames[TRANSITION_FUNCTION_COUNT] = {
+  JNI_FUNCTIONS(TRANSITION_FUNCTION_NAME)
+};
+
+#undef TRANSITION_FUNCTION_NAME
+
+// counters of all functions of a single thread
+// instances are never freed, instead they are reused by new threads
+struct TransitionThread {
+  // registry of all instances, immutable once published
+  struct TransitionThread *next;
+  _Atomic jboolean free;
+  struct TransitionCounters counters[TRANSITION_FUNCTION_COUNT];
+};
+
+// the functions the wrappers forward to, a copy of the redirected table before it was wrapped
+static jniNativeInterface *nextFunctions = NULL;
+static jint transitionSampleInterval = 0;
+
+static _Atomic(struct TransitionThread *) transitionThreads = NULL;
+// written by threads that are excluded or whose counters could not be allocated, never merged
+static struct TransitionThread discardedCounters;
+
+static __thread struct TransitionThread *currentTransitionThread = NULL;
+// calls since the last timed call of the current thread
+static __thread jint untimedTransitions = 0;
+
+// must not call JNI, it would be counted again
+static struct TransitionThread *acquireTransitionThread(void) {
+  for (struct TransitionThread *thread = atomic_load_explicit(&transitionThreads, memory_order_acquire);
+       thread != NULL; thread = thread->next) {
+    jboolean expected = JNI_TRUE;
+    if (atomic_load_explicit(&thread->free, memory_order_relaxed)
+        && atomic_compare_exchange_strong(&thread->free, &expected, JNI_FALSE)) {
+      return thread;
+    }
+  }
+  struct TransitionThread *thread = calloc(1, sizeof(struct TransitionThread));
+  if (thread == NULL) {
+    fprintf(stderr, "calloc(TransitionThread) failed\n");
+    return &discardedCounters;
+  }
+  // publish
+  struct TransitionThread *head = atomic_load(&transitionThreads);
+  do {
+    thread->next = head;
+  } while (!atomic_compare_exchange_weak(&transitionThreads, &head, thread));
+  return thread;
+}
+
+static inline struct TransitionCounters *transitionCounters(jint function) {
+  struct TransitionThread *thread = currentTransitionThread;
+  if (thread == NULL) {
+    thread = acquireTransitionThread();
+    currentTransitionThread = thread;
+  }
+  return &thread->counters[function];
+}
+
+// counts the call, returns the start time if the call is timed, 0 otherwise
+static inline jlong transitionEnter(struct TransitionCounters *counters) {
+  incrementCounter(&counters->calls, 1);
+  if (transitionSampleInterval == 0) {
+    return 0L;
+  }
+  untimedTransitions += 1;
+  if (untimedTransitions < transitionSampleInterval) {
+    return 0L;
+  }
+  untimedTransitions = 0;
+  return nanoTime();
+}
+
+static inline void transitionExit(struct TransitionCounters *counters, jlong startNanos) {
+  if (startNanos != 0L) {
+    // nested calls, eg. from Java code called by Call*Method, count again and are included
+    incrementCounter(&counters->timedCalls, 1);
+    incrementCounter(&counters->timedNanos, (uint64_t) (nanoTime() - startNanos));
+  }
+}
+
+// calls made by the agent itself, eg. while reporting a critical on an application thread, are forwarded uncounted
+#define TRANSITION_WRAPPER_FUNCTION(Name, type, parameters, arguments) \
+  static type JNICALL Transition##Name parameters { \
+    if (isInAgentCall()) { \
+      return nextFunctions->Name arguments; \
+    } \
+    struct TransitionCounters *counters = transitionCounters(TRANSITION_##Name); \
+    jlong startNanos = transitionEnter(counters); \
+    type transitionResult = nextFunctions->Name arguments; \
+    transitionExit(counters, startNanos); \
+    return transitionResult; \
+  }
+
+#define TRANSITION_WRAPPER_VOID(Name, type, parameters, arguments) \
+  static void JNICALL Transition##Name parameters { \
+    if (isInAgentCall()) { \
+      nextFunctions->Name arguments; \
+      return; \
+    } \
+    struct TransitionCounters *counters = transitionCounters(TRANSITION_##Name); \
+    jlong startNanos = transitionEnter(counters); \
+    nextFunctions->Name arguments; \
+    transitionExit(counters, startNanos); \
+  }
+
+// every JNI function with variable arguments has methodID as its last named parameter
+#define TRANSITION_WRAPPER_VARARGS(Name, type, parameters, arguments) \
+  static type JNICALL Transition##Name parameters { \
+    va_list vargs; \
+    va_start(vargs, methodID); \
+    if (isInAgentCall()) { \
+      type transitionResult = nextFunctions->Name##V arguments; \
+      va_end(vargs); \
+      return transitionResult; \
+    } \
+    struct TransitionCounters *counters = transitionCounters(TRANSITION_##Name); \
+    jlong startNanos = transitionEnter(counters); \
+    type transitionResult = nextFunctions->Name##V arguments; \
+    transitionExit(counters, startNanos); \
+    va_end(vargs); \
+    return transitionResult; \
+  }
+
+#define TRANSITION_WRAPPER_VARARGS_VOID(Name, type, parameters, arguments) \
+  static void JNICALL Transition##Name parameters { \
+    va_list vargs; \
+    va_start(vargs, methodID); \
+    if (isInAgentCall()) { \
+      nextFunctions->Name##V arguments; \
+      va_end(vargs); \
+      return; \
+    } \
+    struct TransitionCounters *counters = transitionCounters(TRANSITION_##Name); \
+    jlong startNanos = transitionEnter(counters); \
+    nextFunctions->Name##V arguments; \
+    transitionExit(counters, startNanos); \
+    va_end(vargs); \
+  }
+
+#define TRANSITION_WRAPPER(kind, Name, type, parameters, arguments) TRANSITION_WRAPPER_##kind(Name, type, parameters, arguments)
+
+JNI_FUNCTIONS(TRANSITION_WRAPPER)
+
+#undef TRANSITION_WRAPPER
+#undef TRANSITION_WRAPPER_VARARGS_VOID
+#undef TRANSITION_WRAPPER_VARARGS
+#undef TRANSITION_WRAPPER_VOID
+#undef TRANSITION_WRAPPER_FUNCTION
+
+#define REDIRECT_TRANSITION(kind, Name, type, parameters, arguments) redirected->Name = Transition##Name;
+
+jint redirectJniTransitions(jniNativeInterface *redirected, jint sampleInterval) {
+  // never freed, calls may still be in flight after the table was uninstalled
+  nextFunctions = malloc(sizeof(jniNativeInterface));
+  if (nextFunctions == NULL) {
+    fprintf(stderr, "malloc(jniNativeInterface) failed\n");
+    return JNI_ERR;
+  }
+  memcpy(nextFunctions, redirected, sizeof(jniNativeInterface));
+  transitionSampleInterval = sampleInterval;
+
+  JNI_FUNCTIONS(REDIRECT_TRANSITION)
+  return JNI_OK;
+}
+
+#undef REDIRECT_TRANSITION
+
+void transitionsMerge(struct TransitionTotals *totals) {
+  // free instances are included, they may contain values recorded by a thread that ended during the period
+  for (struct TransitionThread *thread = atomic_load_explicit(&transitionThreads, memory_order_acquire);
+       thread != NULL; thread = thread->next) {
+    for (jint i = 0; i < TRANSITION_FUNCTION_COUNT; i++) {
+      struct TransitionCounters *counters = &thread->counters[i];
+      uint64_t calls = atomic_load_explicit(&counters->calls, memory_order_relaxed);
+      if (calls == counters->merged.calls) {
+        // most functions are never called
+        continue;
+      }
+      uint64_t timedCalls = atomic_load_explicit(&counters->timedCalls, memory_order_relaxed);
+      uint64_t timedNanos = atomic_load_explicit(&counters->timedNanos, memory_order_relaxed);
+      totals[i].calls += calls - counters->merged.calls;
+      totals[i].timedCalls += timedCalls - counters->merged.timedCalls;
+      totals[i].timedNanos += timedNanos - counters->merged.timedNanos;
+      counters->merged.calls = calls;
+      counters->merged.timedCalls = timedCalls;
+      counters->merged.timedNanos = timedNanos;
+    }
+  }
+}
+
+void transitionsExcludeCurrentThread(void) {
+  currentTransitionThread = &discardedCounters;
+}
+
+void transitionsThreadEnd(void) {
+  struct TransitionThread *thread = currentTransitionThread;
+  currentTransitionThread = NULL;
+  if (thread != NULL && thread != &discardedCounters) {
+    atomic_store_explicit(&thread->free, JNI_TRUE, memory_order_release);
+  }
+}
+
+const char *transitionFunctionName(jint function) {
+  return transitionFunctionNames[function];
+}
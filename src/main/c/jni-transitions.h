@@ -0,0 +1,175 @@
+#ifndef JNI_TRANSITIONS_H
+#define JNI_TRANSITIONS_H
+
+#include <jni.h>
+#include <jvmti.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// the JNI functions returning and taking values of a type, X(kind, Name, returnType, (parameters), (arguments))
+// kind is FUNCTION, VOID, VARARGS or VARARGS_VOID, the variable arguments are forwarded to NameV as vargs
+#define JNI_TYPED_FUNCTIONS(X, Type, type) \
+  X(VARARGS, Call##Type##Method, type, (JNIEnv *env, jobject obj, jmethodID methodID, ...), (env, obj, methodID, vargs)) \
+  X(FUNCTION, Call##Type##MethodV, type, (JNIEnv *env, jobject obj, jmethodID methodID, va_list args), (env, obj, methodID, args)) \
+  X(FUNCTION, Call##Type##MethodA, type, (JNIEnv *env, jobject obj, jmethodID methodID, const jvalue *args), (env, obj, methodID, args)) \
+  X(VARARGS, CallNonvirtual##Type##Method, type, (JNIEnv *env, jobject obj, jclass clazz, jmethodID methodID, ...), (env, obj, clazz, methodID, vargs)) \
+  X(FUNCTION, CallNonvirtual##Type##MethodV, type, (JNIEnv *env, jobject obj, jclass clazz, jmethodID methodID, va_list args), (env, obj, clazz, methodID, args)) \
+  X(FUNCTION, CallNonvirtual##Type##MethodA, type, (JNIEnv *env, jobject obj, jclass clazz, jmethodID methodID, const jvalue *args), (env, obj, clazz, methodID, args)) \
+  X(VARARGS, CallStatic##Type##Method, type, (JNIEnv *env, jclass clazz, jmethodID methodID, ...), (env, clazz, methodID, vargs)) \
+  X(FUNCTION, CallStatic##Type##MethodV, type, (JNIEnv *env, jclass clazz, jmethodID methodID, va_list args), (env, clazz, methodID, args)) \
+  X(FUNCTION, CallStatic##Type##MethodA, type, (JNIEnv *env, jclass clazz, jmethodID methodID, const jvalue *args), (env, clazz, methodID, args)) \
+  X(FUNCTION, Get##Type##Field, type, (JNIEnv *env, jobject obj, jfieldID fieldID), (env, obj, fieldID)) \
+  X(VOID, Set##Type##Field, void, (JNIEnv *env, jobject obj, jfieldID fieldID, type val), (env, obj, fieldID, val)) \
+  X(FUNCTION, GetStatic##Type##Field, type, (JNIEnv *env, jclass clazz, jfieldID fieldID), (env, clazz, fieldID)) \
+  X(VOID, SetStatic##Type##Field, void, (JNIEnv *env, jclass clazz, jfieldID fieldID, type value), (env, clazz, fieldID, value))
+
+// the JNI functions operating on arrays of a primitive type, same format as JNI_TYPED_FUNCTIONS
+#define JNI_ARRAY_FUNCTIONS(X, Type, type) \
+  X(FUNCTION, New##Type##Array, type##Array, (JNIEnv *env, jsize len), (env, len)) \
+  X(FUNCTION, Get##Type##ArrayElements, type *, (JNIEnv *env, type##Array array, jboolean *isCopy), (env, array, isCopy)) \
+  X(VOID, Release##Type##ArrayElements, void, (JNIEnv *env, type##Array array, type *elems, jint mode), (env, array, elems, mode)) \
+  X(VOID, Get##Type##ArrayRegion, void, (JNIEnv *env, type##Array array, jsize start, jsize len, type *buf), (env, array, start, len, buf)) \
+  X(VOID, Set##Type##ArrayRegion, void, (JNIEnv *env, type##Array array, jsize start, jsize len, const type *buf), (env, array, start, len, buf))
+
+#ifdef JNI_VERSION_21
+#define JNI_21_FUNCTIONS(X) \
+  X(FUNCTION, IsVirtualThread, jboolean, (JNIEnv *env, jobject obj), (env, obj))
+#else
+#define JNI_21_FUNCTIONS(X)
+#endif
+
+// every JNI function up to JNI_VERSION_21 except the four critical functions
+// the critical functions are measured by the critical events, they rely on being called directly from native code
+#define JNI_FUNCTIONS(X) \
+  X(FUNCTION, GetVersion, jint, (JNIEnv *env), (env)) \
+  X(FUNCTION, DefineClass, jclass, (JNIEnv *env, const char *name, jobject loader, const jbyte *buf, jsize len), (env, name, loader, buf, len)) \
+  X(FUNCTION, FindClass, jclass, (JNIEnv *env, const char *name), (env, name)) \
+  X(FUNCTION, FromReflectedMethod, jmethodID, (JNIEnv *env, jobject method), (env, method)) \
+  X(FUNCTION, FromReflectedField, jfieldID, (JNIEnv *env, jobject field), (env, field)) \
+  X(FUNCTION, ToReflectedMethod, jobject, (JNIEnv *env, jclass cls, jmethodID methodID, jboolean isStatic), (env, cls, methodID, isStatic)) \
+  X(FUNCTION, GetSuperclass, jclass, (JNIEnv *env, jclass sub), (env, sub)) \
+  X(FUNCTION, IsAssignableFrom, jboolean, (JNIEnv *env, jclass sub, jclass sup), (env, sub, sup)) \
+  X(FUNCTION, ToReflectedField, jobject, (JNIEnv *env, jclass cls, jfieldID fieldID, jboolean isStatic), (env, cls, fieldID, isStatic)) \
+  X(FUNCTION, Throw, jint, (JNIEnv *env, jthrowable obj), (env, obj)) \
+  X(FUNCTION, ThrowNew, jint, (JNIEnv *env, jclass clazz, const char *msg), (env, clazz, msg)) \
+  X(FUNCTION, ExceptionOccurred, jthrowable, (JNIEnv *env), (env)) \
+  X(VOID, ExceptionDescribe, void, (JNIEnv *env), (env)) \
+  X(VOID, ExceptionClear, void, (JNIEnv *env), (env)) \
+  X(VOID, FatalError, void, (JNIEnv *env, const char *msg), (env, msg)) \
+  X(FUNCTION, PushLocalFrame, jint, (JNIEnv *env, jint capacity), (env, capacity)) \
+  X(FUNCTION, PopLocalFrame, jobject, (JNIEnv *env, jobject result), (env, result)) \
+  X(FUNCTION, NewGlobalRef, jobject, (JNIEnv *env, jobject lobj), (env, lobj)) \
+  X(VOID, DeleteGlobalRef, void, (JNIEnv *env, jobject gref), (env, gref)) \
+  X(VOID, DeleteLocalRef, void, (JNIEnv *env, jobject obj), (env, obj)) \
+  X(FUNCTION, IsSameObject, jboolean, (JNIEnv *env, jobject obj1, jobject obj2), (env, obj1, obj2)) \
+  X(FUNCTION, NewLocalRef, jobject, (JNIEnv *env, jobject ref), (env, ref)) \
+  X(FUNCTION, EnsureLocalCapacity, jint, (JNIEnv *env, jint capacity), (env, capacity)) \
+  X(FUNCTION, AllocObject, jobject, (JNIEnv *env, jclass clazz), (env, clazz)) \
+  X(VARARGS, NewObject, jobject, (JNIEnv *env, jclass clazz, jmethodID methodID, ...), (env, clazz, methodID, vargs)) \
+  X(FUNCTION, NewObjectV, jobject, (JNIEnv *env, jclass clazz, jmethodID methodID, va_list args), (env, clazz, methodID, args)) \
+  X(FUNCTION, NewObjectA, jobject, (JNIEnv *env, jclass clazz, jmethodID methodID, const jvalue *args), (env, clazz, methodID, args)) \
+  X(FUNCTION, GetObjectClass, jclass, (JNIEnv *env, jobject obj), (env, obj)) \
+  X(FUNCTION, IsInstanceOf, jboolean, (JNIEnv *env, jobject obj, jclass clazz), (env, obj, clazz)) \
+  X(FUNCTION, GetMethodID, jmethodID, (JNIEnv *env, jclass clazz, const char *name, const char *sig), (env, clazz, name, sig)) \
+  X(FUNCTION, GetFieldID, jfieldID, (JNIEnv *env, jclass clazz, const char *name, const char *sig), (env, clazz, name, sig)) \
+  X(FUNCTION, GetStaticMethodID, jmethodID, (JNIEnv *env, jclass clazz, const char *name, const char *sig), (env, clazz, name, sig)) \
+  X(FUNCTION, GetStaticFieldID, jfieldID, (JNIEnv *env, jclass clazz, const char *name, const char *sig), (env, clazz, name, sig)) \
+  JNI_TYPED_FUNCTIONS(X, Object, jobject) \
+  JNI_TYPED_FUNCTIONS(X, Boolean, jboolean) \
+  JNI_TYPED_FUNCTIONS(X, Byte, jbyte) \
+  JNI_TYPED_FUNCTIONS(X, Char, jchar) \
+  JNI_TYPED_FUNCTIONS(X, Short, jshort) \
+  JNI_TYPED_FUNCTIONS(X, Int, jint) \
+  JNI_TYPED_FUNCTIONS(X, Long, jlong) \
+  JNI_TYPED_FUNCTIONS(X, Float, jfloat) \
+  JNI_TYPED_FUNCTIONS(X, Double, jdouble) \
+  X(VARARGS_VOID, CallVoidMethod, void, (JNIEnv *env, jobject obj, jmethodID methodID, ...), (env, obj, methodID, vargs)) \
+  X(VOID, CallVoidMethodV, void, (JNIEnv *env, jobject obj, jmethodID methodID, va_list args), (env, obj, methodID, args)) \
+  X(VOID, CallVoidMethodA, void, (JNIEnv *env, jobject obj, jmethodID methodID, const jvalue *args), (env, obj, methodID, args)) \
+  X(VARARGS_VOID, CallNonvirtualVoidMethod, void, (JNIEnv *env, jobject obj, jclass clazz, jmethodID methodID, ...), (env, obj, clazz, methodID, vargs)) \
+  X(VOID, CallNonvirtualVoidMethodV, void, (JNIEnv *env, jobject obj, jclass clazz, jmethodID methodID, va_list args), (env, obj, clazz, methodID, args)) \
+  X(VOID, CallNonvirtualVoidMethodA, void, (JNIEnv *env, jobject obj, jclass clazz, jmethodID methodID, const jvalue *args), (env, obj, clazz, methodID, args)) \
+  X(VARARGS_VOID, CallStaticVoidMethod, void, (JNIEnv *env, jclass cls, jmethodID methodID, ...), (env, cls, methodID, vargs)) \
+  X(VOID, CallStaticVoidMethodV, void, (JNIEnv *env, jclass cls, jmethodID methodID, va_list args), (env, cls, methodID, args)) \
+  X(VOID, CallStaticVoidMethodA, void, (JNIEnv *env, jclass cls, jmethodID methodID, const jvalue *args), (env, cls, methodID, args)) \
+  X(FUNCTION, NewString, jstring, (JNIEnv *env, const jchar *unicode, jsize len), (env, unicode, len)) \
+  X(FUNCTION, GetStringLength, jsize, (JNIEnv *env, jstring str), (env, str)) \
+  X(FUNCTION, GetStringChars, const jchar *, (JNIEnv *env, jstring str, jboolean *isCopy), (env, str, isCopy)) \
+  X(VOID, ReleaseStringChars, void, (JNIEnv *env, jstring str, const jchar *chars), (env, str, chars)) \
+  X(FUNCTION, NewStringUTF, jstring, (JNIEnv *env, const char *utf), (env, utf)) \
+  X(FUNCTION, GetStringUTFLength, jsize, (JNIEnv *env, jstring str), (env, str)) \
+  X(FUNCTION, GetStringUTFChars, const char *, (JNIEnv *env, jstring str, jboolean *isCopy), (env, str, isCopy)) \
+  X(VOID, ReleaseStringUTFChars, void, (JNIEnv *env, jstring str, const char *chars), (env, str, chars)) \
+  X(FUNCTION, GetArrayLength, jsize, (JNIEnv *env, jarray array), (env, array)) \
+  X(FUNCTION, NewObjectArray, jobjectArray, (JNIEnv *env, jsize len, jclass clazz, jobject init), (env, len, clazz, init)) \
+  X(FUNCTION, GetObjectArrayElement, jobject, (JNIEnv *env, jobjectArray array, jsize index), (env, array, index)) \
+  X(VOID, SetObjectArrayElement, void, (JNIEnv *env, jobjectArray array, jsize index, jobject val), (env, array, index, val)) \
+  JNI_ARRAY_FUNCTIONS(X, Boolean, jboolean) \
+  JNI_ARRAY_FUNCTIONS(X, Byte, jbyte) \
+  JNI_ARRAY_FUNCTIONS(X, Char, jchar) \
+  JNI_ARRAY_FUNCTIONS(X, Short, jshort) \
+  JNI_ARRAY_FUNCTIONS(X, Int, jint) \
+  JNI_ARRAY_FUNCTIONS(X, Long, jlong) \
+  JNI_ARRAY_FUNCTIONS(X, Float, jfloat) \
+  JNI_ARRAY_FUNCTIONS(X, Double, jdouble) \
+  X(FUNCTION, RegisterNatives, jint, (JNIEnv *env, jclass clazz, const JNINativeMethod *methods, jint nMethods), (env, clazz, methods, nMethods)) \
+  X(FUNCTION, UnregisterNatives, jint, (JNIEnv *env, jclass clazz), (env, clazz)) \
+  X(FUNCTION, MonitorEnter, jint, (JNIEnv *env, jobject obj), (env, obj)) \
+  X(FUNCTION, MonitorExit, jint, (JNIEnv *env, jobject obj), (env, obj)) \
+  X(FUNCTION, GetJavaVM, jint, (JNIEnv *env, JavaVM **vm), (env, vm)) \
+  X(VOID, GetStringRegion, void, (JNIEnv *env, jstring str, jsize start, jsize len, jchar *buf), (env, str, start, len, buf)) \
+  X(VOID, GetStringUTFRegion, void, (JNIEnv *env, jstring str, jsize start, jsize len, char *buf), (env, str, start, len, buf)) \
+  X(FUNCTION, NewWeakGlobalRef, jweak, (JNIEnv *env, jobject obj), (env, obj)) \
+  X(VOID, DeleteWeakGlobalRef, void, (JNIEnv *env, jweak ref), (env, ref)) \
+  X(FUNCTION, ExceptionCheck, jboolean, (JNIEnv *env), (env)) \
+  X(FUNCTION, NewDirectByteBuffer, jobject, (JNIEnv *env, void *address, jlong capacity), (env, address, capacity)) \
+  X(FUNCTION, GetDirectBufferAddress, void *, (JNIEnv *env, jobject buf), (env, buf)) \
+  X(FUNCTION, GetDirectBufferCapacity, jlong, (JNIEnv *env, jobject buf), (env, buf)) \
+  X(FUNCTION, GetObjectRefType, jobjectRefType, (JNIEnv *env, jobject obj), (env, obj)) \
+  X(FUNCTION, GetModule, jobject, (JNIEnv *env, jclass clazz), (env, clazz)) \
+  JNI_21_FUNCTIONS(X)
+
+#define TRANSITION_FUNCTION_ID(kind, Name, type, parameters, arguments) TRANSITION_##Name,
+
+// the wrapped JNI functions
+enum TransitionFunction {
+  JNI_FUNCTIONS(TRANSITION_FUNCTION_ID)
+  TRANSITION_FUNCTION_COUNT
+};
+
+#undef TRANSITION_FUNCTION_ID
+
+// counters of a single function summed up since the last report
+struct TransitionTotals {
+  uint64_t calls;
+  // calls whose latency was measured, every transitionSample-th call of a thread
+  uint64_t timedCalls;
+  uint64_t timedNanos;
+};
+
+// counters of a single function of a single thread, written by the owning thread and merged by the reporter thread
+struct TransitionCounters {
+  _Atomic uint64_t calls;
+  _Atomic uint64_t timedCalls;
+  _Atomic uint64_t timedNanos;
+  // values at the last merge, only accessed by the reporter thread
+  struct TransitionTotals merged;
+};
+
+// wraps every function in redirected, calls go to the functions redirected had before
+// the time of every sampleInterval-th call of a thread is measured, 0 only counts calls
+jint redirectJniTransitions(jniNativeInterface *redirected, jint sampleInterval);
+
+// adds the values recorded by all threads since the last merge to totals, indexed by enum TransitionFunction
+void transitionsMerge(struct TransitionTotals *totals);
+
+// calls of the current thread are no longer counted, for the agent threads
+void transitionsExcludeCurrentThread(void);
+
+// called when a thread ends, its counters are reused by the next thread
+void transitionsThreadEnd(void);
+
+// name of the JNI function like "GetObjectField"
+const char *transitionFunctionName(jint function);
+
+#endif
@@ -0,0 +1,296 @@
+// for dl_iterate_phdr
+#define _GNU_SOURCE
+#include <jni.h>
+#include <link.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "agent-options.h"
+#include "native-libraries.h"
+
+// executable segment of a loaded shared object
+struct CodeRange {
+  uintptr_t start;
+  // exclusive
+  uintptr_t end;
+  jint library;
+};
+
+// executable segments of all loaded shared objects sorted by start address
+// immutable once published, replaced as a whole when shared objects were loaded
+struct CodeRanges {
+  // dlpi_adds when the table was built
+  unsigned long long adds;
+  size_t count;
+  struct CodeRange ranges[];
+};
+
+// state of a single dl_iterate_phdr walk
+struct CodeRangesBuilder {
+  struct CodeRange *ranges;
+  size_t count;
+  size_t capacity;
+  unsigned long long adds;
+  jboolean failed;
+};
+
+_Atomic jboolean nativeLibraryFilter[MAX_NATIVE_LIBRARIES];
+_Atomic jboolean unknownLibraryReported = JNI_TRUE;
+
+// tables replaced by a rebuild are never freed, a critical may still be looking them up
+static _Atomic(struct CodeRanges *) codeRanges = NULL;
+// serializes rebuilds, interning and the creation of library strings
+static pthread_mutex_t librariesLock = PTHREAD_MUTEX_INITIALIZER;
+// paths as reported by dl_iterate_phdr, indexed by library, only appended while holding librariesLock
+static char *libraryPaths[MAX_NATIVE_LIBRARIES];
+// file names pointing into libraryPaths
+static const char *libraryNames[MAX_NATIVE_LIBRARIES];
+static _Atomic jint libraryCount = 0;
+// JNI global references, created on first use
+static _Atomic(jstring) libraryStrings[MAX_NATIVE_LIBRARIES];
+
+static const char *fileName(const char *path) {
+  const char *slash = strrchr(path, '/');
+  return slash == NULL ? path : slash + 1;
+}
+
+// libz matches libz.so.1 but not libzstd.so.1
+static jboolean matchesLibrary(const char *name, const char *pattern) {
+  size_t length = strlen(pattern);
+  return strncmp(name, pattern, length) == 0 && (name[length] == '\0' || name[length] == '.');
+}
+
+static jboolean matchesAny(const char *name, const char patterns[][LIBRARY_FILTER_LENGTH], jint count) {
+  for (jint i = 0; i < count; i++) {
+    if (matchesLibrary(name, patterns[i])) {
+      return JNI_TRUE;
+    }
+  }
+  return JNI_FALSE;
+}
+
+static jboolean isLibraryIncluded(const char *name) {
+  if (agentOptions.libraryCount > 0 && !matchesAny(name, agentOptions.libraries, agentOptions.libraryCount)) {
+    return JNI_FALSE;
+  }
+  return !matchesAny(name, agentOptions.excludedLibraries, agentOptions.excludedLibraryCount);
+}
+
+// has to be called with librariesLock held
+static jint internLibrary(const char *path) {
+  // the main executable has an empty name
+  if (path[0] == '\0') {
+    path = "[executable]";
+  }
+  jint count = atomic_load_explicit(&libraryCount, memory_order_relaxed);
+  for (jint i = 0; i < count; i++) {
+    if (strcmp(libraryPaths[i], path) == 0) {
+      return i;
+    }
+  }
+  if (count == MAX_NATIVE_LIBRARIES) {
+    return NATIVE_LIBRARY_UNKNOWN;
+  }
+  char *copy = strdup(path);
+  if (copy == NULL) {
+    fprintf(stderr, "strdup(%s) failed\n", path);
+    return NATIVE_LIBRARY_UNKNOWN;
+  }
+  libraryPaths[count] = copy;
+  libraryNames[count] = fileName(copy);
+  atomic_store_explicit(&nativeLibraryFilter[count], isLibraryIncluded(libraryNames[count]), memory_order_relaxed);
+  atomic_store_explicit(&libraryCount, count + 1, memory_order_release);
+  return count;
+}
+
+static void readAdds(struct dl_phdr_info *info, size_t size, struct CodeRangesBuilder *builder) {
+  // dlpi_adds was added to the structure later
+  if (size >= offsetof(struct dl_phdr_info, dlpi_adds) + sizeof(info->dlpi_adds)) {
+    builder->adds = info->dlpi_adds;
+  }
+}
+
+static int addsCallback(struct dl_phdr_info *info, size_t size, void *data) {
+  readAdds(info, size, data);
+  // the counter is the same for every shared object
+  return 1;
+}
+
+static int addCodeRanges(struct dl_phdr_info *info, size_t size, void *data) {
+  struct CodeRangesBuilder *builder = data;
+  readAdds(info, size, builder);
+  jint library = NATIVE_LIBRARY_UNKNOWN;
+  for (ElfW(Half) i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr) *header = &info->dlpi_phdr[i];
+    if (header->p_type != PT_LOAD || (header->p_flags & PF_X) == 0) {
+      continue;
+    }
+    if (library == NATIVE_LIBRARY_UNKNOWN) {
+      library = internLibrary(info->dlpi_name != NULL ? info->dlpi_name : "");
+      if (library == NATIVE_LIBRARY_UNKNOWN) {
+        // addresses of the shared object stay unknown
+        return 0;
+      }
+    }
+    if (builder->count == builder->capacity) {
+      size_t capacity = builder->capacity == 0 ? 64 : builder->capacity * 2;
+      struct CodeRange *ranges = realloc(builder->ranges, capacity * sizeof(struct CodeRange));
+      if (ranges == NULL) {
+        fprintf(stderr, "realloc(%zu) failed\n", capacity * sizeof(struct CodeRange));
+        builder->failed = JNI_TRUE;
+        return 1;
+      }
+      builder->ranges = ranges;
+      builder->capacity = capacity;
+    }
+    struct CodeRange *range = &builder->ranges[builder->count];
+    builder->count += 1;
+    range->start = (uintptr_t) (info->dlpi_addr + header->p_vaddr);
+    range->end = range->start + (uintptr_t) header->p_memsz;
+    range->library = library;
+  }
+  return 0;
+}
+
+static int compareCodeRanges(const void *a, const void *b) {
+  uintptr_t left = ((const struct CodeRange *) a)->start;
+  uintptr_t right = ((const struct CodeRange *) b)->start;
+  return left < right ? -1 : left > right;
+}
+
+// has to be called with librariesLock held, returns NULL on failure
+static struct CodeRanges *buildCodeRanges(void) {
+  struct CodeRangesBuilder builder = { NULL, 0, 0, 0, JNI_FALSE };
+  dl_iterate_phdr(addCodeRanges, &builder);
+  if (builder.failed) {
+    free(builder.ranges);
+    return NULL;
+  }
+  qsort(builder.ranges, builder.count, sizeof(struct CodeRange), compareCodeRanges);
+  struct CodeRanges *table = malloc(sizeof(struct CodeRanges) + builder.count * sizeof(struct CodeRange));
+  if (table == NULL) {
+    fprintf(stderr, "malloc(%zu) failed\n", sizeof(struct CodeRanges) + builder.count * sizeof(struct CodeRange));
+    free(builder.ranges);
+    return NULL;
+  }
+  table->adds = builder.adds;
+  table->count = builder.count;
+  if (builder.count > 0) {
+    memcpy(table->ranges, builder.ranges, builder.count * sizeof(struct CodeRange));
+  }
+  free(builder.ranges);
+  return table;
+}
+
+// returns the current table, rebuilt if shared objects were loaded since seen was built
+static struct CodeRanges *refreshCodeRanges(struct CodeRanges *seen) {
+  pthread_mutex_lock(&librariesLock);
+  struct CodeRanges *current = atomic_load_explicit(&codeRanges, memory_order_acquire);
+  if (current == seen) {
+    struct CodeRangesBuilder builder = { NULL, 0, 0, 0, JNI_FALSE };
+    if (current != NULL) {
+      dl_iterate_phdr(addsCallback, &builder);
+    }
+    if (current == NULL || builder.adds != current->adds) {
+      struct CodeRanges *rebuilt = buildCodeRanges();
+      if (rebuilt != NULL) {
+        atomic_store_explicit(&codeRanges, rebuilt, memory_order_release);
+        current = rebuilt;
+      }
+    }
+  }
+  pthread_mutex_unlock(&librariesLock);
+  return current;
+}
+
+static jint findCodeRange(const struct CodeRanges *table, uintptr_t address) {
+  // last range starting at or before the address
+  size_t low = 0;
+  size_t high = table->count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (table->ranges[middle].start <= address) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low > 0 && address < table->ranges[low - 1].end) {
+    return table->ranges[low - 1].library;
+  }
+  return NATIVE_LIBRARY_UNKNOWN;
+}
+
+jint nativeLibraryOf(const void *address) {
+  uintptr_t key = (uintptr_t) address;
+  struct CodeRanges *table = atomic_load_explicit(&codeRanges, memory_order_acquire);
+  if (table != NULL) {
+    jint library = findCodeRange(table, key);
+    if (library != NATIVE_LIBRARY_UNKNOWN) {
+      return library;
+    }
+  }
+  table = refreshCodeRanges(table);
+  return table != NULL ? findCodeRange(table, key) : NATIVE_LIBRARY_UNKNOWN;
+}
+
+const char *nativeLibraryName(jint library) {
+  if (library < 0 || library >= atomic_load_explicit(&libraryCount, memory_order_acquire)) {
+    return "unknown";
+  }
+  return libraryNames[library];
+}
+
+jstring nativeLibraryString(JNIEnv *env, jint library) {
+  if (library < 0 || library >= atomic_load_explicit(&libraryCount, memory_order_acquire)) {
+    return NULL;
+  }
+  jstring name = atomic_load_explicit(&libraryStrings[library], memory_order_acquire);
+  if (name != NULL) {
+    return name;
+  }
+  pthread_mutex_lock(&librariesLock);
+  name = atomic_load_explicit(&libraryStrings[library], memory_order_relaxed);
+  if (name == NULL) {
+    jstring nameString = (*env)->NewStringUTF(env, libraryNames[library]);
+    if (nameString == NULL) {
+      fprintf(stderr, "NewStringUTF(%s) failed\n", libraryNames[library]);
+      (*env)->ExceptionClear(env);
+    } else {
+      name = (*env)->NewGlobalRef(env, nameString);
+      (*env)->DeleteLocalRef(env, nameString);
+      atomic_store_explicit(&libraryStrings[library], name, memory_order_release);
+    }
+  }
+  pthread_mutex_unlock(&librariesLock);
+  return name;
+}
+
+void nativeLibrariesApplyFilters(void) {
+  pthread_mutex_lock(&librariesLock);
+  jint count = atomic_load_explicit(&libraryCount, memory_order_relaxed);
+  for (jint i = 0; i < count; i++) {
+    atomic_store_explicit(&nativeLibraryFilter[i], isLibraryIncluded(libraryNames[i]), memory_order_relaxed);
+  }
+  // only libraries can be included explicitly
+  atomic_store_explicit(&unknownLibraryReported, agentOptions.libraryCount == 0, memory_order_relaxed);
+  pthread_mutex_unlock(&librariesLock);
+}
+
+void nativeLibrariesDestroy(JNIEnv *env) {
+  pthread_mutex_lock(&librariesLock);
+  jint count = atomic_load_explicit(&libraryCount, memory_order_relaxed);
+  for (jint i = 0; i < count; i++) {
+    jstring name = atomic_exchange_explicit(&libraryStrings[i], NULL, memory_order_relaxed);
+    if (name != NULL) {
+      (*env)->DeleteGlobalRef(env, name);
+    }
+  }
+  // the address ranges and names stay valid, they are reused when attaching again
+  pthread_mutex_unlock(&librariesLock);
+}
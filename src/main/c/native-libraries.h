@@ -0,0 +1,45 @@
+#ifndef NATIVE_LIBRARIES_H
+#define NATIVE_LIBRARIES_H
+
+#include <jni.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+// maximum number of distinct shared objects that can be told apart, further ones are unknown
+#define MAX_NATIVE_LIBRARIES 1024
+// library of addresses outside of any known shared object
+#define NATIVE_LIBRARY_UNKNOWN (-1)
+
+// index of the shared object containing the code address, NATIVE_LIBRARY_UNKNOWN if none
+// binary search in a cached, sorted table of the executable segments of all loaded shared objects
+// the table is rebuilt with dl_iterate_phdr on a miss if a shared object was loaded since
+// does not call JNI, can be called while a critical is held
+jint nativeLibraryOf(const void *address);
+
+// file name of the library like libz.so.1, "unknown" for NATIVE_LIBRARY_UNKNOWN
+const char *nativeLibraryName(jint library);
+
+// file name of the library as a Java string, NULL for NATIVE_LIBRARY_UNKNOWN
+// JNI global reference, must not be called while a critical is held
+jstring nativeLibraryString(JNIEnv *env, jint library);
+
+// applies the libraries and excludeLibraries options to all libraries seen so far
+void nativeLibrariesApplyFilters(void);
+
+// deletes the global references created by nativeLibraryString
+void nativeLibrariesDestroy(JNIEnv *env);
+
+// filter decision per library, written when a library is first seen or the options change
+extern _Atomic jboolean nativeLibraryFilter[MAX_NATIVE_LIBRARIES];
+// filter decision for addresses outside of any known shared object
+extern _Atomic jboolean unknownLibraryReported;
+
+// whether criticals entered from the library are reported according to the libraries and excludeLibraries options
+static inline jboolean nativeLibraryReported(jint library) {
+  if (library == NATIVE_LIBRARY_UNKNOWN) {
+    return atomic_load_explicit(&unknownLibraryReported, memory_order_relaxed);
+  }
+  return atomic_load_explicit(&nativeLibraryFilter[library], memory_order_relaxed);
+}
+
+#endif
@@ -0,0 +1,14 @@
+#include "probes.h"
+
+#ifdef HAVE_SDT_PROBES
+
+// the semaphores have to be in the .probes section so that tracers find them
+#define PROBE_SEMAPHORE(name) \
+  unsigned short jni_critical_reporter_##name##_semaphore __attribute__((section(".probes"))) = 0;
+
+PROBE_SEMAPHORE(get_string_critical)
+PROBE_SEMAPHORE(release_string_critical)
+PROBE_SEMAPHORE(get_primitive_array_critical)
+PROBE_SEMAPHORE(release_primitive_array_critical)
+
+#endif
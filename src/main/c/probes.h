@@ -0,0 +1,59 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+#include <jni.h>
+
+// USDT probes in the redirected critical functions, provider jni_critical_reporter
+// only compiled in if sys/sdt.h (systemtap-sdt-dev) is available at build time
+// every probe has a semaphore that the tracer increments when it attaches, arguments are only computed while attached
+//
+//   bpftrace -e 'usdt:/path/to/libjni-critical-reporter.so:jni_critical_reporter:get_primitive_array_critical { ... }'
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define HAVE_SDT_PROBES 1
+#endif
+#endif
+
+// defined by the probes profile, a build that asks for probes fails instead of silently dropping them
+#if defined(REQUIRE_SDT_PROBES) && !defined(HAVE_SDT_PROBES)
+#error "REQUIRE_SDT_PROBES is defined but sys/sdt.h was not found, install systemtap-sdt-dev (systemtap-sdt-devel)"
+#endif
+
+#ifdef HAVE_SDT_PROBES
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+// incremented by the tracer, names are fixed by sys/sdt.h
+extern unsigned short jni_critical_reporter_get_string_critical_semaphore;
+extern unsigned short jni_critical_reporter_release_string_critical_semaphore;
+extern unsigned short jni_critical_reporter_get_primitive_array_critical_semaphore;
+extern unsigned short jni_critical_reporter_release_primitive_array_critical_semaphore;
+
+// whether a tracer is attached to the probe
+#define PROBE_ENABLED(name) ((jboolean) __builtin_expect(jni_critical_reporter_##name##_semaphore != 0, 0))
+
+// get_string_critical(carray, length, isCopy, depth, startNanos, acquiredNanos)
+// get_primitive_array_critical(carray, length, isCopy, depth, startNanos, acquiredNanos)
+// length is -1 for nested criticals, no JNI calls are allowed while a critical is held
+#define PROBE_GET_CRITICAL(name, carray, length, isCopy, depth, startNanos, acquiredNanos) \
+  STAP_PROBE6(jni_critical_reporter, name, carray, length, isCopy, depth, startNanos, acquiredNanos)
+
+// release_string_critical(carray, mode, depth, releasedNanos), mode is always 0
+// release_primitive_array_critical(carray, mode, depth, releasedNanos)
+// depth is the number of criticals still held
+#define PROBE_RELEASE_CRITICAL(name, carray, mode, depth, releasedNanos) \
+  STAP_PROBE4(jni_critical_reporter, name, carray, mode, depth, releasedNanos)
+
+#else
+
+#define PROBE_ENABLED(name) JNI_FALSE
+#define PROBE_GET_CRITICAL(name, carray, length, isCopy, depth, startNanos, acquiredNanos) \
+  ((void) (carray), (void) (length), (void) (isCopy), (void) (depth), (void) (startNanos), (void) (acquiredNanos))
+#define PROBE_RELEASE_CRITICAL(name, carray, mode, depth, releasedNanos) \
+  ((void) (carray), (void) (mode), (void) (depth), (void) (releasedNanos))
+
+#endif
+
+#endif
@@ -0,0 +1,40 @@
+#include <jni.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "ring-buffer.h"
+
+
+jint ringBufferInit(struct RingBuffer *ring, jint capacity) {
+  ring->records = calloc((size_t) capacity, sizeof(struct CriticalRecord));
+  if (ring->records == NULL) {
+    fprintf(stderr, "calloc(%d) failed\n", capacity);
+    return JNI_ERR;
+  }
+  ring->mask = (uint64_t) capacity - 1;
+  atomic_init(&ring->head, 0);
+  ring->cachedTail = 0;
+  atomic_init(&ring->dropped, 0);
+  atomic_init(&ring->tail, 0);
+  ring->reportedDropped = 0;
+  return JNI_OK;
+}
+
+void ringBufferDestroy(struct RingBuffer *ring) {
+  free(ring->records);
+  ring->records = NULL;
+}
+
+jint ringBufferDrain(struct RingBuffer *ring, struct CriticalRecord *batch, jint maxRecords) {
+  uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  uint64_t available = head - tail;
+  jint count = available < (uint64_t) maxRecords ? (jint) available : maxRecords;
+  for (jint i = 0; i < count; i++) {
+    batch[i] = ring->records[(tail + (uint64_t) i) & ring->mask];
+  }
+  // hand the slots back to the producer
+  atomic_store_explicit(&ring->tail, tail + (uint64_t) count, memory_order_release);
+  return count;
+}
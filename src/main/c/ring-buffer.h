@@ -0,0 +1,87 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <jni.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define CACHE_LINE_SIZE 64
+
+// the JNI method used to enter the critical
+enum CriticalMethod {
+  GET_STRING_CRITICAL = 0,
+  GET_PRIMITIVE_ARRAY_CRITICAL = 1
+};
+
+// fixed size native record of a single critical, ordered to fit into a cache line
+struct CriticalRecord {
+  // nanoTime() before Get*Critical
+  jlong startNanos;
+  // nanoTime() after Get*Critical returned
+  jlong acquiredNanos;
+  // nanoTime() after Release*Critical
+  jlong endNanos;
+  // native return address of Get*Critical
+  void *callSite;
+  jint method;
+  // number of elements of the array or characters of the string
+  jint length;
+  // enum ArrayType
+  jint elementType;
+  // nesting depth, 1 for the outermost critical
+  jint depth;
+  // number of criticals acquired while the outermost critical was held, 0 for nested criticals
+  jint nestedCriticals;
+  // maximum nesting depth while the outermost critical was held, 0 for nested criticals
+  jint maxDepth;
+  // interned stack, STACK_ID_UNKNOWN if JFR records the stack trace
+  jint stackId;
+  jboolean isCopy;
+  // enum StringCoder, STRING_CODER_UNKNOWN for arrays
+  jbyte coder;
+};
+
+// single producer, single consumer ring buffer
+// the producer is the thread owning the buffer, the consumer is the flusher agent thread
+struct RingBuffer {
+  struct CriticalRecord *records;
+  uint64_t mask;
+
+  // next slot to write, only written by the producer
+  _Alignas(CACHE_LINE_SIZE) _Atomic uint64_t head;
+  // last value of tail seen by the producer, avoids reading tail on every offer
+  uint64_t cachedTail;
+  // number of records that did not fit, only written by the producer
+  _Atomic uint64_t dropped;
+
+  // next slot to read, only written by the consumer
+  _Alignas(CACHE_LINE_SIZE) _Atomic uint64_t tail;
+  // value of dropped at the last flush, only accessed by the consumer
+  uint64_t reportedDropped;
+};
+
+// capacity has to be a power of two
+jint ringBufferInit(struct RingBuffer *ring, jint capacity);
+
+void ringBufferDestroy(struct RingBuffer *ring);
+
+// copies at most maxRecords records into batch, called by the consumer
+jint ringBufferDrain(struct RingBuffer *ring, struct CriticalRecord *batch, jint maxRecords);
+
+// called by the producer, returns JNI_FALSE and counts a drop if the buffer is full
+static inline jboolean ringBufferOffer(struct RingBuffer *ring, const struct CriticalRecord *record) {
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  if (head - ring->cachedTail > ring->mask) {
+    ring->cachedTail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - ring->cachedTail > ring->mask) {
+      uint64_t dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+      atomic_store_explicit(&ring->dropped, dropped + 1, memory_order_relaxed);
+      return JNI_FALSE;
+    }
+  }
+  ring->records[head & ring->mask] = *record;
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  return JNI_TRUE;
+}
+
+#endif
@@ -0,0 +1,150 @@
+#include <jni.h>
+#include <jvmti.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "stack-traces.h"
+
+// linear probing gives up after this many slots and returns STACK_ID_UNKNOWN
+#define MAX_PROBES 32
+
+struct InternedStack {
+  // hash of the frames, 0 if the slot is empty
+  // stacks are identified by their 64 bit hash alone, collisions are not resolved
+  _Atomic uint64_t key;
+  // published by the thread that claimed the slot
+  _Atomic(struct StackFrames *) frames;
+};
+
+// slots are never freed, stack ids stay valid for the lifetime of the process
+static struct InternedStack stackTable[STACK_TABLE_CAPACITY];
+
+static uint64_t hashFrames(const jvmtiFrameInfo *frames, jint count) {
+  // FNV-1a over the method ids and locations
+  uint64_t hash = UINT64_C(0xCBF29CE484222325);
+  for (jint i = 0; i < count; i++) {
+    hash = (hash ^ (uint64_t) (uintptr_t) frames[i].method) * UINT64_C(0x100000001B3);
+    hash = (hash ^ (uint64_t) frames[i].location) * UINT64_C(0x100000001B3);
+  }
+  return hash == 0 ? 1 : hash;
+}
+
+static void publishFrames(struct InternedStack *slot, const jvmtiFrameInfo *frames, jint count) {
+  struct StackFrames *stack = malloc(sizeof(struct StackFrames) + (size_t) count * sizeof(jvmtiFrameInfo));
+  if (stack == NULL) {
+    // the id is still handed out but never defined
+    fprintf(stderr, "malloc(StackFrames) failed\n");
+    return;
+  }
+  stack->depth = count;
+  memcpy(stack->frames, frames, (size_t) count * sizeof(jvmtiFrameInfo));
+  atomic_store_explicit(&slot->frames, stack, memory_order_release);
+}
+
+jint captureStack(jvmtiEnv *jvmti, jint depth) {
+  jvmtiFrameInfo frames[MAX_STACK_DEPTH];
+  jint count;
+  jvmtiError tiErr = (*jvmti)->GetStackTrace(jvmti, NULL, 0, depth, frames, &count);
+  if (tiErr != JVMTI_ERROR_NONE || count == 0) {
+    return STACK_ID_UNKNOWN;
+  }
+  uint64_t key = hashFrames(frames, count);
+  for (uint64_t probe = 0; probe < MAX_PROBES; probe++) {
+    uint64_t index = (key + probe) & (STACK_TABLE_CAPACITY - 1);
+    struct InternedStack *slot = &stackTable[index];
+    uint64_t current = atomic_load_explicit(&slot->key, memory_order_acquire);
+    if (current == 0) {
+      if (atomic_compare_exchange_strong(&slot->key, &current, key)) {
+        publishFrames(slot, frames, count);
+        return (jint) index + 1;
+      }
+      // current was reloaded
+    }
+    if (current == key) {
+      return (jint) index + 1;
+    }
+  }
+  return STACK_ID_UNKNOWN;
+}
+
+const struct StackFrames *internedStack(jint stackId) {
+  return atomic_load_explicit(&stackTable[stackId - 1].frames, memory_order_acquire);
+}
+
+// appends the declaring class of the method in source form, eg. java.lang.String
+static size_t appendClassName(jvmtiEnv *jvmti, JNIEnv *env, jmethodID method, char *buffer, size_t size) {
+  jclass declaringClass;
+  if ((*jvmti)->GetMethodDeclaringClass(jvmti, method, &declaringClass) != JVMTI_ERROR_NONE) {
+    return (size_t) snprintf(buffer, size, "unknown");
+  }
+  char *signature;
+  jvmtiError tiErr = (*jvmti)->GetClassSignature(jvmti, declaringClass, &signature, NULL);
+  (*env)->DeleteLocalRef(env, declaringClass);
+  if (tiErr != JVMTI_ERROR_NONE) {
+    return (size_t) snprintf(buffer, size, "unknown");
+  }
+  // Ljava/lang/String; -> java.lang.String
+  size_t length = strlen(signature);
+  const char *name = signature;
+  if (length >= 2 && signature[0] == 'L' && signature[length - 1] == ';') {
+    name = signature + 1;
+    length -= 2;
+  }
+  size_t written = 0;
+  for (; written < length && written + 1 < size; written++) {
+    buffer[written] = name[written] == '/' ? '.' : name[written];
+  }
+  if (size > 0) {
+    buffer[written] = '\0';
+  }
+  (*jvmti)->Deallocate(jvmti, (unsigned char *) signature);
+  return written;
+}
+
+void formatFrames(jvmtiEnv *jvmti, JNIEnv *env, const jvmtiFrameInfo *frames, jint depth, char *buffer, size_t size) {
+  size_t position = 0;
+  buffer[0] = '\0';
+  for (jint i = 0; i < depth && position + 1 < size; i++) {
+    const jvmtiFrameInfo *frame = &frames[i];
+    if (i > 0) {
+      buffer[position] = '\n';
+      position += 1;
+    }
+    position += appendClassName(jvmti, env, frame->method, buffer + position, size - position);
+    if (position + 1 >= size) {
+      // truncated
+      position = size - 1;
+      break;
+    }
+
+    char *methodName;
+    if ((*jvmti)->GetMethodName(jvmti, frame->method, &methodName, NULL, NULL) != JVMTI_ERROR_NONE) {
+      methodName = NULL;
+    }
+    int written;
+    if (frame->location < 0) {
+      written = snprintf(buffer + position, size - position, ".%s(Native Method)",
+                         methodName == NULL ? "unknown" : methodName);
+    } else {
+      written = snprintf(buffer + position, size - position, ".%s(bci %ld)",
+                         methodName == NULL ? "unknown" : methodName, (long) frame->location);
+    }
+    if (methodName != NULL) {
+      (*jvmti)->Deallocate(jvmti, (unsigned char *) methodName);
+    }
+    if (written < 0 || (size_t) written >= size - position) {
+      // truncated
+      position = size - 1;
+      break;
+    }
+    position += (size_t) written;
+  }
+  buffer[position] = '\0';
+}
+
+void formatStack(jvmtiEnv *jvmti, JNIEnv *env, const struct StackFrames *stack, char *buffer, size_t size) {
+  formatFrames(jvmti, env, stack->frames, stack->depth, buffer, size);
+}
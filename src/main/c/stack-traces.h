@@ -0,0 +1,35 @@
+#ifndef STACK_TRACES_H
+#define STACK_TRACES_H
+
+#include <jni.h>
+#include <jvmti.h>
+#include <stddef.h>
+
+// maximum number of Java frames captured by the agent
+#define MAX_STACK_DEPTH 64
+// number of distinct stacks that can be interned, a power of two
+#define STACK_TABLE_CAPACITY 4096
+// stack id of criticals whose stack was not captured or did not fit into the table
+#define STACK_ID_UNKNOWN 0
+
+// Java frames of an interned stack, top frame first, immutable once published
+struct StackFrames {
+  jint depth;
+  jvmtiFrameInfo frames[];
+};
+
+// captures at most depth frames of the current thread and interns them, returns the stack id
+// must not be called while a critical is held
+jint captureStack(jvmtiEnv *jvmti, jint depth);
+
+// frames of an interned stack, NULL if the id is not in use or the frames are not published yet
+// valid ids are 1 to STACK_TABLE_CAPACITY
+const struct StackFrames *internedStack(jint stackId);
+
+// formats the frames one per line like Class.method(Native Method), called by an agent thread
+void formatFrames(jvmtiEnv *jvmti, JNIEnv *env, const jvmtiFrameInfo *frames, jint depth, char *buffer, size_t size);
+
+// formats an interned stack like formatFrames
+void formatStack(jvmtiEnv *jvmti, JNIEnv *env, const struct StackFrames *stack, char *buffer, size_t size);
+
+#endif
@@ -0,0 +1,121 @@
+#include <jni.h>
+#include <jvmti.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "agent-options.h"
+#include "thread-state.h"
+
+
+__thread struct ThreadState *currentThreadState = NULL;
+
+static _Atomic(struct ThreadState *) threadStates = NULL;
+
+// guards ThreadState.thread against being deleted while another agent thread creates a local reference
+static atomic_flag threadRefLock = ATOMIC_FLAG_INIT;
+
+static inline void lockThreadRefs(void) {
+  while (atomic_flag_test_and_set_explicit(&threadRefLock, memory_order_acquire)) {
+    sched_yield();
+  }
+}
+
+static inline void unlockThreadRefs(void) {
+  atomic_flag_clear_explicit(&threadRefLock, memory_order_release);
+}
+
+struct ThreadState *claimFreeThreadState(void) {
+  for (struct ThreadState *state = firstThreadState(); state != NULL; state = state->next) {
+    int expected = THREAD_STATE_FREE;
+    if (atomic_load_explicit(&state->status, memory_order_relaxed) == THREAD_STATE_FREE
+        && atomic_compare_exchange_strong(&state->status, &expected, THREAD_STATE_ACTIVE)) {
+      return state;
+    }
+  }
+  return NULL;
+}
+
+struct ThreadState *newThreadState(void) {
+  struct ThreadState *state = aligned_alloc(CACHE_LINE_SIZE, sizeof(struct ThreadState));
+  if (state == NULL) {
+    fprintf(stderr, "aligned_alloc(ThreadState) failed\n");
+    return NULL;
+  }
+  memset(state, 0, sizeof(struct ThreadState));
+  if (agentOptions.mode == MODE_ASYNC && ringBufferInit(&state->ring, agentOptions.bufferSize) != JNI_OK) {
+    free(state);
+    return NULL;
+  }
+  state->thread = NULL;
+  atomic_init(&state->status, THREAD_STATE_ACTIVE);
+
+  // publish
+  struct ThreadState *head = atomic_load(&threadStates);
+  do {
+    state->next = head;
+  } while (!atomic_compare_exchange_weak(&threadStates, &head, state));
+  return state;
+}
+
+struct ThreadState *acquireThreadState(jvmtiEnv *jvmti, JNIEnv *env) {
+  jthread thread;
+  jvmtiError tiErr = (*jvmti)->GetCurrentThread(jvmti, &thread);
+  if (tiErr != JVMTI_ERROR_NONE) {
+    fprintf(stderr, "GetCurrentThread (JVMTI) failed with error(%d)\n", tiErr);
+    return NULL;
+  }
+
+  struct ThreadState *state = currentThreadState;
+  if (state == NULL) {
+    state = claimFreeThreadState();
+  }
+  if (state == NULL) {
+    state = newThreadState();
+  }
+  if (state != NULL) {
+    // happens before any record is published through the ring buffer
+    jobject globalThread = (*env)->NewGlobalRef(env, thread);
+    lockThreadRefs();
+    state->thread = globalThread;
+    unlockThreadRefs();
+    currentThreadState = state;
+  }
+  (*env)->DeleteLocalRef(env, thread);
+  return state;
+}
+
+void retireThreadState(void) {
+  struct ThreadState *state = currentThreadState;
+  if (state != NULL) {
+    currentThreadState = NULL;
+    atomic_store_explicit(&state->status, THREAD_STATE_RETIRED, memory_order_release);
+  }
+}
+
+void releaseThreadState(JNIEnv *env, struct ThreadState *state) {
+  lockThreadRefs();
+  if (state->thread != NULL) {
+    (*env)->DeleteGlobalRef(env, state->thread);
+    state->thread = NULL;
+  }
+  unlockThreadRefs();
+  atomic_fetch_add_explicit(&state->generation, 1, memory_order_relaxed);
+  atomic_store_explicit(&state->status, THREAD_STATE_FREE, memory_order_release);
+}
+
+jobject newThreadLocalRef(JNIEnv *env, struct ThreadState *state) {
+  jobject thread = NULL;
+  lockThreadRefs();
+  if (atomic_load_explicit(&state->status, memory_order_acquire) != THREAD_STATE_FREE && state->thread != NULL) {
+    thread = (*env)->NewLocalRef(env, state->thread);
+  }
+  unlockThreadRefs();
+  return thread;
+}
+
+struct ThreadState *firstThreadState(void) {
+  return atomic_load_explicit(&threadStates, memory_order_acquire);
+}
@@ -0,0 +1,112 @@
+#ifndef THREAD_STATE_H
+#define THREAD_STATE_H
+
+#include <jni.h>
+#include <jvmti.h>
+#include <stdatomic.h>
+
+#include "histogram.h"
+#include "jni-copies.h"
+#include "ring-buffer.h"
+
+enum ThreadStateStatus {
+  // not owned by any thread, can be claimed
+  THREAD_STATE_FREE = 0,
+  // owned by a live thread
+  THREAD_STATE_ACTIVE = 1,
+  // the owning thread ended, waits to be drained by the agent thread
+  THREAD_STATE_RETIRED = 2
+};
+
+// time spent in the redirected critical functions outside of the original functions
+// single writer, merged by the agent thread by difference
+struct OverheadCounters {
+  _Atomic uint64_t calls;
+  _Atomic uint64_t nanos;
+  // values at the last report, only accessed by the agent thread
+  uint64_t reportedCalls;
+  uint64_t reportedNanos;
+  // value of nanos at the last adjustment, only accessed by the governor thread
+  uint64_t governedNanos;
+};
+
+static inline void overheadCountersRecord(struct OverheadCounters *counters, jlong nanos) {
+  // single writer, no need for an atomic read-modify-write
+  uint64_t calls = atomic_load_explicit(&counters->calls, memory_order_relaxed);
+  atomic_store_explicit(&counters->calls, calls + 1, memory_order_relaxed);
+  uint64_t total = atomic_load_explicit(&counters->nanos, memory_order_relaxed);
+  atomic_store_explicit(&counters->nanos, total + (uint64_t) (nanos < 0 ? 0 : nanos), memory_order_relaxed);
+}
+
+// the outermost critical currently held by a thread, written by the owning thread, read by the agent threads
+// occupies its own cache line so that readers don't contend with the counters of the owning thread
+struct InFlightCritical {
+  // nanoTime() before the outermost Get*Critical, 0 if none is held
+  // stored last with release semantics, method is valid once a reader sees it
+  _Alignas(CACHE_LINE_SIZE) _Atomic jlong startNanos;
+  // enum CriticalMethod
+  _Atomic jint method;
+};
+
+static inline void inFlightEnter(struct InFlightCritical *inFlight, jint method, jlong startNanos) {
+  atomic_store_explicit(&inFlight->method, method, memory_order_relaxed);
+  atomic_store_explicit(&inFlight->startNanos, startNanos, memory_order_release);
+}
+
+static inline void inFlightExit(struct InFlightCritical *inFlight) {
+  atomic_store_explicit(&inFlight->startNanos, 0L, memory_order_release);
+}
+
+// native per-thread state shared with the agent thread
+// instances are never freed, instead they are reused by new threads once drained
+struct ThreadState {
+  // registry of all thread states, immutable once published
+  struct ThreadState *next;
+  _Atomic int status;
+  // java.lang.Thread owning this state
+  // JNI global reference
+  jobject thread;
+  // only allocated in async mode
+  struct RingBuffer ring;
+  // hold time histograms indexed by enum CriticalMethod
+  struct HistogramShard histograms[2];
+  // incremented every time the state is released, detects reuse by a different thread
+  _Atomic uint32_t generation;
+  // outermost critical currently held, only maintained for GC stalls and the watchdog
+  struct InFlightCritical inFlight;
+  // startNanos of the last critical reported by the watchdog, only accessed by the watchdog thread
+  jlong watchdogReportedNanos;
+  // counters of the copying JNI functions indexed by enum CopyFunction
+  struct CopyCounters copies[COPY_FUNCTION_COUNT];
+  // time spent in the agent, only maintained with overhead or a budget
+  struct OverheadCounters overhead;
+};
+
+extern __thread struct ThreadState *currentThreadState;
+
+// claims a free thread state or allocates a new one unless the thread has one, slow path of getThreadState
+struct ThreadState *acquireThreadState(jvmtiEnv *jvmti, JNIEnv *env);
+
+static inline struct ThreadState *getThreadState(jvmtiEnv *jvmti, JNIEnv *env) {
+  struct ThreadState *state = currentThreadState;
+  // the thread reference is deleted when detaching, the state stays with its thread
+  if (state == NULL || state->thread == NULL) {
+    state = acquireThreadState(jvmti, env);
+  }
+  return state;
+}
+
+// called by the owning thread when it ends
+void retireThreadState(void);
+
+// called by the agent thread once a retired state is drained
+void releaseThreadState(JNIEnv *env, struct ThreadState *state);
+
+// new local reference to the thread owning the state, NULL if the state is not in use
+// can be called by any agent thread while the reporter thread releases states
+jobject newThreadLocalRef(JNIEnv *env, struct ThreadState *state);
+
+// head of the registry, iterate using next
+struct ThreadState *firstThreadState(void);
+
+#endif
@@ -0,0 +1,124 @@
+#include <jni.h>
+#include <jvmti.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "trace-file.h"
+
+// maximum length of the default file name
+#define TRACE_PATH_LENGTH 64
+
+
+__thread struct TraceSegmentHeader *traceSegment = NULL;
+
+// start of the mapping, NULL if the file is not open
+static struct TraceHeader *traceHeader = NULL;
+static size_t traceMappingSize = 0;
+
+jint traceFileOpen(const char *path, jlong size) {
+  if (traceHeader != NULL) {
+    // attached again, keep appending to the same file
+    return JNI_OK;
+  }
+  char defaultPath[TRACE_PATH_LENGTH];
+  if (path == NULL) {
+    snprintf(defaultPath, sizeof(defaultPath), "jni-critical-reporter-%ld.trace", (long) getpid());
+    path = defaultPath;
+  }
+  if (size < TRACE_HEADER_SIZE + TRACE_SEGMENT_SIZE) {
+    fprintf(stderr, "trace file size too small\n");
+    return JNI_ERR;
+  }
+  uint32_t segmentCount = (uint32_t) ((size - TRACE_HEADER_SIZE) / TRACE_SEGMENT_SIZE);
+  size_t mappingSize = TRACE_HEADER_SIZE + (size_t) segmentCount * TRACE_SEGMENT_SIZE;
+
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    fprintf(stderr, "open(%s) failed\n", path);
+    return JNI_ERR;
+  }
+  // sparse, pages are only allocated once a segment is used
+  if (ftruncate(fd, (off_t) mappingSize) != 0) {
+    fprintf(stderr, "ftruncate(%s) failed\n", path);
+    close(fd);
+    return JNI_ERR;
+  }
+  void *mapping = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  // the mapping keeps the file open
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    fprintf(stderr, "mmap(%s) failed\n", path);
+    return JNI_ERR;
+  }
+
+  struct TraceHeader *header = mapping;
+  memcpy(header->magic, TRACE_MAGIC, sizeof(header->magic));
+  header->version = TRACE_VERSION;
+  header->recordSize = sizeof(struct TraceRecord);
+  header->segmentSize = TRACE_SEGMENT_SIZE;
+  header->segmentCount = segmentCount;
+  header->pid = getpid();
+  header->epochOffsetNanos = nanoTimeToEpochNanos(0L);
+  atomic_init(&header->claimedSegments, 0);
+  atomic_init(&header->droppedRecords, 0);
+  traceMappingSize = mappingSize;
+  traceHeader = header;
+  return JNI_OK;
+}
+
+// name of the current thread, empty if it can't be determined
+static void currentThreadName(jvmtiEnv *jvmti, JNIEnv *env, char *buffer, size_t size) {
+  memset(buffer, 0, size);
+  jvmtiThreadInfo info;
+  if ((*jvmti)->GetThreadInfo(jvmti, NULL, &info) != JVMTI_ERROR_NONE) {
+    return;
+  }
+  if (info.name != NULL) {
+    // not NUL terminated if the name is too long
+    size_t length = strlen(info.name);
+    memcpy(buffer, info.name, length < size ? length : size);
+    (*jvmti)->Deallocate(jvmti, (unsigned char *) info.name);
+  }
+  (*env)->DeleteLocalRef(env, info.thread_group);
+  (*env)->DeleteLocalRef(env, info.context_class_loader);
+}
+
+struct TraceSegmentHeader *traceFileClaimSegment(jvmtiEnv *jvmti, JNIEnv *env) {
+  struct TraceHeader *header = traceHeader;
+  if (header == NULL) {
+    return NULL;
+  }
+  uint32_t index = atomic_fetch_add_explicit(&header->claimedSegments, 1, memory_order_relaxed);
+  if (index >= header->segmentCount) {
+    // full, keep the count from growing without bounds
+    atomic_store_explicit(&header->claimedSegments, header->segmentCount, memory_order_relaxed);
+    traceSegment = NULL;
+    return NULL;
+  }
+  struct TraceSegmentHeader *segment =
+      (struct TraceSegmentHeader *) ((char *) header + TRACE_HEADER_SIZE + (size_t) index * TRACE_SEGMENT_SIZE);
+  segment->threadId = (int64_t) syscall(SYS_gettid);
+  currentThreadName(jvmti, env, segment->threadName, sizeof(segment->threadName));
+  atomic_store_explicit(&segment->recordCount, 0, memory_order_release);
+  traceSegment = segment;
+  return segment;
+}
+
+void traceFileDrop(void) {
+  if (traceHeader != NULL) {
+    atomic_fetch_add_explicit(&traceHeader->droppedRecords, 1, memory_order_relaxed);
+  }
+}
+
+void traceFileSync(void) {
+  if (traceHeader != NULL && msync(traceHeader, traceMappingSize, MS_SYNC) != 0) {
+    fprintf(stderr, "msync() failed\n");
+  }
+}
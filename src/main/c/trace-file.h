@@ -0,0 +1,135 @@
+#ifndef TRACE_FILE_H
+#define TRACE_FILE_H
+
+#include <jni.h>
+#include <jvmti.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "ring-buffer.h"
+
+// memory-mapped, per-process, append-only binary trace used in trace mode
+// the file is a header followed by fixed-size segments, every thread appends fixed-size records to its own segment
+// and claims the next free segment when it is full, records survive a crash of the JVM
+// all values are in native byte order, the layout is read by com.github.marschall.jnicriticalreporter.TraceFile
+
+// first 8 bytes of the file
+#define TRACE_MAGIC "JNICRIT\0"
+#define TRACE_VERSION 1
+// size of the file header, segments start at this offset
+#define TRACE_HEADER_SIZE 4096
+// size of a segment including its header
+#define TRACE_SEGMENT_SIZE (64 * 1024)
+#define TRACE_THREAD_NAME_LENGTH 40
+
+struct TraceHeader {
+  char magic[8];
+  uint32_t version;
+  // sizeof(struct TraceRecord)
+  uint32_t recordSize;
+  // TRACE_SEGMENT_SIZE
+  uint32_t segmentSize;
+  // number of segments the file has room for
+  uint32_t segmentCount;
+  int64_t pid;
+  // added to a timestamp gives nanoseconds since the epoch
+  int64_t epochOffsetNanos;
+  // number of segments claimed so far, segments are claimed in order
+  _Atomic uint32_t claimedSegments;
+  uint32_t reserved;
+  // records that were not written because all segments were claimed
+  _Atomic uint64_t droppedRecords;
+};
+
+struct TraceSegmentHeader {
+  // Linux thread id of the owner
+  int64_t threadId;
+  // number of records in the segment, stored with release semantics after the record is written
+  _Atomic uint64_t recordCount;
+  // name of the java.lang.Thread, NUL terminated unless it is TRACE_THREAD_NAME_LENGTH bytes long
+  char threadName[TRACE_THREAD_NAME_LENGTH];
+  uint64_t reserved;
+};
+
+// compact version of struct CriticalRecord
+struct TraceRecord {
+  // nanoTime() before Get*Critical
+  int64_t startNanos;
+  // nanoTime() after Get*Critical returned
+  int64_t acquiredNanos;
+  // nanoTime() after Release*Critical
+  int64_t endNanos;
+  int32_t length;
+  int32_t stackId;
+  // enum CriticalMethod
+  uint8_t method;
+  uint8_t isCopy;
+  // enum ArrayType
+  uint8_t elementType;
+  // saturated at 255
+  uint8_t depth;
+  // saturated at 65535
+  uint16_t nestedCriticals;
+  // saturated at 255
+  uint8_t maxDepth;
+  // enum StringCoder, 0 in files written before the coder was recorded
+  uint8_t coder;
+};
+
+_Static_assert(sizeof(struct TraceHeader) == 56, "TraceHeader layout");
+_Static_assert(sizeof(struct TraceSegmentHeader) == 64, "TraceSegmentHeader layout");
+_Static_assert(sizeof(struct TraceRecord) == 40, "TraceRecord layout");
+
+#define TRACE_SEGMENT_RECORDS ((TRACE_SEGMENT_SIZE - sizeof(struct TraceSegmentHeader)) / sizeof(struct TraceRecord))
+
+// segment of the current thread, NULL if none is claimed yet
+extern __thread struct TraceSegmentHeader *traceSegment;
+
+// creates and maps the file, path may be NULL for jni-critical-reporter-<pid>.trace in the working directory
+// does nothing if the file is already open
+jint traceFileOpen(const char *path, jlong size);
+
+// claims a new segment for the current thread, slow path of traceFileWrite
+// NULL if the file is full
+struct TraceSegmentHeader *traceFileClaimSegment(jvmtiEnv *jvmti, JNIEnv *env);
+
+// counts a record that did not fit
+void traceFileDrop(void);
+
+// writes the dirty pages back to the file without unmapping it, other threads may still write
+void traceFileSync(void);
+
+static inline uint8_t traceSaturate8(jint value) {
+  return value > UINT8_MAX ? UINT8_MAX : (uint8_t) value;
+}
+
+// appends a record to the segment of the current thread, must not be called while a critical is held
+static inline void traceFileWrite(jvmtiEnv *jvmti, JNIEnv *env, const struct CriticalRecord *record) {
+  struct TraceSegmentHeader *segment = traceSegment;
+  // single writer, no need for an atomic read-modify-write
+  uint64_t count = segment != NULL ? atomic_load_explicit(&segment->recordCount, memory_order_relaxed) : 0;
+  if (segment == NULL || count == TRACE_SEGMENT_RECORDS) {
+    segment = traceFileClaimSegment(jvmti, env);
+    if (segment == NULL) {
+      traceFileDrop();
+      return;
+    }
+    count = 0;
+  }
+  struct TraceRecord *slot = (struct TraceRecord *) (segment + 1) + count;
+  slot->startNanos = record->startNanos;
+  slot->acquiredNanos = record->acquiredNanos;
+  slot->endNanos = record->endNanos;
+  slot->length = record->length;
+  slot->stackId = record->stackId;
+  slot->method = (uint8_t) record->method;
+  slot->isCopy = record->isCopy;
+  slot->elementType = (uint8_t) record->elementType;
+  slot->depth = traceSaturate8(record->depth);
+  slot->nestedCriticals = record->nestedCriticals > UINT16_MAX ? UINT16_MAX : (uint16_t) record->nestedCriticals;
+  slot->maxDepth = traceSaturate8(record->maxDepth);
+  slot->coder = (uint8_t) record->coder;
+  atomic_store_explicit(&segment->recordCount, count + 1, memory_order_release);
+}
+
+#endif
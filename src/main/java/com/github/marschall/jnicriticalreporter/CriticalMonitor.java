@@ -0,0 +1,295 @@
+package com.github.marschall.jnicriticalreporter;
+
+import java.lang.management.ManagementFactory;
+import java.time.Duration;
+import java.util.ArrayList;
+import java.util.Comparator;
+import java.util.List;
+import java.util.Map;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.atomic.AtomicReference;
+import java.util.concurrent.atomic.LongAccumulator;
+import java.util.concurrent.atomic.LongAdder;
+
+import javax.management.InstanceAlreadyExistsException;
+import javax.management.JMException;
+import javax.management.MBeanServer;
+import javax.management.ObjectName;
+
+import jdk.jfr.consumer.RecordedEvent;
+import jdk.jfr.consumer.RecordedFrame;
+import jdk.jfr.consumer.RecordedStackTrace;
+import jdk.jfr.consumer.RecordingStream;
+
+/**
+ * Aggregates the {@code com.github.marschall.jnicriticalreporter.Event} events of the agent in process and publishes
+ * them as an MXBean, no recording has to be dumped.
+ * <p>
+ * The events are consumed with a {@link RecordingStream}, JFR delivers them about once per second. Counts are totals
+ * since the monitor was started, percentiles cover between one and two halves of the window. Recording the events
+ * never blocks the stream on a lock.
+ * <p>
+ * The agent starts the monitor with {@code jmx=true} if this class is on the class path, applications can start it
+ * with {@link #start()}.
+ */
+public final class CriticalMonitor implements CriticalMonitorMXBean, AutoCloseable {
+
+  /**
+   * The name the MXBean is registered with.
+   */
+  public static final String OBJECT_NAME = "com.github.marschall.jnicriticalreporter:type=CriticalMonitor";
+
+  private static final String EVENT_NAME = "com.github.marschall.jnicriticalreporter.Event";
+  private static final String STACK_DEFINITION_NAME = "com.github.marschall.jnicriticalreporter.StackDefinition";
+  private static final Duration DEFAULT_WINDOW = Duration.ofMinutes(1L);
+  // bounds the memory used for frames, further frames are counted as OTHER_FRAMES
+  static final int MAX_FRAMES = 1024;
+  static final String OTHER_FRAMES = "[other]";
+  static final String UNKNOWN_FRAME = "[unknown]";
+
+  private final long windowNanos;
+  private final Accumulator total;
+  private final Map<String, Accumulator> methods;
+  private final Map<Object, Accumulator> frames;
+  // top frame by stack id, from the StackDefinition events
+  private final Map<Long, String> stackDefinitions;
+  private volatile RecordingStream stream;
+  private volatile ObjectName registeredName;
+
+  CriticalMonitor(Duration window) {
+    this.windowNanos = window.toNanos();
+    this.total = new Accumulator(this.windowNanos);
+    this.methods = new ConcurrentHashMap<>();
+    this.frames = new ConcurrentHashMap<>();
+    this.stackDefinitions = new ConcurrentHashMap<>();
+  }
+
+  /**
+   * Starts consuming the events and registers the MXBean with the platform MBean server under {@link #OBJECT_NAME}.
+   * If a monitor is already registered it is left running and this method does nothing.
+   *
+   * @return the monitor, {@code null} if a monitor was already registered
+   * @throws JMException if the MXBean can not be registered
+   */
+  public static CriticalMonitor start() throws JMException {
+    return start(DEFAULT_WINDOW);
+  }
+
+  /**
+   * Starts consuming the events and registers the MXBean with the platform MBean server under {@link #OBJECT_NAME}.
+   * If a monitor is already registered it is left running and this method does nothing.
+   *
+   * @param window the window the percentiles are computed over
+   * @return the monitor, {@code null} if a monitor was already registered
+   * @throws JMException if the MXBean can not be registered
+   */
+  public static synchronized CriticalMonitor start(Duration window) throws JMException {
+    MBeanServer server = ManagementFactory.getPlatformMBeanServer();
+    ObjectName name = new ObjectName(OBJECT_NAME);
+    if (server.isRegistered(name)) {
+      return null;
+    }
+    CriticalMonitor monitor = new CriticalMonitor(window);
+    try {
+      server.registerMBean(monitor, name);
+    } catch (InstanceAlreadyExistsException e) {
+      // registered by a different class loader
+      return null;
+    }
+    monitor.registeredName = name;
+    monitor.startStream();
+    return monitor;
+  }
+
+  private void startStream() {
+    RecordingStream recordingStream = new RecordingStream();
+    recordingStream.enable(EVENT_NAME).withoutThreshold();
+    recordingStream.enable(STACK_DEFINITION_NAME);
+    recordingStream.onEvent(EVENT_NAME, this::onCritical);
+    recordingStream.onEvent(STACK_DEFINITION_NAME, this::onStackDefinition);
+    this.stream = recordingStream;
+    recordingStream.startAsync();
+  }
+
+  private void onCritical(RecordedEvent event) {
+    long holdNanos = event.getDuration("holdTime").toNanos();
+    boolean isCopy = event.getBoolean("isCopy");
+    String methodName = event.getString("methodName");
+    this.record(methodName != null ? methodName : UNKNOWN_FRAME, topFrameKey(event), isCopy, holdNanos);
+  }
+
+  private void onStackDefinition(RecordedEvent event) {
+    String stackFrames = event.getString("frames");
+    if (stackFrames == null) {
+      return;
+    }
+    int newLine = stackFrames.indexOf('\n');
+    this.stackDefinitions.putIfAbsent(event.getLong("stackId"), newLine == -1 ? stackFrames : stackFrames.substring(0, newLine));
+  }
+
+  // a frame name if JFR recorded the stack trace, the stack id if the agent captured it
+  private static Object topFrameKey(RecordedEvent event) {
+    RecordedStackTrace stackTrace = event.getStackTrace();
+    if (stackTrace != null && !stackTrace.getFrames().isEmpty()) {
+      RecordedFrame frame = stackTrace.getFrames().get(0);
+      return frame.getMethod().getType().getName() + '.' + frame.getMethod().getName();
+    }
+    if (event.hasField("stackId")) {
+      long stackId = event.getLong("stackId");
+      if (stackId != 0L) {
+        return stackId;
+      }
+    }
+    return UNKNOWN_FRAME;
+  }
+
+  void record(String methodName, Object topFrame, boolean isCopy, long holdNanos) {
+    this.total.record(isCopy, holdNanos);
+    this.methods.computeIfAbsent(methodName, key -> new Accumulator(this.windowNanos)).record(isCopy, holdNanos);
+    Accumulator frame = this.frames.get(topFrame);
+    if (frame == null) {
+      Object key = this.frames.size() < MAX_FRAMES ? topFrame : OTHER_FRAMES;
+      frame = this.frames.computeIfAbsent(key, k -> new Accumulator(this.windowNanos));
+    }
+    frame.record(isCopy, holdNanos);
+  }
+
+  @Override
+  public long getCount() {
+    return this.total.count.sum();
+  }
+
+  @Override
+  public long getCopies() {
+    return this.total.copies.sum();
+  }
+
+  @Override
+  public double getCopyRatio() {
+    long count = this.getCount();
+    return count == 0L ? 0.0d : (double) this.getCopies() / (double) count;
+  }
+
+  @Override
+  public long getWindowSeconds() {
+    return Duration.ofNanos(this.windowNanos).toSeconds();
+  }
+
+  @Override
+  public List<CriticalStatistics> getMethods() {
+    List<CriticalStatistics> statistics = new ArrayList<>(this.methods.size());
+    this.methods.forEach((name, accumulator) -> statistics.add(accumulator.snapshot(name)));
+    statistics.sort(Comparator.comparing(CriticalStatistics::getName));
+    return statistics;
+  }
+
+  @Override
+  public List<CriticalStatistics> getTopFrames() {
+    List<CriticalStatistics> statistics = new ArrayList<>(this.frames.size());
+    this.frames.forEach((key, accumulator) -> statistics.add(accumulator.snapshot(this.frameName(key))));
+    statistics.sort(Comparator.comparingLong(CriticalStatistics::getTotalHoldTimeNanos).reversed());
+    return statistics;
+  }
+
+  private String frameName(Object key) {
+    if (key instanceof Long) {
+      return this.stackDefinitions.getOrDefault(key, "stack " + key);
+    }
+    return (String) key;
+  }
+
+  /**
+   * Stops consuming the events and unregisters the MXBean.
+   *
+   * @throws JMException if the MXBean can not be unregistered
+   */
+  @Override
+  public synchronized void close() throws JMException {
+    RecordingStream recordingStream = this.stream;
+    if (recordingStream != null) {
+      this.stream = null;
+      recordingStream.close();
+    }
+    ObjectName name = this.registeredName;
+    if (name != null) {
+      this.registeredName = null;
+      ManagementFactory.getPlatformMBeanServer().unregisterMBean(name);
+    }
+  }
+
+  /**
+   * Counters and windowed hold time histograms of a method or frame, updated without locks.
+   */
+  static final class Accumulator {
+
+    final LongAdder count;
+    final LongAdder copies;
+    final LongAdder totalHoldNanos;
+    final LongAccumulator maxHoldNanos;
+    private final long halfWindowNanos;
+    private final AtomicReference<Window> window;
+
+    Accumulator(long windowNanos) {
+      this.count = new LongAdder();
+      this.copies = new LongAdder();
+      this.totalHoldNanos = new LongAdder();
+      this.maxHoldNanos = new LongAccumulator(Math::max, 0L);
+      this.halfWindowNanos = Math.max(windowNanos / 2L, 1L);
+      this.window = new AtomicReference<>(new Window(System.nanoTime(), new HoldTimeHistogram(), null));
+    }
+
+    void record(boolean isCopy, long holdNanos) {
+      this.count.increment();
+      if (isCopy) {
+        this.copies.increment();
+      }
+      this.totalHoldNanos.add(holdNanos);
+      this.maxHoldNanos.accumulate(holdNanos);
+      this.currentWindow(System.nanoTime()).current.record(holdNanos);
+    }
+
+    // rotates the halves once the current one is complete, a racing thread may record into the previous half
+    private Window currentWindow(long now) {
+      Window current = this.window.get();
+      if (now - current.startNanos < this.halfWindowNanos) {
+        return current;
+      }
+      // a whole window without events forgets both halves
+      HoldTimeHistogram previous = now - current.startNanos < 2L * this.halfWindowNanos ? current.current : null;
+      Window rotated = new Window(now, new HoldTimeHistogram(), previous);
+      return this.window.compareAndSet(current, rotated) ? rotated : this.window.get();
+    }
+
+    CriticalStatistics snapshot(String name) {
+      long[] counts = new long[HoldTimeHistogram.BUCKET_COUNT];
+      Window current = this.currentWindow(System.nanoTime());
+      current.current.addTo(counts);
+      if (current.previous != null) {
+        current.previous.addTo(counts);
+      }
+      return new CriticalStatistics(name, this.count.sum(), this.copies.sum(), this.totalHoldNanos.sum(),
+          this.maxHoldNanos.get(),
+          HoldTimeHistogram.percentile(counts, 0.5d), HoldTimeHistogram.percentile(counts, 0.99d),
+          HoldTimeHistogram.percentile(counts, 0.999d));
+    }
+
+  }
+
+  /**
+   * The current half of a window and the one before it.
+   */
+  static final class Window {
+
+    final long startNanos;
+    final HoldTimeHistogram current;
+    final HoldTimeHistogram previous;
+
+    Window(long startNanos, HoldTimeHistogram current, HoldTimeHistogram previous) {
+      this.startNanos = startNanos;
+      this.current = current;
+      this.previous = previous;
+    }
+
+  }
+
+}
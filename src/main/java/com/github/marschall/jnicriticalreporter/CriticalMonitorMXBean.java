@@ -0,0 +1,53 @@
+package com.github.marschall.jnicriticalreporter;
+
+import java.util.List;
+
+/**
+ * Live statistics of the JNI criticals reported by the agent.
+ */
+public interface CriticalMonitorMXBean {
+
+  /**
+   * Returns the number of criticals since the monitor was started.
+   *
+   * @return the number of criticals
+   */
+  long getCount();
+
+  /**
+   * Returns the number of criticals where the memory was copied since the monitor was started.
+   *
+   * @return the number of copies
+   */
+  long getCopies();
+
+  /**
+   * Returns the fraction of criticals where the memory was copied.
+   *
+   * @return copies divided by count, 0.0 if there were no criticals
+   */
+  double getCopyRatio();
+
+  /**
+   * Returns the length of the window the percentiles are computed over.
+   *
+   * @return the window in seconds
+   */
+  long getWindowSeconds();
+
+  /**
+   * Returns the statistics per JNI method.
+   *
+   * @return the statistics, one per method
+   */
+  List<CriticalStatistics> getMethods();
+
+  /**
+   * Returns the statistics per top Java frame, ordered by total hold time descending.
+   * Criticals of the agent with {@code stacks=caller} or {@code stacks=N} are attributed once the stack definition was seen.
+   *
+   * @return the statistics, one per top frame
+   */
+  List<CriticalStatistics> getTopFrames();
+
+}
@@ -0,0 +1,128 @@
+package com.github.marschall.jnicriticalreporter;
+
+import javax.management.ConstructorParameters;
+
+/**
+ * Statistics of the criticals of a JNI method or a top frame, mapped to {@code CompositeData} by JMX.
+ * <p>
+ * Counts are totals since the monitor was started, percentiles are computed over the last window.
+ */
+public final class CriticalStatistics {
+
+  private final String name;
+  private final long count;
+  private final long copies;
+  private final long totalHoldTimeNanos;
+  private final long maxHoldTimeNanos;
+  private final long p50HoldTimeNanos;
+  private final long p99HoldTimeNanos;
+  private final long p999HoldTimeNanos;
+
+  /**
+   * Constructor used by JMX clients to reconstruct the statistics.
+   *
+   * @param name the method name or top frame
+   * @param count the number of criticals
+   * @param copies the number of criticals where the memory was copied
+   * @param totalHoldTimeNanos the sum of the hold times
+   * @param maxHoldTimeNanos the maximum hold time
+   * @param p50HoldTimeNanos the median hold time in the last window
+   * @param p99HoldTimeNanos the 99th percentile of the hold time in the last window
+   * @param p999HoldTimeNanos the 99.9th percentile of the hold time in the last window
+   */
+  @ConstructorParameters({"name", "count", "copies", "totalHoldTimeNanos", "maxHoldTimeNanos",
+    "p50HoldTimeNanos", "p99HoldTimeNanos", "p999HoldTimeNanos"})
+  public CriticalStatistics(String name, long count, long copies, long totalHoldTimeNanos, long maxHoldTimeNanos,
+      long p50HoldTimeNanos, long p99HoldTimeNanos, long p999HoldTimeNanos) {
+    this.name = name;
+    this.count = count;
+    this.copies = copies;
+    this.totalHoldTimeNanos = totalHoldTimeNanos;
+    this.maxHoldTimeNanos = maxHoldTimeNanos;
+    this.p50HoldTimeNanos = p50HoldTimeNanos;
+    this.p99HoldTimeNanos = p99HoldTimeNanos;
+    this.p999HoldTimeNanos = p999HoldTimeNanos;
+  }
+
+  /**
+   * Returns the name of the JNI method or the top frame like {@code java.util.zip.Deflater.deflateBytesBytes}.
+   *
+   * @return the name
+   */
+  public String getName() {
+    return this.name;
+  }
+
+  /**
+   * Returns the number of criticals since the monitor was started.
+   *
+   * @return the number of criticals
+   */
+  public long getCount() {
+    return this.count;
+  }
+
+  /**
+   * Returns the number of criticals where the memory was copied since the monitor was started.
+   *
+   * @return the number of copies
+   */
+  public long getCopies() {
+    return this.copies;
+  }
+
+  /**
+   * Returns the fraction of criticals where the memory was copied, a high ratio indicates the GC does not support pinning.
+   *
+   * @return copies divided by count, 0.0 if there were no criticals
+   */
+  public double getCopyRatio() {
+    return this.count == 0L ? 0.0d : (double) this.copies / (double) this.count;
+  }
+
+  /**
+   * Returns the sum of the hold times since the monitor was started.
+   *
+   * @return the total hold time in nanoseconds
+   */
+  public long getTotalHoldTimeNanos() {
+    return this.totalHoldTimeNanos;
+  }
+
+  /**
+   * Returns the longest hold time since the monitor was started.
+   *
+   * @return the maximum hold time in nanoseconds
+   */
+  public long getMaxHoldTimeNanos() {
+    return this.maxHoldTimeNanos;
+  }
+
+  /**
+   * Returns the median hold time in the last window.
+   *
+   * @return the median hold time in nanoseconds
+   */
+  public long getP50HoldTimeNanos() {
+    return this.p50HoldTimeNanos;
+  }
+
+  /**
+   * Returns the 99th percentile of the hold time in the last window.
+   *
+   * @return the 99th percentile in nanoseconds
+   */
+  public long getP99HoldTimeNanos() {
+    return this.p99HoldTimeNanos;
+  }
+
+  /**
+   * Returns the 99.9th percentile of the hold time in the last window.
+   *
+   * @return the 99.9th percentile in nanoseconds
+   */
+  public long getP999HoldTimeNanos() {
+    return this.p999HoldTimeNanos;
+  }
+
+}
@@ -0,0 +1,87 @@
+package com.github.marschall.jnicriticalreporter;
+
+import java.util.concurrent.atomic.AtomicLongArray;
+
+/**
+ * Lock-free log-linear histogram of hold times in nanoseconds.
+ * <p>
+ * Values below 16 have their own bucket, larger values are split into 8 buckets per power of two, the relative
+ * error of a percentile is at most 12.5%.
+ */
+final class HoldTimeHistogram {
+
+  private static final int LINEAR_BUCKETS = 16;
+  private static final int SUB_BUCKET_BITS = 3;
+  private static final int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  // the first power of two with sub buckets is 2^4 = LINEAR_BUCKETS
+  private static final int FIRST_EXPONENT = 4;
+  static final int BUCKET_COUNT = LINEAR_BUCKETS + (63 - FIRST_EXPONENT) * SUB_BUCKETS;
+
+  private final AtomicLongArray buckets;
+
+  HoldTimeHistogram() {
+    this.buckets = new AtomicLongArray(BUCKET_COUNT);
+  }
+
+  static int bucketIndex(long nanos) {
+    if (nanos < LINEAR_BUCKETS) {
+      return (int) Math.max(nanos, 0L);
+    }
+    int exponent = 63 - Long.numberOfLeadingZeros(nanos);
+    int subBucket = (int) (nanos >>> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return LINEAR_BUCKETS + (exponent - FIRST_EXPONENT) * SUB_BUCKETS + subBucket;
+  }
+
+  // largest value that falls into the bucket
+  static long bucketUpperBound(int index) {
+    if (index < LINEAR_BUCKETS) {
+      return index;
+    }
+    int exponent = (index - LINEAR_BUCKETS) / SUB_BUCKETS + FIRST_EXPONENT;
+    int subBucket = (index - LINEAR_BUCKETS) % SUB_BUCKETS;
+    long width = 1L << (exponent - SUB_BUCKET_BITS);
+    return (SUB_BUCKETS + subBucket) * width + width - 1L;
+  }
+
+  void record(long nanos) {
+    this.buckets.incrementAndGet(bucketIndex(nanos));
+  }
+
+  /**
+   * Adds the counts of this histogram to the counts.
+   *
+   * @param counts the counts to add to, indexed by bucket
+   */
+  void addTo(long[] counts) {
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+      counts[i] += this.buckets.get(i);
+    }
+  }
+
+  /**
+   * Computes a percentile from bucket counts.
+   *
+   * @param counts the counts indexed by bucket
+   * @param percentile the percentile from 0.0 to 1.0
+   * @return the upper bound of the bucket containing the percentile, 0 if there are no values
+   */
+  static long percentile(long[] counts, double percentile) {
+    long total = 0L;
+    for (long count : counts) {
+      total += count;
+    }
+    if (total == 0L) {
+      return 0L;
+    }
+    long rank = Math.max((long) Math.ceil(percentile * total), 1L);
+    long seen = 0L;
+    for (int i = 0; i < counts.length; i++) {
+      seen += counts[i];
+      if (seen >= rank) {
+        return bucketUpperBound(i);
+      }
+    }
+    return bucketUpperBound(counts.length - 1);
+  }
+
+}
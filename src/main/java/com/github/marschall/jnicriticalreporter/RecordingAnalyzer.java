@@ -0,0 +1,457 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static java.nio.charset.StandardCharsets.UTF_8;
+
+import java.io.IOException;
+import java.io.Writer;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.time.Duration;
+import java.time.Instant;
+import java.util.ArrayList;
+import java.util.Comparator;
+import java.util.HashMap;
+import java.util.List;
+import java.util.Locale;
+import java.util.Map;
+import java.util.TreeMap;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
+
+import jdk.jfr.consumer.RecordedEvent;
+import jdk.jfr.consumer.RecordedFrame;
+import jdk.jfr.consumer.RecordedStackTrace;
+import jdk.jfr.consumer.RecordingFile;
+
+/**
+ * Analyzes the {@code com.github.marschall.jnicriticalreporter.Event} events of many recordings in parallel.
+ * <pre>
+ * java -cp jni-critical-reporter.jar com.github.marschall.jnicriticalreporter.RecordingAnalyzer [--report file] [--collapsed file] [--in-flight file] [--bucket duration] [--threads n] recording...
+ * </pre>
+ * Every recording is read by a single thread one event at a time, only the aggregates are kept in memory. Without
+ * options the report is printed.
+ */
+public final class RecordingAnalyzer {
+
+  private static final String EVENT_NAME = "com.github.marschall.jnicriticalreporter.Event";
+  private static final String STACK_DEFINITION_NAME = "com.github.marschall.jnicriticalreporter.StackDefinition";
+  private static final String GARBAGE_COLLECTION_NAME = "jdk.GarbageCollection";
+  static final Duration DEFAULT_BUCKET = Duration.ofMillis(10L);
+  static final String UNKNOWN_CALL_SITE = "[unknown]";
+
+  static final String REPORT_HEADER = "methodName,callSite,count,copies,copyRatio,p50HoldTime,p99HoldTime,maxHoldTime,totalHoldTime";
+  static final String IN_FLIGHT_HEADER = "bucketStartTime,criticalsStarted,averageInFlight,gcPauseTime";
+
+  private RecordingAnalyzer() {
+    throw new AssertionError("not instantiable");
+  }
+
+  public static void main(String[] args) throws IOException, InterruptedException {
+    Path report = null;
+    Path collapsed = null;
+    Path inFlight = null;
+    Duration bucket = DEFAULT_BUCKET;
+    int threads = Runtime.getRuntime().availableProcessors();
+    List<Path> recordings = new ArrayList<>();
+    boolean valid = true;
+    for (int i = 0; i < args.length && valid; i++) {
+      String arg = args[i];
+      if (arg.equals("--report") && i + 1 < args.length) {
+        report = Path.of(args[++i]);
+      } else if (arg.equals("--collapsed") && i + 1 < args.length) {
+        collapsed = Path.of(args[++i]);
+      } else if (arg.equals("--in-flight") && i + 1 < args.length) {
+        inFlight = Path.of(args[++i]);
+      } else if (arg.equals("--bucket") && i + 1 < args.length) {
+        bucket = parseDuration(args[++i]);
+      } else if (arg.equals("--threads") && i + 1 < args.length) {
+        threads = Integer.parseInt(args[++i]);
+      } else if (!arg.startsWith("--")) {
+        recordings.add(Path.of(arg));
+      } else {
+        valid = false;
+      }
+    }
+    if (!valid || recordings.isEmpty() || bucket.isZero() || bucket.isNegative() || threads < 1) {
+      System.err.println("usage: RecordingAnalyzer [--report file] [--collapsed file] [--in-flight file] [--bucket duration] [--threads n] recording...");
+      System.exit(1);
+    }
+
+    Analysis analysis = analyze(recordings, bucket, threads);
+    if (report != null) {
+      try (Writer writer = Files.newBufferedWriter(report, UTF_8)) {
+        analysis.writeReport(writer);
+      }
+    }
+    if (collapsed != null) {
+      try (Writer writer = Files.newBufferedWriter(collapsed, UTF_8)) {
+        analysis.writeCollapsed(writer);
+      }
+    }
+    if (inFlight != null) {
+      try (Writer writer = Files.newBufferedWriter(inFlight, UTF_8)) {
+        analysis.writeInFlight(writer);
+      }
+    }
+    if (report == null && collapsed == null && inFlight == null) {
+      analysis.writeReport(System.out);
+    }
+  }
+
+  // the same format as the durations of the agent options like 10ms
+  static Duration parseDuration(String value) {
+    int unitStart = 0;
+    while (unitStart < value.length() && Character.isDigit(value.charAt(unitStart))) {
+      unitStart += 1;
+    }
+    if (unitStart == 0) {
+      throw new IllegalArgumentException("invalid duration: " + value);
+    }
+    long amount = Long.parseLong(value.substring(0, unitStart));
+    switch (value.substring(unitStart)) {
+      case "ns":
+        return Duration.ofNanos(amount);
+      case "us":
+        return Duration.ofNanos(Math.multiplyExact(amount, 1_000L));
+      case "ms":
+        return Duration.ofMillis(amount);
+      case "s":
+        return Duration.ofSeconds(amount);
+      default:
+        throw new IllegalArgumentException("invalid duration: " + value);
+    }
+  }
+
+  /**
+   * Analyzes recordings in parallel, one recording per task.
+   *
+   * @param recordings the recordings to read
+   * @param bucket the width of the buckets of the in-flight series
+   * @param threads the number of recordings read at the same time
+   * @return the merged analysis of all recordings
+   * @throws IOException if a recording can not be read
+   * @throws InterruptedException if interrupted while waiting for the recordings to be read
+   */
+  public static Analysis analyze(List<Path> recordings, Duration bucket, int threads) throws IOException, InterruptedException {
+    ExecutorService executor = Executors.newFixedThreadPool(Math.min(threads, Math.max(recordings.size(), 1)));
+    try {
+      List<Future<Analysis>> futures = new ArrayList<>(recordings.size());
+      for (Path recording : recordings) {
+        futures.add(executor.submit(() -> analyzeRecording(recording, bucket)));
+      }
+      Analysis merged = new Analysis(bucket);
+      for (Future<Analysis> future : futures) {
+        try {
+          merged.merge(future.get());
+        } catch (ExecutionException e) {
+          Throwable cause = e.getCause();
+          if (cause instanceof IOException) {
+            throw (IOException) cause;
+          }
+          throw new IllegalStateException("analyzing a recording failed", cause);
+        }
+      }
+      return merged;
+    } finally {
+      executor.shutdownNow();
+    }
+  }
+
+  /**
+   * Analyzes a single recording.
+   *
+   * @param recording the recording to read
+   * @param bucket the width of the buckets of the in-flight series
+   * @return the analysis of the recording
+   * @throws IOException if the recording can not be read
+   */
+  public static Analysis analyzeRecording(Path recording, Duration bucket) throws IOException {
+    Analysis analysis = new Analysis(bucket);
+    // stack ids are only unique within a recording, resolved once all stack definitions are seen
+    Map<Long, String> stackDefinitions = new HashMap<>();
+    Map<Long, Long> holdNanosByStackId = new HashMap<>();
+    try (RecordingFile file = new RecordingFile(recording)) {
+      while (file.hasMoreEvents()) {
+        RecordedEvent event = file.readEvent();
+        String eventName = event.getEventType().getName();
+        if (eventName.equals(EVENT_NAME)) {
+          analysis.addCritical(event, stackDefinitions, holdNanosByStackId);
+        } else if (eventName.equals(STACK_DEFINITION_NAME)) {
+          String frames = event.getString("frames");
+          if (frames != null) {
+            stackDefinitions.putIfAbsent(event.getLong("stackId"), frames);
+          }
+        } else if (eventName.equals(GARBAGE_COLLECTION_NAME)) {
+          analysis.addGarbageCollection(event);
+        }
+      }
+    }
+    holdNanosByStackId.forEach((stackId, holdNanos) -> {
+      String frames = stackDefinitions.get(stackId);
+      analysis.addCollapsed(frames != null ? collapseDefinition(frames) : "stack " + stackId, holdNanos);
+    });
+    return analysis;
+  }
+
+  // StackDefinition frames are one per line with the top frame first, collapsed stacks start at the root
+  static String collapseDefinition(String frames) {
+    String[] lines = frames.split("\n");
+    StringBuilder collapsed = new StringBuilder(frames.length());
+    for (int i = lines.length - 1; i >= 0; i--) {
+      if (!lines[i].isEmpty()) {
+        if (collapsed.length() > 0) {
+          collapsed.append(';');
+        }
+        collapsed.append(lines[i].trim().replace(';', ':'));
+      }
+    }
+    return collapsed.toString();
+  }
+
+  static String collapseStackTrace(RecordedStackTrace stackTrace) {
+    List<RecordedFrame> frames = stackTrace.getFrames();
+    StringBuilder collapsed = new StringBuilder(frames.size() * 32);
+    for (int i = frames.size() - 1; i >= 0; i--) {
+      if (collapsed.length() > 0) {
+        collapsed.append(';');
+      }
+      collapsed.append(frameName(frames.get(i)));
+    }
+    return collapsed.toString();
+  }
+
+  private static String frameName(RecordedFrame frame) {
+    return frame.getMethod().getType().getName() + '.' + frame.getMethod().getName();
+  }
+
+  /**
+   * The aggregates of one or more recordings.
+   */
+  public static final class Analysis {
+
+    private final long bucketNanos;
+    private final Map<CallSiteKey, CallSiteStatistics> callSites;
+    private final Map<String, Long> collapsed;
+    // indexed by bucket start in nanoseconds since the epoch divided by bucketNanos
+    private final TreeMap<Long, InFlightBucket> inFlight;
+
+    Analysis(Duration bucket) {
+      this.bucketNanos = bucket.toNanos();
+      this.callSites = new HashMap<>();
+      this.collapsed = new HashMap<>();
+      this.inFlight = new TreeMap<>();
+    }
+
+    void addCritical(RecordedEvent event, Map<Long, String> stackDefinitions, Map<Long, Long> holdNanosByStackId) {
+      long holdNanos = event.getDuration("holdTime").toNanos();
+      boolean isCopy = event.getBoolean("isCopy");
+      String methodName = event.getString("methodName");
+
+      RecordedStackTrace stackTrace = event.getStackTrace();
+      long stackId = event.hasField("stackId") ? event.getLong("stackId") : 0L;
+      String callSite = event.hasField("callSite") ? event.getString("callSite") : null;
+      if (callSite == null) {
+        if (stackTrace != null && !stackTrace.getFrames().isEmpty()) {
+          callSite = frameName(stackTrace.getFrames().get(0));
+        } else if (stackId != 0L && stackDefinitions.containsKey(stackId)) {
+          String frames = stackDefinitions.get(stackId);
+          int newLine = frames.indexOf('\n');
+          callSite = (newLine == -1 ? frames : frames.substring(0, newLine)).trim();
+        } else {
+          callSite = stackId != 0L ? "stack " + stackId : UNKNOWN_CALL_SITE;
+        }
+      }
+      this.callSites.computeIfAbsent(new CallSiteKey(methodName != null ? methodName : UNKNOWN_CALL_SITE, callSite),
+          key -> new CallSiteStatistics()).add(isCopy, holdNanos);
+
+      if (stackTrace != null && !stackTrace.getFrames().isEmpty()) {
+        this.addCollapsed(collapseStackTrace(stackTrace), holdNanos);
+      } else if (stackId != 0L) {
+        holdNanosByStackId.merge(stackId, holdNanos, Long::sum);
+      }
+
+      // criticalStartTime only has millisecond precision
+      Instant criticalStart = event.getInstant("criticalStartTime");
+      long acquireNanos = event.hasField("acquireTime") ? event.getDuration("acquireTime").toNanos() : 0L;
+      long acquiredNanos = epochNanos(criticalStart) + acquireNanos;
+      this.addInFlight(acquiredNanos, acquiredNanos + holdNanos);
+    }
+
+    void addCollapsed(String stack, long holdNanos) {
+      this.collapsed.merge(stack, holdNanos, Long::sum);
+    }
+
+    void addGarbageCollection(RecordedEvent event) {
+      // the sum of the pauses is spread over the whole collection
+      long startNanos = epochNanos(event.getStartTime());
+      long endNanos = Math.max(epochNanos(event.getEndTime()), startNanos + 1L);
+      long pauseNanos = event.hasField("sumOfPauses") ? event.getDuration("sumOfPauses").toNanos() : endNanos - startNanos;
+      double pausePerNano = (double) pauseNanos / (double) (endNanos - startNanos);
+      this.forEachBucket(startNanos, endNanos, (bucket, overlapNanos) -> bucket.gcPauseNanos += (long) (overlapNanos * pausePerNano));
+    }
+
+    private void addInFlight(long startNanos, long endNanos) {
+      this.bucket(Math.floorDiv(startNanos, this.bucketNanos)).started += 1L;
+      this.forEachBucket(startNanos, Math.max(endNanos, startNanos + 1L), (bucket, overlapNanos) -> bucket.inFlightNanos += overlapNanos);
+    }
+
+    private void forEachBucket(long startNanos, long endNanos, BucketAction action) {
+      for (long index = Math.floorDiv(startNanos, this.bucketNanos); index * this.bucketNanos < endNanos; index++) {
+        long bucketStart = index * this.bucketNanos;
+        long overlapNanos = Math.min(endNanos, bucketStart + this.bucketNanos) - Math.max(startNanos, bucketStart);
+        action.accept(this.bucket(index), overlapNanos);
+      }
+    }
+
+    private InFlightBucket bucket(long index) {
+      return this.inFlight.computeIfAbsent(index, key -> new InFlightBucket());
+    }
+
+    void merge(Analysis other) {
+      other.callSites.forEach((key, statistics) -> this.callSites.merge(key, statistics, CallSiteStatistics::merge));
+      other.collapsed.forEach((stack, holdNanos) -> this.collapsed.merge(stack, holdNanos, Long::sum));
+      other.inFlight.forEach((index, bucket) -> this.inFlight.merge(index, bucket, InFlightBucket::merge));
+    }
+
+    /**
+     * Returns the number of criticals analyzed.
+     *
+     * @return the number of criticals
+     */
+    public long criticalCount() {
+      long count = 0L;
+      for (CallSiteStatistics statistics : this.callSites.values()) {
+        count += statistics.count;
+      }
+      return count;
+    }
+
+    /**
+     * Writes one CSV line per method and call site ordered by total hold time descending, times are in nanoseconds.
+     * The call site is the native caller if the agent reported it, otherwise the top Java frame.
+     *
+     * @param output where to write the report to
+     * @throws IOException if writing fails
+     */
+    public void writeReport(Appendable output) throws IOException {
+      output.append(REPORT_HEADER).append('\n');
+      List<Map.Entry<CallSiteKey, CallSiteStatistics>> entries = new ArrayList<>(this.callSites.entrySet());
+      entries.sort(Comparator.comparingLong((Map.Entry<CallSiteKey, CallSiteStatistics> entry) -> entry.getValue().totalHoldNanos).reversed());
+      for (Map.Entry<CallSiteKey, CallSiteStatistics> entry : entries) {
+        CallSiteStatistics statistics = entry.getValue();
+        output.append(entry.getKey().methodName).append(',')
+              .append(csvQuote(entry.getKey().callSite)).append(',')
+              .append(Long.toString(statistics.count)).append(',')
+              .append(Long.toString(statistics.copies)).append(',')
+              .append(String.format(Locale.ROOT, "%.4f", (double) statistics.copies / (double) statistics.count)).append(',')
+              .append(Long.toString(HoldTimeHistogram.percentile(statistics.buckets, 0.5d))).append(',')
+              .append(Long.toString(HoldTimeHistogram.percentile(statistics.buckets, 0.99d))).append(',')
+              .append(Long.toString(statistics.maxHoldNanos)).append(',')
+              .append(Long.toString(statistics.totalHoldNanos)).append('\n');
+      }
+    }
+
+    /**
+     * Writes the stacks in the collapsed format of {@code flamegraph.pl}, root frame first, weighted by hold time in nanoseconds.
+     *
+     * @param output where to write the stacks to
+     * @throws IOException if writing fails
+     */
+    public void writeCollapsed(Appendable output) throws IOException {
+      for (Map.Entry<String, Long> entry : new TreeMap<>(this.collapsed).entrySet()) {
+        output.append(entry.getKey()).append(' ').append(Long.toString(entry.getValue())).append('\n');
+      }
+    }
+
+    /**
+     * Writes one CSV line per time bucket with criticals or garbage collections, buckets without either are omitted.
+     * {@code averageInFlight} is the time criticals were held in the bucket divided by its width, {@code gcPauseTime}
+     * is in nanoseconds and only available if the recordings contain {@code jdk.GarbageCollection}.
+     *
+     * @param output where to write the series to
+     * @throws IOException if writing fails
+     */
+    public void writeInFlight(Appendable output) throws IOException {
+      output.append(IN_FLIGHT_HEADER).append('\n');
+      for (Map.Entry<Long, InFlightBucket> entry : this.inFlight.entrySet()) {
+        InFlightBucket bucket = entry.getValue();
+        output.append(Instant.EPOCH.plusNanos(entry.getKey() * this.bucketNanos).toString()).append(',')
+              .append(Long.toString(bucket.started)).append(',')
+              .append(String.format(Locale.ROOT, "%.4f", (double) bucket.inFlightNanos / (double) this.bucketNanos)).append(',')
+              .append(Long.toString(bucket.gcPauseNanos)).append('\n');
+      }
+    }
+
+  }
+
+  private static long epochNanos(Instant instant) {
+    return instant.getEpochSecond() * 1_000_000_000L + instant.getNano();
+  }
+
+  private static String csvQuote(String value) {
+    if (value.indexOf(',') == -1 && value.indexOf('"') == -1 && value.indexOf('\n') == -1) {
+      return value;
+    }
+    return '"' + value.replace("\"", "\"\"") + '"';
+  }
+
+  @FunctionalInterface
+  interface BucketAction {
+
+    void accept(InFlightBucket bucket, long overlapNanos);
+
+  }
+
+  record CallSiteKey(String methodName, String callSite) {
+
+  }
+
+  static final class CallSiteStatistics {
+
+    long count;
+    long copies;
+    long totalHoldNanos;
+    long maxHoldNanos;
+    final long[] buckets = new long[HoldTimeHistogram.BUCKET_COUNT];
+
+    void add(boolean isCopy, long holdNanos) {
+      this.count += 1L;
+      if (isCopy) {
+        this.copies += 1L;
+      }
+      this.totalHoldNanos += holdNanos;
+      this.maxHoldNanos = Math.max(this.maxHoldNanos, holdNanos);
+      this.buckets[HoldTimeHistogram.bucketIndex(holdNanos)] += 1L;
+    }
+
+    CallSiteStatistics merge(CallSiteStatistics other) {
+      this.count += other.count;
+      this.copies += other.copies;
+      this.totalHoldNanos += other.totalHoldNanos;
+      this.maxHoldNanos = Math.max(this.maxHoldNanos, other.maxHoldNanos);
+      for (int i = 0; i < this.buckets.length; i++) {
+        this.buckets[i] += other.buckets[i];
+      }
+      return this;
+    }
+
+  }
+
+  static final class InFlightBucket {
+
+    long started;
+    long inFlightNanos;
+    long gcPauseNanos;
+
+    InFlightBucket merge(InFlightBucket other) {
+      this.started += other.started;
+      this.inFlightNanos += other.inFlightNanos;
+      this.gcPauseNanos += other.gcPauseNanos;
+      return this;
+    }
+
+  }
+
+}
@@ -0,0 +1,270 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static java.nio.charset.StandardCharsets.UTF_8;
+
+import java.io.IOException;
+import java.io.PrintStream;
+import java.io.Writer;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.time.Instant;
+import java.util.Arrays;
+import java.util.List;
+import java.util.Locale;
+import java.util.Map;
+import java.util.TreeMap;
+
+import jdk.jfr.AnnotationElement;
+import jdk.jfr.Category;
+import jdk.jfr.DataAmount;
+import jdk.jfr.Description;
+import jdk.jfr.Event;
+import jdk.jfr.EventFactory;
+import jdk.jfr.Label;
+import jdk.jfr.Name;
+import jdk.jfr.Recording;
+import jdk.jfr.StackTrace;
+import jdk.jfr.Timespan;
+import jdk.jfr.Timestamp;
+import jdk.jfr.ValueDescriptor;
+
+/**
+ * Converts a trace file written with {@code mode=trace} to CSV or JFR and prints summaries.
+ * <pre>
+ * java -cp jni-critical-reporter.jar com.github.marschall.jnicriticalreporter.TraceConverter [--csv file] [--jfr file] [--summary] trace-file
+ * </pre>
+ * Without options a summary is printed.
+ */
+public final class TraceConverter {
+
+  // not the name of the agent event, the fields differ
+  private static final String EVENT_NAME = "com.github.marschall.jnicriticalreporter.TraceEvent";
+
+  static final String CSV_HEADER = "threadId,threadName,methodName,criticalStartTime,acquireTime,holdTime,isCopy,"
+      + "length,elementType,bytes,depth,nestedCriticals,maxDepth,stackId,stringCoder";
+
+  private TraceConverter() {
+    throw new AssertionError("not instantiable");
+  }
+
+  public static void main(String[] args) throws IOException {
+    Path csv = null;
+    Path jfr = null;
+    boolean summary = false;
+    Path traceFile = null;
+    for (int i = 0; i < args.length; i++) {
+      String arg = args[i];
+      if (arg.equals("--csv") && i + 1 < args.length) {
+        csv = Path.of(args[++i]);
+      } else if (arg.equals("--jfr") && i + 1 < args.length) {
+        jfr = Path.of(args[++i]);
+      } else if (arg.equals("--summary")) {
+        summary = true;
+      } else if (!arg.startsWith("--") && traceFile == null) {
+        traceFile = Path.of(arg);
+      } else {
+        traceFile = null;
+        break;
+      }
+    }
+    if (traceFile == null) {
+      System.err.println("usage: TraceConverter [--csv file] [--jfr file] [--summary] trace-file");
+      System.exit(1);
+    }
+
+    TraceFile trace = TraceFile.read(traceFile);
+    if (csv != null) {
+      try (Writer writer = Files.newBufferedWriter(csv, UTF_8)) {
+        writeCsv(trace, writer);
+      }
+    }
+    if (jfr != null) {
+      writeJfr(trace, jfr);
+    }
+    if (summary || (csv == null && jfr == null)) {
+      writeSummary(trace, System.out);
+    }
+  }
+
+  /**
+   * Writes one line per critical, times are in nanoseconds.
+   *
+   * @param trace the trace file
+   * @param output where to write the CSV to
+   * @throws IOException if writing fails
+   */
+  public static void writeCsv(TraceFile trace, Appendable output) throws IOException {
+    output.append(CSV_HEADER).append('\n');
+    for (TraceFile.Segment segment : trace.segments()) {
+      String threadName = csvQuote(segment.threadName());
+      for (int i = 0; i < segment.recordCount(); i++) {
+        TraceFile.TraceRecord record = segment.record(i);
+        String elementType = record.elementTypeName();
+        String coder = record.coderName();
+        output.append(Long.toString(record.threadId())).append(',')
+              .append(threadName).append(',')
+              .append(record.methodName()).append(',')
+              .append(Instant.EPOCH.plusNanos(trace.toEpochNanos(record.startNanos())).toString()).append(',')
+              .append(Long.toString(record.acquireNanos())).append(',')
+              .append(Long.toString(record.holdNanos())).append(',')
+              .append(Boolean.toString(record.isCopy())).append(',')
+              .append(Integer.toString(record.length())).append(',')
+              .append(elementType != null ? elementType : "").append(',')
+              .append(Long.toString(record.bytes())).append(',')
+              .append(Integer.toString(record.depth())).append(',')
+              .append(Integer.toString(record.nestedCriticals())).append(',')
+              .append(Integer.toString(record.maxDepth())).append(',')
+              .append(Integer.toString(record.stackId())).append(',')
+              .append(coder != null ? coder : "").append('\n');
+      }
+    }
+  }
+
+  private static String csvQuote(String value) {
+    if (value.indexOf(',') == -1 && value.indexOf('"') == -1 && value.indexOf('\n') == -1) {
+      return value;
+    }
+    return '"' + value.replace("\"", "\"\"") + '"';
+  }
+
+  /**
+   * Commits one {@code com.github.marschall.jnicriticalreporter.TraceEvent} per critical in a new recording and dumps it.
+   * The events carry the original start time in {@code criticalStartTime}, the event time is the time of the conversion.
+   *
+   * @param trace the trace file
+   * @param output the JFR file to write
+   * @throws IOException if writing fails
+   */
+  public static void writeJfr(TraceFile trace, Path output) throws IOException {
+    EventFactory factory = EventFactory.create(getEventAnnotations(), getValueDescriptors());
+    try (Recording recording = new Recording()) {
+      recording.enable(EVENT_NAME).withoutThreshold();
+      recording.start();
+      trace.forEach(record -> {
+        Event event = factory.newEvent();
+        event.set(0, record.isCopy());
+        event.set(1, record.methodName());
+        event.set(2, record.holdNanos());
+        event.set(3, trace.toEpochNanos(record.startNanos()) / 1_000_000L);
+        event.set(4, record.threadName());
+        event.set(5, record.threadId());
+        event.set(6, (long) record.length());
+        event.set(7, record.elementTypeName());
+        event.set(8, record.bytes());
+        event.set(9, (long) record.depth());
+        event.set(10, (long) record.nestedCriticals());
+        event.set(11, (long) record.maxDepth());
+        event.set(12, (long) record.stackId());
+        event.set(13, record.acquireNanos());
+        event.set(14, record.coderName());
+        event.commit();
+      });
+      recording.stop();
+      recording.dump(output);
+    }
+  }
+
+  private static List<AnnotationElement> getEventAnnotations() {
+    String[] category = { "JNI" };
+    return List.of(
+        new AnnotationElement(Name.class, EVENT_NAME),
+        new AnnotationElement(Label.class, "JNI Critical Trace"),
+        new AnnotationElement(Description.class, "Lists invocation of JNI critical methods, converted from a trace file"),
+        new AnnotationElement(Category.class, category),
+        new AnnotationElement(StackTrace.class, false));
+  }
+
+  private static List<ValueDescriptor> getValueDescriptors() {
+    return List.of(
+        field(boolean.class, "isCopy", "IsCopy", "Whether the memory was copied"),
+        field(String.class, "methodName", "Method Name", "Name of the JNI critical method"),
+        field(long.class, "holdTime", "Hold Time", "Time between returning from Get*Critical and returning from Release*Critical",
+            new AnnotationElement(Timespan.class, Timespan.NANOSECONDS)),
+        field(long.class, "criticalStartTime", "Critical Start Time", "Time Get*Critical was called",
+            new AnnotationElement(Timestamp.class, Timestamp.MILLISECONDS_SINCE_EPOCH)),
+        field(String.class, "threadName", "Thread Name", "Name of the thread that held the critical, possibly truncated"),
+        field(long.class, "threadId", "Thread ID", "Linux thread id of the thread that held the critical"),
+        field(long.class, "length", "Length", "Number of elements of the array or characters of the string"),
+        field(String.class, "elementType", "Element Type", "Primitive type of the elements, char for strings"),
+        field(long.class, "bytes", "Bytes", "Size of the memory pinned or copied",
+            new AnnotationElement(DataAmount.class, DataAmount.BYTES)),
+        field(long.class, "depth", "Depth", "Nesting depth, 1 for the outermost critical"),
+        field(long.class, "nestedCriticals", "Nested Criticals", "Number of criticals acquired while the outermost critical was held"),
+        field(long.class, "maxDepth", "Max Depth", "Maximum nesting depth while the outermost critical was held"),
+        field(long.class, "stackId", "Stack ID", "Stack captured by the agent, 0 if unknown"),
+        field(long.class, "acquireTime", "Acquire Time", "Time spent in Get*Critical, includes waiting for a garbage collection to finish",
+            new AnnotationElement(Timespan.class, Timespan.NANOSECONDS)),
+        field(String.class, "stringCoder", "String Coder",
+            "LATIN1 or UTF16, GetStringCritical always copies LATIN1 strings, only set for GetStringCritical"));
+  }
+
+  private static ValueDescriptor field(Class<?> type, String name, String label, String description, AnnotationElement... additional) {
+    AnnotationElement[] annotations = Arrays.copyOf(additional, additional.length + 2);
+    annotations[additional.length] = new AnnotationElement(Label.class, label);
+    annotations[additional.length + 1] = new AnnotationElement(Description.class, description);
+    return new ValueDescriptor(type, name, List.of(annotations));
+  }
+
+  /**
+   * Prints count, copies, LATIN1 strings, total, maximum and percentiles of the hold time per method.
+   * The percentiles are the upper bounds of the histogram buckets they fall into, the summary needs constant memory
+   * per method independent of the size of the trace.
+   *
+   * @param trace the trace file
+   * @param output where to print the summary to
+   */
+  public static void writeSummary(TraceFile trace, PrintStream output) {
+    Map<String, MethodSummary> summaries = new TreeMap<>();
+    trace.forEach(record -> summaries.computeIfAbsent(record.methodName(), MethodSummary::new).add(record));
+    output.printf(Locale.ROOT, "pid %d, %d segments, %d dropped records%n",
+        trace.pid(), trace.segments().size(), trace.droppedRecords());
+    for (MethodSummary summary : summaries.values()) {
+      summary.print(output);
+    }
+  }
+
+  static final class MethodSummary {
+
+    private final String methodName;
+    private final long[] buckets;
+    private long count;
+    private long copies;
+    private long latin1Strings;
+    private long bytes;
+    private long totalAcquireNanos;
+    private long totalHoldNanos;
+    private long maxHoldNanos;
+
+    MethodSummary(String methodName) {
+      this.methodName = methodName;
+      this.buckets = new long[HoldTimeHistogram.BUCKET_COUNT];
+    }
+
+    void add(TraceFile.TraceRecord record) {
+      long holdNanos = record.holdNanos();
+      this.count += 1L;
+      this.totalHoldNanos += holdNanos;
+      this.maxHoldNanos = Math.max(this.maxHoldNanos, holdNanos);
+      this.buckets[HoldTimeHistogram.bucketIndex(holdNanos)] += 1L;
+      if (record.isCopy()) {
+        this.copies += 1;
+      }
+      if ("LATIN1".equals(record.coderName())) {
+        this.latin1Strings += 1;
+      }
+      this.bytes += record.bytes();
+      this.totalAcquireNanos += record.acquireNanos();
+    }
+
+    void print(PrintStream output) {
+      output.printf(Locale.ROOT, "%s: count %d, copies %d, latin1 strings %d, bytes %d, acquire time %d ns, "
+          + "hold time total %d ns, p50 %d ns, p90 %d ns, p99 %d ns, p99.9 %d ns, max %d ns%n",
+          this.methodName, this.count, this.copies, this.latin1Strings, this.bytes, this.totalAcquireNanos, this.totalHoldNanos,
+          HoldTimeHistogram.percentile(this.buckets, 0.5d), HoldTimeHistogram.percentile(this.buckets, 0.9d),
+          HoldTimeHistogram.percentile(this.buckets, 0.99d), HoldTimeHistogram.percentile(this.buckets, 0.999d),
+          this.maxHoldNanos);
+    }
+
+  }
+
+}
@@ -0,0 +1,320 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static java.nio.charset.StandardCharsets.UTF_8;
+
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.channels.FileChannel;
+import java.nio.channels.FileChannel.MapMode;
+import java.nio.file.Path;
+import java.nio.file.StandardOpenOption;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+import java.util.function.Consumer;
+
+/**
+ * A trace file written by the agent with {@code mode=trace}.
+ * <p>
+ * The file is a header followed by fixed-size segments. Every segment belongs to a single thread and contains
+ * fixed-size records. The layout has to match {@code trace-file.h}. Files of crashed JVMs can be read as well,
+ * only records that were completely written are visible.
+ */
+public final class TraceFile {
+
+  static final byte[] MAGIC = { 'J', 'N', 'I', 'C', 'R', 'I', 'T', 0 };
+  static final int VERSION = 1;
+  static final int HEADER_SIZE = 4096;
+  static final int SEGMENT_HEADER_SIZE = 64;
+  static final int RECORD_SIZE = 40;
+  static final int THREAD_NAME_LENGTH = 40;
+
+  private static final String[] METHOD_NAMES = { "GetStringCritical", "GetPrimitiveArrayCritical" };
+  private static final String[] ELEMENT_TYPES = { "boolean", "byte", "char", "short", "int", "long", "float", "double" };
+  private static final int[] ELEMENT_SIZES = { 1, 1, 2, 2, 4, 8, 4, 8 };
+  private static final String[] CODERS = { null, "LATIN1", "UTF16" };
+
+  private final long pid;
+  private final long epochOffsetNanos;
+  private final long droppedRecords;
+  private final List<Segment> segments;
+
+  private TraceFile(long pid, long epochOffsetNanos, long droppedRecords, List<Segment> segments) {
+    this.pid = pid;
+    this.epochOffsetNanos = epochOffsetNanos;
+    this.droppedRecords = droppedRecords;
+    this.segments = segments;
+  }
+
+  /**
+   * Maps a trace file.
+   *
+   * @param path the file written by the agent
+   * @return the trace file
+   * @throws IOException if the file can not be read or is not a trace file
+   */
+  public static TraceFile read(Path path) throws IOException {
+    try (FileChannel channel = FileChannel.open(path, StandardOpenOption.READ)) {
+      if (channel.size() < HEADER_SIZE) {
+        throw new IOException("not a trace file: " + path);
+      }
+      ByteBuffer header = channel.map(MapMode.READ_ONLY, 0L, HEADER_SIZE);
+      byte[] magic = new byte[MAGIC.length];
+      header.get(0, magic);
+      if (!Arrays.equals(magic, MAGIC)) {
+        throw new IOException("not a trace file: " + path);
+      }
+      // written in the byte order of the machine running the agent
+      header.order(ByteOrder.LITTLE_ENDIAN);
+      if (header.getInt(8) != VERSION) {
+        header.order(ByteOrder.BIG_ENDIAN);
+        if (header.getInt(8) != VERSION) {
+          throw new IOException("unsupported trace file version: " + path);
+        }
+      }
+      int recordSize = header.getInt(12);
+      int segmentSize = header.getInt(16);
+      int segmentCount = header.getInt(20);
+      if (recordSize != RECORD_SIZE || segmentSize <= SEGMENT_HEADER_SIZE) {
+        throw new IOException("unsupported trace file layout: " + path);
+      }
+      long pid = header.getLong(24);
+      long epochOffsetNanos = header.getLong(32);
+      // may be larger than segmentCount if the file was full
+      int claimedSegments = Math.min(header.getInt(40), segmentCount);
+      long droppedRecords = header.getLong(48);
+
+      int capacity = (segmentSize - SEGMENT_HEADER_SIZE) / RECORD_SIZE;
+      List<Segment> segments = new ArrayList<>(claimedSegments);
+      for (int i = 0; i < claimedSegments; i++) {
+        long position = HEADER_SIZE + (long) i * segmentSize;
+        if (position + segmentSize > channel.size()) {
+          break;
+        }
+        ByteBuffer segment = channel.map(MapMode.READ_ONLY, position, segmentSize).order(header.order());
+        long threadId = segment.getLong(0);
+        // a crash may leave a count that was not yet stored
+        int recordCount = (int) Math.min(Math.max(segment.getLong(8), 0L), capacity);
+        String threadName = readThreadName(segment);
+        segments.add(new Segment(threadId, threadName, segment, recordCount));
+      }
+      // the mappings stay valid after the channel is closed
+      return new TraceFile(pid, epochOffsetNanos, droppedRecords, List.copyOf(segments));
+    }
+  }
+
+  private static String readThreadName(ByteBuffer segment) {
+    byte[] name = new byte[THREAD_NAME_LENGTH];
+    segment.get(16, name);
+    int length = 0;
+    while (length < name.length && name[length] != 0) {
+      length += 1;
+    }
+    return new String(name, 0, length, UTF_8);
+  }
+
+  /**
+   * Returns the process id of the JVM that wrote the file.
+   *
+   * @return the process id
+   */
+  public long pid() {
+    return this.pid;
+  }
+
+  /**
+   * Converts a native timestamp of a record to nanoseconds since the epoch.
+   *
+   * @param nanos a timestamp of a record
+   * @return nanoseconds since the epoch
+   */
+  public long toEpochNanos(long nanos) {
+    return nanos + this.epochOffsetNanos;
+  }
+
+  /**
+   * Returns the number of records that were not written because the file was full.
+   *
+   * @return the number of dropped records
+   */
+  public long droppedRecords() {
+    return this.droppedRecords;
+  }
+
+  /**
+   * Returns the segments in the order they were claimed.
+   *
+   * @return the segments, not modifiable
+   */
+  public List<Segment> segments() {
+    return this.segments;
+  }
+
+  /**
+   * Passes every record of every segment to the action.
+   *
+   * @param action the action to perform for every record
+   */
+  public void forEach(Consumer<? super TraceRecord> action) {
+    for (Segment segment : this.segments) {
+      segment.forEach(action);
+    }
+  }
+
+  /**
+   * The records of a single thread. A thread can have several segments.
+   */
+  public static final class Segment {
+
+    private final long threadId;
+    private final String threadName;
+    private final ByteBuffer buffer;
+    private final int recordCount;
+
+    Segment(long threadId, String threadName, ByteBuffer buffer, int recordCount) {
+      this.threadId = threadId;
+      this.threadName = threadName;
+      this.buffer = buffer;
+      this.recordCount = recordCount;
+    }
+
+    /**
+     * Returns the Linux thread id of the thread that wrote the segment.
+     *
+     * @return the native thread id
+     */
+    public long threadId() {
+      return this.threadId;
+    }
+
+    /**
+     * Returns the name of the thread that wrote the segment, possibly truncated.
+     *
+     * @return the thread name
+     */
+    public String threadName() {
+      return this.threadName;
+    }
+
+    /**
+     * Returns the number of records in the segment.
+     *
+     * @return the number of records
+     */
+    public int recordCount() {
+      return this.recordCount;
+    }
+
+    /**
+     * Returns a record of the segment.
+     *
+     * @param index the index of the record, from 0 to {@link #recordCount()} exclusive
+     * @return the record
+     */
+    public TraceRecord record(int index) {
+      if (index < 0 || index >= this.recordCount) {
+        throw new IndexOutOfBoundsException(index);
+      }
+      int offset = SEGMENT_HEADER_SIZE + index * RECORD_SIZE;
+      ByteBuffer b = this.buffer;
+      return new TraceRecord(this.threadId, this.threadName,
+          b.getLong(offset), b.getLong(offset + 8), b.getLong(offset + 16),
+          b.getInt(offset + 24), b.getInt(offset + 28),
+          Byte.toUnsignedInt(b.get(offset + 32)), b.get(offset + 33) != 0, Byte.toUnsignedInt(b.get(offset + 34)),
+          Byte.toUnsignedInt(b.get(offset + 35)), Short.toUnsignedInt(b.getShort(offset + 36)),
+          Byte.toUnsignedInt(b.get(offset + 38)), Byte.toUnsignedInt(b.get(offset + 39)));
+    }
+
+    /**
+     * Passes every record of the segment to the action.
+     *
+     * @param action the action to perform for every record
+     */
+    public void forEach(Consumer<? super TraceRecord> action) {
+      for (int i = 0; i < this.recordCount; i++) {
+        action.accept(record(i));
+      }
+    }
+
+  }
+
+  /**
+   * A single critical, the timestamps are native and can be converted with {@link TraceFile#toEpochNanos(long)}.
+   *
+   * @param threadId the Linux thread id of the thread that held the critical
+   * @param threadName the name of the thread that held the critical, possibly truncated
+   * @param startNanos the time before {@code Get*Critical}
+   * @param acquiredNanos the time after {@code Get*Critical} returned
+   * @param endNanos the time after {@code Release*Critical} returned
+   * @param length the number of elements of the array or characters of the string
+   * @param stackId the interned stack, 0 if unknown
+   * @param method 0 for {@code GetStringCritical}, 1 for {@code GetPrimitiveArrayCritical}
+   * @param isCopy whether the memory was copied
+   * @param elementType the element type index, 8 if unknown
+   * @param depth the nesting depth, 1 for the outermost critical
+   * @param nestedCriticals the number of criticals acquired while the outermost critical was held
+   * @param maxDepth the maximum nesting depth while the outermost critical was held
+   * @param coder the coder of the string, 1 for LATIN1, 2 for UTF16, 0 if unknown or an array
+   */
+  public record TraceRecord(long threadId, String threadName, long startNanos, long acquiredNanos, long endNanos,
+      int length, int stackId, int method, boolean isCopy, int elementType, int depth, int nestedCriticals, int maxDepth,
+      int coder) {
+
+    /**
+     * Returns the name of the JNI method.
+     *
+     * @return {@code GetStringCritical} or {@code GetPrimitiveArrayCritical}
+     */
+    public String methodName() {
+      return method < METHOD_NAMES.length ? METHOD_NAMES[method] : "unknown";
+    }
+
+    /**
+     * Returns the Java name of the element type.
+     *
+     * @return the element type like {@code int}, {@code null} if unknown
+     */
+    public String elementTypeName() {
+      return elementType < ELEMENT_TYPES.length ? ELEMENT_TYPES[elementType] : null;
+    }
+
+    /**
+     * Returns the coder of the string, {@code GetStringCritical} always copies LATIN1 strings.
+     *
+     * @return {@code LATIN1} or {@code UTF16}, {@code null} if unknown or an array
+     */
+    public String coderName() {
+      return coder < CODERS.length ? CODERS[coder] : null;
+    }
+
+    /**
+     * Returns the size of the memory pinned or copied.
+     *
+     * @return the size in bytes, 0 if the element type is unknown
+     */
+    public long bytes() {
+      return elementType < ELEMENT_SIZES.length ? (long) length * ELEMENT_SIZES[elementType] : 0L;
+    }
+
+    /**
+     * Returns the time spent in {@code Get*Critical}.
+     *
+     * @return the acquire time in nanoseconds
+     */
+    public long acquireNanos() {
+      return acquiredNanos - startNanos;
+    }
+
+    /**
+     * Returns the time between returning from {@code Get*Critical} and returning from {@code Release*Critical}.
+     *
+     * @return the hold time in nanoseconds
+     */
+    public long holdNanos() {
+      return endNanos - acquiredNanos;
+    }
+
+  }
+
+}
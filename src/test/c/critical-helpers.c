@@ -0,0 +1,52 @@
+#include <jni.h>
+#include <time.h>
+
+// native helpers of CriticalHelpers, only built for the tests, not part of the agent
+
+
+JNIEXPORT jint JNICALL Java_com_github_marschall_jnicriticalreporter_CriticalHelpers_holdArrayCritical
+  (JNIEnv *env, jclass clazz, jbyteArray array, jlong millis) {
+  jbyte *elements = (*env)->GetPrimitiveArrayCritical(env, array, NULL);
+  if (elements == NULL) {
+    // OutOfMemoryError is pending
+    return -1;
+  }
+  // no JNI calls are allowed while the critical is held
+  struct timespec remaining = { (time_t) (millis / 1000L), (long) (millis % 1000L) * 1000000L };
+  while (nanosleep(&remaining, &remaining) != 0) {
+    // interrupted by a signal, sleep for the rest
+  }
+  jint first = elements[0];
+  (*env)->ReleasePrimitiveArrayCritical(env, array, elements, JNI_ABORT);
+  return first;
+}
+
+JNIEXPORT jlong JNICALL Java_com_github_marschall_jnicriticalreporter_CriticalHelpers_intArrayElements
+  (JNIEnv *env, jclass clazz, jintArray array, jint iterations) {
+  jlong sum = 0L;
+  for (jint iteration = 0; iteration < iterations; iteration++) {
+    jint *elements = (*env)->GetIntArrayElements(env, array, NULL);
+    if (elements == NULL) {
+      // OutOfMemoryError is pending
+      return -1L;
+    }
+    sum += elements[0];
+    (*env)->ReleaseIntArrayElements(env, array, elements, JNI_ABORT);
+  }
+  return sum;
+}
+
+JNIEXPORT jint JNICALL Java_com_github_marschall_jnicriticalreporter_CriticalHelpers_stringCritical
+  (JNIEnv *env, jclass clazz, jstring string, jint iterations) {
+  jint sum = 0;
+  for (jint iteration = 0; iteration < iterations; iteration++) {
+    const jchar *chars = (*env)->GetStringCritical(env, string, NULL);
+    if (chars == NULL) {
+      // OutOfMemoryError is pending
+      return -1;
+    }
+    sum += chars[0];
+    (*env)->ReleaseStringCritical(env, string, chars);
+  }
+  return sum;
+}
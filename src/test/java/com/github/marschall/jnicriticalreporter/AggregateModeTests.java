@@ -0,0 +1,77 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static com.github.marschall.jnicriticalreporter.ModeTestSupport.CRITICAL_EVENT;
+import static com.github.marschall.jnicriticalreporter.ModeTestSupport.PACKAGE;
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertFalse;
+import static org.junit.jupiter.api.Assertions.assertNotNull;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.IOException;
+import java.nio.file.Path;
+import java.time.Duration;
+import java.util.List;
+
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
+
+import jdk.jfr.consumer.RecordedEvent;
+
+/**
+ * Runs with {@code mode=aggregate,period=1s} and the test library on {@code java.library.path}.
+ */
+class AggregateModeTests {
+
+  private static final String CALL_SITE_SUMMARY_EVENT = PACKAGE + "CallSiteSummary";
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void callSiteSummaries() throws IOException {
+    byte[] array = new byte[1024];
+    List<RecordedEvent> events = ModeTestSupport.record(this.temporaryFolder, Duration.ofMillis(2_500L),
+        () -> ModeTestSupport.pin(array, 1_000), CALL_SITE_SUMMARY_EVENT, CRITICAL_EVENT);
+
+    // no event per critical
+    assertTrue(ModeTestSupport.named(events, CRITICAL_EVENT).isEmpty());
+    List<RecordedEvent> summaries = ModeTestSupport.named(events, CALL_SITE_SUMMARY_EVENT);
+    assertFalse(summaries.isEmpty(), "no call site summaries");
+    long arrayCriticals = 0L;
+    for (RecordedEvent summary : summaries) {
+      assertNotNull(summary.getString("callSite"));
+      assertTrue(summary.getLong("count") > 0L);
+      assertTrue(summary.getDuration("maxTime").compareTo(summary.getDuration("totalTime")) <= 0);
+      if ("GetPrimitiveArrayCritical".equals(summary.getString("methodName"))) {
+        arrayCriticals += summary.getLong("count");
+      }
+    }
+    assertTrue(arrayCriticals >= 1_000L, "array criticals: " + arrayCriticals);
+  }
+
+  @Test
+  void latin1Strings() throws IOException {
+    List<RecordedEvent> events = ModeTestSupport.record(this.temporaryFolder, Duration.ofMillis(2_500L), () -> {
+      CriticalHelpers.stringCritical("latin1", 100);
+      CriticalHelpers.stringCritical("utf16 \u20ac", 50);
+    }, CALL_SITE_SUMMARY_EVENT);
+
+    long count = 0L;
+    long copies = 0L;
+    long latin1Strings = 0L;
+    for (RecordedEvent summary : ModeTestSupport.named(events, CALL_SITE_SUMMARY_EVENT)) {
+      String nativeLibrary = summary.getString("nativeLibrary");
+      if ("GetStringCritical".equals(summary.getString("methodName"))
+          && nativeLibrary != null && nativeLibrary.startsWith("libcritical-helpers.")) {
+        count += summary.getLong("count");
+        copies += summary.getLong("copies");
+        latin1Strings += summary.getLong("latin1Strings");
+      }
+    }
+    assertEquals(150L, count);
+    assertEquals(100L, latin1Strings);
+    // LATIN1 strings are always copied, UTF16 strings are pinned
+    assertTrue(copies >= latin1Strings, "copies: " + copies);
+  }
+
+}
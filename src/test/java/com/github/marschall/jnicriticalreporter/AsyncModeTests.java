@@ -0,0 +1,51 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static com.github.marschall.jnicriticalreporter.ModeTestSupport.CRITICAL_EVENT;
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertNotNull;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.IOException;
+import java.nio.file.Path;
+import java.time.Duration;
+import java.util.List;
+
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
+
+import jdk.jfr.consumer.RecordedEvent;
+import jdk.jfr.consumer.RecordedThread;
+
+/**
+ * Runs with {@code mode=async,flushInterval=100ms}.
+ */
+class AsyncModeTests {
+
+  private static final int PINS = 100;
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void drainedByAgentThread() throws IOException {
+    byte[] array = new byte[512];
+    List<RecordedEvent> events = ModeTestSupport.record(this.temporaryFolder, Duration.ofSeconds(1L),
+        () -> ModeTestSupport.pin(array, PINS), CRITICAL_EVENT);
+
+    String threadName = Thread.currentThread().getName();
+    long pinned = 0L;
+    for (RecordedEvent event : events) {
+      if (event.getLong("length") != array.length) {
+        continue;
+      }
+      pinned += 1L;
+      assertEquals("GetPrimitiveArrayCritical", event.getString("methodName"));
+      // committed on the agent thread, the thread that held the critical is a field
+      RecordedThread criticalThread = event.getThread("criticalThread");
+      assertNotNull(criticalThread);
+      assertEquals(threadName, criticalThread.getJavaName());
+    }
+    assertTrue(pinned >= PINS, "pinned: " + pinned);
+  }
+
+}
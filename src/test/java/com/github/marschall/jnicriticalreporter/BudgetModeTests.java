@@ -0,0 +1,43 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static com.github.marschall.jnicriticalreporter.ModeTestSupport.PACKAGE;
+import static org.junit.jupiter.api.Assertions.assertFalse;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.IOException;
+import java.nio.file.Path;
+import java.time.Duration;
+import java.util.List;
+
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
+
+import jdk.jfr.consumer.RecordedEvent;
+
+/**
+ * Runs with {@code budget=0.0001%,budgetInterval=100ms}, a budget every critical exceeds.
+ */
+class BudgetModeTests {
+
+  private static final String SAMPLING_RATE_CHANGE_EVENT = PACKAGE + "SamplingRateChange";
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void samplingIntervalRaised() throws IOException {
+    byte[] array = new byte[64];
+    List<RecordedEvent> events = ModeTestSupport.record(this.temporaryFolder, Duration.ofMillis(500L), () -> {
+      long deadline = System.nanoTime() + Duration.ofSeconds(1L).toNanos();
+      while (System.nanoTime() < deadline) {
+        ModeTestSupport.pin(array, 1_000);
+      }
+    }, SAMPLING_RATE_CHANGE_EVENT);
+
+    assertFalse(events.isEmpty(), "sampling interval never changed");
+    RecordedEvent first = events.get(0);
+    assertTrue(first.getLong("sampleInterval") > first.getLong("previousSampleInterval"), first::toString);
+    assertTrue(first.getDouble("overhead") > first.getDouble("budget"), first::toString);
+  }
+
+}
@@ -0,0 +1,38 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static com.github.marschall.jnicriticalreporter.ModeTestSupport.CRITICAL_EVENT;
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertFalse;
+
+import java.io.IOException;
+import java.nio.file.Path;
+import java.time.Duration;
+import java.util.List;
+
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
+
+import jdk.jfr.consumer.RecordedEvent;
+
+/**
+ * Runs with {@code libraries=libzip}.
+ */
+class CallSiteFilterModeTests {
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void onlyFilteredLibrary() throws IOException {
+    byte[] array = new byte[640];
+    // Deflater is implemented in libzip
+    List<RecordedEvent> events = ModeTestSupport.record(this.temporaryFolder, Duration.ZERO,
+        () -> ModeTestSupport.pin(array, 10), CRITICAL_EVENT);
+
+    assertFalse(events.isEmpty(), "no events");
+    for (RecordedEvent event : events) {
+      assertEquals("libzip.so", event.getString("nativeLibrary"), event::toString);
+    }
+  }
+
+}
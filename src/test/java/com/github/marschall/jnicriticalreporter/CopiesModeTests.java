@@ -0,0 +1,69 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static com.github.marschall.jnicriticalreporter.ModeTestSupport.PACKAGE;
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.IOException;
+import java.nio.file.Path;
+import java.time.Duration;
+import java.util.List;
+
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
+
+import jdk.jfr.consumer.RecordedEvent;
+
+/**
+ * Runs with {@code copies=true,period=1s} and the test library on {@code java.library.path}.
+ */
+class CopiesModeTests {
+
+  private static final String COPY_EVENT = PACKAGE + "Copy";
+  private static final String COPY_SUMMARY_EVENT = PACKAGE + "CopySummary";
+  private static final int LENGTH = 777;
+  private static final int CALLS = 50;
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void arrayElements() throws IOException {
+    int[] array = new int[LENGTH];
+    List<RecordedEvent> events = ModeTestSupport.record(this.temporaryFolder, Duration.ofMillis(2_500L),
+        () -> CriticalHelpers.intArrayElements(array, CALLS), COPY_EVENT, COPY_SUMMARY_EVENT);
+
+    long copies = 0L;
+    long releases = 0L;
+    for (RecordedEvent copy : ModeTestSupport.named(events, COPY_EVENT)) {
+      String functionName = copy.getString("functionName");
+      if (functionName.equals("GetIntArrayElements") && copy.getLong("bytes") == LENGTH * Integer.BYTES) {
+        // HotSpot always copies the elements
+        assertTrue(copy.getBoolean("isCopy"), copy::toString);
+        assertTrue(!copy.getDuration("copyTime").isNegative(), copy::toString);
+        copies += 1L;
+      } else if (functionName.equals("ReleaseIntArrayElements")) {
+        // copying back is not counted
+        assertEquals(0L, copy.getLong("bytes"));
+        releases += 1L;
+      }
+    }
+    assertEquals(CALLS, copies);
+    assertTrue(releases >= CALLS, "releases: " + releases);
+
+    long calls = 0L;
+    long bytes = 0L;
+    long summaryCopies = 0L;
+    for (RecordedEvent summary : ModeTestSupport.named(events, COPY_SUMMARY_EVENT)) {
+      if (summary.getString("functionName").equals("GetIntArrayElements")) {
+        calls += summary.getLong("calls");
+        bytes += summary.getLong("bytes");
+        summaryCopies += summary.getLong("copies");
+      }
+    }
+    assertTrue(calls >= CALLS, "calls: " + calls);
+    assertTrue(bytes >= (long) CALLS * LENGTH * Integer.BYTES, "bytes: " + bytes);
+    assertTrue(summaryCopies >= CALLS, "copies: " + summaryCopies);
+  }
+
+}
@@ -0,0 +1,45 @@
+package com.github.marschall.jnicriticalreporter;
+
+/**
+ * Native helpers that call JNI functions in ways no JDK method does, the library is compiled from
+ * {@code src/test/c/critical-helpers.c} by the build and found through {@code java.library.path}.
+ */
+final class CriticalHelpers {
+
+  static {
+    System.loadLibrary("critical-helpers");
+  }
+
+  private CriticalHelpers() {
+    throw new AssertionError("not instantiable");
+  }
+
+  /**
+   * Pins the array with {@code GetPrimitiveArrayCritical} and sleeps while holding the critical.
+   *
+   * @param array the array to pin, must not be empty
+   * @param millis how long the critical is held
+   * @return the first element to prevent dead code elimination
+   */
+  static native int holdArrayCritical(byte[] array, long millis);
+
+  /**
+   * Calls {@code GetIntArrayElements} and {@code ReleaseIntArrayElements} in a loop.
+   *
+   * @param array the array to copy, must not be empty
+   * @param iterations how often the elements are copied
+   * @return the sum of the first elements to prevent dead code elimination
+   */
+  static native long intArrayElements(int[] array, int iterations);
+
+  /**
+   * Calls {@code GetStringCritical} and {@code ReleaseStringCritical} in a loop, the string natives of the JDK pin
+   * the {@code byte[]} of the string with {@code GetPrimitiveArrayCritical} instead.
+   *
+   * @param string the string to pin, must not be empty
+   * @param iterations how often the string is pinned
+   * @return the sum of the first characters to prevent dead code elimination
+   */
+  static native int stringCritical(String string, int iterations);
+
+}
@@ -0,0 +1,95 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static java.nio.charset.StandardCharsets.UTF_8;
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertNotNull;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.ByteArrayOutputStream;
+import java.io.IOException;
+import java.lang.management.ManagementFactory;
+import java.time.Duration;
+import java.util.List;
+import java.util.zip.ZipEntry;
+import java.util.zip.ZipOutputStream;
+
+import javax.management.JMException;
+import javax.management.JMX;
+import javax.management.ObjectName;
+
+import org.junit.jupiter.api.Test;
+
+class CriticalMonitorTests {
+
+  @Test
+  void percentiles() {
+    CriticalMonitor monitor = new CriticalMonitor(Duration.ofMinutes(1L));
+    for (int i = 1; i <= 1000; i++) {
+      monitor.record("GetPrimitiveArrayCritical", "java.util.zip.Deflater.deflateBytesBytes", i % 4 == 0, i * 1_000L);
+    }
+    monitor.record("GetStringCritical", 42L, true, 10L);
+
+    assertEquals(1001L, monitor.getCount());
+    assertEquals(251L, monitor.getCopies());
+
+    List<CriticalStatistics> methods = monitor.getMethods();
+    assertEquals(2, methods.size());
+    CriticalStatistics arrays = methods.get(0);
+    assertEquals("GetPrimitiveArrayCritical", arrays.getName());
+    assertEquals(0.25d, arrays.getCopyRatio(), 0.0001d);
+    assertEquals(1_000_000L, arrays.getMaxHoldTimeNanos());
+    assertWithinBucket(500_000L, arrays.getP50HoldTimeNanos());
+    assertWithinBucket(990_000L, arrays.getP99HoldTimeNanos());
+
+    List<CriticalStatistics> frames = monitor.getTopFrames();
+    assertEquals("java.util.zip.Deflater.deflateBytesBytes", frames.get(0).getName());
+    // the stack definition was not seen
+    assertEquals("stack 42", frames.get(1).getName());
+  }
+
+  @Test
+  void histogramBuckets() {
+    for (long nanos : new long[] {0L, 1L, 15L, 16L, 17L, 1_000L, 123_456_789L, Long.MAX_VALUE}) {
+      int index = HoldTimeHistogram.bucketIndex(nanos);
+      assertTrue(index < HoldTimeHistogram.BUCKET_COUNT, "index of " + nanos);
+      assertTrue(HoldTimeHistogram.bucketUpperBound(index) >= nanos, "upper bound of " + nanos);
+      if (index > 0) {
+        assertTrue(HoldTimeHistogram.bucketUpperBound(index - 1) < nanos, "upper bound below " + nanos);
+      }
+    }
+  }
+
+  @Test
+  void mxBean() throws IOException, JMException, InterruptedException {
+    CriticalMonitor monitor = CriticalMonitor.start(Duration.ofSeconds(10L));
+    assertNotNull(monitor);
+    try {
+      CriticalMonitorMXBean proxy = JMX.newMXBeanProxy(ManagementFactory.getPlatformMBeanServer(),
+          new ObjectName(CriticalMonitor.OBJECT_NAME), CriticalMonitorMXBean.class);
+      long deadline = System.nanoTime() + Duration.ofSeconds(30L).toNanos();
+      // the stream delivers events about once per second
+      while (proxy.getCount() == 0L && System.nanoTime() < deadline) {
+        deflate();
+        Thread.sleep(100L);
+      }
+      assertTrue(proxy.getCount() > 0L, "no events encountered");
+      assertTrue(proxy.getMethods().stream().anyMatch(statistics -> statistics.getName().equals("GetPrimitiveArrayCritical")));
+    } finally {
+      monitor.close();
+    }
+  }
+
+  private static void assertWithinBucket(long expected, long actual) {
+    // the relative error is at most 12.5%
+    assertTrue(actual >= expected && actual <= expected + expected / 8L, "expected " + expected + " but was " + actual);
+  }
+
+  private static void deflate() throws IOException {
+    ByteArrayOutputStream bos = new ByteArrayOutputStream();
+    try (ZipOutputStream deflater = new ZipOutputStream(bos)) {
+      deflater.putNextEntry(new ZipEntry("name"));
+      deflater.write(CriticalMonitorTests.class.getName().getBytes(UTF_8));
+    }
+  }
+
+}
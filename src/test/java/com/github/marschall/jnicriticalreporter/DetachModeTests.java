@@ -0,0 +1,61 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static com.github.marschall.jnicriticalreporter.ModeTestSupport.CRITICAL_EVENT;
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertNotNull;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.IOException;
+import java.nio.file.Path;
+import java.time.Duration;
+import java.util.List;
+
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
+
+import com.sun.tools.attach.AgentInitializationException;
+import com.sun.tools.attach.AgentLoadException;
+import com.sun.tools.attach.AttachNotSupportedException;
+import com.sun.tools.attach.VirtualMachine;
+
+import jdk.jfr.consumer.RecordedEvent;
+
+/**
+ * Runs with {@code -Djdk.attach.allowAttachSelf=true} and the path of the agent in the {@code agentPath} system property.
+ */
+class DetachModeTests {
+
+  private static final int PINS = 100;
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void detach() throws IOException, AttachNotSupportedException, AgentLoadException, AgentInitializationException {
+    String agentPath = System.getProperty("agentPath");
+    assertNotNull(agentPath, "agentPath not set");
+    byte[] array = new byte[128];
+
+    List<RecordedEvent> attached = ModeTestSupport.record(this.temporaryFolder, Duration.ZERO,
+        () -> ModeTestSupport.pin(array, PINS), CRITICAL_EVENT);
+    assertTrue(countPinned(attached, array) >= PINS);
+
+    VirtualMachine vm = VirtualMachine.attach(Long.toString(ProcessHandle.current().pid()));
+    try {
+      vm.loadAgentPath(agentPath, "detach");
+    } finally {
+      vm.detach();
+    }
+
+    List<RecordedEvent> detached = ModeTestSupport.record(this.temporaryFolder, Duration.ZERO,
+        () -> ModeTestSupport.pin(array, PINS), CRITICAL_EVENT);
+    assertEquals(0L, countPinned(detached, array));
+  }
+
+  private static long countPinned(List<RecordedEvent> events, byte[] array) {
+    return events.stream()
+        .filter(event -> event.getLong("length") == array.length)
+        .count();
+  }
+
+}
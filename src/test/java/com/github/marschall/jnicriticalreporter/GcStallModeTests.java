@@ -0,0 +1,81 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static com.github.marschall.jnicriticalreporter.ModeTestSupport.PACKAGE;
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertFalse;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.IOException;
+import java.nio.file.Path;
+import java.time.Duration;
+import java.util.List;
+
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
+
+import jdk.jfr.consumer.RecordedEvent;
+import jdk.jfr.consumer.RecordedThread;
+
+/**
+ * Runs with {@code gcStalls=true,flushInterval=100ms} and the test library on {@code java.library.path}.
+ */
+class GcStallModeTests {
+
+  private static final String GC_LOCKER_STALL_EVENT = PACKAGE + "GCLockerStall";
+  private static final String GC_LOCKER_HOLDER_EVENT = PACKAGE + "GCLockerHolder";
+  private static final String HOLDER_THREAD = "critical holder";
+  private static final long HOLD_MILLIS = 1_000L;
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void gcWhileCriticalHeld() throws IOException {
+    byte[] array = new byte[1024];
+    List<RecordedEvent> events = ModeTestSupport.record(this.temporaryFolder, Duration.ofMillis(500L), () -> {
+      Thread holder = new Thread(() -> CriticalHelpers.holdArrayCritical(array, HOLD_MILLIS), HOLDER_THREAD);
+      holder.start();
+      // let the holder enter the critical
+      ModeTestSupport.sleep(Duration.ofMillis(200L));
+      System.gc();
+      try {
+        holder.join();
+      } catch (InterruptedException e) {
+        Thread.currentThread().interrupt();
+        throw new AssertionError("interrupted", e);
+      }
+    }, GC_LOCKER_STALL_EVENT, GC_LOCKER_HOLDER_EVENT);
+
+    List<RecordedEvent> stalls = ModeTestSupport.named(events, GC_LOCKER_STALL_EVENT);
+    List<RecordedEvent> holders = ModeTestSupport.named(events, GC_LOCKER_HOLDER_EVENT);
+    assertFalse(stalls.isEmpty(), "no stalls");
+
+    // with the GCLocker the collection waits for the release, with region pinning (JDK 22+ G1) it starts while
+    // the critical is held
+    boolean attributed = false;
+    for (RecordedEvent holderEvent : holders) {
+      if (isHolderThread(holderEvent.getThread("criticalThread"))) {
+        assertEquals("GetPrimitiveArrayCritical", holderEvent.getString("methodName"));
+        assertTrue(holderEvent.getDuration("heldTime").compareTo(Duration.ofMillis(100L)) >= 0, holderEvent::toString);
+        assertTrue(holderEvent.getDuration("heldTime").compareTo(Duration.ofMillis(HOLD_MILLIS)) <= 0, holderEvent::toString);
+        attributed = true;
+      }
+    }
+    for (RecordedEvent stall : stalls) {
+      assertTrue(stall.getLong("inFlightCriticals") >= 0L, stall::toString);
+      if (isHolderThread(stall.getThread("blockingThread"))) {
+        assertEquals("GetPrimitiveArrayCritical", stall.getString("blockingMethodName"));
+        // the collection was delayed until the release
+        assertTrue(stall.getDuration("blockingHoldTime").compareTo(Duration.ofMillis(HOLD_MILLIS)) >= 0, stall::toString);
+        assertTrue(stall.getDuration("releaseToGcTime").compareTo(Duration.ofMillis(1L)) < 0, stall::toString);
+        attributed = true;
+      }
+    }
+    assertTrue(attributed, () -> "stall not attributed to the holder, stalls: " + stalls + " holders: " + holders);
+  }
+
+  private static boolean isHolderThread(RecordedThread thread) {
+    return thread != null && HOLDER_THREAD.equals(thread.getJavaName());
+  }
+
+}
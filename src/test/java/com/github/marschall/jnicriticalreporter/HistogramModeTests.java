@@ -0,0 +1,65 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static com.github.marschall.jnicriticalreporter.ModeTestSupport.PACKAGE;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.IOException;
+import java.nio.file.Path;
+import java.time.Duration;
+import java.util.Comparator;
+import java.util.List;
+import java.util.stream.Collectors;
+
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
+
+import jdk.jfr.consumer.RecordedEvent;
+
+/**
+ * Runs with {@code histogram=true,period=1s}.
+ */
+class HistogramModeTests {
+
+  private static final String HOLD_TIME_HISTOGRAM_EVENT = PACKAGE + "HoldTimeHistogram";
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void periodicHistograms() throws IOException {
+    byte[] array = new byte[4096];
+    long[] pins = new long[1];
+    List<RecordedEvent> events = ModeTestSupport.record(this.temporaryFolder, Duration.ofMillis(1_500L), () -> {
+      long deadline = System.nanoTime() + Duration.ofMillis(3_500L).toNanos();
+      while (System.nanoTime() < deadline) {
+        ModeTestSupport.pin(array, 100);
+        pins[0] += 100L;
+      }
+    }, HOLD_TIME_HISTOGRAM_EVENT);
+
+    List<RecordedEvent> arrayHistograms = events.stream()
+        .filter(event -> "GetPrimitiveArrayCritical".equals(event.getString("methodName")))
+        .sorted(Comparator.comparing(RecordedEvent::getEndTime))
+        .collect(Collectors.toList());
+    assertTrue(arrayHistograms.size() >= 3, () -> "histograms: " + arrayHistograms.size());
+
+    long count = 0L;
+    for (RecordedEvent histogram : arrayHistograms) {
+      count += histogram.getLong("count");
+      // the percentiles are upper bounds of the buckets and can not decrease
+      assertTrue(histogram.getDuration("p50Time").compareTo(histogram.getDuration("p90Time")) <= 0, histogram::toString);
+      assertTrue(histogram.getDuration("p90Time").compareTo(histogram.getDuration("p99Time")) <= 0, histogram::toString);
+      assertTrue(histogram.getDuration("p99Time").compareTo(histogram.getDuration("p999Time")) <= 0, histogram::toString);
+      assertTrue(histogram.getDuration("p999Time").compareTo(histogram.getDuration("maxTime")) <= 0, histogram::toString);
+    }
+    // every outermost critical of the workload is in exactly one period, criticals before the recording may be as well
+    assertTrue(count >= pins[0], "histogram count " + count + " pins " + pins[0]);
+
+    for (int i = 1; i < arrayHistograms.size(); i++) {
+      Duration between = Duration.between(arrayHistograms.get(i - 1).getEndTime(), arrayHistograms.get(i).getEndTime());
+      assertTrue(between.compareTo(Duration.ofMillis(500L)) > 0 && between.compareTo(Duration.ofMillis(1_500L)) < 0,
+          "period: " + between);
+    }
+  }
+
+}
@@ -0,0 +1,51 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static com.github.marschall.jnicriticalreporter.ModeTestSupport.PACKAGE;
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertNotNull;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.IOException;
+import java.nio.file.Path;
+import java.time.Duration;
+import java.util.List;
+
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
+
+import jdk.jfr.consumer.RecordedEvent;
+
+/**
+ * Runs with {@code hotArrays=4,period=1s}.
+ */
+class HotArraysModeTests {
+
+  private static final String HOT_PINNED_ARRAY_EVENT = PACKAGE + "HotPinnedArray";
+  // longer than every other array pinned by the test JVM
+  private static final int LENGTH = 4 * 1024 * 1024 + 1;
+  private static final int PINS = 50;
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void hottestArray() throws IOException {
+    byte[] array = new byte[LENGTH];
+    List<RecordedEvent> events = ModeTestSupport.record(this.temporaryFolder, Duration.ofMillis(2_500L),
+        () -> ModeTestSupport.pin(array, PINS), HOT_PINNED_ARRAY_EVENT);
+
+    RecordedEvent hot = null;
+    for (RecordedEvent event : events) {
+      if (event.getLong("length") == LENGTH) {
+        hot = event;
+      }
+    }
+    assertNotNull(hot, "array not reported");
+    assertEquals(1L, hot.getLong("rank"));
+    assertEquals(PINS, hot.getLong("pins"));
+    assertEquals("byte", hot.getString("elementType"));
+    assertEquals(LENGTH, hot.getLong("bytes"));
+    assertTrue(hot.getDuration("holdTime").toNanos() > 0L);
+  }
+
+}
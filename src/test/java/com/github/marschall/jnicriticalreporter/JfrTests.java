@@ -1,8 +1,19 @@
 package com.github.marschall.jnicriticalreporter;
 
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertFalse;
+import static org.junit.jupiter.api.Assertions.assertNotNull;
+import static org.junit.jupiter.api.Assertions.assertNull;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.IOException;
+import java.nio.file.Path;
+import java.util.Arrays;
 import java.util.List;
+import java.util.zip.Deflater;
 
 import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
 
 import jdk.jfr.AnnotationElement;
 import jdk.jfr.Category;
@@ -11,11 +22,61 @@ import jdk.jfr.Event;
 import jdk.jfr.EventFactory;
 import jdk.jfr.Label;
 import jdk.jfr.Name;
+import jdk.jfr.Recording;
 import jdk.jfr.ValueDescriptor;
+import jdk.jfr.consumer.RecordedEvent;
+import jdk.jfr.consumer.RecordingFile;
 
 
 public class JfrTests {
 
+  private static final String JNI_CRITICAL_EVENT = "com.github.marschall.jnicriticalreporter.Event";
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void generatedEvent() throws IOException, ClassNotFoundException {
+    // defined by the agent to the bootstrap class loader
+    Class<?> eventClass = Class.forName("com.github.marschall.jnicriticalreporter.CriticalEvent", false, null);
+    assertNull(eventClass.getClassLoader());
+
+    byte[] input = new byte[1000];
+    Arrays.fill(input, (byte) 'a');
+    byte[] output = new byte[4096];
+    Path recordingPath = this.temporaryFolder.resolve("generated.jfr");
+    try (Recording recording = new Recording()) {
+      recording.enable(JNI_CRITICAL_EVENT).withoutThreshold();
+      recording.start();
+      // Deflater#deflate pins the input and the output array with GetPrimitiveArrayCritical
+      Deflater deflater = new Deflater();
+      try {
+        deflater.setInput(input);
+        deflater.finish();
+        assertTrue(deflater.deflate(output) > 0);
+      } finally {
+        deflater.end();
+      }
+      recording.stop();
+      recording.dump(recordingPath);
+    }
+
+    RecordedEvent inputEvent = null;
+    for (RecordedEvent event : RecordingFile.readAllEvents(recordingPath)) {
+      if (event.getEventType().getName().equals(JNI_CRITICAL_EVENT) && event.getLong("length") == input.length) {
+        inputEvent = event;
+      }
+    }
+    assertNotNull(inputEvent, "no event for the input array");
+    assertEquals("GetPrimitiveArrayCritical", inputEvent.getString("methodName"));
+    assertEquals("byte", inputEvent.getString("elementType"));
+    assertEquals(input.length, inputEvent.getLong("bytes"));
+    // HotSpot pins primitive arrays
+    assertFalse(inputEvent.getBoolean("isCopy"));
+    assertFalse(inputEvent.getDuration("holdTime").isNegative());
+    assertFalse(inputEvent.getDuration("acquireTime").isNegative());
+  }
+
   @Test
   void customEvent() {
     EventFactory eventFactory = EventFactory.create(getEventAnnotations(), getValueDescriptors());
@@ -0,0 +1,112 @@
+package com.github.marschall.jnicriticalreporter;
+
+import java.io.IOException;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.time.Duration;
+import java.util.ArrayList;
+import java.util.List;
+import java.util.Set;
+import java.util.zip.Deflater;
+
+import jdk.jfr.Recording;
+import jdk.jfr.consumer.RecordedEvent;
+import jdk.jfr.consumer.RecordingFile;
+
+/**
+ * Workloads and recordings shared by the tests of the agent modes, each {@code *ModeTests} class runs in its own
+ * surefire execution with the agent options of the mode.
+ */
+final class ModeTestSupport {
+
+  static final String PACKAGE = "com.github.marschall.jnicriticalreporter.";
+  static final String CRITICAL_EVENT = PACKAGE + "Event";
+
+  private ModeTestSupport() {
+    throw new AssertionError("not instantiable");
+  }
+
+  interface Workload {
+
+    void run() throws IOException;
+
+  }
+
+  /**
+   * Runs the workload in a new recording and returns the events with one of the names.
+   *
+   * @param directory where the recording is dumped
+   * @param settle how long to wait after the workload for periodic and asynchronous events
+   * @param workload the code to record
+   * @param eventNames the events to enable and return
+   * @return the recorded events with one of the names
+   * @throws IOException if the workload or dumping fails
+   */
+  static List<RecordedEvent> record(Path directory, Duration settle, Workload workload, String... eventNames) throws IOException {
+    // a test may record several times
+    Path recordingPath = Files.createTempFile(directory, "mode", ".jfr");
+    try (Recording recording = new Recording()) {
+      for (String eventName : eventNames) {
+        recording.enable(eventName).withoutThreshold();
+      }
+      recording.start();
+      workload.run();
+      sleep(settle);
+      recording.stop();
+      recording.dump(recordingPath);
+    }
+    Set<String> names = Set.of(eventNames);
+    List<RecordedEvent> events = new ArrayList<>();
+    for (RecordedEvent event : RecordingFile.readAllEvents(recordingPath)) {
+      if (names.contains(event.getEventType().getName())) {
+        events.add(event);
+      }
+    }
+    return events;
+  }
+
+  static List<RecordedEvent> named(List<RecordedEvent> events, String eventName) {
+    List<RecordedEvent> result = new ArrayList<>();
+    for (RecordedEvent event : events) {
+      if (event.getEventType().getName().equals(eventName)) {
+        result.add(event);
+      }
+    }
+    return result;
+  }
+
+  /**
+   * Pins the same array {@code count} times in outermost criticals. {@link Deflater#deflate(byte[])} pins the input
+   * array and then the output array in a nested critical. {@code CRC32} is not used because it is an intrinsic.
+   *
+   * @param array the array to pin
+   * @param count how many times the array is pinned
+   * @return the compressed bytes so the calls are not eliminated
+   */
+  static long pin(byte[] array, int count) {
+    // never the length of an input array
+    byte[] output = new byte[array.length + 64];
+    long compressed = 0L;
+    for (int i = 0; i < count; i++) {
+      Deflater deflater = new Deflater();
+      try {
+        deflater.setInput(array);
+        deflater.finish();
+        compressed += deflater.deflate(output);
+      } finally {
+        deflater.end();
+      }
+    }
+    return compressed;
+  }
+
+  static void sleep(Duration duration) {
+    try {
+      Thread.sleep(duration.toMillis());
+    } catch (InterruptedException e) {
+      Thread.currentThread().interrupt();
+      throw new AssertionError("interrupted", e);
+    }
+  }
+
+}
@@ -0,0 +1,49 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static com.github.marschall.jnicriticalreporter.ModeTestSupport.CRITICAL_EVENT;
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.IOException;
+import java.nio.file.Path;
+import java.time.Duration;
+import java.util.List;
+
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
+
+import jdk.jfr.consumer.RecordedEvent;
+
+/**
+ * Runs in the default configuration, without {@code nested}.
+ */
+class NestingTests {
+
+  private static final int PINS = 20;
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void onlyOutermostReported() throws IOException {
+    byte[] array = new byte[768];
+    // the output array is pinned in a nested critical
+    int outputLength = array.length + 64;
+    List<RecordedEvent> events = ModeTestSupport.record(this.temporaryFolder, Duration.ZERO,
+        () -> ModeTestSupport.pin(array, PINS), CRITICAL_EVENT);
+
+    long outermost = 0L;
+    for (RecordedEvent event : events) {
+      long length = event.getLong("length");
+      assertTrue(length != outputLength, event::toString);
+      if (length == array.length) {
+        outermost += 1L;
+        assertEquals(1L, event.getLong("depth"));
+        assertEquals(2L, event.getLong("maxDepth"));
+        assertEquals(1L, event.getLong("nestedCriticals"));
+      }
+    }
+    assertEquals(PINS, outermost);
+  }
+
+}
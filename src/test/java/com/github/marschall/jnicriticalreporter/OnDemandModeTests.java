@@ -0,0 +1,44 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static com.github.marschall.jnicriticalreporter.ModeTestSupport.CRITICAL_EVENT;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.IOException;
+import java.nio.file.Path;
+import java.time.Duration;
+import java.util.List;
+
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
+
+import jdk.jfr.consumer.RecordedEvent;
+
+/**
+ * Runs with {@code onDemand=true,flushInterval=100ms} and without a recording started on the command line.
+ */
+class OnDemandModeTests {
+
+  private static final int PINS = 100;
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void redirectedOnceRecording() throws IOException {
+    byte[] array = new byte[256];
+    // only the idle table is installed, the criticals are counted but not reported
+    ModeTestSupport.pin(array, PINS);
+
+    List<RecordedEvent> events = ModeTestSupport.record(this.temporaryFolder, Duration.ZERO, () -> {
+      // the agent thread checks the recordings every flushInterval
+      ModeTestSupport.sleep(Duration.ofSeconds(1L));
+      ModeTestSupport.pin(array, PINS);
+    }, CRITICAL_EVENT);
+
+    long pinned = events.stream()
+        .filter(event -> event.getLong("length") == array.length)
+        .count();
+    assertTrue(pinned >= PINS, () -> "pinned: " + pinned);
+  }
+
+}
@@ -0,0 +1,84 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static com.github.marschall.jnicriticalreporter.ModeTestSupport.CRITICAL_EVENT;
+import static com.github.marschall.jnicriticalreporter.ModeTestSupport.PACKAGE;
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertFalse;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.IOException;
+import java.nio.file.Path;
+import java.time.Duration;
+import java.time.Instant;
+import java.util.List;
+
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
+
+import jdk.jfr.consumer.RecordedEvent;
+import jdk.jfr.consumer.RecordedThread;
+
+/**
+ * Runs with {@code clock=tsc,overhead=true,period=1s}, without an invariant time stamp counter the agent falls back
+ * to {@code CLOCK_MONOTONIC}.
+ */
+class OverheadModeTests {
+
+  private static final String OVERHEAD_EVENT = PACKAGE + "AgentOverhead";
+  private static final String THREAD_NAME = "overhead-workload";
+  private static final int LENGTH = 4091;
+  private static final int PINS = 20;
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void acquireTimeAndOverhead() throws IOException {
+    byte[] array = new byte[LENGTH];
+    Instant before = Instant.now();
+    List<RecordedEvent> events = ModeTestSupport.record(this.temporaryFolder, Duration.ofMillis(2_500L), () -> {
+      // the overhead is reported per thread
+      Thread workload = new Thread(() -> ModeTestSupport.pin(array, PINS), THREAD_NAME);
+      workload.start();
+      try {
+        workload.join();
+      } catch (InterruptedException e) {
+        Thread.currentThread().interrupt();
+        throw new AssertionError("interrupted", e);
+      }
+    }, CRITICAL_EVENT, OVERHEAD_EVENT);
+    Instant after = Instant.now();
+
+    int pinned = 0;
+    for (RecordedEvent event : ModeTestSupport.named(events, CRITICAL_EVENT)) {
+      if (event.getLong("length") != LENGTH) {
+        continue;
+      }
+      Duration acquireTime = event.getDuration("acquireTime");
+      assertFalse(acquireTime.isNegative(), event::toString);
+      // nothing else pins, there is no garbage collection to wait for
+      assertTrue(acquireTime.compareTo(Duration.ofSeconds(1L)) < 0, event::toString);
+      assertFalse(event.getDuration("holdTime").isNegative(), event::toString);
+      // the clock is converted to wall clock time with millisecond precision
+      Instant start = event.getInstant("criticalStartTime");
+      assertFalse(start.isBefore(before.minusMillis(1L)), event::toString);
+      assertFalse(start.isAfter(after.plusMillis(1L)), event::toString);
+      pinned += 1;
+    }
+    assertEquals(PINS, pinned);
+
+    long calls = 0L;
+    long overheadNanos = 0L;
+    for (RecordedEvent overhead : ModeTestSupport.named(events, OVERHEAD_EVENT)) {
+      RecordedThread thread = overhead.getThread("criticalThread");
+      if (thread != null && THREAD_NAME.equals(thread.getJavaName())) {
+        calls += overhead.getLong("calls");
+        overheadNanos += overhead.getDuration("overheadTime").toNanos();
+      }
+    }
+    // every pin gets and releases two criticals
+    assertTrue(calls >= 4L * PINS, "calls: " + calls);
+    assertTrue(overheadNanos > 0L, "overhead: " + overheadNanos);
+  }
+
+}
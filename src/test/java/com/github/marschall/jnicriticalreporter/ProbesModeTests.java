@@ -0,0 +1,75 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static java.nio.charset.StandardCharsets.ISO_8859_1;
+import static java.nio.charset.StandardCharsets.UTF_8;
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertFalse;
+import static org.junit.jupiter.api.Assertions.assertNotEquals;
+import static org.junit.jupiter.api.Assertions.assertNotNull;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.IOException;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.util.List;
+import java.util.concurrent.TimeUnit;
+
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
+
+/**
+ * Runs without the agent, starts JVMs with {@code mode=probes}. The path of the agent is in the {@code agentPath}
+ * system property, {@code sdtAvailable} is {@code true} if the agent was built with {@code sys/sdt.h}.
+ */
+class ProbesModeTests {
+
+  private static final String UNSUPPORTED = "mode=probes is not supported, the agent was built without sys/sdt.h";
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void probesMode() throws IOException, InterruptedException {
+    String agentPath = System.getProperty("agentPath");
+    assertNotNull(agentPath, "agentPath not set");
+    boolean sdtAvailable = Boolean.parseBoolean(System.getProperty("sdtAvailable"));
+
+    Path output = this.temporaryFolder.resolve("output.txt");
+    Process process = new ProcessBuilder(List.of(
+            Path.of(System.getProperty("java.home"), "bin", "java").toString(),
+            "-agentpath:" + agentPath + "=mode=probes",
+            "-Xcheck:jni",
+            "-cp", System.getProperty("java.class.path"),
+            Workload.class.getName()))
+        .redirectErrorStream(true)
+        .redirectOutput(output.toFile())
+        .start();
+    assertTrue(process.waitFor(1L, TimeUnit.MINUTES), "timed out");
+    String log = Files.readString(output, UTF_8);
+
+    if (sdtAvailable) {
+      assertEquals(0, process.exitValue(), log);
+      assertFalse(log.contains(UNSUPPORTED), log);
+      // the probes are described in the ELF notes of the library
+      String library = Files.readString(Path.of(agentPath), ISO_8859_1);
+      assertTrue(library.contains(".note.stapsdt"), "no probes in " + agentPath);
+      assertTrue(library.contains("get_primitive_array_critical"), "no probes in " + agentPath);
+    } else {
+      // the JVM does not start if the agent fails to load
+      assertNotEquals(0, process.exitValue(), log);
+      assertTrue(log.contains(UNSUPPORTED), log);
+    }
+  }
+
+  /**
+   * Main class of the JVM with the agent.
+   */
+  static final class Workload {
+
+    public static void main(String[] args) {
+      ModeTestSupport.pin(new byte[1024], 100);
+    }
+
+  }
+
+}
@@ -0,0 +1,127 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.IOException;
+import java.nio.file.Path;
+import java.time.Duration;
+import java.util.Arrays;
+import java.util.List;
+
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
+
+import jdk.jfr.AnnotationElement;
+import jdk.jfr.Description;
+import jdk.jfr.Event;
+import jdk.jfr.EventFactory;
+import jdk.jfr.Label;
+import jdk.jfr.Name;
+import jdk.jfr.Recording;
+import jdk.jfr.StackTrace;
+import jdk.jfr.Timespan;
+import jdk.jfr.Timestamp;
+import jdk.jfr.ValueDescriptor;
+
+class RecordingAnalyzerTests {
+
+  private static final String EVENT_NAME = "com.github.marschall.jnicriticalreporter.Event";
+  private static final String CALL_SITE = "libtest.so+0x10";
+  // 2020-01-01T00:00:00Z
+  private static final long START_MILLIS = 1_577_836_800_000L;
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void analyzeRecordings() throws IOException, InterruptedException {
+    Path first = this.writeRecording("first.jfr", new long[] {1_000_000L, 3_000_000L}, true);
+    Path second = this.writeRecording("second.jfr", new long[] {2_000_000L, 4_000_000L}, false);
+
+    RecordingAnalyzer.Analysis analysis = RecordingAnalyzer.analyze(List.of(first, second), Duration.ofMillis(10L), 2);
+
+    StringBuilder report = new StringBuilder();
+    analysis.writeReport(report);
+    String line = Arrays.stream(report.toString().split("\n"))
+        .filter(l -> l.contains(CALL_SITE))
+        .findFirst()
+        .orElseThrow();
+    String[] columns = line.split(",");
+    assertEquals("GetPrimitiveArrayCritical", columns[0]);
+    assertEquals("4", columns[2]);
+    assertEquals("2", columns[3]);
+    assertEquals("0.5000", columns[4]);
+    assertEquals("4000000", columns[7]);
+    assertEquals("10000000", columns[8]);
+
+    StringBuilder collapsed = new StringBuilder();
+    analysis.writeCollapsed(collapsed);
+    assertTrue(collapsed.toString().contains("RecordingAnalyzerTests.commit"), collapsed.toString());
+
+    StringBuilder inFlight = new StringBuilder();
+    analysis.writeInFlight(inFlight);
+    assertTrue(inFlight.toString().contains("2020-01-01T00:00:00Z,4,1.0000,0"), inFlight.toString());
+  }
+
+  @Test
+  void collapseDefinition() {
+    assertEquals("java.lang.Thread.run;com.example.Native.call", RecordingAnalyzer.collapseDefinition("com.example.Native.call\njava.lang.Thread.run\n"));
+  }
+
+  @Test
+  void parseDuration() {
+    assertEquals(Duration.ofMillis(10L), RecordingAnalyzer.parseDuration("10ms"));
+    assertEquals(Duration.ofNanos(5_000L), RecordingAnalyzer.parseDuration("5us"));
+  }
+
+  private Path writeRecording(String fileName, long[] holdNanos, boolean isCopy) throws IOException {
+    EventFactory factory = EventFactory.create(getEventAnnotations(), getValueDescriptors());
+    Path path = this.temporaryFolder.resolve(fileName);
+    try (Recording recording = new Recording()) {
+      recording.enable(EVENT_NAME).withoutThreshold().withStackTrace();
+      recording.start();
+      for (long hold : holdNanos) {
+        commit(factory, hold, isCopy);
+      }
+      recording.stop();
+      recording.dump(path);
+    }
+    return path;
+  }
+
+  private static void commit(EventFactory factory, long holdNanos, boolean isCopy) {
+    Event event = factory.newEvent();
+    event.set(0, isCopy);
+    event.set(1, "GetPrimitiveArrayCritical");
+    event.set(2, holdNanos);
+    // all criticals start at the same time, the in-flight time adds up to one bucket
+    event.set(3, START_MILLIS);
+    event.set(4, 0L);
+    event.set(5, CALL_SITE);
+    event.commit();
+  }
+
+  private static List<AnnotationElement> getEventAnnotations() {
+    return List.of(
+        new AnnotationElement(Name.class, EVENT_NAME),
+        new AnnotationElement(Label.class, "JNI Critical"),
+        new AnnotationElement(StackTrace.class, true));
+  }
+
+  private static List<ValueDescriptor> getValueDescriptors() {
+    return List.of(
+        field(boolean.class, "isCopy"),
+        field(String.class, "methodName"),
+        new ValueDescriptor(long.class, "holdTime", List.of(new AnnotationElement(Timespan.class, Timespan.NANOSECONDS))),
+        new ValueDescriptor(long.class, "criticalStartTime",
+            List.of(new AnnotationElement(Timestamp.class, Timestamp.MILLISECONDS_SINCE_EPOCH))),
+        new ValueDescriptor(long.class, "acquireTime", List.of(new AnnotationElement(Timespan.class, Timespan.NANOSECONDS))),
+        field(String.class, "callSite"));
+  }
+
+  private static ValueDescriptor field(Class<?> type, String name) {
+    return new ValueDescriptor(type, name, List.of(new AnnotationElement(Description.class, name)));
+  }
+
+}
@@ -0,0 +1,47 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static com.github.marschall.jnicriticalreporter.ModeTestSupport.CRITICAL_EVENT;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.IOException;
+import java.nio.file.Path;
+import java.time.Duration;
+import java.util.List;
+
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
+
+import jdk.jfr.consumer.RecordedEvent;
+
+/**
+ * Runs with {@code sample=1/4,threshold=1us}.
+ */
+class SamplingModeTests {
+
+  private static final int LARGE_ARRAY = 1024 * 1024;
+  private static final int PINS = 400;
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void sampleAndThreshold() throws IOException {
+    byte[] small = new byte[16];
+    byte[] large = new byte[LARGE_ARRAY];
+    List<RecordedEvent> events = ModeTestSupport.record(this.temporaryFolder, Duration.ZERO, () -> {
+      ModeTestSupport.pin(small, PINS);
+      // compressing a megabyte takes longer than the threshold
+      ModeTestSupport.pin(large, PINS);
+    }, CRITICAL_EVENT);
+
+    for (RecordedEvent event : events) {
+      assertTrue(event.getDuration("holdTime").compareTo(Duration.ofNanos(1_000L)) >= 0, event::toString);
+    }
+    long largeEvents = events.stream()
+        .filter(event -> event.getLong("length") == LARGE_ARRAY)
+        .count();
+    // every 4th critical of the thread, other criticals of the thread may shift the count
+    assertTrue(largeEvents >= PINS / 4 - 10 && largeEvents <= PINS / 4 + 10, () -> "large events: " + largeEvents);
+  }
+
+}
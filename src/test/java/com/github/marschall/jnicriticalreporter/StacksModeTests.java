@@ -0,0 +1,72 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static com.github.marschall.jnicriticalreporter.ModeTestSupport.CRITICAL_EVENT;
+import static com.github.marschall.jnicriticalreporter.ModeTestSupport.PACKAGE;
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertFalse;
+import static org.junit.jupiter.api.Assertions.assertNotNull;
+import static org.junit.jupiter.api.Assertions.assertNull;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.IOException;
+import java.nio.file.Path;
+import java.time.Duration;
+import java.util.HashMap;
+import java.util.List;
+import java.util.Map;
+
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
+
+import jdk.jfr.consumer.RecordedEvent;
+
+/**
+ * Runs with {@code stacks=4,period=1s}.
+ */
+class StacksModeTests {
+
+  private static final String STACK_DEFINITION_EVENT = PACKAGE + "StackDefinition";
+  private static final int LENGTH = 4093;
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void stackIds() throws IOException {
+    byte[] array = new byte[LENGTH];
+    List<RecordedEvent> events = ModeTestSupport.record(this.temporaryFolder, Duration.ofMillis(2_500L),
+        () -> ModeTestSupport.pin(array, 10), CRITICAL_EVENT, STACK_DEFINITION_EVENT);
+
+    Map<Long, String> definitions = new HashMap<>();
+    for (RecordedEvent definition : ModeTestSupport.named(events, STACK_DEFINITION_EVENT)) {
+      long stackId = definition.getLong("stackId");
+      String frames = definition.getString("frames");
+      // every period all stacks are defined again with the same frames
+      String previous = definitions.putIfAbsent(stackId, frames);
+      if (previous != null) {
+        assertEquals(previous, frames);
+      }
+    }
+
+    int pinned = 0;
+    for (RecordedEvent event : ModeTestSupport.named(events, CRITICAL_EVENT)) {
+      if (event.getLong("length") != LENGTH) {
+        continue;
+      }
+      // the stack is only in the stack definition
+      assertNull(event.getStackTrace(), event::toString);
+      long stackId = event.getLong("stackId");
+      assertTrue(stackId > 0L, event::toString);
+      String frames = definitions.get(stackId);
+      assertNotNull(frames, () -> "no definition of stack " + stackId);
+      String[] lines = frames.split("\n");
+      assertTrue(lines.length <= 4, frames);
+      assertTrue(lines[0].startsWith("java.util.zip.Deflater."), frames);
+      assertTrue(lines[0].endsWith("(Native Method)"), frames);
+      assertFalse(lines[lines.length - 1].endsWith("(Native Method)"), frames);
+      pinned += 1;
+    }
+    assertEquals(10, pinned);
+  }
+
+}
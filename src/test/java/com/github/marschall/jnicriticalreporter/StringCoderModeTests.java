@@ -0,0 +1,58 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static com.github.marschall.jnicriticalreporter.ModeTestSupport.CRITICAL_EVENT;
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.IOException;
+import java.nio.file.Path;
+import java.time.Duration;
+import java.util.List;
+
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
+
+import jdk.jfr.consumer.RecordedEvent;
+
+/**
+ * Runs with {@code mode=sync} and the test library on {@code java.library.path}.
+ */
+class StringCoderModeTests {
+
+  private static final String LATIN1 = "latin1 string";
+  private static final String UTF16 = "utf16 €";
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void stringCoder() throws IOException {
+    List<RecordedEvent> events = ModeTestSupport.record(this.temporaryFolder, Duration.ofMillis(100L), () -> {
+      CriticalHelpers.stringCritical(LATIN1, 10);
+      CriticalHelpers.stringCritical(UTF16, 5);
+    }, CRITICAL_EVENT);
+
+    int latin1 = 0;
+    int utf16 = 0;
+    for (RecordedEvent event : events) {
+      if (!"GetStringCritical".equals(event.getString("methodName"))) {
+        continue;
+      }
+      assertEquals("char", event.getString("elementType"));
+      String coder = event.getString("stringCoder");
+      if ("LATIN1".equals(coder)) {
+        assertEquals(LATIN1.length(), event.getLong("length"), event::toString);
+        // expanded to UTF-16 in a copy
+        assertTrue(event.getBoolean("isCopy"), event::toString);
+        latin1 += 1;
+      } else {
+        assertEquals("UTF16", coder, event::toString);
+        assertEquals(UTF16.length(), event.getLong("length"), event::toString);
+        utf16 += 1;
+      }
+    }
+    assertEquals(10, latin1);
+    assertEquals(5, utf16);
+  }
+
+}
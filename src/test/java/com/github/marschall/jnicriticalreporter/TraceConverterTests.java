@@ -0,0 +1,146 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static java.nio.charset.StandardCharsets.UTF_8;
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertNull;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.ByteArrayOutputStream;
+import java.io.IOException;
+import java.io.PrintStream;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.util.ArrayList;
+import java.util.List;
+
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
+
+import jdk.jfr.consumer.RecordedEvent;
+import jdk.jfr.consumer.RecordingFile;
+
+class TraceConverterTests {
+
+  private static final int SEGMENT_SIZE = 64 * 1024;
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void readTraceFile() throws IOException {
+    TraceFile trace = TraceFile.read(writeTraceFile());
+    assertEquals(42L, trace.pid());
+    assertEquals(3L, trace.droppedRecords());
+    assertEquals(2, trace.segments().size());
+
+    TraceFile.Segment main = trace.segments().get(0);
+    assertEquals("main", main.threadName());
+    assertEquals(2, main.recordCount());
+    TraceFile.TraceRecord first = main.record(0);
+    assertEquals("GetPrimitiveArrayCritical", first.methodName());
+    assertEquals("int", first.elementTypeName());
+    assertEquals(400L, first.bytes());
+    assertEquals(100L, first.acquireNanos());
+    assertEquals(1_000L, first.holdNanos());
+    assertTrue(first.isCopy());
+
+    TraceFile.TraceRecord string = trace.segments().get(1).record(0);
+    assertEquals("GetStringCritical", string.methodName());
+    assertEquals(2, string.depth());
+    assertEquals("LATIN1", string.coderName());
+    assertNull(first.coderName());
+  }
+
+  @Test
+  void writeCsv() throws IOException {
+    TraceFile trace = TraceFile.read(writeTraceFile());
+    StringBuilder csv = new StringBuilder();
+    TraceConverter.writeCsv(trace, csv);
+    String[] lines = csv.toString().split("\n");
+    assertEquals(4, lines.length);
+    assertEquals(TraceConverter.CSV_HEADER, lines[0]);
+    assertEquals("7,main,GetPrimitiveArrayCritical,1970-01-01T00:00:01.000001Z,100,1000,true,100,int,400,1,0,1,0,", lines[1]);
+    assertEquals("8,\"worker, 1\",GetStringCritical,1970-01-01T00:00:01.000003Z,10,20,true,5,char,10,2,0,0,3,LATIN1", lines[3]);
+  }
+
+  @Test
+  void writeSummary() throws IOException {
+    TraceFile trace = TraceFile.read(writeTraceFile());
+    ByteArrayOutputStream bos = new ByteArrayOutputStream();
+    try (PrintStream output = new PrintStream(bos, true, UTF_8)) {
+      TraceConverter.writeSummary(trace, output);
+    }
+    String summary = bos.toString(UTF_8);
+    assertTrue(summary.contains("GetPrimitiveArrayCritical: count 2, copies 1"), summary);
+    assertTrue(summary.contains("GetStringCritical: count 1, copies 1, latin1 strings 1"), summary);
+  }
+
+  @Test
+  void writeJfr() throws IOException {
+    TraceFile trace = TraceFile.read(writeTraceFile());
+    Path jfr = this.temporaryFolder.resolve("trace.jfr");
+    TraceConverter.writeJfr(trace, jfr);
+    List<RecordedEvent> events = new ArrayList<>();
+    for (RecordedEvent event : RecordingFile.readAllEvents(jfr)) {
+      if (event.getEventType().getName().equals("com.github.marschall.jnicriticalreporter.TraceEvent")) {
+        events.add(event);
+      }
+    }
+    assertEquals(3, events.size());
+  }
+
+  private Path writeTraceFile() throws IOException {
+    ByteBuffer buffer = ByteBuffer.allocate(TraceFile.HEADER_SIZE + 2 * SEGMENT_SIZE).order(ByteOrder.LITTLE_ENDIAN);
+    buffer.put(0, TraceFile.MAGIC);
+    buffer.putInt(8, TraceFile.VERSION);
+    buffer.putInt(12, TraceFile.RECORD_SIZE);
+    buffer.putInt(16, SEGMENT_SIZE);
+    buffer.putInt(20, 2);
+    buffer.putLong(24, 42L);
+    // timestamps start at 1 second since the epoch
+    buffer.putLong(32, 1_000_000_000L);
+    buffer.putInt(40, 2);
+    buffer.putLong(48, 3L);
+
+    int main = TraceFile.HEADER_SIZE;
+    writeSegmentHeader(buffer, main, 7L, "main", 2);
+    writeRecord(buffer, main, 0, 1_000L, 1_100L, 2_100L, 100, 0, 1, true, 4, 1, 0, 1, 0);
+    writeRecord(buffer, main, 1, 2_000L, 2_010L, 2_030L, 10, 0, 1, false, 1, 1, 0, 1, 0);
+
+    int worker = TraceFile.HEADER_SIZE + SEGMENT_SIZE;
+    writeSegmentHeader(buffer, worker, 8L, "worker, 1", 1);
+    // compact strings always copy LATIN1 strings
+    writeRecord(buffer, worker, 0, 3_000L, 3_010L, 3_030L, 5, 3, 0, true, 2, 2, 0, 0, 1);
+
+    Path path = this.temporaryFolder.resolve("test.trace");
+    Files.write(path, buffer.array());
+    return path;
+  }
+
+  private static void writeSegmentHeader(ByteBuffer buffer, int offset, long threadId, String threadName, long recordCount) {
+    buffer.putLong(offset, threadId);
+    buffer.putLong(offset + 8, recordCount);
+    buffer.put(offset + 16, threadName.getBytes(UTF_8));
+  }
+
+  private static void writeRecord(ByteBuffer buffer, int segment, int index, long startNanos, long acquiredNanos, long endNanos,
+      int length, int stackId, int method, boolean isCopy, int elementType, int depth, int nestedCriticals, int maxDepth,
+      int coder) {
+    int offset = segment + TraceFile.SEGMENT_HEADER_SIZE + index * TraceFile.RECORD_SIZE;
+    buffer.putLong(offset, startNanos);
+    buffer.putLong(offset + 8, acquiredNanos);
+    buffer.putLong(offset + 16, endNanos);
+    buffer.putInt(offset + 24, length);
+    buffer.putInt(offset + 28, stackId);
+    buffer.put(offset + 32, (byte) method);
+    buffer.put(offset + 33, (byte) (isCopy ? 1 : 0));
+    buffer.put(offset + 34, (byte) elementType);
+    buffer.put(offset + 35, (byte) depth);
+    buffer.putShort(offset + 36, (short) nestedCriticals);
+    buffer.put(offset + 38, (byte) maxDepth);
+    buffer.put(offset + 39, (byte) coder);
+  }
+
+}
@@ -0,0 +1,43 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertNotNull;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.IOException;
+import java.nio.file.Path;
+import java.util.concurrent.atomic.AtomicLong;
+
+import org.junit.jupiter.api.Test;
+
+/**
+ * Runs with {@code mode=trace} and the trace file in the {@code traceFile} system property.
+ */
+class TraceModeTests {
+
+  private static final int PINS = 100;
+
+  @Test
+  void traceFile() throws IOException {
+    String traceFile = System.getProperty("traceFile");
+    assertNotNull(traceFile, "traceFile not set");
+    byte[] array = new byte[384];
+    ModeTestSupport.pin(array, PINS);
+
+    // the records written so far are visible through the mapping while the agent is running
+    TraceFile trace = TraceFile.read(Path.of(traceFile));
+    assertEquals(ProcessHandle.current().pid(), trace.pid());
+    AtomicLong pinned = new AtomicLong();
+    trace.forEach(record -> {
+      if (record.length() == array.length) {
+        assertEquals("GetPrimitiveArrayCritical", record.methodName());
+        assertEquals("byte", record.elementTypeName());
+        assertEquals(array.length, record.bytes());
+        assertTrue(record.holdNanos() >= 0L);
+        pinned.incrementAndGet();
+      }
+    });
+    assertTrue(pinned.get() >= PINS, "pinned: " + pinned);
+  }
+
+}
@@ -0,0 +1,56 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static com.github.marschall.jnicriticalreporter.ModeTestSupport.PACKAGE;
+import static org.junit.jupiter.api.Assertions.assertFalse;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.OutputStream;
+import java.nio.file.Path;
+import java.time.Duration;
+import java.util.List;
+
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
+
+import jdk.jfr.consumer.RecordedEvent;
+
+/**
+ * Runs with {@code transitions=true,transitionSample=1,period=1s}.
+ */
+class TransitionsModeTests {
+
+  private static final String TRANSITION_PROFILE_EVENT = PACKAGE + "TransitionProfile";
+  private static final int WRITES = 1_000;
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void countedCalls() throws IOException {
+    Path file = this.temporaryFolder.resolve("transitions.bin");
+    byte[] buffer = new byte[64];
+    List<RecordedEvent> events = ModeTestSupport.record(this.temporaryFolder, Duration.ofMillis(2_500L), () -> {
+      // FileOutputStream#write(byte[]) copies the bytes with GetByteArrayRegion
+      try (OutputStream output = new FileOutputStream(file.toFile())) {
+        for (int i = 0; i < WRITES; i++) {
+          output.write(buffer);
+        }
+      }
+    }, TRANSITION_PROFILE_EVENT);
+
+    assertFalse(events.isEmpty(), "no transition profiles");
+    long regionCalls = 0L;
+    for (RecordedEvent event : events) {
+      assertFalse(event.getString("functionName").endsWith("Critical"), event::toString);
+      if (event.getString("functionName").equals("GetByteArrayRegion")) {
+        regionCalls += event.getLong("calls");
+        // every call is timed
+        assertTrue(event.getLong("timedCalls") == event.getLong("calls"), event::toString);
+      }
+    }
+    assertTrue(regionCalls >= WRITES, "GetByteArrayRegion calls: " + regionCalls);
+  }
+
+}
@@ -0,0 +1,69 @@
+package com.github.marschall.jnicriticalreporter;
+
+import static com.github.marschall.jnicriticalreporter.ModeTestSupport.PACKAGE;
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertFalse;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+import java.io.IOException;
+import java.nio.file.Path;
+import java.time.Duration;
+import java.util.ArrayList;
+import java.util.List;
+
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.io.TempDir;
+
+import jdk.jfr.consumer.RecordedEvent;
+import jdk.jfr.consumer.RecordedThread;
+
+/**
+ * Runs with {@code watchdog=50ms,watchdogInterval=10ms} and the test library on {@code java.library.path}.
+ */
+class WatchdogModeTests {
+
+  private static final String LONG_HELD_EVENT = PACKAGE + "LongHeldCritical";
+  private static final String THREAD_NAME = "watchdog-holder";
+  private static final long HOLD_MILLIS = 500L;
+
+  @TempDir
+  Path temporaryFolder;
+
+  @Test
+  void longHeldCritical() throws IOException {
+    List<RecordedEvent> events = ModeTestSupport.record(this.temporaryFolder, Duration.ofMillis(500L), () -> {
+      Thread holder = new Thread(() -> {
+        // short criticals are not reported
+        ModeTestSupport.pin(new byte[1024], 10);
+        CriticalHelpers.holdArrayCritical(new byte[16], HOLD_MILLIS);
+      }, THREAD_NAME);
+      holder.start();
+      try {
+        holder.join();
+      } catch (InterruptedException e) {
+        Thread.currentThread().interrupt();
+        throw new AssertionError("interrupted", e);
+      }
+    }, LONG_HELD_EVENT);
+
+    List<RecordedEvent> held = new ArrayList<>();
+    for (RecordedEvent event : events) {
+      RecordedThread thread = event.getThread("criticalThread");
+      if (thread != null && THREAD_NAME.equals(thread.getJavaName())) {
+        held.add(event);
+      }
+    }
+    // every critical is reported at most once
+    assertEquals(1, held.size(), held::toString);
+    RecordedEvent event = held.get(0);
+    assertEquals("GetPrimitiveArrayCritical", event.getString("methodName"));
+    Duration heldTime = event.getDuration("heldTime");
+    // reported while still held, within a few intervals of the threshold
+    assertTrue(heldTime.compareTo(Duration.ofMillis(50L)) >= 0, event::toString);
+    assertTrue(heldTime.compareTo(Duration.ofMillis(HOLD_MILLIS)) < 0, event::toString);
+    assertFalse(event.getInstant("criticalStartTime").isAfter(event.getStartTime()), event::toString);
+    String frames = event.getString("frames");
+    assertTrue(frames.startsWith(CriticalHelpers.class.getName() + ".holdArrayCritical(Native Method)"), frames);
+  }
+
+}